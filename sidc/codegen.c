@@ -203,9 +203,9 @@ int ssc_var_code_for_base_read
 	{	
 		if (var->type.fid == SSC_TYPE_FUNDAMENTAL_STRING)
 		{
-			fprintf(c_file, "if (! (");
+			fprintf(c_file, "if (SSC_UNLIKELY(! (");
 			ssc_var_code_base_exp(var, prefix, c_file);
-			fprintf(c_file, " = ssc_segment_read_string(%s)))\n",
+			fprintf(c_file, " = ssc_segment_read_string(%s))))\n",
 			        segment);
 			failable = 1;
 		}
@@ -228,9 +228,9 @@ int ssc_var_code_for_base_read
 	}
 	else
 	{
-		fprintf(c_file, "if (%s__read(&(", var->type.sym->name);
+		fprintf(c_file, "if (SSC_UNLIKELY(%s__read(&(", var->type.sym->name);
 		ssc_var_code_base_exp(var, prefix, c_file);
-		fprintf(c_file, "), %s, msg_iter) < 0)\n", segment);
+		fprintf(c_file, "), %s, msg_iter) < 0))\n", segment);
 		failable = 1;
 	}
 	
@@ -498,6 +498,80 @@ void ssc_var_code_for_count
 	fprintf(c_file, "\n");
 }
 
+//Writes code to check sequence bounds of a variable, 
+//executing fail_stmt if one is exceeded
+static void ssc_var_code_for_check
+	(SscVar *var, const char *prefix, const char *fail_stmt, FILE *c_file)
+{
+	int nested;
+	
+	if (! ssc_type_has_bounds(var->type))
+		return;
+	nested = var->type.sym && var->type.sym->v.xstruct.fields.has_bounds;
+	
+	fprintf(c_file,
+			"    //%s%s\n",  prefix, var->name);
+	if (var->type.complexity == SSC_TYPE_NONE)
+	{
+		fprintf(c_file, 
+			"    if (SSC_UNLIKELY(! %s__check_bounds(&(", 
+			var->type.sym->name);
+		ssc_var_code_base_exp(var, prefix, c_file);
+		fprintf(c_file, 
+			"))))\n"
+			"        %s;\n", 
+			fail_stmt);
+	}
+	else if (var->type.complexity > 0 
+		|| var->type.complexity == SSC_TYPE_SEQ)
+	{
+		if (var->type.complexity == SSC_TYPE_SEQ && var->type.bound)
+			fprintf(c_file, 
+			"    if (SSC_UNLIKELY(%s%s.len > %d))\n"
+			"        %s;\n",
+				prefix, var->name, var->type.bound, fail_stmt);
+		if (nested)
+		{
+			fprintf(c_file, 
+			"    {\n"
+			"        int _i;\n");
+			if (var->type.complexity > 0)
+				fprintf(c_file, 
+			"        for (_i = 0; _i < %d; _i++)\n",
+					var->type.complexity);
+			else
+				fprintf(c_file, 
+			"        for (_i = 0; _i < %s%s.len; _i++)\n",
+					prefix, var->name);
+			fprintf(c_file, 
+			"            if (SSC_UNLIKELY(! %s__check_bounds(&(",
+				var->type.sym->name);
+			ssc_var_code_base_exp(var, prefix, c_file);
+			fprintf(c_file, 
+			"))))\n"
+			"                %s;\n"
+			"    }\n", 
+				fail_stmt);
+		}
+	}
+	else //optional
+	{
+		fprintf(c_file, 
+			"    if (");
+		ssc_var_code_optional_test_exp(var, prefix, c_file);
+		fprintf(c_file, 
+			"\n"
+			"        && SSC_UNLIKELY(! %s__check_bounds(&(",
+			var->type.sym->name);
+		ssc_var_code_base_exp(var, prefix, c_file);
+		fprintf(c_file, 
+			"))))\n"
+			"        %s;\n", 
+			fail_stmt);
+	}
+	fprintf(c_file, "\n");
+}
+
 //Writes code to serialize a given variable
 void ssc_var_code_for_write
 	(SscVar *var, const char *prefix, FILE *c_file)
@@ -539,7 +613,7 @@ void ssc_var_code_for_write
 			"        SscSegment sub_seg;\n"
 			"        \n"
 			"        ssc_segment_write_uint32(seg, %s%s.len);\n"
-			"        ssc_msg_iter_get_segment(msg_iter, "
+			"        ssc_msg_iter_take_segment(msg_iter, "
 			"%d * %s%s.len, %d * %s%s.len, &sub_seg);\n"
 			"        for (_i = 0; _i < %s%s.len; _i++)\n"
 			"        {\n"
@@ -568,7 +642,7 @@ void ssc_var_code_for_write
 			"        SscSegment sub_seg;\n"
 			"        \n"
 			"        ssc_segment_write_uint8(seg, 1);\n"
-			"        ssc_msg_iter_get_segment(msg_iter, "
+			"        ssc_msg_iter_take_segment(msg_iter, "
 			"%d, %d, &sub_seg);\n"
 			"        ", 
 			(int) base_size.n_bytes, (int) base_size.n_submsgs);
@@ -647,11 +721,20 @@ void ssc_var_code_for_read
 			"    {\n"
 			"        int _i;\n"
 			"        SscSegment sub_seg;\n"
-			"        %s%s.len = ssc_segment_read_uint32(seg);\n"
-			"        if (ssc_msg_iter_get_segment(msg_iter, "
-			"%d * %s%s.len, %d * %s%s.len, &sub_seg) == MDSL_FAILURE)\n"
+			"        %s%s.len = ssc_segment_read_uint32(seg);\n",
+			prefix, var->name);
+		if (var->type.bound)
+		{
+			fprintf(c_file, 
+			"        if (SSC_UNLIKELY(%s%s.len > %d))\n"
+			"            goto _ssc_fail_%s;\n",
+				prefix, var->name, var->type.bound,
+				var->name);
+		}
+		fprintf(c_file, 
+			"        if (SSC_UNLIKELY(ssc_msg_iter_get_segment(msg_iter, "
+			"%d * %s%s.len, %d * %s%s.len, &sub_seg) == MDSL_FAILURE))\n"
 			"            goto _ssc_fail_%s;\n",
-			prefix, var->name, 
 			(int) base_size.n_bytes, prefix, var->name,
 			(int) base_size.n_submsgs, prefix, var->name,
 			var->name);
@@ -661,12 +744,12 @@ void ssc_var_code_for_read
 			"        {\n",
 				prefix, var->name);
 		fprintf(c_file,
-			"            if (! (%s%s.data = (", 
+			"            if (SSC_UNLIKELY(! (%s%s.data = (", 
 			prefix, var->name);
 		ssc_gen_base_type(var->type, c_file);
 		fprintf(c_file, " *) mdsl_tryalloc(sizeof(");
 		ssc_gen_base_type(var->type, c_file);
-		fprintf(c_file, ") * %s%s.len)))\n"
+		fprintf(c_file, ") * %s%s.len))))\n"
 			"                goto _ssc_fail_%s;\n"
 			"            for (_i = 0; _i < %s%s.len; _i++)\n"
 			"            {\n"
@@ -716,8 +799,8 @@ void ssc_var_code_for_read
 			"        presence = ssc_segment_read_uint8(seg);\n"
 			"        if (presence)\n"
 			"        {\n"
-			"            if (ssc_msg_iter_get_segment(msg_iter, "
-			"%d, %d, &sub_seg) == MDSL_FAILURE)\n"
+			"            if (SSC_UNLIKELY(ssc_msg_iter_get_segment(msg_iter, "
+			"%d, %d, &sub_seg) == MDSL_FAILURE))\n"
 			"                goto _ssc_fail_%s;\n",
 			(int) base_size.n_bytes, 
 			(int) base_size.n_submsgs, 
@@ -725,12 +808,12 @@ void ssc_var_code_for_read
 		if (! ssc_optional_type_is_baseless(var->type))
 		{
 			fprintf(c_file, 
-			"            if (! (%s%s = (",
+			"            if (SSC_UNLIKELY(! (%s%s = (",
 				prefix, var->name);
 			ssc_gen_base_type(var->type, c_file);
 			fprintf(c_file, " *) mdsl_tryalloc(sizeof(");
 			ssc_gen_base_type(var->type, c_file);
-			fprintf(c_file, "))))\n"
+			fprintf(c_file, ")))))\n"
 			"            goto _ssc_fail_%s;\n",
 				var->name);
 		}
@@ -783,6 +866,19 @@ void ssc_var_list_code_for_count
 	}
 }
 
+//Writes code to check sequence bounds of a given list of variables
+void ssc_var_list_code_for_check
+	(SscVarList list, const char *prefix, const char *fail_stmt, 
+	 FILE *c_file)
+{
+	int i;
+	
+	for (i = 0; i < list.len; i++)
+	{
+		ssc_var_code_for_check(list.a[i], prefix, fail_stmt, c_file);
+	}
+}
+
 //Writes code to serialize a given list of variables
 void ssc_var_list_code_for_write
 	(SscVarList list, const char *prefix, FILE *c_file)
@@ -807,15 +903,37 @@ void ssc_var_list_code_for_read
 	}
 }
 
-//Writes code to deserialize a given list of variables: 
-//error handling part
-int ssc_var_list_code_for_read_fail
-	(SscVarList list, const char *prefix, int with_free, FILE *c_file)
+//Writes a cold function to free a partially deserialized list 
+//of variables
+int ssc_var_list_code_for_read_fail_fn
+	(SscVarList list, const char *prefix, 
+	 const char *fn_name, const char *type_name,
+	 int with_free, FILE *c_file)
 {
 	int i;
 	int free_required = with_free ? 1 : 0;
 	int label_count = 0;
 	
+	for (i = 0; i < list.len; i++)
+	{
+		if (ssc_type_read_can_fail(list.a[i]->type))
+			label_count++;
+	}
+	if (! (with_free || label_count))
+		return 0;
+	
+	fprintf(c_file, 
+		"static SSC_COLD void %s(%s *value, int _ssc_stage)\n"
+		"{\n"
+		"    switch (_ssc_stage)\n"
+		"    {\n",
+		fn_name, type_name);
+	if (with_free)
+		fprintf(c_file, 
+		"    case %d:\n", (int) list.len);
+	
+	//Each stage frees one more variable and falls through to 
+	//the stages below it
 	for (i = list.len - 1; i >= 0; i--)
 	{
 		SscVar *iter = list.a[i];
@@ -825,9 +943,51 @@ int ssc_var_list_code_for_read_fail
 		
 		if (ssc_type_read_can_fail(iter->type))
 		{
+			if (free_required)
+				fprintf(c_file, 
+		"        SSC_FALLTHROUGH;\n");
 			fprintf(c_file, 
-		"_ssc_fail_%s:\n", iter->name);
+		"    case %d: //%s\n", i, iter->name);
 			free_required = 1;
+		}
+	}
+	
+	fprintf(c_file, 
+		"        break;\n"
+		"    }\n"
+		"}\n\n");
+	
+	return label_count + (with_free ? 1 : 0);
+}
+
+//Writes code to deserialize a given list of variables: 
+//error handling part
+int ssc_var_list_code_for_read_fail
+	(SscVarList list, const char *fn_name, int with_free, 
+	 const char *tail, FILE *c_file)
+{
+	int i;
+	int label_count = 0;
+	
+	if (with_free)
+	{
+		fprintf(c_file, 
+		"    %s(value, %d);\n"
+		"    %s;\n",
+			fn_name, (int) list.len, tail);
+	}
+	
+	for (i = list.len - 1; i >= 0; i--)
+	{
+		SscVar *iter = list.a[i];
+		
+		if (ssc_type_read_can_fail(iter->type))
+		{
+			fprintf(c_file, 
+		"_ssc_fail_%s:\n"
+		"    %s(value, %d);\n"
+		"    %s;\n", 
+				iter->name, fn_name, i, tail);
 			label_count++;
 		}
 	}
@@ -846,3 +1006,168 @@ void ssc_var_list_code_for_free
 	}
 }
 
+
+////////////////////////////////////////
+//Streams
+
+void ssc_var_list_gen_stream_declaration
+	(SscVarList list, const char *owner, FILE *h_file)
+{
+	int i;
+	
+	for (i = 0; i < list.streams_len; i++)
+	{
+		SscVar *var = list.streams[i];
+		
+		//Separator comment
+		fprintf(h_file, "//Stream %s::%s\n", owner, var->name);
+		
+		//Function to give the field a new stream and send to it
+		fprintf(h_file, 
+			"void %s__%s__open\n"
+			"    (%s *value, SscStreamWriter *writer, \n"
+			"     SscStreamSendFn send, void *send_data);\n\n",
+			owner, var->name, owner);
+		
+		//Function to add elements to the stream
+		fprintf(h_file, 
+			"MdslStatus %s__%s__put\n"
+			"    (SscStreamWriter *writer, ",
+			owner, var->name);
+		ssc_gen_base_type(var->type, h_file);
+		fprintf(h_file, " *elems, size_t n);\n\n");
+		
+		//Function to receive the stream the field refers to
+		fprintf(h_file, 
+			"void %s__%s__accept\n"
+			"    (%s *value, SscStreamReader *reader);\n\n",
+			owner, var->name, owner);
+		
+		//Function to get the next element received
+		ssc_gen_base_type(var->type, h_file);
+		fprintf(h_file, " *%s__%s__next(SscStreamReader *reader);\n\n",
+			owner, var->name);
+	}
+}
+
+void ssc_var_list_code_for_streams
+	(SscVarList list, const char *owner, FILE *c_file)
+{
+	int i;
+	
+	for (i = 0; i < list.streams_len; i++)
+	{
+		SscVar *var = list.streams[i];
+		
+		//Separator comment
+		fprintf(c_file, "//Stream %s::%s\n", owner, var->name);
+		
+		//Chunk serialization for the writer
+		fprintf(c_file, 
+			"static MmcMsg *%s__%s__create_chunk\n"
+			"    (uint64_t id, uint64_t index, void *elems, size_t n, int last)\n"
+			"{\n"
+			"    %s__%s__Chunk chunk;\n"
+			"    \n"
+			"    chunk.stream = id;\n"
+			"    chunk.index = index;\n"
+			"    chunk.data.data = (",
+			owner, var->name, owner, var->name);
+		ssc_gen_base_type(var->type, c_file);
+		fprintf(c_file, 
+			" *) elems;\n"
+			"    chunk.data.len = n;\n"
+			"    chunk.last = last;\n"
+			"    return %s__%s__Chunk__serialize(&chunk);\n"
+			"}\n\n",
+			owner, var->name);
+		
+		//Chunk deserialization for the reader
+		fprintf(c_file, 
+			"static MdslStatus %s__%s__read_chunk\n"
+			"    (MmcMsg *msg, void *chunk, uint64_t *id, uint64_t *index, \n"
+			"     void **elems, size_t *n, int *last)\n"
+			"{\n"
+			"    %s__%s__Chunk *value = (%s__%s__Chunk *) chunk;\n"
+			"    \n"
+			"    if (SSC_UNLIKELY(%s__%s__Chunk__deserialize(msg, value) \n"
+			"            != MDSL_SUCCESS))\n"
+			"        return MDSL_FAILURE;\n"
+			"    \n"
+			"    *id = value->stream;\n"
+			"    *index = value->index;\n"
+			"    *elems = value->data.data;\n"
+			"    *n = value->data.len;\n"
+			"    *last = value->last;\n"
+			"    return MDSL_SUCCESS;\n"
+			"}\n\n",
+			owner, var->name, 
+			owner, var->name, owner, var->name, 
+			owner, var->name);
+		
+		fprintf(c_file, 
+			"static void %s__%s__free_chunk(void *chunk)\n"
+			"{\n"
+			"    %s__%s__Chunk__free((%s__%s__Chunk *) chunk);\n"
+			"}\n\n",
+			owner, var->name, 
+			owner, var->name, owner, var->name);
+		
+		//Function to give the field a new stream and send to it
+		fprintf(c_file, 
+			"void %s__%s__open\n"
+			"    (%s *value, SscStreamWriter *writer, \n"
+			"     SscStreamSendFn send, void *send_data)\n"
+			"{\n"
+			"    value->%s = ssc_stream_new_id();\n"
+			"    ssc_stream_writer_init(writer, value->%s, \n"
+			"        sizeof(",
+			owner, var->name, owner, 
+			var->name, var->name);
+		ssc_gen_base_type(var->type, c_file);
+		fprintf(c_file, 
+			"), %d, %s__%s__create_chunk, send, send_data);\n"
+			"}\n\n",
+			var->type.bound, owner, var->name);
+		
+		//Function to add elements to the stream
+		fprintf(c_file, 
+			"MdslStatus %s__%s__put\n"
+			"    (SscStreamWriter *writer, ",
+			owner, var->name);
+		ssc_gen_base_type(var->type, c_file);
+		fprintf(c_file, 
+			" *elems, size_t n)\n"
+			"{\n"
+			"    return ssc_stream_writer_put(writer, elems, n);\n"
+			"}\n\n");
+		
+		//Function to receive the stream the field refers to
+		fprintf(c_file, 
+			"void %s__%s__accept\n"
+			"    (%s *value, SscStreamReader *reader)\n"
+			"{\n"
+			"    ssc_stream_reader_init(reader, value->%s, \n"
+			"        sizeof(",
+			owner, var->name, owner, var->name);
+		ssc_gen_base_type(var->type, c_file);
+		fprintf(c_file, 
+			"), sizeof(%s__%s__Chunk), \n"
+			"        %s__%s__read_chunk, %s__%s__free_chunk);\n"
+			"}\n\n",
+			owner, var->name, 
+			owner, var->name, owner, var->name);
+		
+		//Function to get the next element received
+		ssc_gen_base_type(var->type, c_file);
+		fprintf(c_file, 
+			" *%s__%s__next(SscStreamReader *reader)\n"
+			"{\n"
+			"    return (", 
+			owner, var->name);
+		ssc_gen_base_type(var->type, c_file);
+		fprintf(c_file, 
+			" *) ssc_stream_reader_next(reader);\n"
+			"}\n\n");
+	}
+}
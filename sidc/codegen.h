@@ -28,6 +28,12 @@ void ssc_var_gen(SscVar *var, FILE *output);
 void ssc_var_list_code_for_count
 	(SscVarList list, const char *prefix, FILE *c_file);
 	
+//Writes code to check sequence bounds of a given list of variables,
+//executing fail_stmt if one is exceeded
+void ssc_var_list_code_for_check
+	(SscVarList list, const char *prefix, const char *fail_stmt, 
+	 FILE *c_file);
+
 //Writes code to serialize a given list of variables
 void ssc_var_list_code_for_write
 	(SscVarList list, const char *prefix, FILE *c_file);
@@ -36,15 +42,41 @@ void ssc_var_list_code_for_write
 void ssc_var_list_code_for_read
 	(SscVarList list, const char *prefix, FILE *c_file);
 
+//Writes a cold function to free a partially deserialized list 
+//of variables. The function takes the index of the variable that 
+//failed to deserialize, or list.len to free all variables 
+//(only if with_free is nonzero).
+//Returns number of failure stages, zero means no function was needed.
+int ssc_var_list_code_for_read_fail_fn
+	(SscVarList list, const char *prefix, 
+	 const char *fn_name, const char *type_name,
+	 int with_free, FILE *c_file);
+
 //Writes code to deserialize a given list of variables: 
 //error handling part
+//Each goto label calls the function written by 
+//ssc_var_list_code_for_read_fail_fn() and then executes tail.
+//If with_free is nonzero, code to free all variables is written 
+//before labels.
 //Returns number of goto labels added to the code to handle failure.
 //Zero labels mean no code was needed.
 int ssc_var_list_code_for_read_fail
-	(SscVarList list, const char *prefix, int with_free, FILE *c_file);
+	(SscVarList list, const char *fn_name, int with_free, 
+	 const char *tail, FILE *c_file);
 
 //Writes code to free a given list of variables
 void ssc_var_list_code_for_free
 	(SscVarList list, const char *prefix, FILE *c_file);
 	
 
+
+//Writes declarations of the helpers producing and consuming 
+//the chunks of each stream field of a list, whose structure 
+//is named owner
+void ssc_var_list_gen_stream_declaration
+	(SscVarList list, const char *owner, FILE *h_file);
+
+//Writes code of the helpers declared by 
+//ssc_var_list_gen_stream_declaration()
+void ssc_var_list_code_for_streams
+	(SscVarList list, const char *owner, FILE *c_file);
@@ -30,6 +30,8 @@ typedef struct
 	char *sf; //Serialization function name
 	char *df; //Deserialization function name
 	char *ff; //Free function name
+	char *tf; //Serialization to caller-provided storage function name
+	char *pf; //Serialization with string pool function name
 } ArgsType;
 
 static ArgsType args_in = 
@@ -37,7 +39,9 @@ static ArgsType args_in =
 	"__in_args",
 	"__create_msg",
 	"__read_msg",
-	"__in_args_free"
+	"__in_args_free",
+	"__create_msg_to",
+	"__create_msg_pooled"
 };
 
 static ArgsType args_out =
@@ -45,7 +49,9 @@ static ArgsType args_out =
 	"__out_args", 
 	"__create_reply", 
 	"__read_reply",
-	"__out_args_free"
+	"__out_args_free",
+	"__create_reply_to",
+	"__create_reply_pooled"
 };
 
 
@@ -54,6 +60,7 @@ static void ssc_arglist_gen_declaration
 	const char *name_prefix, const ArgsType args_type,
 	FILE *h_file)
 {
+	char *type_name;
 	int i;
 	
 	//Structure definition
@@ -68,6 +75,20 @@ static void ssc_arglist_gen_declaration
 	
 	fprintf(h_file, "} %s%s;\n\n", name_prefix, args_type.sn);
 	
+	if (args.bounded)
+	{
+		//Upper bound of serialized size
+		fprintf(h_file, 
+			"#define %s%s__MAX_WIRE_SIZE_BYTES (%zu + SSC_PREFIX_SIZE)\n"
+			"#define %s%s__MAX_WIRE_SIZE_SUBMSGS (%zu)\n"
+			"#define %s%s__MAX_WIRE_SIZE \\\n"
+			"    {%s%s__MAX_WIRE_SIZE_BYTES, %s%s__MAX_WIRE_SIZE_SUBMSGS}\n\n",
+			name_prefix, args_type.sn, args.max_size.n_bytes,
+			name_prefix, args_type.sn, args.max_size.n_submsgs,
+			name_prefix, args_type.sn, 
+			name_prefix, args_type.sn, name_prefix, args_type.sn);
+	}
+	
 	//Function to free the structure
 	fprintf(h_file, 
 		"void %s%s(%s%s *value);\n\n",
@@ -77,11 +98,33 @@ static void ssc_arglist_gen_declaration
 	fprintf(h_file, 
 		"MmcMsg *%s%s(%s%s *value);\n\n",
 		name_prefix, args_type.sf, name_prefix, args_type.sn);
+	
+	//Function to serialize a structure into a message, sharing 
+	//repeated strings
+	fprintf(h_file, 
+		"MmcMsg *%s%s(%s%s *value, SscStrPool *pool);\n\n",
+		name_prefix, args_type.pf, name_prefix, args_type.sn);
 		
+	//Function to serialize a structure into caller-provided storage
+	fprintf(h_file, 
+		"//Submessages written to submsgs are owned by the caller, \n"
+		"//who has to unref them\n"
+		"MdslStatus %s%s\n"
+		"    (%s%s *value, void *mem, size_t mem_len, \n"
+		"     MmcMsg **submsgs, size_t submsgs_len, SscDLen *size);\n\n",
+		name_prefix, args_type.tf, name_prefix, args_type.sn);
+	
 	//Function to deserialize a message to get back structure
 	fprintf(h_file, 
 		"MdslStatus %s%s(MmcMsg *msg, %s%s *value);\n\n",
 		name_prefix, args_type.df, name_prefix, args_type.sn);
+	
+	//Helpers for stream arguments
+	type_name = mdsl_alloc(strlen(name_prefix) + strlen(args_type.sn) + 1);
+	strcpy(type_name, name_prefix);
+	strcat(type_name, args_type.sn);
+	ssc_var_list_gen_stream_declaration(args, type_name, h_file);
+	free(type_name);
 }
 
 static void ssc_arglist_gen_code
@@ -90,6 +133,7 @@ static void ssc_arglist_gen_code
 	int prefix_val, 
 	FILE *c_file)
 {
+	char *fail_fn, *type_name;
 	
 	//Function to free the structure
 	fprintf(c_file, 
@@ -105,14 +149,25 @@ static void ssc_arglist_gen_code
 	fprintf(c_file, 
 		"MmcMsg *%s%s(%s%s *value)\n"
 		"{\n"
+		"    return %s%s(value, NULL);\n"
+		"}\n\n",
+		name_prefix, args_type.sf, name_prefix, args_type.sn,
+		name_prefix, args_type.pf);
+	
+	//Function to serialize a structure into a message, sharing 
+	//repeated strings
+	fprintf(c_file, 
+		"MmcMsg *%s%s(%s%s *value, SscStrPool *pool)\n"
+		"{\n"
 		"    SscSegment seg[1];\n"
 		"    SscMsgIter msg_iter[1];\n"
 		"    SscDLen size = {%d + SSC_PREFIX_SIZE, %d};\n"
 		"    MmcMsg *msg;\n"
 		"    \n",
-		name_prefix, args_type.sf, name_prefix, args_type.sn, 
+		name_prefix, args_type.pf, name_prefix, args_type.sn, 
 		(int) args.base_size.n_bytes, 
 		(int) args.base_size.n_submsgs);
+	ssc_var_list_code_for_check(args, "value->", "return NULL", c_file);
 	if (! args.constsize)
 	{
 		fprintf(c_file, 
@@ -128,7 +183,8 @@ static void ssc_arglist_gen_code
 		"    msg = mmc_msg_newa(size.n_bytes, size.n_submsgs);\n"
 		"    \n"
 		"    ssc_msg_iter_init(msg_iter, msg);\n"
-		"    ssc_msg_iter_get_segment(msg_iter, %d + SSC_PREFIX_SIZE, %d, seg);\n"
+		"    ssc_msg_iter_set_str_pool(msg_iter, pool);\n"
+		"    ssc_msg_iter_take_segment(msg_iter, %d + SSC_PREFIX_SIZE, %d, seg);\n"
 		"    \n"
 		"    ssc_segment_write_uint8(seg, %d); //name_prefix\n"
 		"    \n",
@@ -138,9 +194,70 @@ static void ssc_arglist_gen_code
 	ssc_var_list_code_for_write(args, "value->", c_file);
 	fprintf(c_file, 
 		"    \n"
+		"    if (pool)\n"
+		"        ssc_str_pool_reset(pool);\n"
 		"    return msg;\n"
 		"}\n\n");
 	
+	//Function to serialize a structure into caller-provided storage
+	fprintf(c_file, 
+		"MdslStatus %s%s\n"
+		"    (%s%s *value, void *mem, size_t mem_len, \n"
+		"     MmcMsg **submsgs, size_t submsgs_len, SscDLen *dlen)\n"
+		"{\n"
+		"    SscSegment seg[1];\n"
+		"    SscMsgIter msg_iter[1];\n"
+		"    SscDLen size = {%d + SSC_PREFIX_SIZE, %d};\n"
+		"    \n",
+		name_prefix, args_type.tf, name_prefix, args_type.sn, 
+		(int) args.base_size.n_bytes, 
+		(int) args.base_size.n_submsgs);
+	ssc_var_list_code_for_check
+		(args, "value->", "return MDSL_FAILURE", c_file);
+	if (! args.constsize)
+	{
+		fprintf(c_file, 
+		"    //Size computation\n");
+		
+		ssc_var_list_code_for_count(args, "value->", c_file);
+		
+		fprintf(c_file, 
+		"    \n");
+	}
+	fprintf(c_file, 
+		"    if (size.n_bytes > mem_len || size.n_submsgs > submsgs_len)\n"
+		"        return MDSL_FAILURE;\n"
+		"    \n"
+		"    ssc_msg_iter_init_mem(msg_iter, mem, size.n_bytes, \n"
+		"        submsgs, size.n_submsgs);\n"
+		"    ssc_msg_iter_take_segment(msg_iter, %d + SSC_PREFIX_SIZE, %d, seg);\n"
+		"    \n"
+		"    ssc_segment_write_uint8(seg, %d); //name_prefix\n"
+		"    \n",
+			(int) args.base_size.n_bytes, 
+			(int) args.base_size.n_submsgs,
+			prefix_val);
+	ssc_var_list_code_for_write(args, "value->", c_file);
+	fprintf(c_file, 
+		"    \n"
+		"    if (dlen)\n"
+		"        *dlen = size;\n"
+		"    return MDSL_SUCCESS;\n"
+		"}\n\n");
+	
+	//Function to deserialize a message: cleanup on failure, 
+	//kept out of line
+	fail_fn = mdsl_alloc(strlen(name_prefix) + strlen(args_type.df) 
+		+ sizeof("_fail"));
+	strcpy(fail_fn, name_prefix);
+	strcat(fail_fn, args_type.df);
+	strcat(fail_fn, "_fail");
+	type_name = mdsl_alloc(strlen(name_prefix) + strlen(args_type.sn) + 1);
+	strcpy(type_name, name_prefix);
+	strcat(type_name, args_type.sn);
+	ssc_var_list_code_for_read_fail_fn
+		(args, "value->", fail_fn, type_name, 1, c_file);
+	
 	//Function to deserialize a message to get back structure
 	fprintf(c_file, 
 		"MdslStatus %s%s(MmcMsg *msg, %s%s *value)\n"
@@ -150,14 +267,14 @@ static void ssc_arglist_gen_code
 		"    uint8_t prefix_val;\n"
 		"    \n"
 		"    ssc_msg_iter_init(msg_iter, msg);\n"
-		"    if (ssc_msg_iter_get_segment(msg_iter, SSC_PREFIX_SIZE, 0, seg)\n"
-		"            == MDSL_FAILURE)\n"
+		"    if (SSC_UNLIKELY(ssc_msg_iter_get_segment(msg_iter, SSC_PREFIX_SIZE, 0, seg)\n"
+		"            == MDSL_FAILURE))\n"
 		"        goto _ssc_return;\n"
 		"    prefix_val = ssc_segment_read_uint8(seg);\n"
-		"    if (prefix_val != %d)\n"
+		"    if (SSC_UNLIKELY(prefix_val != %d))\n"
 		"        goto _ssc_return;\n"
-		"    if (ssc_msg_iter_get_segment(msg_iter, %d, %d, seg)\n"
-		"            == MDSL_FAILURE)\n"
+		"    if (SSC_UNLIKELY(ssc_msg_iter_get_segment(msg_iter, %d, %d, seg)\n"
+		"            == MDSL_FAILURE))\n"
 		"        goto _ssc_return;\n"
 		"    \n",
 		name_prefix, args_type.df, name_prefix, args_type.sn,
@@ -168,19 +285,69 @@ static void ssc_arglist_gen_code
 	ssc_var_list_code_for_read(args, "value->", c_file);
 	
 	fprintf(c_file,
-		"    if (! ssc_msg_iter_at_end(msg_iter))\n"
+		"    if (SSC_UNLIKELY(! ssc_msg_iter_at_end(msg_iter)))\n"
 		"        goto _ssc_destroy_n_return;\n"
 		"    \n"
 		"    return MDSL_SUCCESS;\n"
 		"    \n"
 		"_ssc_destroy_n_return:\n");
 	
-	ssc_var_list_code_for_read_fail(args, "value->", 1, c_file);
+	ssc_var_list_code_for_read_fail
+		(args, fail_fn, 1, "goto _ssc_return", c_file);
 	
 	fprintf(c_file, 
 		"_ssc_return:\n"
 		"    return MDSL_FAILURE;\n"
 		"}\n\n");
+	
+	//Helpers for stream arguments
+	ssc_var_list_code_for_streams(args, type_name, c_file);
+	
+	free(fail_fn);
+	free(type_name);
+}
+
+//Helpers for putting calls to a function in batches
+static void ssc_fn_gen_batch_declaration
+	(const char *name_prefix, FILE *h_file)
+{
+	//Function to serialize a call and add it to a batch
+	fprintf(h_file, 
+		"MdslStatus %s__batch_add(SscBatch *batch, %s%s *value);\n\n",
+		name_prefix, name_prefix, args_in.sn);
+	
+	//Function to deserialize the reply to a call in a batch reply
+	fprintf(h_file, 
+		"MdslStatus %s__read_batch_reply\n"
+		"    (MmcMsg *reply, size_t index, %s%s *value);\n\n",
+		name_prefix, name_prefix, args_out.sn);
+}
+
+static void ssc_fn_gen_batch_code
+	(const char *name_prefix, FILE *c_file)
+{
+	//Function to serialize a call and add it to a batch
+	fprintf(c_file, 
+		"MdslStatus %s__batch_add(SscBatch *batch, %s%s *value)\n"
+		"{\n"
+		"    return ssc_batch_add(batch, %s%s(value));\n"
+		"}\n\n",
+		name_prefix, name_prefix, args_in.sn,
+		name_prefix, args_in.sf);
+	
+	//Function to deserialize the reply to a call in a batch reply
+	fprintf(c_file, 
+		"MdslStatus %s__read_batch_reply\n"
+		"    (MmcMsg *reply, size_t index, %s%s *value)\n"
+		"{\n"
+		"    MmcMsg *msg = ssc_batch_reply_get(reply, index);\n"
+		"    \n"
+		"    if (SSC_UNLIKELY(! msg))\n"
+		"        return MDSL_FAILURE;\n"
+		"    return %s%s(msg, value);\n"
+		"}\n\n",
+		name_prefix, name_prefix, args_out.sn,
+		name_prefix, args_out.df);
 }
 
 //Count all functions (including those in parent interfaces
@@ -315,6 +482,7 @@ void ssc_iface_gen_declaration(SscSymbol *value, FILE *h_file)
 			(iface->fns[i]->in, fl->data[i], args_in, h_file);
 		ssc_arglist_gen_declaration
 			(iface->fns[i]->out, fl->data[i], args_out, h_file);
+		ssc_fn_gen_batch_declaration(fl->data[i], h_file);
 	}
 	
 	//Prevent multiple declarations: end
@@ -368,12 +536,31 @@ void ssc_iface_gen_code
 		"};\n"
 		"SscSkel %s[1] = {{\n"
 		"    %d,\n"
-		"    ssc_sstub_array__%s\n"
-		"}};\n\n",
+		"    ssc_sstub_array__%s,\n",
 		value->name,
 		fl_len, 
 		value->name);
 	
+	//Largest size of arguments, as the size of a union of them all
+	if (fl_len > 0)
+	{
+		fprintf(c_file, 
+		"    sizeof(union {\n");
+		for (i = 0; i < fl_len; i++)
+			fprintf(c_file, 
+		"        %s__in_args a%d;\n",
+				fl->data[i], i);
+		fprintf(c_file, 
+		"    })\n");
+	}
+	else
+	{
+		fprintf(c_file, 
+		"    0\n");
+	}
+	fprintf(c_file, 
+		"}};\n\n");
+	
 	//Write code for each function.
 	for (i = 0; i < iface->fns_len; i++)
 	{
@@ -390,6 +577,7 @@ void ssc_iface_gen_code
 			(iface->fns[i]->in, fl->data[base + i], args_in, base + i, c_file);
 		ssc_arglist_gen_code
 			(iface->fns[i]->out, fl->data[base + i], args_out, 0, c_file);
+		ssc_fn_gen_batch_code(fl->data[base + i], c_file);
 	}
 	
 	//Garbage collection
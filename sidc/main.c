@@ -31,11 +31,31 @@ int main(int argc, char *argv[])
 	
 	
 	char *c_file, *h_file, *infile, *outprefix;
+	SscCodecMode mode = SSC_CODEC_UNROLLED;
 	
 	//Read arguments
+	if (argc >= 2)
+	{
+		//--inline: field-level codec as static inline functions 
+		//in the header
+		//--table: descriptor tables for the libssc interpreter 
+		//instead of unrolled code
+		if (strcmp(argv[1], "--inline") == 0)
+			mode = SSC_CODEC_INLINE;
+		else if (strcmp(argv[1], "--table") == 0)
+			mode = SSC_CODEC_TABLE;
+		
+		if (mode != SSC_CODEC_UNROLLED)
+		{
+			argv[1] = argv[0];
+			argc--;
+			argv++;
+		}
+	}
 	if (argc != 2 && argc != 3)
 	{
-		printf("Usage: %s filename [output_prefix]\n", argv[0]);
+		printf("Usage: %s [--inline | --table] filename [output_prefix]\n",
+			argv[0]);
 		exit(1);
 	}
 	infile = argv[1];
@@ -117,6 +137,23 @@ int main(int argc, char *argv[])
 		}
 		
 		//Write boilerplates
+		if (mode == SSC_CODEC_INLINE)
+		{
+			//The inline codec in the header calls header-only 
+			//primitives, so whoever includes it needs them too
+			fprintf(h_stream, 
+				"#ifndef SSC_HEADER_ONLY\n"
+				"#define SSC_HEADER_ONLY\n"
+				"#endif\n"
+				"#include <ssc/ssc.h>\n"
+				"#ifndef SSC_PRIMITIVES_INLINE\n"
+				"#error \"<ssc/ssc.h> was included without "
+				"SSC_HEADER_ONLY before this header\"\n"
+				"#endif\n\n");
+			fprintf(c_stream, "#define SSC_HEADER_ONLY\n");
+		}
+		if (mode == SSC_CODEC_TABLE)
+			fprintf(c_stream, "#include <stddef.h>\n");
 		fprintf(c_stream, "#include <ssc/ssc.h>\n\n");
 		
 		//Generate declarations
@@ -124,8 +161,10 @@ int main(int argc, char *argv[])
 		{
 			if (symbols.d[i]->type == SSC_SYMBOL_STRUCT)
 			{
-				ssc_struct_gen_declaration(symbols.d[i], h_stream);
-				ssc_struct_gen_declaration(symbols.d[i], c_stream);
+				ssc_struct_gen_declaration
+					(symbols.d[i], mode, h_stream);
+				ssc_struct_gen_declaration
+					(symbols.d[i], mode, c_stream);
 			}
 			else if (symbols.d[i]->type == SSC_SYMBOL_INTERFACE)		
 			{
@@ -134,11 +173,28 @@ int main(int argc, char *argv[])
 			}
 		}
 		
+		//Generate inline codec or descriptor tables
+		for (i = 0; i < symbols.len; i++)
+		{
+			if (symbols.d[i]->type != SSC_SYMBOL_STRUCT)
+				continue;
+			
+			if (mode == SSC_CODEC_INLINE)
+			{
+				ssc_struct_gen_codec(symbols.d[i], 1, h_stream);
+				ssc_struct_gen_codec(symbols.d[i], 1, c_stream);
+			}
+			else if (mode == SSC_CODEC_TABLE)
+			{
+				ssc_struct_gen_table(symbols.d[i], c_stream);
+			}
+		}
+		
 		//Generate code
 		for (iter = file_data.list; iter; iter = iter->next)
 		{
 			if (iter->type == SSC_SYMBOL_STRUCT)
-				ssc_struct_gen_code(iter, c_stream);
+				ssc_struct_gen_code(iter, mode, c_stream);
 			else if (iter->type == SSC_SYMBOL_INTERFACE)
 				ssc_iface_gen_code(iter, c_stream);
 		}
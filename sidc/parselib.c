@@ -491,6 +491,90 @@ SscVar *ssc_parser_new_var
 }
 
 
+//Streams
+
+//Adds the structure carrying chunks of a stream field:
+//  struct <owner>__<field>__Chunk 
+//      { uint64 stream; uint64 index; seq(N) T data; uint8 last; };
+static MdslStatus ssc_parser_add_stream_chunk
+	(SscParser *parser, const char *owner, SscVar *var)
+{
+	SscSymbol *sym;
+	SscVarList *fields;
+	SscType id_type, last_type;
+	char *name;
+	
+	name = ssc_parser_strcat(parser, owner, "__");
+	name = ssc_parser_strcat(parser, name, var->name);
+	name = ssc_parser_strcat(parser, name, "__Chunk");
+	sym = ssc_parser_alloc_symbol(parser, name, SSC_SYMBOL_STRUCT);
+	if (! sym)
+		return MDSL_FAILURE;
+	
+	id_type.sym = NULL;
+	id_type.fid = SSC_TYPE_FUNDAMENTAL_UINT64;
+	id_type.complexity = SSC_TYPE_NONE;
+	id_type.bound = 0;
+	last_type = id_type;
+	last_type.fid = SSC_TYPE_FUNDAMENTAL_UINT8;
+	
+	fields = &(sym->v.xstruct.fields);
+	fields->a = ssc_parser_alloc_final(parser, sizeof(SscVar *) * 4);
+	fields->len = 4;
+	fields->a[0] = ssc_parser_new_var(parser, id_type, "stream");
+	fields->a[1] = ssc_parser_new_var(parser, id_type, "index");
+	fields->a[2] = ssc_parser_new_var(parser, var->type, "data");
+	fields->a[2]->type.complexity = SSC_TYPE_SEQ;
+	fields->a[3] = ssc_parser_new_var(parser, last_type, "last");
+	fields->streams = NULL;
+	fields->streams_len = 0;
+	
+	return MDSL_SUCCESS;
+}
+
+//Replaces each stream field of the list by a uint64 holding its 
+//stream no., keeping the stream field in list->streams, 
+//and adds its chunk structure
+static MdslStatus ssc_parser_split_streams
+	(SscParser *parser, const char *owner, SscVarList *list)
+{
+	SscType id_type;
+	size_t i, j;
+	
+	id_type.sym = NULL;
+	id_type.fid = SSC_TYPE_FUNDAMENTAL_UINT64;
+	id_type.complexity = SSC_TYPE_NONE;
+	id_type.bound = 0;
+	
+	list->streams = NULL;
+	list->streams_len = 0;
+	for (i = 0; i < list->len; i++)
+	{
+		if (list->a[i]->type.complexity == SSC_TYPE_STREAM)
+			list->streams_len++;
+	}
+	if (! list->streams_len)
+		return MDSL_SUCCESS;
+	
+	list->streams = ssc_parser_alloc_final
+		(parser, sizeof(SscVar *) * list->streams_len);
+	for (i = 0, j = 0; i < list->len; i++)
+	{
+		SscVar *var = list->a[i];
+		
+		if (var->type.complexity != SSC_TYPE_STREAM)
+			continue;
+		
+		if (ssc_parser_add_stream_chunk(parser, owner, var)
+			!= MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		list->streams[j++] = var;
+		list->a[i] = ssc_parser_new_var(parser, id_type, var->name);
+	}
+	
+	return MDSL_SUCCESS;
+}
+
 //Struct
 MdslStatus ssc_parser_add_struct
 	(SscParser *parser, const char *name, SscRList *fields)
@@ -510,7 +594,7 @@ MdslStatus ssc_parser_add_struct
 		return MDSL_FAILURE;
 	}
 	
-	return MDSL_SUCCESS;
+	return ssc_parser_split_streams(parser, name, &sym->v.xstruct.fields);
 }
 
 //Function
@@ -550,6 +634,7 @@ MdslStatus ssc_parser_add_interface(SscParser *parser,
 	const char *name, const char *parent, SscRList *fns)
 {
 	SscSymbol *sym, *psym;
+	size_t i;
 	
 	if (parent)
 	{
@@ -575,6 +660,25 @@ MdslStatus ssc_parser_add_interface(SscParser *parser,
 		return MDSL_FAILURE;
 	}
 	
+	//Stream arguments belong to the argument structures
+	for (i = 0; i < sym->v.xiface.fns_len; i++)
+	{
+		SscFn *fn = sym->v.xiface.fns[i];
+		char *fn_name;
+		
+		fn_name = ssc_parser_strcat(parser, name, "__");
+		fn_name = ssc_parser_strcat(parser, fn_name, fn->name);
+		if (ssc_parser_split_streams(parser, 
+				ssc_parser_strcat(parser, fn_name, "__in_args"), 
+				&fn->in) 
+				!= MDSL_SUCCESS
+			|| ssc_parser_split_streams(parser, 
+				ssc_parser_strcat(parser, fn_name, "__out_args"), 
+				&fn->out) 
+				!= MDSL_SUCCESS)
+			return MDSL_FAILURE;
+	}
+	
 	return MDSL_SUCCESS;
 }
 	
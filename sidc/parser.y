@@ -74,6 +74,7 @@
 		lhs.xtype.sym = NULL; \
 		lhs.xtype.fid = SSC_TYPE_FUNDAMENTAL_ ## tfid; \
 		lhs.xtype.complexity = SSC_TYPE_NONE; \
+		lhs.xtype.bound = 0; \
 	} while(0)
 
 static void ssc_yyerror
@@ -215,10 +216,36 @@ type: base_type { $$.xtype = $1.xtype; }
 			$$.xtype = $2.xtype; 
 			$$.xtype.complexity = SSC_TYPE_SEQ;
 		} 
+	| KW_SEQ LPAREN integer_exp RPAREN base_type {
+			if ($3.xint <= 0)
+			{
+				ssc_parser_error(parser, "Sequence bound should be > 0");
+				YYABORT;
+			}
+			$$.xtype = $5.xtype;
+			$$.xtype.complexity = SSC_TYPE_SEQ;
+			$$.xtype.bound = $3.xint;
+		}
 	| KW_OPTIONAL base_type { 
 			$$.xtype = $2.xtype; 
 			$$.xtype.complexity = SSC_TYPE_OPTIONAL;
 		} 
+	| VAL_ID LPAREN integer_exp RPAREN base_type {
+			//Not a keyword, so that it stays usable as a name
+			if (strcmp($1.xstr, "stream") != 0)
+			{
+				ssc_parser_error(parser, "Unexpected %s", $1.xstr);
+				YYABORT;
+			}
+			if ($3.xint <= 0)
+			{
+				ssc_parser_error(parser, "Chunk length should be > 0");
+				YYABORT;
+			}
+			$$.xtype = $5.xtype;
+			$$.xtype.complexity = SSC_TYPE_STREAM;
+			$$.xtype.bound = $3.xint;
+		}
 	;
 
 base_type: KW_INT8 { ssc_ftype($$, INT8); }
@@ -242,6 +269,7 @@ base_type: KW_INT8 { ssc_ftype($$, INT8); }
 			$$.xtype.sym = sym;
 			$$.xtype.fid = SSC_TYPE_FUNDAMENTAL_NONE;
 			$$.xtype.complexity = SSC_TYPE_NONE;
+			$$.xtype.bound = 0;
 		}
 	;
 
@@ -80,6 +80,9 @@ void ssc_sequencer_process_symbol(SscSequencer *seqr, SscSymbol *sym)
 		//For each member
 		ssc_sequencer_process_varlist
 			(seqr, sym->v.xstruct.fields.a, sym->v.xstruct.fields.len);
+		ssc_sequencer_process_varlist
+			(seqr, sym->v.xstruct.fields.streams, 
+			 sym->v.xstruct.fields.streams_len);
 	}
 	else if (sym->type == SSC_SYMBOL_INTERFACE)
 	{
@@ -89,6 +92,10 @@ void ssc_sequencer_process_symbol(SscSequencer *seqr, SscSymbol *sym)
 			
 			ssc_sequencer_process_varlist(seqr, fn->in.a, fn->in.len);
 			ssc_sequencer_process_varlist(seqr, fn->out.a, fn->out.len);
+			ssc_sequencer_process_varlist
+				(seqr, fn->in.streams, fn->in.streams_len);
+			ssc_sequencer_process_varlist
+				(seqr, fn->out.streams, fn->out.streams_len);
 		}
 	}
 	
@@ -22,13 +22,16 @@
 
 //Writes C code for given structure
 
-void ssc_struct_gen_declaration(SscSymbol *value, FILE *h_file)
+void ssc_struct_gen_declaration
+	(SscSymbol *value, SscCodecMode mode, FILE *h_file)
 {
 	SscVarList fields;
+	const char *linkage;
 	int i;
 	
 	//Get details
 	fields = value->v.xstruct.fields;
+	linkage = mode == SSC_CODEC_INLINE ? "static inline " : "";
 	
 	//Separator comment
 	fprintf(h_file, "//%s\n", value->name);
@@ -55,64 +58,116 @@ void ssc_struct_gen_declaration(SscSymbol *value, FILE *h_file)
 	{
 		//Structure is not of constant size, have to write functions
 		fprintf(h_file, 
-			"SscDLen %s__count(%s *value);\n\n",
-			value->name, value->name);
+			"%sSscDLen %s__count(%s *value);\n\n",
+			linkage, value->name, value->name);
+	}
+	
+	if (fields.has_bounds)
+	{
+		//Function to check sequence bounds before serializing
+		fprintf(h_file, 
+			"%sint %s__check_bounds(%s *value);\n\n",
+			linkage, value->name, value->name);
+	}
+	
+	if (fields.bounded)
+	{
+		//Upper bound of serialized size
+		fprintf(h_file, 
+			"#define %s__MAX_WIRE_SIZE_BYTES (%zu)\n"
+			"#define %s__MAX_WIRE_SIZE_SUBMSGS (%zu)\n"
+			"#define %s__MAX_WIRE_SIZE \\\n"
+			"    {%s__MAX_WIRE_SIZE_BYTES, %s__MAX_WIRE_SIZE_SUBMSGS}\n\n",
+			value->name, fields.max_size.n_bytes,
+			value->name, fields.max_size.n_submsgs,
+			value->name, value->name, value->name);
 	}
 	
 	//Serialization function
 	fprintf(h_file, 
-		"void %s__write\n"
-		"    (%s *value, SscSegment *seg, SscMsgIter *msg_iter);\n\n",
-		value->name, value->name);
+		"%svoid %s__write\n"
+		"    (%s *SSC_RESTRICT value, SscSegment *SSC_RESTRICT seg, \n"
+		"     SscMsgIter *SSC_RESTRICT msg_iter);\n\n",
+		linkage, value->name, value->name);
 	
 	//Deserialization function
 	fprintf(h_file, 
-		"int %s__read\n"
-		"    (%s *value, SscSegment *seg, SscMsgIter *msg_iter);\n\n",
-		value->name, value->name);
+		"%sint %s__read\n"
+		"    (%s *SSC_RESTRICT value, SscSegment *SSC_RESTRICT seg, \n"
+		"     SscMsgIter *SSC_RESTRICT msg_iter);\n\n",
+		linkage, value->name, value->name);
 	
 	//Function to free the structure
 	fprintf(h_file, 
-		"void %s__free(%s *value);\n\n",
-		value->name, value->name);
+		"%svoid %s__free(%s *value);\n\n",
+		linkage, value->name, value->name);
 	
 	//Function to serialize a structure into a message
 	fprintf(h_file, 
 		"MmcMsg *%s__serialize(%s *value);\n\n",
 		value->name, value->name);
+	
+	//Function to serialize a structure into a message, sharing 
+	//repeated strings
+	fprintf(h_file, 
+		"MmcMsg *%s__serialize_pooled(%s *value, SscStrPool *pool);\n\n",
+		value->name, value->name);
+		
+	//Function to serialize a structure into caller-provided storage
+	fprintf(h_file, 
+		"//Submessages written to submsgs are owned by the caller, \n"
+		"//who has to unref them\n"
+		"MdslStatus %s__serialize_to\n"
+		"    (%s *value, void *mem, size_t mem_len, \n"
+		"     MmcMsg **submsgs, size_t submsgs_len, SscDLen *size);\n\n",
+		value->name, value->name);
 		
 	//Function to deserialize a message to get back structure
 	fprintf(h_file, 
 		"MdslStatus %s__deserialize(MmcMsg *msg, %s *value);\n\n",
 		value->name, value->name);
 	
+	//Helpers for stream fields
+	ssc_var_list_gen_stream_declaration(fields, value->name, h_file);
+	
 	//Prevent multiple declarations: end
 	fprintf(h_file, 
 		"#endif //SSC_STRUCT__%s__DECLARED\n\n",
 		value->name);
 }
 
-void ssc_struct_gen_code
-	(SscSymbol *value, FILE *c_file)
+void ssc_struct_gen_codec
+	(SscSymbol *value, int inline_codec, FILE *c_file)
 {
 	SscVarList fields;
-	int label_count;
+	const char *linkage;
+	char *fail_fn;
 	
 	//Get details
 	fields = value->v.xstruct.fields;
+	linkage = inline_codec ? "static inline " : "";
 	
-	//Separator comment
-	fprintf(c_file, "//%s\n", value->name);
+	if (inline_codec)
+	{
+		//Separator comment
+		fprintf(c_file, "//%s: codec\n", value->name);
+		
+		//Prevent multiple definitions
+		fprintf(c_file, 
+			"#ifndef SSC_STRUCT__%s__CODEC_DEFINED\n"
+			"#define SSC_STRUCT__%s__CODEC_DEFINED\n\n",
+			value->name, value->name);
+	}
 	
 	if (! fields.constsize)
 	{
 		//Structure is not of constant size, have to write functions
 		
 		fprintf(c_file, 
-			"SscDLen %s__count(%s *value)\n"
+			"%sSscDLen %s__count(%s *value)\n"
 			"{\n"
 			"    SscDLen size = {0, 0};\n\n",
-			value->name, value->name);
+			linkage, value->name, value->name);
 		
 		ssc_var_list_code_for_count(fields, "value->", c_file);
 		
@@ -121,46 +176,224 @@ void ssc_struct_gen_code
 			"}\n\n");	
 	}
 	
+	if (fields.has_bounds)
+	{
+		//Function to check sequence bounds before serializing
+		fprintf(c_file, 
+			"%sint %s__check_bounds(%s *value)\n"
+			"{\n",
+			linkage, value->name, value->name);
+		
+		ssc_var_list_code_for_check(fields, "value->", "return 0", c_file);
+		
+		fprintf(c_file, 
+			"    return 1;\n"
+			"}\n\n");
+	}
+	
 	//Serialization function
 	fprintf(c_file, 
-		"void %s__write\n"
-		"    (%s *value, SscSegment *seg, SscMsgIter *msg_iter)\n"
+		"%svoid %s__write\n"
+		"    (%s *SSC_RESTRICT value, SscSegment *SSC_RESTRICT seg, \n"
+		"     SscMsgIter *SSC_RESTRICT msg_iter)\n"
 		"{\n",
-		value->name, value->name);
+		linkage, value->name, value->name);
 	
 	ssc_var_list_code_for_write(fields, "value->", c_file);
 	
 	fprintf(c_file, "}\n\n");
 	
+	//Deserialization function: cleanup on failure, kept out of line
+	fail_fn = mdsl_alloc(strlen(value->name) + sizeof("__read_fail"));
+	strcpy(fail_fn, value->name);
+	strcat(fail_fn, "__read_fail");
+	ssc_var_list_code_for_read_fail_fn
+		(fields, "value->", fail_fn, value->name, 0, c_file);
+	
 	//Deserialization function
 	fprintf(c_file, 
-		"MdslStatus %s__read\n"
-		"    (%s *value, SscSegment *seg, SscMsgIter *msg_iter)\n"
+		"%sMdslStatus %s__read\n"
+		"    (%s *SSC_RESTRICT value, SscSegment *SSC_RESTRICT seg, \n"
+		"     SscMsgIter *SSC_RESTRICT msg_iter)\n"
 		"{\n",
-		value->name, value->name);
+		linkage, value->name, value->name);
 	
 	ssc_var_list_code_for_read
 		(fields, "value->", c_file);
 	fprintf(c_file, "\n    return 0;\n\n");
-	label_count = ssc_var_list_code_for_read_fail(fields, "value->", 0, c_file);
-	if (label_count > 0)
-		fprintf(c_file, "\n    return -1;\n");
+	ssc_var_list_code_for_read_fail(fields, fail_fn, 0, "return -1", c_file);
 	fprintf(c_file, "}\n\n");
+	free(fail_fn);
 	
 	//Function to free the structure
 	fprintf(c_file, 
-		"void %s__free(%s *value)\n"
+		"%svoid %s__free(%s *value)\n"
 		"{\n",
-		value->name, value->name);
+		linkage, value->name, value->name);
 	
 	ssc_var_list_code_for_free(fields, "value->", c_file);
 	
 	fprintf(c_file, "}\n\n");
 	
+	//Prevent multiple definitions: end
+	if (inline_codec)
+		fprintf(c_file, 
+			"#endif //SSC_STRUCT__%s__CODEC_DEFINED\n\n",
+			value->name);
+}
+
+//Field type names for descriptor tables, 
+//have to be kept in sync with enum SscTypeFundamentalID
+static const char *ssc_field_type_names[] =
+{
+	NULL,
+	"SSC_FIELD_UINT8",
+	"SSC_FIELD_UINT16",
+	"SSC_FIELD_UINT32",
+	"SSC_FIELD_UINT64",
+	"SSC_FIELD_INT8",
+	"SSC_FIELD_INT16",
+	"SSC_FIELD_INT32",
+	"SSC_FIELD_INT64",
+	"SSC_FIELD_FLT32",
+	"SSC_FIELD_FLT64",
+	"SSC_FIELD_STRING",
+	"SSC_FIELD_MSG"
+};
+
+void ssc_struct_gen_table(SscSymbol *value, FILE *c_file)
+{
+	SscVarList fields;
+	int i;
+	
+	//Get details
+	fields = value->v.xstruct.fields;
+	
+	//Separator comment
+	fprintf(c_file, "//%s: descriptor table\n", value->name);
+	
+	if (fields.len > 0)
+	{
+		fprintf(c_file, 
+			"static const SscFieldDesc %s__fields[] =\n"
+			"{\n",
+			value->name);
+		for (i = 0; i < fields.len; i++)
+		{
+			SscVar *var = fields.a[i];
+			
+			fprintf(c_file, 
+				"    {%s, %d, %d, offsetof(%s, %s), ",
+				var->type.sym ? "SSC_FIELD_STRUCT" 
+					: ssc_field_type_names[var->type.fid],
+				var->type.complexity, var->type.bound,
+				value->name, var->name);
+			if (var->type.sym)
+				fprintf(c_file, "&%s__desc}", var->type.sym->name);
+			else
+				fprintf(c_file, "NULL}");
+			fprintf(c_file, "%s\n", i + 1 < fields.len ? "," : "");
+		}
+		fprintf(c_file, "};\n\n");
+	}
+	
+	fprintf(c_file, 
+		"static const SscStructDesc %s__desc =\n"
+		"{\n"
+		"    sizeof(%s), %d, {%d, %d}, %d, %s%s\n"
+		"};\n\n",
+		value->name, value->name, fields.constsize ? 1 : 0, 
+		(int) fields.base_size.n_bytes, 
+			(int) fields.base_size.n_submsgs,
+		(int) fields.len, 
+		fields.len > 0 ? value->name : "NULL", 
+		fields.len > 0 ? "__fields" : "");
+}
+
+//Writes field-level codec functions calling the table interpreter
+static void ssc_struct_gen_table_codec(SscSymbol *value, FILE *c_file)
+{
+	SscVarList fields;
+	
+	//Get details
+	fields = value->v.xstruct.fields;
+	
+	if (! fields.constsize)
+	{
+		fprintf(c_file, 
+			"SscDLen %s__count(%s *value)\n"
+			"{\n"
+			"    return ssc_table_count(&%s__desc, value);\n"
+			"}\n\n",
+			value->name, value->name, value->name);
+	}
+	
+	if (fields.has_bounds)
+	{
+		fprintf(c_file, 
+			"int %s__check_bounds(%s *value)\n"
+			"{\n"
+			"    return ssc_table_check_bounds(&%s__desc, value);\n"
+			"}\n\n",
+			value->name, value->name, value->name);
+	}
+	
+	fprintf(c_file, 
+		"void %s__write\n"
+		"    (%s *SSC_RESTRICT value, SscSegment *SSC_RESTRICT seg, \n"
+		"     SscMsgIter *SSC_RESTRICT msg_iter)\n"
+		"{\n"
+		"    ssc_table_write(&%s__desc, value, seg, msg_iter);\n"
+		"}\n\n",
+		value->name, value->name, value->name);
+	
+	fprintf(c_file, 
+		"MdslStatus %s__read\n"
+		"    (%s *SSC_RESTRICT value, SscSegment *SSC_RESTRICT seg, \n"
+		"     SscMsgIter *SSC_RESTRICT msg_iter)\n"
+		"{\n"
+		"    return ssc_table_read(&%s__desc, value, seg, msg_iter);\n"
+		"}\n\n",
+		value->name, value->name, value->name);
+	
+	fprintf(c_file, 
+		"void %s__free(%s *value)\n"
+		"{\n"
+		"    ssc_table_free(&%s__desc, value);\n"
+		"}\n\n",
+		value->name, value->name, value->name);
+}
+
+void ssc_struct_gen_code
+	(SscSymbol *value, SscCodecMode mode, FILE *c_file)
+{
+	SscVarList fields;
+	
+	//Get details
+	fields = value->v.xstruct.fields;
+	
+	//Separator comment
+	fprintf(c_file, "//%s\n", value->name);
+	
+	//Field-level codec, unless it is inline in the header
+	if (mode == SSC_CODEC_UNROLLED)
+		ssc_struct_gen_codec(value, 0, c_file);
+	else if (mode == SSC_CODEC_TABLE)
+		ssc_struct_gen_table_codec(value, c_file);
+	
 	//Function to serialize a structure into a message
 	fprintf(c_file, 
 		"MmcMsg *%s__serialize(%s *value)\n"
 		"{\n"
+		"    return %s__serialize_pooled(value, NULL);\n"
+		"}\n\n",
+		value->name, value->name, value->name);
+	
+	//Function to serialize a structure into a message, sharing 
+	//repeated strings
+	fprintf(c_file, 
+		"MmcMsg *%s__serialize_pooled(%s *value, SscStrPool *pool)\n"
+		"{\n"
 		"    SscSegment seg;\n"
 		"    SscMsgIter msg_iter;\n"
 		"    SscDLen dlen = {%d, %d};\n"
@@ -169,6 +402,14 @@ void ssc_struct_gen_code
 		value->name, value->name, 
 		(int) fields.base_size.n_bytes, 
 			(int) fields.base_size.n_submsgs);
+	if (fields.has_bounds)
+	{
+		fprintf(c_file, 
+		"    if (SSC_UNLIKELY(! %s__check_bounds(value)))\n"
+		"        return NULL;\n"
+		"    \n",
+		value->name);
+	}
 	if (! fields.constsize)
 	{
 		fprintf(c_file, 
@@ -186,16 +427,71 @@ void ssc_struct_gen_code
 		"    msg = mmc_msg_newa(dlen.n_bytes, dlen.n_submsgs);\n"
 		"    \n"
 		"    ssc_msg_iter_init(&msg_iter, msg);\n"
-		"    ssc_msg_iter_get_segment(&msg_iter, %d, %d, &seg);\n"
+		"    ssc_msg_iter_set_str_pool(&msg_iter, pool);\n"
+		"    ssc_msg_iter_take_segment(&msg_iter, %d, %d, &seg);\n"
 		"    \n"
 		"    %s__write(value, &seg, &msg_iter);\n"
 		"    \n"
+		"    if (pool)\n"
+		"        ssc_str_pool_reset(pool);\n"
 		"    return msg;\n"
 		"}\n\n",
 		(int) fields.base_size.n_bytes, 
 			(int) fields.base_size.n_submsgs, 
 		value->name);
 	
+	//Function to serialize a structure into caller-provided storage
+	fprintf(c_file, 
+		"MdslStatus %s__serialize_to\n"
+		"    (%s *value, void *mem, size_t mem_len, \n"
+		"     MmcMsg **submsgs, size_t submsgs_len, SscDLen *size)\n"
+		"{\n"
+		"    SscSegment seg;\n"
+		"    SscMsgIter msg_iter;\n"
+		"    SscDLen dlen = {%d, %d};\n"
+		"    \n",
+		value->name, value->name, 
+		(int) fields.base_size.n_bytes, 
+			(int) fields.base_size.n_submsgs);
+	if (fields.has_bounds)
+	{
+		fprintf(c_file, 
+		"    if (SSC_UNLIKELY(! %s__check_bounds(value)))\n"
+		"        return MDSL_FAILURE;\n"
+		"    \n",
+		value->name);
+	}
+	if (! fields.constsize)
+	{
+		fprintf(c_file, 
+		"    //Size computation\n"
+		"    {\n"
+		"        SscDLen dynamic;\n"
+		"        dynamic = %s__count(value);\n"
+		"        dlen.n_bytes += dynamic.n_bytes;\n"
+		"        dlen.n_submsgs += dynamic.n_submsgs;\n"
+		"    }\n"
+		"    \n",
+		value->name);
+	}
+	fprintf(c_file, 
+		"    if (dlen.n_bytes > mem_len || dlen.n_submsgs > submsgs_len)\n"
+		"        return MDSL_FAILURE;\n"
+		"    \n"
+		"    ssc_msg_iter_init_mem(&msg_iter, mem, dlen.n_bytes, \n"
+		"        submsgs, dlen.n_submsgs);\n"
+		"    ssc_msg_iter_take_segment(&msg_iter, %d, %d, &seg);\n"
+		"    \n"
+		"    %s__write(value, &seg, &msg_iter);\n"
+		"    \n"
+		"    if (size)\n"
+		"        *size = dlen;\n"
+		"    return MDSL_SUCCESS;\n"
+		"}\n\n",
+		(int) fields.base_size.n_bytes, 
+			(int) fields.base_size.n_submsgs, 
+		value->name);
+	
 	//Function to deserialize a message to get back structure
 	fprintf(c_file, 
 		"int %s__deserialize(MmcMsg *msg, %s *value)\n"
@@ -204,14 +500,14 @@ void ssc_struct_gen_code
 		"    SscMsgIter msg_iter;\n"
 		"    \n"
 		"    ssc_msg_iter_init(&msg_iter, msg);\n"
-		"    if (ssc_msg_iter_get_segment(&msg_iter, %d, %d, &seg) \n"
-		"            == MDSL_FAILURE)\n"
+		"    if (SSC_UNLIKELY(ssc_msg_iter_get_segment(&msg_iter, %d, %d, &seg) \n"
+		"            == MDSL_FAILURE))\n"
 		"        goto _ssc_return;\n"
 		"    \n"
-		"    if (%s__read(value, &seg, &msg_iter) < 0)\n"
+		"    if (SSC_UNLIKELY(%s__read(value, &seg, &msg_iter) < 0))\n"
 		"        goto _ssc_return;\n"
 		"    \n"
-		"    if (! ssc_msg_iter_at_end(&msg_iter))\n"
+		"    if (SSC_UNLIKELY(! ssc_msg_iter_at_end(&msg_iter)))\n"
 		"        goto _ssc_destroy_n_return;\n"
 		"    \n"
 		"    return MDSL_SUCCESS;\n"
@@ -226,6 +522,9 @@ void ssc_struct_gen_code
 			(int) fields.base_size.n_submsgs,
 		value->name,
 		value->name);
+	
+	//Helpers for stream fields
+	ssc_var_list_code_for_streams(fields, value->name, c_file);
 }
 
 
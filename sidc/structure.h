@@ -19,9 +19,31 @@
  */
 
 
+//How field-level codec functions (__count, __write, __read, __free)
+//are generated
+typedef enum
+{
+	//Out-of-line functions in the .c file
+	SSC_CODEC_UNROLLED = 0,
+	//static inline functions in the header (sidc --inline)
+	SSC_CODEC_INLINE = 1,
+	//Descriptor tables interpreted by libssc (sidc --table)
+	SSC_CODEC_TABLE = 2
+} SscCodecMode;
+
 //Writes header code for given structure
-void ssc_struct_gen_declaration(SscSymbol *value, FILE *h_file);
+void ssc_struct_gen_declaration
+	(SscSymbol *value, SscCodecMode mode, FILE *h_file);
+
+//Writes field-level codec functions (__count, __write, __read, __free)
+//for given structure, static inline if inline_codec is set
+void ssc_struct_gen_codec
+	(SscSymbol *value, int inline_codec, FILE *c_file);
+
+//Writes descriptor table for given structure (SSC_CODEC_TABLE)
+void ssc_struct_gen_table(SscSymbol *value, FILE *c_file);
 
-//Writes C code for given structure
+//Writes C code for given structure. In SSC_CODEC_INLINE mode
+//the field-level codec is left to ssc_struct_gen_codec().
 void ssc_struct_gen_code
-	(SscSymbol *value, FILE *c_file);
+	(SscSymbol *value, SscCodecMode mode, FILE *c_file);
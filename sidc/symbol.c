@@ -176,11 +176,14 @@ static void ssc_calc_var_list_size
 {
 	int constsize = 1;
 	SscDLen size = {0, 0};
+	int bounded = 1;
+	SscDLen max_size = {0, 0};
+	int has_bounds = 0;
 	int i;
 	
 	for (i = 0; i < listptr->len; i++)
 	{
-		SscDLen unit_size;
+		SscDLen unit_size, unit_max_size;
 		int unit_constsize;
 		
 		unit_size = ssc_type_calc_base_size(listptr->a[i]->type);
@@ -190,12 +193,28 @@ static void ssc_calc_var_list_size
 		size.n_submsgs += unit_size.n_submsgs;
 		if (unit_constsize == 0)
 			constsize = 0;
+		
+		if (ssc_type_calc_max_size(listptr->a[i]->type, &unit_max_size))
+		{
+			max_size.n_bytes += unit_max_size.n_bytes;
+			max_size.n_submsgs += unit_max_size.n_submsgs;
+		}
+		else
+		{
+			bounded = 0;
+		}
+		
+		if (ssc_type_has_bounds(listptr->a[i]->type))
+			has_bounds = 1;
 	}
 	
 	
 	//Now return our findings
 	listptr->base_size = size;
 	listptr->constsize = constsize;
+	listptr->max_size = bounded ? max_size : size;
+	listptr->bounded = bounded;
+	listptr->has_bounds = has_bounds;
 }
 
 SscDLen ssc_base_type_calc_base_size(SscType type)
@@ -269,6 +288,77 @@ int ssc_type_is_constsize(SscType type)
 	return ssc_base_type_is_constsize(type);
 }
 
+int ssc_base_type_calc_max_size(SscType type, SscDLen *res)
+{
+	if (type.sym)
+	{
+		if (type.sym->v.xstruct.fields.constsize == -1)
+			ssc_calc_var_list_size(&(type.sym->v.xstruct.fields));
+		
+		*res = type.sym->v.xstruct.fields.max_size;
+		return type.sym->v.xstruct.fields.bounded;
+	}
+	
+	//Strings and messages travel as submessages of any length
+	if (type.fid == SSC_TYPE_FUNDAMENTAL_STRING 
+		|| type.fid == SSC_TYPE_FUNDAMENTAL_MSG)
+		return 0;
+	
+	*res = ssc_type_fundamental_sizes[type.fid];
+	return 1;
+}
+
+int ssc_type_calc_max_size(SscType type, SscDLen *res)
+{
+	SscDLen base_max;
+	
+	if (! ssc_base_type_calc_max_size(type, &base_max))
+		return 0;
+	
+	if (type.complexity == SSC_TYPE_OPTIONAL)
+	{
+		res->n_bytes = 1 + base_max.n_bytes;
+		res->n_submsgs = base_max.n_submsgs;
+	}
+	else if (type.complexity == SSC_TYPE_SEQ)
+	{
+		if (! type.bound)
+			return 0;
+		if (base_max.n_bytes > (SIZE_MAX - 4) / type.bound)
+			return 0;
+		
+		res->n_bytes = 4 + type.bound * base_max.n_bytes;
+		res->n_submsgs = type.bound * base_max.n_submsgs;
+	}
+	else if (type.complexity > 0)
+	{
+		res->n_bytes = type.complexity * base_max.n_bytes;
+		res->n_submsgs = type.complexity * base_max.n_submsgs;
+	}
+	else
+	{
+		*res = base_max;
+	}
+	
+	return 1;
+}
+
+int ssc_type_has_bounds(SscType type)
+{
+	if (type.complexity == SSC_TYPE_SEQ && type.bound)
+		return 1;
+	
+	if (type.sym)
+	{
+		if (type.sym->v.xstruct.fields.constsize == -1)
+			ssc_calc_var_list_size(&(type.sym->v.xstruct.fields));
+		
+		return type.sym->v.xstruct.fields.has_bounds;
+	}
+	
+	return 0;
+}
+
 SscSymbolDB *ssc_symbol_db_new()
 {
 	SscSymbolDB *db = mdsl_new(SscSymbolDB);
@@ -55,6 +55,9 @@ extern char *ssc_type_fundamental_names[13];
 
 typedef enum
 {
+	//Only in SscVarList::streams, the parser replaces 
+	//stream fields by their stream no.
+	SSC_TYPE_STREAM = -3,
 	SSC_TYPE_OPTIONAL = -2,
 	SSC_TYPE_SEQ = -1,
 	SSC_TYPE_NONE = 0
@@ -67,6 +70,8 @@ typedef struct
 	SscSymbol *sym;
 	SscTypeFundamentalID fid; //If sym is not null this is invalid
 	int complexity;
+	int bound; //Maximum length for sequences, 0 if unbounded;
+	           //elements per chunk for streams
 } SscType;
 
 SscDLen ssc_base_type_calc_base_size(SscType type);
@@ -74,6 +79,14 @@ int ssc_base_type_is_constsize(SscType type);
 SscDLen ssc_type_calc_base_size(SscType type);
 int ssc_type_is_constsize(SscType type);
 
+//Computes upper bound of serialized size (base size + dynamic size).
+//Returns 0 if the size is unbounded.
+int ssc_base_type_calc_max_size(SscType type, SscDLen *res);
+int ssc_type_calc_max_size(SscType type, SscDLen *res);
+
+//Tells whether serializing the type has to check sequence bounds
+int ssc_type_has_bounds(SscType type);
+
 #define ssc_type_is_fundamental(typeptr) ((typeptr)->sym ? 0 : 1)
 
 //Variable
@@ -91,6 +104,21 @@ typedef struct
 	//Size information, will be calculated by database
 	SscDLen base_size;
 	int constsize;
+	
+	//Upper bound of total size, valid only if bounded is nonzero.
+	//Strings and messages are unbounded, so a bounded list 
+	//never has submessages.
+	SscDLen max_size;
+	int bounded;
+	
+	//Whether some sequence, possibly in a nested structure, 
+	//has a bound to check before serializing
+	int has_bounds;
+	
+	//Stream fields, which a holds as uint64 stream nos. 
+	//of the same names. Their chunks are structures of their own.
+	SscVar **streams;
+	size_t streams_len;
 } SscVarList;
 
 //Function
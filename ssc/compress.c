@@ -0,0 +1,338 @@
+/* compress.h
+ * Block compression for message frames
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incl.h"
+
+//LZ4 block format: sequences of
+//  token                     literal length << 4 | (match length - 4)
+//  [255...] byte             rest of literal length, if token has 15
+//  literals
+//  uint16 (little endian)    offset of the match, backwards
+//  [255...] byte             rest of match length, if token has 15
+//The last sequence ends after its literals; the last 5 bytes are 
+//always literals, and the last match starts 12 bytes before the end 
+//at the latest.
+#define SSC_LZ4_MIN_MATCH 4
+#define SSC_LZ4_LAST_LITERALS 5
+#define SSC_LZ4_MF_LIMIT 12
+#define SSC_LZ4_HASH_LOG 13
+
+static inline uint32_t ssc_lz4_load32(const uint8_t *p)
+{
+	uint32_t v;
+	
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t ssc_lz4_hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - SSC_LZ4_HASH_LOG);
+}
+
+//Writes the rest of a length of 15 or more
+static inline uint8_t *ssc_lz4_put_len(uint8_t *op, size_t len)
+{
+	len -= 15;
+	while (len >= 255)
+	{
+		*(op++) = 255;
+		len -= 255;
+	}
+	*(op++) = len;
+	return op;
+}
+
+size_t ssc_lz4_compress
+	(const void *src, size_t len, void *dest, size_t dest_len)
+{
+	const uint8_t *in = src, *end = in + len;
+	const uint8_t *ip = in, *anchor = in;
+	uint8_t *op = dest, *op_end = op + dest_len;
+	uint16_t table[1 << SSC_LZ4_HASH_LOG];
+	size_t lit_len;
+	
+	if (len > SSC_MSG_CHUNK_SIZE)
+		return 0;
+	
+	//Positions of earlier 4-byte sequences, by hash; 
+	//chunks are short enough for 16-bit positions and offsets
+	memset(table, 0, sizeof(table));
+	
+	if (len > SSC_LZ4_MF_LIMIT)
+	{
+		const uint8_t *mf_limit = end - SSC_LZ4_MF_LIMIT;
+		const uint8_t *match_limit = end - SSC_LZ4_LAST_LITERALS;
+		
+		ip++;
+		while (ip < mf_limit)
+		{
+			const uint8_t *ref, *mp, *rp;
+			uint32_t seq, h;
+			size_t match_len;
+			
+			seq = ssc_lz4_load32(ip);
+			h = ssc_lz4_hash(seq);
+			ref = in + table[h];
+			table[h] = ip - in;
+			if (ssc_lz4_load32(ref) != seq || ip - ref > 65535)
+			{
+				//Skip faster through data that does not compress
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+			
+			//Extend the match both ways
+			while (ip > anchor && ref > in && ip[-1] == ref[-1])
+			{
+				ip--;
+				ref--;
+			}
+			mp = ip + SSC_LZ4_MIN_MATCH;
+			rp = ref + SSC_LZ4_MIN_MATCH;
+			while (mp < match_limit && *mp == *rp)
+			{
+				mp++;
+				rp++;
+			}
+			
+			lit_len = ip - anchor;
+			match_len = mp - ip - SSC_LZ4_MIN_MATCH;
+			if ((size_t) (op_end - op) < 1 + lit_len / 255 + 1 + lit_len 
+				+ 2 + match_len / 255 + 1)
+				return 0;
+			
+			//Token, literals, offset, match length
+			*op = (lit_len < 15 ? lit_len : 15) << 4 
+				| (match_len < 15 ? match_len : 15);
+			op++;
+			if (lit_len >= 15)
+				op = ssc_lz4_put_len(op, lit_len);
+			memcpy(op, anchor, lit_len);
+			op += lit_len;
+			*(op++) = (ip - ref) & 0xff;
+			*(op++) = (ip - ref) >> 8;
+			if (match_len >= 15)
+				op = ssc_lz4_put_len(op, match_len);
+			
+			ip = anchor = mp;
+			if (ip < mf_limit)
+				table[ssc_lz4_hash(ssc_lz4_load32(ip - 2))] 
+					= ip - 2 - in;
+		}
+	}
+	
+	//Last literals
+	lit_len = end - anchor;
+	if ((size_t) (op_end - op) < 1 + lit_len / 255 + 1 + lit_len)
+		return 0;
+	*(op++) = (lit_len < 15 ? lit_len : 15) << 4;
+	if (lit_len >= 15)
+		op = ssc_lz4_put_len(op, lit_len);
+	memcpy(op, anchor, lit_len);
+	op += lit_len;
+	
+	return op - (uint8_t *) dest;
+}
+
+//Reads the rest of a length that has 15 in the token
+static inline MdslStatus ssc_lz4_get_len
+	(const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+	uint8_t b;
+	
+	do
+	{
+		if (*ip >= end)
+			return MDSL_FAILURE;
+		b = **ip;
+		(*ip)++;
+		*len += b;
+	} while (b == 255);
+	
+	return MDSL_SUCCESS;
+}
+
+MdslStatus ssc_lz4_decompress
+	(const void *src, size_t len, void *dest, size_t dest_len)
+{
+	const uint8_t *ip = src, *end = ip + len;
+	uint8_t *op = dest, *op_end = op + dest_len;
+	
+	while (1)
+	{
+		size_t lit_len, match_len, offset;
+		uint8_t token;
+		
+		if (ip >= end)
+			return MDSL_FAILURE;
+		token = *(ip++);
+		
+		lit_len = token >> 4;
+		if (lit_len == 15 
+			&& ssc_lz4_get_len(&ip, end, &lit_len) != MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		if (lit_len > (size_t) (end - ip) 
+			|| lit_len > (size_t) (op_end - op))
+			return MDSL_FAILURE;
+		memcpy(op, ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+		
+		if (ip == end)
+			break;
+		
+		if (end - ip < 2)
+			return MDSL_FAILURE;
+		offset = ip[0] | (((size_t) ip[1]) << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t) (op - (uint8_t *) dest))
+			return MDSL_FAILURE;
+		
+		match_len = token & 15;
+		if (match_len == 15 
+			&& ssc_lz4_get_len(&ip, end, &match_len) != MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		match_len += SSC_LZ4_MIN_MATCH;
+		if (match_len > (size_t) (op_end - op))
+			return MDSL_FAILURE;
+		
+		//Matches may overlap what they produce
+		if (offset >= match_len)
+		{
+			memcpy(op, op - offset, match_len);
+			op += match_len;
+		}
+		else
+		{
+			for (; match_len > 0; match_len--, op++)
+				*op = op[-offset];
+		}
+	}
+	
+	return op == op_end ? MDSL_SUCCESS : MDSL_FAILURE;
+}
+
+size_t ssc_msg_chunk_span
+	(const struct iovec *iov, size_t n_iov, size_t offset, size_t *n_span)
+{
+	size_t len;
+	
+	//Piece of a large block
+	if (offset > 0 || iov[0].iov_len > SSC_MSG_CHUNK_SIZE)
+	{
+		*n_span = 1;
+		len = iov[0].iov_len - offset;
+		return len < SSC_MSG_CHUNK_SIZE ? len : SSC_MSG_CHUNK_SIZE;
+	}
+	
+	//Run of blocks
+	len = 0;
+	for (*n_span = 0; *n_span < n_iov; (*n_span)++)
+	{
+		if (iov[*n_span].iov_len > SSC_MSG_CHUNK_SIZE - len)
+			break;
+		len += iov[*n_span].iov_len;
+	}
+	
+	return len;
+}
+
+size_t ssc_msg_chunks_bound(const struct iovec *iov, size_t n_iov)
+{
+	size_t i, offset, n_span, len, res;
+	
+	res = 0;
+	for (i = 0, offset = 0; i < n_iov; )
+	{
+		len = ssc_msg_chunk_span(iov + i, n_iov - i, offset, &n_span);
+		res += SSC_MSG_CHUNK_HEADER_SIZE + ssc_lz4_bound(len);
+		if (n_span == 1 && offset + len < iov[i].iov_len)
+		{
+			offset += len;
+		}
+		else
+		{
+			i += n_span;
+			offset = 0;
+		}
+	}
+	
+	return res;
+}
+
+size_t ssc_msg_chunks_encode(const struct iovec *iov, size_t n_iov, 
+	SscMsgCodec codec, void *scratch, void *dest)
+{
+	uint8_t *op = dest;
+	size_t i, j, offset, n_span, len, stored;
+	const uint8_t *chunk;
+	
+	for (i = 0, offset = 0; i < n_iov; )
+	{
+		len = ssc_msg_chunk_span(iov + i, n_iov - i, offset, &n_span);
+		
+		//Gather runs of blocks
+		if (n_span == 1)
+		{
+			chunk = ((const uint8_t *) iov[i].iov_base) + offset;
+		}
+		else
+		{
+			uint8_t *ptr = scratch;
+			
+			for (j = 0; j < n_span; j++)
+			{
+				memcpy(ptr, iov[i + j].iov_base, iov[i + j].iov_len);
+				ptr += iov[i + j].iov_len;
+			}
+			chunk = scratch;
+		}
+		
+		stored = 0;
+		if (codec == SSC_MSG_CODEC_LZ4 && len >= SSC_MSG_CHUNK_MIN)
+			stored = ssc_lz4_compress(chunk, len, 
+				op + SSC_MSG_CHUNK_HEADER_SIZE, len - 1);
+		if (stored)
+		{
+			ssc_uint32_store_le(op, stored 
+				| (((uint32_t) SSC_MSG_CODEC_LZ4) << 24));
+		}
+		else
+		{
+			stored = len;
+			ssc_uint32_store_le(op, stored);
+			memcpy(op + SSC_MSG_CHUNK_HEADER_SIZE, chunk, len);
+		}
+		op += SSC_MSG_CHUNK_HEADER_SIZE + stored;
+		
+		if (n_span == 1 && offset + len < iov[i].iov_len)
+		{
+			offset += len;
+		}
+		else
+		{
+			i += n_span;
+			offset = 0;
+		}
+	}
+	
+	return op - (uint8_t *) dest;
+}
@@ -0,0 +1,82 @@
+/* compress.h
+ * Block compression for message frames
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Compressed frames (SSC_MSG_FRAME_COMPRESSED, see reader.h) carry 
+//the memory blocks as a stream of chunks instead. Chunks are cut 
+//from the nonempty blocks in breadth-first order, as determined 
+//by the layout alone: a run of consecutive blocks that together fit 
+//in SSC_MSG_CHUNK_SIZE bytes makes one chunk, and a larger block is 
+//cut into pieces of SSC_MSG_CHUNK_SIZE bytes (the last one shorter),
+//each one chunk. Every chunk is
+//  uint32 (little endian)    no. of bytes stored | codec << 24
+//  stored bytes              chunk, encoded with the codec
+//so tiny blocks are compressed together, and a piece of a block 
+//can be decompressed straight into its message.
+
+//Codecs for chunks
+typedef enum
+{
+	//Stored as is
+	SSC_MSG_CODEC_NONE = 0,
+	//LZ4 block format
+	SSC_MSG_CODEC_LZ4 = 1
+} SscMsgCodec;
+
+#define SSC_MSG_CHUNK_HEADER_SIZE 4
+#define SSC_MSG_CHUNK_SIZE 65536
+
+//Chunks shorter than this are stored without trying to compress them
+#define SSC_MSG_CHUNK_MIN 64
+
+//Frames whose blocks add up to fewer bytes are not worth compressing
+#define SSC_MSG_COMPRESS_MIN 256
+
+//Largest no. of bytes ssc_lz4_compress() gives for len bytes
+static inline size_t ssc_lz4_bound(size_t len)
+{
+	return len + len / 255 + 16;
+}
+
+//Compresses len bytes (at most SSC_MSG_CHUNK_SIZE) into LZ4 block 
+//format. Returns the compressed length, or 0 if it does not fit in 
+//dest_len bytes.
+size_t ssc_lz4_compress
+	(const void *src, size_t len, void *dest, size_t dest_len);
+
+//Decompresses LZ4 block format, which must give exactly dest_len bytes
+MdslStatus ssc_lz4_decompress
+	(const void *src, size_t len, void *dest, size_t dest_len);
+
+//Finds the chunk that starts offset bytes into iov[0]. 
+//Returns its length, and sets *n_span to the no. of iovecs it covers.
+//The next chunk starts at iov[*n_span] if the chunk reaches the end 
+//of the iovecs it covers, otherwise further into iov[0].
+size_t ssc_msg_chunk_span
+	(const struct iovec *iov, size_t n_iov, size_t offset, size_t *n_span);
+
+//Largest no. of bytes ssc_msg_chunks_encode() gives for blocks in iov
+size_t ssc_msg_chunks_bound(const struct iovec *iov, size_t n_iov);
+
+//Encodes nonempty blocks in iov as a stream of chunks into dest, 
+//which must have room for ssc_msg_chunks_bound() bytes. 
+//Chunks that do not shrink are stored as is. scratch must have room 
+//for SSC_MSG_CHUNK_SIZE bytes. Returns the no. of bytes written.
+size_t ssc_msg_chunks_encode(const struct iovec *iov, size_t n_iov, 
+	SscMsgCodec codec, void *scratch, void *dest);
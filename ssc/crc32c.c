@@ -0,0 +1,277 @@
+/* crc32c.h
+ * CRC32C checksums
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incl.h"
+
+#include <pthread.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SSC_CRC32C_X86 1
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+//Reflected polynomial
+#define SSC_CRC32C_POLY 0x82F63B78
+
+//Bytes in each of the three streams the hardware version 
+//processes at once
+#define SSC_CRC32C_STRIDE 1024
+
+typedef uint32_t (*SscCrc32cFn)(uint32_t crc, const uint8_t *p, size_t len);
+
+//Slicing-by-8 tables: ssc_crc32c_table[k][b] is the CRC 
+//of byte b followed by k zero bytes
+static uint32_t ssc_crc32c_table[8][256];
+
+//ssc_crc32c_x8n[k] is x^(8 * 2^k) modulo the polynomial, for 
+//moving a checksum past 2^k bytes
+static uint32_t ssc_crc32c_x8n[64];
+
+static pthread_once_t ssc_crc32c_once = PTHREAD_ONCE_INIT;
+static SscCrc32cFn ssc_crc32c_update;
+
+static uint32_t ssc_crc32c_update_portable
+	(uint32_t crc, const uint8_t *p, size_t len)
+{
+	while (len > 0 && (((uintptr_t) p) & 7))
+	{
+		crc = ssc_crc32c_table[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+		p++;
+		len--;
+	}
+	
+	while (len >= 8)
+	{
+		uint64_t v = ssc_uint64_load_le((void *) p) ^ crc;
+		
+		crc = ssc_crc32c_table[7][v & 0xff]
+			^ ssc_crc32c_table[6][(v >> 8) & 0xff]
+			^ ssc_crc32c_table[5][(v >> 16) & 0xff]
+			^ ssc_crc32c_table[4][(v >> 24) & 0xff]
+			^ ssc_crc32c_table[3][(v >> 32) & 0xff]
+			^ ssc_crc32c_table[2][(v >> 40) & 0xff]
+			^ ssc_crc32c_table[1][(v >> 48) & 0xff]
+			^ ssc_crc32c_table[0][v >> 56];
+		p += 8;
+		len -= 8;
+	}
+	
+	while (len > 0)
+	{
+		crc = ssc_crc32c_table[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+		p++;
+		len--;
+	}
+	
+	return crc;
+}
+
+#ifdef SSC_CRC32C_X86
+
+//Multiplier for skipping SSC_CRC32C_STRIDE bytes (see below)
+static uint64_t ssc_crc32c_stride_k;
+
+__attribute__((target("sse4.2")))
+static uint32_t ssc_crc32c_update_sse42
+	(uint32_t crc, const uint8_t *p, size_t len)
+{
+	uint64_t crc64;
+	
+	while (len > 0 && (((uintptr_t) p) & 7))
+	{
+		crc = _mm_crc32_u8(crc, *p);
+		p++;
+		len--;
+	}
+	
+	crc64 = crc;
+	while (len >= 8)
+	{
+		crc64 = _mm_crc32_u64(crc64, *((const uint64_t *) p));
+		p += 8;
+		len -= 8;
+	}
+	crc = crc64;
+	
+	while (len > 0)
+	{
+		crc = _mm_crc32_u8(crc, *p);
+		p++;
+		len--;
+	}
+	
+	return crc;
+}
+
+//Advances crc over SSC_CRC32C_STRIDE zero bytes, i.e. multiplies it 
+//by x^(8 * SSC_CRC32C_STRIDE) modulo the polynomial. The carry-less
+//product with x^(8 * SSC_CRC32C_STRIDE - 32) is reduced by crc32,
+//which multiplies by the remaining x^32.
+__attribute__((target("sse4.2,pclmul")))
+static inline uint32_t ssc_crc32c_shift(uint32_t crc)
+{
+	__m128i prod;
+	
+	prod = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc), 
+		_mm_cvtsi64_si128(ssc_crc32c_stride_k), 0);
+	return _mm_crc32_u64(0, _mm_cvtsi128_si64(prod));
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t ssc_crc32c_update_pclmul
+	(uint32_t crc, const uint8_t *p, size_t len)
+{
+	while (len > 0 && (((uintptr_t) p) & 7))
+	{
+		crc = _mm_crc32_u8(crc, *p);
+		p++;
+		len--;
+	}
+	
+	//The crc32 instruction has a latency of 3 cycles, 
+	//so three independent streams keep it busy
+	while (len >= 3 * SSC_CRC32C_STRIDE)
+	{
+		const uint64_t *p0 = (const uint64_t *) p;
+		const uint64_t *p1 = p0 + SSC_CRC32C_STRIDE / 8;
+		const uint64_t *p2 = p1 + SSC_CRC32C_STRIDE / 8;
+		uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+		size_t i;
+		
+		for (i = 0; i < SSC_CRC32C_STRIDE / 8; i++)
+		{
+			crc0 = _mm_crc32_u64(crc0, p0[i]);
+			crc1 = _mm_crc32_u64(crc1, p1[i]);
+			crc2 = _mm_crc32_u64(crc2, p2[i]);
+		}
+		
+		crc = ssc_crc32c_shift(ssc_crc32c_shift(crc0) ^ crc1) ^ crc2;
+		p += 3 * SSC_CRC32C_STRIDE;
+		len -= 3 * SSC_CRC32C_STRIDE;
+	}
+	
+	return ssc_crc32c_update_sse42(crc, p, len);
+}
+
+#endif
+
+//Multiplies a and b modulo the polynomial, both reflected: 
+//bit 31 is x^0. a must not be 0.
+static uint32_t ssc_crc32c_mul(uint32_t a, uint32_t b)
+{
+	uint32_t m = 0x80000000, p = 0;
+	
+	while (1)
+	{
+		if (a & m)
+		{
+			p ^= b;
+			if (! (a & (m - 1)))
+				break;
+		}
+		m >>= 1;
+		b = (b >> 1) ^ ((b & 1) ? SSC_CRC32C_POLY : 0);
+	}
+	
+	return p;
+}
+
+static void ssc_crc32c_init(void)
+{
+	uint32_t crc;
+	int b, k;
+	
+	for (b = 0; b < 256; b++)
+	{
+		crc = b;
+		for (k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ ((crc & 1) ? SSC_CRC32C_POLY : 0);
+		ssc_crc32c_table[0][b] = crc;
+	}
+	for (b = 0; b < 256; b++)
+	{
+		crc = ssc_crc32c_table[0][b];
+		for (k = 1; k < 8; k++)
+		{
+			crc = ssc_crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			ssc_crc32c_table[k][b] = crc;
+		}
+	}
+	
+	//x^8 from x^1, then squares
+	crc = 0x40000000;
+	for (k = 0; k < 3; k++)
+		crc = ssc_crc32c_mul(crc, crc);
+	ssc_crc32c_x8n[0] = crc;
+	for (k = 1; k < 64; k++)
+		ssc_crc32c_x8n[k] = ssc_crc32c_mul
+			(ssc_crc32c_x8n[k - 1], ssc_crc32c_x8n[k - 1]);
+	
+	ssc_crc32c_update = ssc_crc32c_update_portable;
+	
+#ifdef SSC_CRC32C_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2"))
+	{
+		ssc_crc32c_update = ssc_crc32c_update_sse42;
+		if (__builtin_cpu_supports("pclmul"))
+		{
+			//x^(8 * SSC_CRC32C_STRIDE - 32), reflected, 
+			//shifted left by one for the carry-less product
+			crc = 0x80000000;
+			for (k = 0; k < 8 * SSC_CRC32C_STRIDE - 32; k++)
+				crc = (crc >> 1) ^ ((crc & 1) ? SSC_CRC32C_POLY : 0);
+			ssc_crc32c_stride_k = ((uint64_t) crc) << 1;
+			ssc_crc32c_update = ssc_crc32c_update_pclmul;
+		}
+	}
+#endif
+}
+
+uint32_t ssc_crc32c(uint32_t crc, const void *data, size_t len)
+{
+	pthread_once(&ssc_crc32c_once, ssc_crc32c_init);
+	return ~ssc_crc32c_update(~crc, data, len);
+}
+
+uint32_t ssc_crc32c_portable(uint32_t crc, const void *data, size_t len)
+{
+	pthread_once(&ssc_crc32c_once, ssc_crc32c_init);
+	return ~ssc_crc32c_update_portable(~crc, data, len);
+}
+
+uint32_t ssc_crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+	uint32_t shift = 0x80000000;
+	int k;
+	
+	pthread_once(&ssc_crc32c_once, ssc_crc32c_init);
+	
+	//crc1 followed by len2 zero bytes, to which the second string 
+	//adds crc2 (the pre and post inversions cancel out)
+	for (k = 0; len2; k++, len2 >>= 1)
+	{
+		if (len2 & 1)
+			shift = ssc_crc32c_mul(ssc_crc32c_x8n[k], shift);
+	}
+	
+	return ssc_crc32c_mul(shift, crc1) ^ crc2;
+}
@@ -0,0 +1,34 @@
+/* crc32c.h
+ * CRC32C checksums
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//CRC32C (Castagnoli polynomial, as in iSCSI and ext4). 
+//Uses the SSE 4.2 crc32 instruction where available, on three 
+//interleaved streams combined by carry-less multiplication when 
+//PCLMULQDQ is also there; otherwise a table-driven implementation.
+
+//Continues the checksum crc (0 initially) over len bytes at data
+uint32_t ssc_crc32c(uint32_t crc, const void *data, size_t len);
+
+//As ssc_crc32c(), always with the table-driven implementation
+uint32_t ssc_crc32c_portable(uint32_t crc, const void *data, size_t len);
+
+//Checksum of two byte strings one after the other, from the checksum
+//crc1 of the first and crc2 of the second, which is len2 bytes long
+uint32_t ssc_crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
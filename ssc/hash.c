@@ -0,0 +1,308 @@
+/* hash.h
+ * Content hashing of message trees
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incl.h"
+
+//Odd constants with well mixed bits
+#define SSC_HASH_P0 0xa0761d6478bd642fULL
+#define SSC_HASH_P1 0xe7037ed1a0b428dbULL
+#define SSC_HASH_P2 0x8ebc6af09c88c6e3ULL
+#define SSC_HASH_P3 0x589965cc75374cc3ULL
+
+//Multiplies, folding the 128-bit product into 64 bits
+static inline uint64_t ssc_hash_mum(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 r = ((unsigned __int128) a) * b;
+	
+	return ((uint64_t) r) ^ ((uint64_t) (r >> 64));
+#else
+	uint64_t ha = a >> 32, la = (uint32_t) a;
+	uint64_t hb = b >> 32, lb = (uint32_t) b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	
+	c += lo < t;
+	return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif
+}
+
+static inline uint64_t ssc_hash_load64(const uint8_t *p)
+{
+	return ssc_uint64_load_le((void *) p);
+}
+
+void ssc_hash128(const void *data, size_t len, uint64_t seed, 
+	SscMsgHash *hash)
+{
+	const uint8_t *p = data;
+	uint64_t s0, s1, t[2];
+	size_t rem;
+	
+	//Two independent lanes of 16 bytes each
+	s0 = seed ^ SSC_HASH_P0;
+	s1 = ssc_hash_mum(seed ^ SSC_HASH_P1, SSC_HASH_P2);
+	for (rem = len; rem >= 32; rem -= 32, p += 32)
+	{
+		s0 = ssc_hash_mum(ssc_hash_load64(p) ^ SSC_HASH_P1, 
+			ssc_hash_load64(p + 8) ^ s0);
+		s1 = ssc_hash_mum(ssc_hash_load64(p + 16) ^ SSC_HASH_P2, 
+			ssc_hash_load64(p + 24) ^ s1);
+	}
+	if (rem >= 16)
+	{
+		s0 = ssc_hash_mum(ssc_hash_load64(p) ^ SSC_HASH_P1, 
+			ssc_hash_load64(p + 8) ^ s0);
+		rem -= 16;
+		p += 16;
+	}
+	
+	//The rest, zero padded
+	t[0] = t[1] = 0;
+	memcpy(t, p, rem);
+	s1 = ssc_hash_mum(ssc_uint64_load_le(t) ^ SSC_HASH_P2, 
+		ssc_uint64_load_le(t + 1) ^ s1);
+	
+	hash->lo = ssc_hash_mum(s0 ^ SSC_HASH_P3, s1 ^ len);
+	hash->hi = ssc_hash_mum(s1 ^ SSC_HASH_P0, hash->lo ^ s0);
+}
+
+void ssc_msg_hash_fold(SscMsgHash *hash, const SscMsgHash *sub)
+{
+	uint64_t lo, hi;
+	
+	lo = ssc_hash_mum(hash->lo ^ SSC_HASH_P1, sub->lo ^ SSC_HASH_P2);
+	hi = ssc_hash_mum(hash->hi ^ SSC_HASH_P3, sub->hi ^ SSC_HASH_P0);
+	hash->lo = lo ^ sub->hi;
+	hash->hi = hi ^ sub->lo ^ lo;
+}
+
+void ssc_msg_hash_block(const void *mem, size_t mem_len, 
+	size_t submsgs_len, SscMsgHash *hash)
+{
+	ssc_hash128(mem, mem_len, submsgs_len, hash);
+}
+
+//Memo
+
+//Open addressing with linear probing, deletion by backward shifting
+typedef struct
+{
+	MmcMsg *msg;
+	SscMsgHash hash;
+} SscMsgHashMemoEntry;
+
+struct _SscMsgHashMemo
+{
+	SscMsgHashMemoEntry *entries;
+	size_t mask, n_entries, max_entries;
+};
+
+static inline size_t ssc_msg_hash_memo_slot
+	(SscMsgHashMemo *memo, MmcMsg *msg)
+{
+	return ssc_hash_mum(((uintptr_t) msg) ^ SSC_HASH_P0, SSC_HASH_P1) 
+		& memo->mask;
+}
+
+SscMsgHashMemo *ssc_msg_hash_memo_new(size_t max_entries)
+{
+	SscMsgHashMemo *memo;
+	size_t n_slots;
+	
+	//Keep the table at most half full
+	if (max_entries < 1)
+		max_entries = 1;
+	for (n_slots = 2; n_slots < 2 * max_entries; n_slots *= 2)
+		;
+	
+	memo = mdsl_new(SscMsgHashMemo);
+	memo->entries = mdsl_alloc(sizeof(SscMsgHashMemoEntry) * n_slots);
+	memset(memo->entries, 0, sizeof(SscMsgHashMemoEntry) * n_slots);
+	memo->mask = n_slots - 1;
+	memo->n_entries = 0;
+	memo->max_entries = max_entries;
+	
+	return memo;
+}
+
+void ssc_msg_hash_memo_clear(SscMsgHashMemo *memo)
+{
+	size_t i;
+	
+	for (i = 0; i <= memo->mask && memo->n_entries > 0; i++)
+	{
+		if (memo->entries[i].msg)
+		{
+			mmc_msg_unref(memo->entries[i].msg);
+			memo->entries[i].msg = NULL;
+			memo->n_entries--;
+		}
+	}
+}
+
+void ssc_msg_hash_memo_free(SscMsgHashMemo *memo)
+{
+	ssc_msg_hash_memo_clear(memo);
+	free(memo->entries);
+	free(memo);
+}
+
+static SscMsgHashMemoEntry *ssc_msg_hash_memo_find
+	(SscMsgHashMemo *memo, MmcMsg *msg)
+{
+	size_t i;
+	
+	for (i = ssc_msg_hash_memo_slot(memo, msg); memo->entries[i].msg; 
+		i = (i + 1) & memo->mask)
+	{
+		if (memo->entries[i].msg == msg)
+			return memo->entries + i;
+	}
+	
+	return NULL;
+}
+
+static void ssc_msg_hash_memo_add
+	(SscMsgHashMemo *memo, MmcMsg *msg, SscMsgHash *hash)
+{
+	size_t i;
+	
+	if (memo->n_entries >= memo->max_entries)
+		ssc_msg_hash_memo_clear(memo);
+	
+	i = ssc_msg_hash_memo_slot(memo, msg);
+	while (memo->entries[i].msg)
+		i = (i + 1) & memo->mask;
+	
+	mmc_msg_ref(msg);
+	memo->entries[i].msg = msg;
+	memo->entries[i].hash = *hash;
+	memo->n_entries++;
+}
+
+void ssc_msg_hash_memo_forget(SscMsgHashMemo *memo, MmcMsg *msg)
+{
+	SscMsgHashMemoEntry *entry;
+	size_t i, j, home;
+	
+	entry = ssc_msg_hash_memo_find(memo, msg);
+	if (! entry)
+		return;
+	
+	mmc_msg_unref(entry->msg);
+	entry->msg = NULL;
+	memo->n_entries--;
+	
+	//Move back entries that would no longer be found
+	i = entry - memo->entries;
+	for (j = (i + 1) & memo->mask; memo->entries[j].msg; 
+		j = (j + 1) & memo->mask)
+	{
+		home = ssc_msg_hash_memo_slot(memo, memo->entries[j].msg);
+		if (((j - home) & memo->mask) >= ((j - i) & memo->mask))
+		{
+			memo->entries[i] = memo->entries[j];
+			memo->entries[j].msg = NULL;
+			i = j;
+		}
+	}
+}
+
+//A message queued for hashing. Its submessages are nodes 
+//first to first + n_sub - 1, or none if its hash was memoized.
+typedef struct
+{
+	MmcMsg *msg;
+	SscMsgHash hash;
+	size_t first, n_sub;
+	int memoize;
+} SscMsgHashNode;
+
+void ssc_msg_hash(MmcMsg *msg, SscMsgHashMemo *memo, SscMsgHash *hash)
+{
+	SscMsgHashMemoEntry *entry;
+	SscMsgHashNode *nodes;
+	size_t i, j, qlim, alloc;
+	
+	alloc = 16;
+	nodes = mdsl_alloc(sizeof(SscMsgHashNode) * alloc);
+	nodes[0].msg = msg;
+	qlim = 1;
+	
+	//Breadth-first, hashing blocks and queueing the submessages 
+	//of messages not found in the memo
+	for (i = 0; i < qlim; i++)
+	{
+		SscMsgHashNode *node = nodes + i;
+		
+		msg = node->msg;
+		node->first = qlim;
+		node->n_sub = 0;
+		node->memoize = memo && (msg->submsgs_len > 0 
+			|| msg->mem_len >= SSC_MSG_HASH_MEMO_MIN);
+		if (node->memoize)
+		{
+			entry = ssc_msg_hash_memo_find(memo, msg);
+			if (entry)
+			{
+				node->hash = entry->hash;
+				node->memoize = 0;
+				continue;
+			}
+		}
+		
+		ssc_msg_hash_block(msg->mem, msg->mem_len, msg->submsgs_len, 
+			&node->hash);
+		node->n_sub = msg->submsgs_len;
+		if (qlim + node->n_sub > alloc)
+		{
+			SscMsgHashNode *new_nodes;
+			
+			while (qlim + node->n_sub > alloc)
+				alloc *= 2;
+			new_nodes = mdsl_alloc(sizeof(SscMsgHashNode) * alloc);
+			memcpy(new_nodes, nodes, sizeof(SscMsgHashNode) * qlim);
+			free(nodes);
+			nodes = new_nodes;
+			node = nodes + i;
+		}
+		for (j = 0; j < node->n_sub; j++)
+			nodes[qlim + j].msg = msg->submsgs[j];
+		qlim += node->n_sub;
+	}
+	
+	//Submessages come later in breadth-first order, 
+	//so going backwards their hashes are complete when needed.
+	//A message appearing more than once is memoized once.
+	for (i = qlim; i > 0; i--)
+	{
+		SscMsgHashNode *node = nodes + i - 1;
+		
+		for (j = 0; j < node->n_sub; j++)
+			ssc_msg_hash_fold(&node->hash, &nodes[node->first + j].hash);
+		if (node->memoize && ! ssc_msg_hash_memo_find(memo, node->msg))
+			ssc_msg_hash_memo_add(memo, node->msg, &node->hash);
+	}
+	*hash = nodes[0].hash;
+	
+	free(nodes);
+}
@@ -0,0 +1,69 @@
+/* hash.h
+ * Content hashing of message trees
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//128-bit non-cryptographic hashes, for content-addressed caching 
+//and deduplication. Not suitable where collisions can be forced.
+//
+//The hash of a message tree is defined recursively: the memory block
+//is hashed with a seed depending on the no. of submessages, then 
+//the hashes of the submessages are folded in, in order. It depends 
+//on both the contents and the shape of the tree, and the hash of 
+//a shared submessage can be reused wherever it appears.
+
+typedef struct
+{
+	uint64_t lo, hi;
+} SscMsgHash;
+
+//Memoized hashes of message trees, keyed by the root's pointer. 
+//The memo holds a reference to every message in it.
+typedef struct _SscMsgHashMemo SscMsgHashMemo;
+
+//Only blocks this long or messages with submessages are memoized
+#define SSC_MSG_HASH_MEMO_MIN 256
+
+//Hashes len bytes at data
+void ssc_hash128(const void *data, size_t len, uint64_t seed, 
+	SscMsgHash *hash);
+
+//Folds the hash of a submessage into that of its parent
+void ssc_msg_hash_fold(SscMsgHash *hash, const SscMsgHash *sub);
+
+//Hashes the memory block of a message with submsgs_len submessages,
+//the start of the message's hash before ssc_msg_hash_fold()
+void ssc_msg_hash_block(const void *mem, size_t mem_len, 
+	size_t submsgs_len, SscMsgHash *hash);
+
+//Creates a memo holding up to max_entries hashes. When it is full, 
+//it is cleared before adding more.
+SscMsgHashMemo *ssc_msg_hash_memo_new(size_t max_entries);
+
+//Forgets all hashes
+void ssc_msg_hash_memo_clear(SscMsgHashMemo *memo);
+
+//Forgets the hash of a message, which must be done before modifying 
+//it, together with all messages it is part of
+void ssc_msg_hash_memo_forget(SscMsgHashMemo *memo, MmcMsg *msg);
+
+void ssc_msg_hash_memo_free(SscMsgHashMemo *memo);
+
+//Hashes a message tree. If memo is not NULL, hashes of submessages 
+//found in it are used instead of walking them, and new ones are added.
+void ssc_msg_hash(MmcMsg *msg, SscMsgHashMemo *memo, SscMsgHash *hash);
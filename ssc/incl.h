@@ -34,5 +34,16 @@
 #include "types.h"
 #include "serialize.h"
 #include "interface.h"
+#include "hash.h"
 #include "msg.h"
+#include "crc32c.h"
+#include "compress.h"
+#include "memfd.h"
+#include "reader.h"
+#include "sender.h"
+#include "stream.h"
+#include "shmring.h"
+#include "reclog.h"
+#include "transport.h"
+#include "table.h"
 
@@ -51,12 +51,45 @@ struct _SscServant
 
 	SscImplFn impl; 
 	void *user_data;
+	
+	//Buffer of skel->max_args_size bytes for arguments, kept across
+	//calls; NULL while a call is using it, or before the first call
+	void *args_buf;
 };
 
-static void ssc_servant_call(MmcServant *p_servant, MmcMsg *msg, MmcReplier *replier)
+//Gets room for arguments of size bytes, the servant's buffer 
+//unless another call is using it
+static void *ssc_servant_args_take(SscServant *servant, size_t size)
 {
-	SscServant *servant = (SscServant *) p_servant;
+	void *buf;
+	
+	if (size <= servant->skel->max_args_size)
+	{
+		buf = __atomic_exchange_n(&servant->args_buf, NULL, 
+			__ATOMIC_ACQUIRE);
+		if (buf)
+			return buf;
+		size = servant->skel->max_args_size;
+	}
+	
+	return mdsl_tryalloc(size);
+}
+
+//Gives back room taken by ssc_servant_args_take(), 
+//keeping it as the servant's buffer if it is large enough
+static void ssc_servant_args_give_back
+	(SscServant *servant, void *buf, size_t size)
+{
+	if (size <= servant->skel->max_args_size)
+		buf = __atomic_exchange_n(&servant->args_buf, buf, 
+			__ATOMIC_RELEASE);
+	free(buf);
+}
 
+//Dispatches one call
+static void ssc_servant_dispatch
+	(SscServant *servant, MmcMsg *msg, MmcReplier *replier)
+{
 	int id;
 	void *args = NULL;
 	SscSStub *sstub;
@@ -85,7 +118,7 @@ static void ssc_servant_call(MmcServant *p_servant, MmcMsg *msg, MmcReplier *rep
 	//Deserialize the arguments
 	if (sstub->args_size)
 	{
-		args = mdsl_tryalloc(sstub->args_size);
+		args = ssc_servant_args_take(servant, sstub->args_size);
 		if (!args)
 			goto fail;
 		if ((* sstub->read_msg)(msg, args) != MDSL_SUCCESS)
@@ -99,7 +132,7 @@ static void ssc_servant_call(MmcServant *p_servant, MmcMsg *msg, MmcReplier *rep
 	if (sstub->in_args_free)
 		(* sstub->in_args_free) (args);
 	if (args)
-		free(args);
+		ssc_servant_args_give_back(servant, args, sstub->args_size);
 	
 	return;
 	
@@ -111,7 +144,75 @@ fail:
 	mmc_msg_unref(reply_msg);
 	
 	if (args)
-		free(args);
+		ssc_servant_args_give_back(servant, args, sstub->args_size);
+}
+
+//Replier keeping the first reply to one call of a batch
+typedef struct
+{
+	MmcReplier parent;
+	MmcMsg *reply;
+} SscBatchReplier;
+
+static void ssc_batch_replier_call(MmcReplier *p_replier, MmcMsg *reply)
+{
+	SscBatchReplier *replier = (SscBatchReplier *) p_replier;
+	
+	if (replier->reply)
+		return;
+	mmc_msg_ref(reply);
+	replier->reply = reply;
+}
+
+//Dispatches all calls of a batch and sends back one reply for all
+static void ssc_servant_dispatch_batch
+	(SscServant *servant, MmcMsg *msg, MmcReplier *replier)
+{
+	SscBatchReplier batch_replier;
+	MmcMsg *reply_msg;
+	size_t i;
+	
+	if (msg->mem_len != SSC_PREFIX_SIZE)
+	{
+		reply_msg = ssc_create_prefixed_empty_msg(1);
+		mmc_replier_call(replier, reply_msg);
+		mmc_msg_unref(reply_msg);
+		return;
+	}
+	
+	reply_msg = mmc_msg_newa(SSC_PREFIX_SIZE, msg->submsgs_len);
+	*((uint8_t *) reply_msg->mem) = SSC_BATCH_PREFIX;
+	
+	batch_replier.parent.call = ssc_batch_replier_call;
+	for (i = 0; i < msg->submsgs_len; i++)
+	{
+		MmcMsg *call = msg->submsgs[i];
+		
+		batch_replier.reply = NULL;
+		if (ssc_read_prefix(call) != SSC_BATCH_PREFIX)
+			ssc_servant_dispatch
+				(servant, call, (MmcReplier *) &batch_replier);
+		
+		//Calls that were not replied to have failed
+		if (! batch_replier.reply)
+			batch_replier.reply = ssc_create_prefixed_empty_msg(1);
+		reply_msg->submsgs[i] = batch_replier.reply;
+	}
+	
+	mmc_replier_call(replier, reply_msg);
+	mmc_msg_unref(reply_msg);
+}
+
+static void ssc_servant_call(MmcServant *p_servant, MmcMsg *msg, MmcReplier *replier)
+{
+	SscServant *servant = (SscServant *) p_servant;
+	
+	//Skeletons with too many functions use the prefix as a method no.
+	if (ssc_read_prefix(msg) == SSC_BATCH_PREFIX 
+		&& servant->skel->n_fns < SSC_BATCH_PREFIX)
+		ssc_servant_dispatch_batch(servant, msg, replier);
+	else
+		ssc_servant_dispatch(servant, msg, replier);
 }
 
 void ssc_servant_return(SscServant *servant, 
@@ -119,6 +220,10 @@ void ssc_servant_return(SscServant *servant,
 {
 	MmcMsg *reply_msg = (* servant->skel->sstubs[method_id].create_reply)
 		(args);
+	
+	//Return arguments exceeding a bound cannot be sent
+	if (! reply_msg)
+		reply_msg = ssc_create_prefixed_empty_msg(1);
 	mmc_replier_call(replier, reply_msg);
 	mmc_msg_unref(reply_msg);
 }
@@ -126,6 +231,7 @@ void ssc_servant_return(SscServant *servant,
 static void ssc_servant_destroy(MmcServant *p_servant)
 {
 	SscServant *servant = (SscServant*) p_servant;
+	free(servant->args_buf);
 	free(servant);	
 }
 
@@ -143,7 +249,85 @@ SscServant *ssc_servant_new(const SscSkel *skel,
 	servant->skel = skel;
 	servant->impl = impl;
 	servant->user_data = user_data;;
+	servant->args_buf = NULL;
 	
 	return servant;
 }
 
+//Batches of calls
+void ssc_batch_init(SscBatch *batch)
+{
+	batch->calls = NULL;
+	batch->n_calls = batch->alloc = 0;
+}
+
+MdslStatus ssc_batch_add(SscBatch *batch, MmcMsg *call)
+{
+	if (! call)
+		return MDSL_FAILURE;
+	if (batch->n_calls == batch->alloc)
+	{
+		size_t new_alloc = batch->alloc ? batch->alloc * 2 : 8;
+		MmcMsg **new_calls;
+		
+		new_calls = realloc(batch->calls, sizeof(MmcMsg *) * new_alloc);
+		if (! new_calls)
+		{
+			mmc_msg_unref(call);
+			return MDSL_FAILURE;
+		}
+		batch->calls = new_calls;
+		batch->alloc = new_alloc;
+	}
+	
+	batch->calls[batch->n_calls++] = call;
+	return MDSL_SUCCESS;
+}
+
+MmcMsg *ssc_batch_finish(SscBatch *batch)
+{
+	MmcMsg *msg;
+	size_t i;
+	
+	if (! batch->n_calls)
+		return NULL;
+	msg = mmc_msg_try_newa(SSC_PREFIX_SIZE, batch->n_calls);
+	if (! msg)
+		return NULL;
+	
+	*((uint8_t *) msg->mem) = SSC_BATCH_PREFIX;
+	for (i = 0; i < batch->n_calls; i++)
+		msg->submsgs[i] = batch->calls[i];
+	batch->n_calls = 0;
+	
+	return msg;
+}
+
+void ssc_batch_clear(SscBatch *batch)
+{
+	size_t i;
+	
+	for (i = 0; i < batch->n_calls; i++)
+		mmc_msg_unref(batch->calls[i]);
+	free(batch->calls);
+	ssc_batch_init(batch);
+}
+
+int ssc_batch_reply_len(MmcMsg *reply)
+{
+	if (reply->mem_len != SSC_PREFIX_SIZE 
+		|| ssc_read_prefix(reply) != SSC_BATCH_PREFIX)
+		return -1;
+	
+	return reply->submsgs_len;
+}
+
+MmcMsg *ssc_batch_reply_get(MmcMsg *reply, size_t index)
+{
+	int len = ssc_batch_reply_len(reply);
+	
+	if (len < 0 || index >= (size_t) len)
+		return NULL;
+	
+	return reply->submsgs[index];
+}
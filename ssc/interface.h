@@ -42,6 +42,9 @@ typedef struct
 {
 	int n_fns;
 	SscSStub *sstubs;
+	//Largest args_size of all stubs, so that servants can keep 
+	//one buffer for arguments of any call (0 if not given)
+	size_t max_args_size;
 } SscSkel;
 
 //Servant type 
@@ -70,3 +73,43 @@ SscServant *ssc_servant_new(const SscSkel *skel,
  */
 void ssc_servant_return(SscServant *servant, 
 		int method_id, MmcReplier *replier, void *args);
+
+//Batches of calls
+//
+//A batch is a message with prefix SSC_BATCH_PREFIX whose submessages
+//are ordinary call messages, possibly to different methods. 
+//The servant dispatches them in order and sends one reply of the 
+//same shape, whose i-th submessage is the reply to the i-th call: 
+//prefix 0 for success, 1 for failure (as for single calls). 
+//Batches cannot be nested. Skeletons with SSC_BATCH_PREFIX or more 
+//functions cannot use batches; for them the prefix is a method no. 
+//as any other.
+#define SSC_BATCH_PREFIX 255
+
+//Calls collected for a batch
+typedef struct
+{
+	MmcMsg **calls;
+	size_t n_calls, alloc;
+} SscBatch;
+
+void ssc_batch_init(SscBatch *batch);
+
+//Adds a call message to the batch, taking over the reference 
+//(which is dropped on failure). Fails if call is NULL, so that 
+//the result of X__create_msg() can be passed directly.
+MdslStatus ssc_batch_add(SscBatch *batch, MmcMsg *call);
+
+//Creates the batch message from all calls added so far and empties 
+//the batch, or returns NULL if there are none or memory is short
+MmcMsg *ssc_batch_finish(SscBatch *batch);
+
+//Drops all calls added so far and frees the batch's storage
+void ssc_batch_clear(SscBatch *batch);
+
+//Gets the no. of replies in a batch reply, -1 if it is not one
+int ssc_batch_reply_len(MmcMsg *reply);
+
+//Gets the reply to index-th call of a batch (borrowed), 
+//NULL if out of range or not a batch reply
+MmcMsg *ssc_batch_reply_get(MmcMsg *reply, size_t index);
@@ -0,0 +1,158 @@
+/* memfd.h
+ * Passing large messages as memory files
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "incl.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//Seals the receiver insists on
+#define SSC_MSG_MEMFD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+int ssc_msg_memfd_new(MmcMsg *msg, SscMsgFlatSize *size)
+{
+	SscMsgFlatSize local_size;
+	struct iovec *iov;
+	size_t len, i;
+	char *mem, *dest;
+	int fd;
+	
+	if (! size)
+		size = &local_size;
+	
+	//Flatten needs room for all layout elements as its queue
+	ssc_msg_flatten(msg, 0, NULL, NULL, size);
+	len = sizeof(uint32_t) * size->n_layout + size->n_bytes;
+	iov = mdsl_tryalloc(sizeof(struct iovec) * size->n_layout);
+	if (! iov)
+		return -1;
+	
+	fd = memfd_create("ssc-msg", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		goto fail;
+	if (ftruncate(fd, len) < 0)
+		goto fail;
+	mem = mmap(NULL, len, PROT_READ | PROT_WRITE, 
+		MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (mem == MAP_FAILED)
+		goto fail;
+	
+	ssc_msg_flatten(msg, size->n_layout, (uint32_t *) mem, iov, NULL);
+	dest = mem + sizeof(uint32_t) * size->n_layout;
+	for (i = 0; i < size->n_iov; i++)
+	{
+		memcpy(dest, iov[i].iov_base, iov[i].iov_len);
+		dest += iov[i].iov_len;
+	}
+	
+	//Write sealing fails while writable mappings exist
+	munmap(mem, len);
+	if (fcntl(fd, F_ADD_SEALS, SSC_MSG_MEMFD_SEALS | F_SEAL_SEAL) < 0)
+		goto fail;
+	
+	free(iov);
+	return fd;
+	
+fail:
+	if (fd >= 0)
+		close(fd);
+	free(iov);
+	return -1;
+}
+
+struct _SscMsgMapping
+{
+	void *mem;
+	size_t len;
+	SscMsgSlab *slab;
+};
+
+SscMsgMapping *ssc_msg_mapping_new
+	(int fd, size_t n_layout, size_t len, SscMsgLimits *limits)
+{
+	SscMsgMapping *mapping;
+	SscMsgSlab *slab;
+	struct stat st;
+	void *mem;
+	int seals;
+	
+	if (n_layout < 1 || len / sizeof(uint32_t) < n_layout)
+		goto fail;
+	
+	//Without the seals the sender could still change the file
+	seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 
+		|| (seals & SSC_MSG_MEMFD_SEALS) != SSC_MSG_MEMFD_SEALS)
+		goto fail;
+	if (fstat(fd, &st) < 0 || st.st_size < 0 
+		|| ((uint64_t) st.st_size) != len)
+		goto fail;
+	
+	mem = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED)
+		goto fail;
+	close(fd);
+	
+	if (limits && ssc_msg_limits_check(limits, n_layout, (uint32_t *) mem)
+			!= SSC_MSG_LIMITS_OK)
+	{
+		munmap(mem, len);
+		return NULL;
+	}
+	
+	slab = ssc_msg_slab_new(mem, len);
+	if (! slab)
+	{
+		munmap(mem, len);
+		return NULL;
+	}
+	
+	mapping = mdsl_new(SscMsgMapping);
+	mapping->mem = mem;
+	mapping->len = len;
+	mapping->slab = slab;
+	
+	return mapping;
+	
+fail:
+	close(fd);
+	return NULL;
+}
+
+MmcMsg *ssc_msg_mapping_get_root(SscMsgMapping *mapping)
+{
+	return ssc_msg_slab_get_root(mapping->slab);
+}
+
+int ssc_msg_mapping_in_use(SscMsgMapping *mapping)
+{
+	return ssc_msg_slab_in_use(mapping->slab);
+}
+
+void ssc_msg_mapping_free(SscMsgMapping *mapping)
+{
+	ssc_msg_slab_free(mapping->slab);
+	munmap(mapping->mem, mapping->len);
+	free(mapping);
+}
@@ -0,0 +1,56 @@
+/* memfd.h
+ * Passing large messages as memory files
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//A message tree can be passed between processes on the same host 
+//as a memory file (memfd) holding the layout followed by the nonempty
+//memory blocks in breadth-first order, as ssc_msg_slab_new() takes. 
+//The file is sealed against writing and resizing before it is passed 
+//on (e.g. over a unix socket as SCM_RIGHTS, see reader.h), so that 
+//the receiver can map it and use the messages in place, without 
+//the sender being able to change them underneath.
+
+//Creates a sealed memory file holding the message tree. 
+//size, if not NULL, receives the sizes of the tree; the file is 
+//sizeof(uint32_t) * n_layout + n_bytes long. 
+//Returns the file descriptor (close-on-exec), or -1 on failure.
+int ssc_msg_memfd_new(MmcMsg *msg, SscMsgFlatSize *size);
+
+//A message tree in a mapped memory file
+typedef struct _SscMsgMapping SscMsgMapping;
+
+//Maps a memory file of len bytes with a layout of n_layout elements,
+//and builds the message tree over it. Takes over fd, closing it 
+//in any case. Fails if the file is not sealed against writing and 
+//resizing, is not len bytes long, or does not hold a valid tree.
+//If limits is not NULL, the layout is checked against them first.
+SscMsgMapping *ssc_msg_mapping_new
+	(int fd, size_t n_layout, size_t len, SscMsgLimits *limits);
+
+//Returns the root of the message tree, as with ssc_msg_slab_new().
+//The memory of the messages is read-only.
+MmcMsg *ssc_msg_mapping_get_root(SscMsgMapping *mapping);
+
+//Returns whether messages of the tree are still referenced 
+//(see ssc_msg_slab_in_use()), so that the file must stay mapped
+int ssc_msg_mapping_in_use(SscMsgMapping *mapping);
+
+//Frees the message tree and unmaps the file. The messages must not
+//be in use any more.
+void ssc_msg_mapping_free(SscMsgMapping *mapping);
@@ -20,6 +20,8 @@
 
 #include "incl.h"
 
+#include <pthread.h>
+
 size_t ssc_msg_count(MmcMsg *msg)
 {
 	int i;
@@ -31,24 +33,104 @@ size_t ssc_msg_count(MmcMsg *msg)
 	return res;
 }
 
+//Writes the layout element of a message at layout[*pos], in extended
+//form if the length does not fit. Returns 0 if there is no room.
+static inline int ssc_msg_layout_put(uint32_t *layout, size_t len, 
+	size_t *pos, size_t mem_len, uint32_t flags)
+{
+	if (mem_len < SSC_MSG_EXTENDED)
+	{
+		if (*pos >= len)
+			return 0;
+		layout[*pos] = ssc_uint32_to_le(mem_len | flags);
+		(*pos)++;
+	}
+	else
+	{
+		if (*pos + 3 > len)
+			return 0;
+		layout[*pos] = ssc_uint32_to_le(SSC_MSG_EXTENDED | flags);
+		layout[*pos + 1] = ssc_uint32_to_le((uint32_t) mem_len);
+		layout[*pos + 2] = ssc_uint32_to_le
+			((uint32_t) (((uint64_t) mem_len) >> 32));
+		(*pos) += 3;
+	}
+	
+	return 1;
+}
+
+//Reads the layout element at element *pos of the len elements 
+//at layout (not necessarily aligned), moving *pos past it. 
+//Returns 0 if it is truncated or larger than SSC_MSG_MAX_MEM_LEN.
+static inline int ssc_msg_layout_get(void *layout, size_t len, 
+	size_t *pos, uint32_t *flags, size_t *mem_len)
+{
+	char *el_ptr = ((char *) layout) + (*pos) * sizeof(uint32_t);
+	uint32_t layout_el;
+	uint64_t ext_len;
+	
+	if (*pos >= len)
+		return 0;
+	layout_el = ssc_uint32_load_le(el_ptr);
+	*flags = layout_el & SSC_MSG_ALL;
+	
+	if ((layout_el & (~SSC_MSG_ALL)) != SSC_MSG_EXTENDED)
+	{
+		*mem_len = layout_el & (~SSC_MSG_ALL);
+		(*pos)++;
+		return 1;
+	}
+	
+	if (*pos + 3 > len)
+		return 0;
+	ext_len = ssc_uint32_load_le(el_ptr + sizeof(uint32_t))
+		| (((uint64_t) ssc_uint32_load_le(el_ptr + 2 * sizeof(uint32_t)))
+			<< 32);
+	if (ext_len > SSC_MSG_MAX_MEM_LEN || ext_len > SIZE_MAX)
+		return 0;
+	*mem_len = ext_len;
+	(*pos) += 3;
+	
+	return 1;
+}
+
+//Layout elements needed for a message, not counting submessages
+static inline size_t ssc_msg_layout_el_len(MmcMsg *msg)
+{
+	return msg->mem_len < SSC_MSG_EXTENDED ? 1 : 3;
+}
+
+size_t ssc_msg_layout_len(MmcMsg *msg)
+{
+	size_t i;
+	size_t res = ssc_msg_layout_el_len(msg);
+	
+	for (i = 0; i < msg->submsgs_len; i++)
+		res += ssc_msg_layout_len(msg->submsgs[i]);
+	
+	return res;
+}
+
 void ssc_msg_create_layout(MmcMsg *msg, size_t len, uint32_t *layout)
 {
 	int i, j;
 	MmcMsg **qdata;
 	int qlim;
+	size_t pos;
 	
 	//Initialize queue
-	qdata = mdsl_alloc(sizeof(MmcMsg) * len);
+	qdata = mdsl_alloc(sizeof(MmcMsg *) * len);
 	qdata[0] = msg;
 	qlim = 1;
 
 	//Create layout element for root element
-	layout[0] = msg->mem_len;
-	if (msg->submsgs_len)
-		layout[0] |= SSC_MSG_SUBMSG;
+	pos = 0;
+	if (! ssc_msg_layout_put(layout, len, &pos, msg->mem_len, 
+			msg->submsgs_len ? SSC_MSG_SUBMSG : 0))
+		ssc_error("Layout array too small");
 
 	//Iterate for each message in queue
-	for (i = 0; i < len; i++)
+	for (i = 0; i < qlim; i++)
 	{
 		MmcMsg *curmsg = qdata[i];
 
@@ -56,18 +138,19 @@ void ssc_msg_create_layout(MmcMsg *msg, size_t len, uint32_t *layout)
 		for (j = 0; j < curmsg->submsgs_len; j++)
 		{
 			MmcMsg *submsg = curmsg->submsgs[j];
-			uint32_t layout_el;
+			uint32_t flags = 0;
 
 			//Create layout element for submessage
-			layout_el = submsg->mem_len;
 			if (submsg->submsgs_len)
-				layout_el |= SSC_MSG_SUBMSG;
+				flags |= SSC_MSG_SUBMSG;
 			if (j < (curmsg->submsgs_len - 1))
-				layout_el |= SSC_MSG_SIBLING;
+				flags |= SSC_MSG_SIBLING;
+			if (! ssc_msg_layout_put(layout, len, &pos, 
+					submsg->mem_len, flags))
+				ssc_error("Layout array too small");
 
 			//Push it onto queue
 			qdata[qlim] = submsg;
-			layout[qlim] = ssc_uint32_to_le(layout_el);
 
 			qlim++;
 		}
@@ -79,49 +162,59 @@ void ssc_msg_create_layout(MmcMsg *msg, size_t len, uint32_t *layout)
 
 MmcMsg *ssc_msg_alloc_by_layout(size_t len, uint32_t *layout)
 {
-	int i, j;
+	size_t i, j, n_nodes;
 	MmcMsg **qdata = NULL;
-	int qlim;
+	size_t qlim, pos, qpos;
+	uint32_t flags;
+	size_t mem_len;
 	MmcMsg *res;
 
 	//Sanity checks
 	if (len < 1)
 		return NULL;
-	if (ssc_uint32_from_le(layout[len - 1]) & SSC_MSG_ALL)
-		return NULL;
 	
-	//Initialize queue
-	qdata = mdsl_tryalloc(sizeof(MmcMsg) * len);
+	//Initialize queue. There are no more messages than elements.
+	qdata = mdsl_tryalloc(sizeof(MmcMsg *) * len);
 	if (! qdata)
 		return NULL;
 	qlim = 1;
+	
+	//qpos is where the next message to be queued is described,
+	//pos where the next message to be allocated is.
+	qpos = 0;
+	if (! ssc_msg_layout_get(layout, len, &qpos, &flags, &mem_len)
+		|| (flags & SSC_MSG_SIBLING))
+		qlim = 0;
+	pos = 0;
 
 	//Imitate tree traversal to find metadata for all nodes
 	//Allocate all messages
 	for (i = 0; i < qlim; i++)
 	{
-		size_t mem_len;
 		size_t submsgs_len;
-		uint32_t layout_el;
-
-		layout_el = ssc_uint32_from_le(layout[i]);
 
-		//Get size of the memory
-		mem_len = layout_el & (~SSC_MSG_ALL);
+		ssc_msg_layout_get(layout, len, &pos, &flags, &mem_len);
 
 		//Count submessages
 		submsgs_len = 0;
-		if (layout_el & SSC_MSG_SUBMSG)
+		if (flags & SSC_MSG_SUBMSG)
 		{
-			//Queue must never overflow
-			if (qlim >= len)
+			uint32_t sub_flags;
+			size_t sub_len;
+			int ok;
+			
+			do
+			{
+				//Layout must not run out
+				ok = ssc_msg_layout_get(layout, len, &qpos, 
+					&sub_flags, &sub_len);
+				if (! ok)
+					break;
+				submsgs_len++;
+			} while (sub_flags & SSC_MSG_SIBLING);
+			if (! ok)
 				break;
-
-			int b = qlim;
-			while (ssc_uint32_from_le(layout[qlim]) & SSC_MSG_SIBLING)
-				qlim++;
-			qlim++;
-			submsgs_len = qlim - b;
+			qlim += submsgs_len;
 		}
 
 		//Create message
@@ -129,13 +222,14 @@ MmcMsg *ssc_msg_alloc_by_layout(size_t len, uint32_t *layout)
 		if (! qdata[i])
 			break;
 	}
+	n_nodes = i;
 
 	//If allocation stopped halfway, free all messages and quit
 	//Allocation can stop because of failed malloc(),
-	//or invalid tree information bits.
-	if (i < len)
+	//invalid tree information bits, or elements left over.
+	if (n_nodes == 0 || n_nodes < qlim || qpos != len)
 	{
-		for (j = 0; j < i; j++)
+		for (j = 0; j < n_nodes; j++)
 			mmc_msg_unref(qdata[j]);
 		free(qdata);
 		return NULL;
@@ -143,7 +237,7 @@ MmcMsg *ssc_msg_alloc_by_layout(size_t len, uint32_t *layout)
 
 	//Assemble the tree
 	qlim = 1;
-	for (i = 0; i < len; i++)
+	for (i = 0; i < n_nodes; i++)
 	{
 		MmcMsg *curmsg = qdata[i];
 
@@ -168,7 +262,7 @@ size_t ssc_msg_get_blocks(MmcMsg *msg, size_t len, SscMBlock *data)
 	int dc;
 	
 	//Initialize queue
-	qdata = mdsl_alloc(sizeof(MmcMsg) * len);
+	qdata = mdsl_alloc(sizeof(MmcMsg *) * len);
 	qdata[0] = msg;
 	qlim = 1;
 
@@ -176,11 +270,13 @@ size_t ssc_msg_get_blocks(MmcMsg *msg, size_t len, SscMBlock *data)
 	dc = 0;
 
 	//Iterate for each message in queue
-	for (i = 0; i < len; i++)
+	for (i = 0; i < qlim; i++)
 	{
 		MmcMsg *curmsg = qdata[i];
 
 		//Push submessages onto queue
+		if (qlim + curmsg->submsgs_len > len)
+			ssc_error("Layout array too small");
 		for (j = 0; j < curmsg->submsgs_len; j++)
 		{
 			qdata[qlim] = curmsg->submsgs[j];
@@ -202,5 +298,1107 @@ size_t ssc_msg_get_blocks(MmcMsg *msg, size_t len, SscMBlock *data)
 	return dc;
 }
 
+//Shape plans
+
+struct _SscMsgPlan
+{
+	//Per message, in breadth-first order
+	size_t *mem_len;
+	uint32_t *submsgs_len;
+	size_t n_nodes;
+	
+	//Queue for allocating without nodes given
+	MmcMsg **qdata;
+};
+
+SscMsgPlan *ssc_msg_plan_new(size_t len, uint32_t *layout)
+{
+	SscMsgPlan *plan;
+	size_t i, pos, qpos, qlim, mem_len;
+	uint32_t flags;
+	
+	if (len < 1)
+		return NULL;
+	
+	//There are no more messages than elements
+	plan = mdsl_tryalloc(sizeof(SscMsgPlan));
+	if (! plan)
+		return NULL;
+	plan->mem_len = mdsl_tryalloc(sizeof(size_t) * len);
+	plan->submsgs_len = mdsl_tryalloc(sizeof(uint32_t) * len);
+	plan->qdata = mdsl_tryalloc(sizeof(MmcMsg *) * len);
+	if (! plan->mem_len || ! plan->submsgs_len || ! plan->qdata)
+		goto fail;
+	
+	//Decode and validate the layout, as ssc_msg_alloc_by_layout()
+	qpos = 0;
+	if (! ssc_msg_layout_get(layout, len, &qpos, &flags, &mem_len)
+		|| (flags & SSC_MSG_SIBLING))
+		goto fail;
+	qlim = 1;
+	pos = 0;
+	for (i = 0; i < qlim; i++)
+	{
+		uint32_t submsgs_len = 0;
+		
+		ssc_msg_layout_get(layout, len, &pos, &flags, &plan->mem_len[i]);
+		if (flags & SSC_MSG_SUBMSG)
+		{
+			uint32_t sub_flags;
+			
+			do
+			{
+				if (! ssc_msg_layout_get(layout, len, &qpos, 
+						&sub_flags, &mem_len))
+					goto fail;
+				submsgs_len++;
+			} while (sub_flags & SSC_MSG_SIBLING);
+			qlim += submsgs_len;
+		}
+		plan->submsgs_len[i] = submsgs_len;
+	}
+	if (qpos != len)
+		goto fail;
+	plan->n_nodes = qlim;
+	
+	return plan;
+	
+fail:
+	ssc_msg_plan_free(plan);
+	return NULL;
+}
+
+size_t ssc_msg_plan_get_n_nodes(SscMsgPlan *plan)
+{
+	return plan->n_nodes;
+}
+
+MmcMsg *ssc_msg_plan_alloc(SscMsgPlan *plan, MmcMsg **nodes)
+{
+	size_t i, j, qlim;
+	
+	if (! nodes)
+		nodes = plan->qdata;
+	
+	for (i = 0; i < plan->n_nodes; i++)
+	{
+		nodes[i] = mmc_msg_try_newa
+			(plan->mem_len[i], plan->submsgs_len[i]);
+		if (! nodes[i])
+		{
+			for (j = 0; j < i; j++)
+				mmc_msg_unref(nodes[j]);
+			return NULL;
+		}
+	}
+	
+	qlim = 1;
+	for (i = 0; i < plan->n_nodes; i++)
+	{
+		for (j = 0; j < plan->submsgs_len[i]; j++)
+			nodes[i]->submsgs[j] = nodes[qlim++];
+	}
+	
+	return nodes[0];
+}
+
+void ssc_msg_plan_free(SscMsgPlan *plan)
+{
+	free(plan->mem_len);
+	free(plan->submsgs_len);
+	free(plan->qdata);
+	free(plan);
+}
+
+//Varint layouts
+
+size_t ssc_msg_layout_to_varint(uint32_t *layout, size_t len, void *buf)
+{
+	uint8_t *out = buf;
+	size_t pos = 0, n_bytes = 0;
+	
+	while (pos < len)
+	{
+		uint32_t flags;
+		size_t mem_len;
+		uint64_t val;
+		
+		if (! ssc_msg_layout_get(layout, len, &pos, &flags, &mem_len))
+			return 0;
+		if (((uint64_t) mem_len) >> 62)
+			return 0;
+		val = (((uint64_t) mem_len) << 2) | (flags >> 30);
+		
+		do
+		{
+			uint8_t byte = val & 0x7f;
+			
+			val >>= 7;
+			if (val)
+				byte |= 0x80;
+			if (out)
+				out[n_bytes] = byte;
+			n_bytes++;
+		} while (val);
+	}
+	
+	return n_bytes;
+}
+
+MdslStatus ssc_msg_layout_from_varint
+	(void *buf, size_t len, uint32_t *layout, size_t *n_layout)
+{
+	uint8_t *in = buf, *end = in + len;
+	size_t pos = 0;
+	
+	//Each message takes at least as many bytes as elements
+	//(extended elements need 5 bytes), so layout cannot overflow
+	while (in < end)
+	{
+		uint64_t val;
+		
+		//Most blocks are small
+		if (SSC_LIKELY(*in < 0x80))
+		{
+			val = *in;
+			in++;
+		}
+		else
+		{
+			int shift = 0;
+			uint8_t byte;
+			
+			val = 0;
+			do
+			{
+				if (in == end || shift > 63)
+					return MDSL_FAILURE;
+				byte = *in;
+				in++;
+				val |= ((uint64_t) (byte & 0x7f)) << shift;
+				shift += 7;
+			} while (byte & 0x80);
+		}
+		
+		if ((val >> 2) > SSC_MSG_MAX_MEM_LEN || (val >> 2) > SIZE_MAX)
+			return MDSL_FAILURE;
+		if (! ssc_msg_layout_put(layout, len, &pos, val >> 2, 
+				((uint32_t) (val & 3)) << 30))
+			return MDSL_FAILURE;
+	}
+	
+	*n_layout = pos;
+	return MDSL_SUCCESS;
+}
+
+//Limits
+
+void ssc_msg_limits_init(SscMsgLimits *limits)
+{
+	memset(limits, 0, sizeof(SscMsgLimits));
+}
+
+SscMsgLimitsResult ssc_msg_limits_check
+	(SscMsgLimits *limits, size_t len, uint32_t *layout)
+{
+	size_t i, qlim, pos, qpos, level_end, depth, n_bytes;
+	SscMsgLimitsResult res = SSC_MSG_LIMITS_OK;
+	uint32_t flags;
+	size_t mem_len;
+	
+	//Every message takes at least one element
+	if (limits->max_nodes && len > 3 * limits->max_nodes)
+	{
+		limits->n_over_nodes++;
+		return SSC_MSG_LIMITS_NODES;
+	}
+	qpos = 0;
+	if (! ssc_msg_layout_get(layout, len, &qpos, &flags, &mem_len)
+		|| (flags & SSC_MSG_SIBLING))
+	{
+		limits->n_invalid++;
+		return SSC_MSG_LIMITS_INVALID;
+	}
+	
+	//Children of a level are queued contiguously, so a level ends
+	//where the queue stood when its first message was reached
+	qlim = 1;
+	pos = 0;
+	level_end = 1;
+	depth = 1;
+	n_bytes = 0;
+	for (i = 0; i < qlim; i++)
+	{
+		ssc_msg_layout_get(layout, len, &pos, &flags, &mem_len);
+		
+		if (i == level_end)
+		{
+			depth++;
+			level_end = qlim;
+			if (limits->max_depth && depth > limits->max_depth)
+			{
+				res = SSC_MSG_LIMITS_DEPTH;
+				break;
+			}
+		}
+		
+		if (limits->max_block && mem_len > limits->max_block)
+		{
+			res = SSC_MSG_LIMITS_BLOCK;
+			break;
+		}
+		//n_bytes never exceeds max_bytes, so this cannot wrap
+		if (limits->max_bytes && mem_len > limits->max_bytes - n_bytes)
+		{
+			res = SSC_MSG_LIMITS_BYTES;
+			break;
+		}
+		n_bytes += mem_len;
+		
+		if (flags & SSC_MSG_SUBMSG)
+		{
+			uint32_t sub_flags;
+			size_t sub_len;
+			
+			do
+			{
+				if (! ssc_msg_layout_get(layout, len, &qpos, 
+						&sub_flags, &sub_len))
+				{
+					res = SSC_MSG_LIMITS_INVALID;
+					break;
+				}
+				qlim++;
+			} while (sub_flags & SSC_MSG_SIBLING);
+			if (res != SSC_MSG_LIMITS_OK)
+				break;
+			if (limits->max_nodes && qlim > limits->max_nodes)
+			{
+				res = SSC_MSG_LIMITS_NODES;
+				break;
+			}
+		}
+	}
+	if (res == SSC_MSG_LIMITS_OK && qpos != len)
+		res = SSC_MSG_LIMITS_INVALID;
+	
+	switch (res)
+	{
+	case SSC_MSG_LIMITS_INVALID:
+		limits->n_invalid++;
+		break;
+	case SSC_MSG_LIMITS_NODES:
+		limits->n_over_nodes++;
+		break;
+	case SSC_MSG_LIMITS_BYTES:
+		limits->n_over_bytes++;
+		break;
+	case SSC_MSG_LIMITS_DEPTH:
+		limits->n_over_depth++;
+		break;
+	case SSC_MSG_LIMITS_BLOCK:
+		limits->n_over_block++;
+		break;
+	default:
+		break;
+	}
+	
+	return res;
+}
+
+//Flattening
+
+//Recursive part of size query
+static void ssc_msg_flatten_count(MmcMsg *msg, SscMsgFlatSize *size)
+{
+	size_t i;
+	
+	size->n_nodes++;
+	size->n_layout += ssc_msg_layout_el_len(msg);
+	if (msg->mem_len > 0)
+	{
+		size->n_iov++;
+		size->n_bytes += msg->mem_len;
+	}
+	
+	for (i = 0; i < msg->submsgs_len; i++)
+		ssc_msg_flatten_count(msg->submsgs[i], size);
+}
+
+//Hash of a message's block, and where its submessages are 
+//in breadth-first order
+typedef struct
+{
+	SscMsgHash hash;
+	size_t first, n_sub;
+} SscMsgFlatHash;
+
+//Breadth-first pass of ssc_msg_flatten(), also hashing every block 
+//into hashes and continuing *crc over the blocks, if not NULL
+static MdslStatus ssc_msg_flatten_walk(MmcMsg *msg, size_t len, 
+	uint32_t *layout, struct iovec *iov, SscMsgFlatSize *size, 
+	SscMsgFlatHash *hashes, uint32_t *crc)
+{
+	size_t i, j, qlim, dc, pos, n_bytes;
+	
+	//Size query
+	if (! layout && ! iov)
+	{
+		if (size)
+		{
+			size->n_nodes = size->n_layout = size->n_iov 
+				= size->n_bytes = 0;
+			ssc_msg_flatten_count(msg, size);
+		}
+		return MDSL_SUCCESS;
+	}
+	
+	if (len < 1)
+		return MDSL_FAILURE;
+	
+	//iov[i].iov_base holds the queue of messages. 
+	//Message i is taken off the queue before iov[dc] is written, 
+	//and dc <= i, so output never overwrites an unprocessed entry.
+	iov[0].iov_base = msg;
+	qlim = 1;
+	dc = 0;
+	n_bytes = 0;
+	
+	//Create layout element for root element
+	pos = 0;
+	if (! ssc_msg_layout_put(layout, len, &pos, msg->mem_len, 
+			msg->submsgs_len ? SSC_MSG_SUBMSG : 0))
+		return MDSL_FAILURE;
+	
+	for (i = 0; i < qlim; i++)
+	{
+		MmcMsg *curmsg = (MmcMsg *) iov[i].iov_base;
+		
+		//Queue must never overflow
+		if (qlim + curmsg->submsgs_len > len)
+			return MDSL_FAILURE;
+		
+		//Push submessages onto queue with their layout elements
+		for (j = 0; j < curmsg->submsgs_len; j++)
+		{
+			MmcMsg *submsg = curmsg->submsgs[j];
+			uint32_t flags = 0;
+			
+			if (submsg->submsgs_len)
+				flags |= SSC_MSG_SUBMSG;
+			if (j < (curmsg->submsgs_len - 1))
+				flags |= SSC_MSG_SIBLING;
+			if (! ssc_msg_layout_put(layout, len, &pos, 
+					submsg->mem_len, flags))
+				return MDSL_FAILURE;
+			
+			iov[qlim].iov_base = submsg;
+			qlim++;
+		}
+		
+		//Hash the block as it goes by
+		if (hashes)
+		{
+			hashes[i].first = qlim - curmsg->submsgs_len;
+			hashes[i].n_sub = curmsg->submsgs_len;
+			ssc_msg_hash_block(curmsg->mem, curmsg->mem_len, 
+				curmsg->submsgs_len, &hashes[i].hash);
+		}
+		
+		//Output memory block if nonempty
+		if (curmsg->mem_len > 0)
+		{
+			if (crc)
+				*crc = ssc_crc32c(*crc, curmsg->mem, curmsg->mem_len);
+			iov[dc].iov_base = curmsg->mem;
+			iov[dc].iov_len = curmsg->mem_len;
+			dc++;
+			n_bytes += curmsg->mem_len;
+		}
+	}
+	
+	if (size)
+	{
+		size->n_nodes = qlim;
+		size->n_layout = pos;
+		size->n_iov = dc;
+		size->n_bytes = n_bytes;
+	}
+	
+	return MDSL_SUCCESS;
+}
+
+MdslStatus ssc_msg_flatten(MmcMsg *msg, size_t len, 
+	uint32_t *layout, struct iovec *iov, SscMsgFlatSize *size)
+{
+	return ssc_msg_flatten_walk(msg, len, layout, iov, size, NULL, NULL);
+}
+
+MdslStatus ssc_msg_flatten_hashed(MmcMsg *msg, size_t len, 
+	uint32_t *layout, struct iovec *iov, SscMsgFlatSize *size, 
+	SscMsgHash *hash)
+{
+	return ssc_msg_flatten_full(msg, len, layout, iov, size, hash, NULL);
+}
+
+MdslStatus ssc_msg_flatten_full(MmcMsg *msg, size_t len, 
+	uint32_t *layout, struct iovec *iov, SscMsgFlatSize *size, 
+	SscMsgHash *hash, uint32_t *crc)
+{
+	SscMsgFlatSize local_size;
+	SscMsgFlatHash *hashes;
+	size_t i, j;
+	
+	if (! layout || ! iov)
+		return MDSL_FAILURE;
+	if (! hash)
+		return ssc_msg_flatten_walk(msg, len, layout, iov, size, NULL, crc);
+	if (! size)
+		size = &local_size;
+	
+	//There are no more messages than elements
+	hashes = mdsl_tryalloc(sizeof(SscMsgFlatHash) * (len ? len : 1));
+	if (! hashes)
+		return MDSL_FAILURE;
+	if (ssc_msg_flatten_walk(msg, len, layout, iov, size, hashes, crc) 
+		!= MDSL_SUCCESS)
+	{
+		free(hashes);
+		return MDSL_FAILURE;
+	}
+	
+	//Submessages come later in breadth-first order, 
+	//so going backwards their hashes are complete when needed
+	for (i = size->n_nodes; i > 0; i--)
+	{
+		SscMsgFlatHash *node = hashes + i - 1;
+		
+		for (j = 0; j < node->n_sub; j++)
+			ssc_msg_hash_fold(&node->hash, &hashes[node->first + j].hash);
+	}
+	*hash = hashes[0].hash;
+	
+	free(hashes);
+	return MDSL_SUCCESS;
+}
+
+//Zero-copy reconstruction
+struct _SscMsgSlab
+{
+	//The root comes first in the allocation holding all messages 
+	//and submessage arrays, so freeing the root frees them all
+	MmcMsg root;
+};
+
+//Reference count of a message
+static inline int ssc_msg_get_refcount(MmcMsg *msg)
+{
+	return ((MdslRC *) msg)->refcount;
+}
+
+SscMsgSlab *ssc_msg_slab_new(void *buf, size_t len)
+{
+	SscMsgSlab *slab;
+	MmcMsg *nodes, **submsgs;
+	char *mem;
+	size_t i, qlim, pos, qpos, n_nodes, n_layout, n_bytes, mem_len;
+	size_t max_layout = len / sizeof(uint32_t);
+	uint32_t flags = 0, sub_flags = 0;
+	
+	//First pass: validate the layout, count messages and bytes
+	qpos = 0;
+	if (! ssc_msg_layout_get(buf, max_layout, &qpos, &flags, &mem_len)
+		|| (flags & SSC_MSG_SIBLING))
+		return NULL;
+	qlim = 1;
+	pos = 0;
+	n_bytes = 0;
+	for (i = 0; i < qlim; i++)
+	{
+		ssc_msg_layout_get(buf, max_layout, &pos, &flags, &mem_len);
+		if (mem_len > len - n_bytes)
+			return NULL;
+		n_bytes += mem_len;
+		
+		if (flags & SSC_MSG_SUBMSG)
+		{
+			do
+			{
+				if (! ssc_msg_layout_get(buf, max_layout, &qpos, 
+						&sub_flags, &mem_len))
+					return NULL;
+				qlim++;
+			} while (sub_flags & SSC_MSG_SIBLING);
+		}
+	}
+	n_nodes = qlim;
+	n_layout = qpos;
+	if (n_layout * sizeof(uint32_t) + n_bytes != len)
+		return NULL;
+	
+	//One allocation for all messages and all submessage arrays
+	//(every message but the root is a submessage)
+	slab = mdsl_tryalloc(sizeof(MmcMsg) * n_nodes 
+		+ sizeof(MmcMsg *) * (n_nodes - 1));
+	if (! slab)
+		return NULL;
+	nodes = &slab->root;
+	submsgs = (MmcMsg **) (nodes + n_nodes);
+	
+	//Second pass: assemble the tree. Children of each message 
+	//are the next run of messages in breadth-first order.
+	mem = ((char *) buf) + n_layout * sizeof(uint32_t);
+	qlim = 1;
+	pos = 0;
+	qpos = 0;
+	ssc_msg_layout_get(buf, n_layout, &qpos, &flags, &mem_len);
+	for (i = 0; i < n_nodes; i++)
+	{
+		MmcMsg *node = nodes + i;
+		
+		ssc_msg_layout_get(buf, n_layout, &pos, &flags, &mem_len);
+		
+		//Messages other than the root hold a reference that is 
+		//never dropped, so that they are only ever freed with it
+		mdsl_rc_init(node);
+		if (i > 0)
+			mmc_msg_ref(node);
+		node->mem_len = mem_len;
+		node->mem = mem;
+		mem += node->mem_len;
+		
+		node->submsgs = submsgs;
+		node->submsgs_len = 0;
+		if (flags & SSC_MSG_SUBMSG)
+		{
+			do
+			{
+				ssc_msg_layout_get(buf, n_layout, &qpos, 
+					&sub_flags, &mem_len);
+				submsgs[node->submsgs_len] = nodes + qlim;
+				node->submsgs_len++;
+				qlim++;
+			} while (sub_flags & SSC_MSG_SIBLING);
+			submsgs += node->submsgs_len;
+		}
+	}
+	
+	return slab;
+}
+
+MmcMsg *ssc_msg_slab_get_root(SscMsgSlab *slab)
+{
+	return &slab->root;
+}
+
+int ssc_msg_slab_in_use(SscMsgSlab *slab)
+{
+	MmcMsg *nodes = &slab->root;
+	size_t i, qlim;
+	
+	//The slab's own reference to the root, and the parent's and 
+	//the pinned one to every other message are not counted
+	if (ssc_msg_get_refcount(nodes) > 1)
+		return 1;
+	qlim = 1;
+	for (i = 0; i < qlim; i++)
+	{
+		if (i > 0 && ssc_msg_get_refcount(nodes + i) > 2)
+			return 1;
+		qlim += nodes[i].submsgs_len;
+	}
+	
+	return 0;
+}
+
+void ssc_msg_slab_free(SscMsgSlab *slab)
+{
+	mmc_msg_unref(&slab->root);
+}
+
+//Parallel flattening and allocation
 
+typedef void (*SscMsgParallelFn)(void *data, unsigned int k);
 
+//Worker threads kept for one parallel call, so that each pass only 
+//costs a wakeup and a barrier rather than starting and joining threads
+typedef struct _SscMsgPool SscMsgPool;
+
+typedef struct
+{
+	SscMsgPool *pool;
+	unsigned int k;
+} SscMsgPoolWorker;
+
+struct _SscMsgPool
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t start_cond, done_cond;
+	
+	//Current pass: its no., work and parts, and how many of the 
+	//workers' parts are not done yet
+	uint64_t pass;
+	SscMsgParallelFn fn;
+	void *data;
+	unsigned int n_parts, n_pending;
+	int stop;
+	
+	//Workers are started when first needed; max_threads counts the 
+	//calling thread too
+	unsigned int max_threads, n_workers;
+	int started;
+	pthread_t threads[SSC_MSG_MAX_THREADS];
+	SscMsgPoolWorker workers[SSC_MSG_MAX_THREADS];
+};
+
+static void *ssc_msg_pool_main(void *arg)
+{
+	SscMsgPoolWorker *worker = arg;
+	SscMsgPool *pool = worker->pool;
+	uint64_t seen = 0;
+	
+	pthread_mutex_lock(&pool->mutex);
+	while (1)
+	{
+		SscMsgParallelFn fn;
+		void *data;
+		
+		while (! pool->stop && pool->pass == seen)
+			pthread_cond_wait(&pool->start_cond, &pool->mutex);
+		if (pool->stop)
+			break;
+		seen = pool->pass;
+		if (worker->k >= pool->n_parts)
+			continue;
+		
+		fn = pool->fn;
+		data = pool->data;
+		pthread_mutex_unlock(&pool->mutex);
+		fn(data, worker->k);
+		pthread_mutex_lock(&pool->mutex);
+		
+		pool->n_pending--;
+		if (pool->n_pending == 0)
+			pthread_cond_signal(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	
+	return NULL;
+}
+
+static void ssc_msg_pool_init(SscMsgPool *pool, unsigned int max_threads)
+{
+	pool->pass = 0;
+	pool->n_pending = 0;
+	pool->stop = 0;
+	pool->max_threads = max_threads;
+	pool->n_workers = 0;
+	pool->started = 0;
+}
+
+//Starts up to max_threads - 1 workers. Parts whose worker could not 
+//be started run on the calling thread.
+static void ssc_msg_pool_start(SscMsgPool *pool)
+{
+	unsigned int k;
+	
+	pool->started = 1;
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		goto fail_mutex;
+	if (pthread_cond_init(&pool->start_cond, NULL) != 0)
+		goto fail_start_cond;
+	if (pthread_cond_init(&pool->done_cond, NULL) != 0)
+		goto fail_done_cond;
+	
+	for (k = 1; k < pool->max_threads; k++)
+	{
+		pool->workers[k].pool = pool;
+		pool->workers[k].k = k;
+		if (pthread_create(pool->threads + k, NULL, 
+				ssc_msg_pool_main, pool->workers + k) != 0)
+			break;
+		pool->n_workers++;
+	}
+	return;
+	
+fail_done_cond:
+	pthread_cond_destroy(&pool->start_cond);
+fail_start_cond:
+	pthread_mutex_destroy(&pool->mutex);
+fail_mutex:
+	pool->max_threads = 1;
+}
+
+//Runs fn(data, k) for every k < n_parts (at most max_threads), 
+//k = 0 on the calling thread, and waits for all of them.
+static void ssc_msg_pool_run(SscMsgPool *pool, unsigned int n_parts, 
+	SscMsgParallelFn fn, void *data)
+{
+	unsigned int k, n_workers;
+	
+	if (n_parts > 1 && ! pool->started)
+		ssc_msg_pool_start(pool);
+	n_workers = pool->n_workers < n_parts ? pool->n_workers : n_parts - 1;
+	if (n_workers == 0)
+	{
+		for (k = 0; k < n_parts; k++)
+			fn(data, k);
+		return;
+	}
+	
+	pthread_mutex_lock(&pool->mutex);
+	pool->fn = fn;
+	pool->data = data;
+	pool->n_parts = n_parts;
+	pool->n_pending = n_workers;
+	pool->pass++;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->mutex);
+	
+	fn(data, 0);
+	for (k = n_workers + 1; k < n_parts; k++)
+		fn(data, k);
+	
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->n_pending > 0)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static void ssc_msg_pool_destroy(SscMsgPool *pool)
+{
+	unsigned int k;
+	
+	if (pool->max_threads <= 1 || ! pool->started)
+		return;
+	
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->mutex);
+	for (k = 1; k <= pool->n_workers; k++)
+		pthread_join(pool->threads[k], NULL);
+	
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->start_cond);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+//Gets part k of n_threads equal parts of [0, n)
+static void ssc_msg_parallel_slice(size_t n, unsigned int n_threads, 
+	unsigned int k, size_t *start, size_t *end)
+{
+	*start = ((uint64_t) n) * k / n_threads;
+	*end = ((uint64_t) n) * (k + 1) / n_threads;
+}
+
+//A message queued for flattening, with its SSC_MSG_SIBLING flag
+typedef struct
+{
+	MmcMsg *msg;
+	uint32_t flags;
+} SscMsgFlattenEl;
+
+typedef struct
+{
+	size_t n_children, n_layout, n_iov, n_bytes;
+} SscMsgFlattenCount;
+
+typedef struct
+{
+	unsigned int n_threads;
+	
+	//Current level, and room for the next one
+	SscMsgFlattenEl *cur, *next;
+	size_t n_cur;
+	
+	uint32_t *layout;
+	size_t len;
+	struct iovec *iov;
+	
+	//Totals of each part of the level, 
+	//then where each part's output starts
+	SscMsgFlattenCount parts[SSC_MSG_MAX_THREADS];
+} SscMsgFlattenJob;
+
+static void ssc_msg_flatten_count_part(void *data, unsigned int k)
+{
+	SscMsgFlattenJob *job = data;
+	SscMsgFlattenCount count = {0, 0, 0, 0};
+	size_t i, start, end;
+	
+	ssc_msg_parallel_slice(job->n_cur, job->n_threads, k, &start, &end);
+	for (i = start; i < end; i++)
+	{
+		MmcMsg *msg = job->cur[i].msg;
+		
+		count.n_children += msg->submsgs_len;
+		count.n_layout += ssc_msg_layout_el_len(msg);
+		if (msg->mem_len > 0)
+		{
+			count.n_iov++;
+			count.n_bytes += msg->mem_len;
+		}
+	}
+	
+	job->parts[k] = count;
+}
+
+static void ssc_msg_flatten_write_part(void *data, unsigned int k)
+{
+	SscMsgFlattenJob *job = data;
+	size_t i, j, start, end, pos, dc, qlim;
+	
+	ssc_msg_parallel_slice(job->n_cur, job->n_threads, k, &start, &end);
+	pos = job->parts[k].n_layout;
+	dc = job->parts[k].n_iov;
+	qlim = job->parts[k].n_children;
+	for (i = start; i < end; i++)
+	{
+		MmcMsg *msg = job->cur[i].msg;
+		
+		//Room was checked beforehand
+		ssc_msg_layout_put(job->layout, job->len, &pos, msg->mem_len, 
+			job->cur[i].flags | (msg->submsgs_len ? SSC_MSG_SUBMSG : 0));
+		
+		if (msg->mem_len > 0)
+		{
+			job->iov[dc].iov_base = msg->mem;
+			job->iov[dc].iov_len = msg->mem_len;
+			dc++;
+		}
+		
+		for (j = 0; j < msg->submsgs_len; j++)
+		{
+			job->next[qlim].msg = msg->submsgs[j];
+			job->next[qlim].flags 
+				= j < msg->submsgs_len - 1 ? SSC_MSG_SIBLING : 0;
+			qlim++;
+		}
+	}
+}
+
+MdslStatus ssc_msg_flatten_parallel(MmcMsg *msg, size_t len, 
+	uint32_t *layout, struct iovec *iov, SscMsgFlatSize *size,
+	unsigned int n_threads)
+{
+	SscMsgFlattenJob job;
+	SscMsgPool pool;
+	SscMsgFlatSize res = {0, 0, 0, 0};
+	size_t cur_alloc, next_alloc;
+	MdslStatus status = MDSL_FAILURE;
+	
+	if (n_threads > SSC_MSG_MAX_THREADS)
+		n_threads = SSC_MSG_MAX_THREADS;
+	if (n_threads <= 1 || (! layout && ! iov))
+		return ssc_msg_flatten(msg, len, layout, iov, size);
+	
+	job.layout = layout;
+	job.len = len;
+	job.iov = iov;
+	job.cur = mdsl_tryalloc(sizeof(SscMsgFlattenEl));
+	job.next = NULL;
+	if (! job.cur)
+		return MDSL_FAILURE;
+	cur_alloc = 1;
+	next_alloc = 0;
+	job.cur[0].msg = msg;
+	job.cur[0].flags = 0;
+	job.n_cur = 1;
+	ssc_msg_pool_init(&pool, n_threads);
+	
+	while (job.n_cur > 0)
+	{
+		SscMsgFlattenCount level = {0, 0, 0, 0};
+		unsigned int k;
+		
+		job.n_threads = job.n_cur >= SSC_MSG_PARALLEL_MIN ? n_threads : 1;
+		ssc_msg_pool_run
+			(&pool, job.n_threads, ssc_msg_flatten_count_part, &job);
+		
+		//Turn the totals into where each part starts
+		for (k = 0; k < job.n_threads; k++)
+		{
+			SscMsgFlattenCount count = job.parts[k];
+			
+			job.parts[k].n_children = level.n_children;
+			job.parts[k].n_layout = res.n_layout + level.n_layout;
+			job.parts[k].n_iov = res.n_iov + level.n_iov;
+			level.n_children += count.n_children;
+			level.n_layout += count.n_layout;
+			level.n_iov += count.n_iov;
+			level.n_bytes += count.n_bytes;
+		}
+		if (level.n_layout > len - res.n_layout 
+			|| level.n_iov > len - res.n_iov)
+			goto out;
+		
+		if (next_alloc < level.n_children)
+		{
+			free(job.next);
+			next_alloc = level.n_children;
+			job.next = mdsl_tryalloc(sizeof(SscMsgFlattenEl) * next_alloc);
+			if (! job.next)
+				goto out;
+		}
+		
+		ssc_msg_pool_run
+			(&pool, job.n_threads, ssc_msg_flatten_write_part, &job);
+		
+		res.n_nodes += job.n_cur;
+		res.n_layout += level.n_layout;
+		res.n_iov += level.n_iov;
+		res.n_bytes += level.n_bytes;
+		
+		//Next level
+		{
+			SscMsgFlattenEl *tmp = job.cur;
+			size_t tmp_alloc = cur_alloc;
+			
+			job.cur = job.next;
+			cur_alloc = next_alloc;
+			job.next = tmp;
+			next_alloc = tmp_alloc;
+			job.n_cur = level.n_children;
+		}
+	}
+	
+	if (size)
+		*size = res;
+	status = MDSL_SUCCESS;
+	
+out:
+	ssc_msg_pool_destroy(&pool);
+	free(job.cur);
+	free(job.next);
+	return status;
+}
+
+typedef struct
+{
+	unsigned int n_threads;
+	size_t n_nodes;
+	
+	//Per message: block length, no. of submessages, first submessage
+	size_t *mem_len, *submsgs_len, *first;
+	MmcMsg **nodes;
+	
+	int failed[SSC_MSG_MAX_THREADS];
+} SscMsgAllocJob;
+
+static void ssc_msg_alloc_part(void *data, unsigned int k)
+{
+	SscMsgAllocJob *job = data;
+	size_t i, start, end;
+	
+	ssc_msg_parallel_slice(job->n_nodes, job->n_threads, k, &start, &end);
+	job->failed[k] = 0;
+	for (i = start; i < end; i++)
+	{
+		job->nodes[i] = mmc_msg_try_newa
+			(job->mem_len[i], job->submsgs_len[i]);
+		if (! job->nodes[i])
+			job->failed[k] = 1;
+	}
+}
+
+static void ssc_msg_link_part(void *data, unsigned int k)
+{
+	SscMsgAllocJob *job = data;
+	size_t i, j, start, end;
+	
+	ssc_msg_parallel_slice(job->n_nodes, job->n_threads, k, &start, &end);
+	for (i = start; i < end; i++)
+	{
+		MmcMsg *node = job->nodes[i];
+		
+		for (j = 0; j < node->submsgs_len; j++)
+			node->submsgs[j] = job->nodes[job->first[i] + j];
+	}
+}
+
+MmcMsg *ssc_msg_alloc_by_layout_parallel
+	(size_t len, uint32_t *layout, unsigned int n_threads)
+{
+	SscMsgAllocJob job;
+	SscMsgPool pool;
+	size_t i, qlim, pos, qpos, mem_len;
+	uint32_t flags = 0;
+	MmcMsg *res = NULL;
+	unsigned int k;
+	
+	if (n_threads > SSC_MSG_MAX_THREADS)
+		n_threads = SSC_MSG_MAX_THREADS;
+	if (n_threads <= 1 || len < SSC_MSG_PARALLEL_MIN)
+		return ssc_msg_alloc_by_layout(len, layout);
+	
+	//There are no more messages than elements
+	job.mem_len = mdsl_tryalloc(sizeof(size_t) * len);
+	job.submsgs_len = mdsl_tryalloc(sizeof(size_t) * len);
+	job.first = mdsl_tryalloc(sizeof(size_t) * len);
+	job.nodes = mdsl_tryalloc(sizeof(MmcMsg *) * len);
+	if (! job.mem_len || ! job.submsgs_len || ! job.first || ! job.nodes)
+		goto out;
+	
+	//Decode and validate the layout, as ssc_msg_alloc_by_layout()
+	qpos = 0;
+	if (! ssc_msg_layout_get(layout, len, &qpos, &flags, &mem_len)
+		|| (flags & SSC_MSG_SIBLING))
+		goto out;
+	qlim = 1;
+	pos = 0;
+	for (i = 0; i < qlim; i++)
+	{
+		size_t submsgs_len = 0;
+		
+		ssc_msg_layout_get(layout, len, &pos, &flags, &job.mem_len[i]);
+		job.first[i] = qlim;
+		if (flags & SSC_MSG_SUBMSG)
+		{
+			uint32_t sub_flags;
+			
+			do
+			{
+				if (! ssc_msg_layout_get(layout, len, &qpos, 
+						&sub_flags, &mem_len))
+					goto out;
+				submsgs_len++;
+			} while (sub_flags & SSC_MSG_SIBLING);
+			qlim += submsgs_len;
+		}
+		job.submsgs_len[i] = submsgs_len;
+	}
+	if (qpos != len)
+		goto out;
+	job.n_nodes = qlim;
+	
+	//Allocate, then link
+	job.n_threads = job.n_nodes >= SSC_MSG_PARALLEL_MIN ? n_threads : 1;
+	ssc_msg_pool_init(&pool, job.n_threads);
+	ssc_msg_pool_run(&pool, job.n_threads, ssc_msg_alloc_part, &job);
+	for (k = 0; k < job.n_threads; k++)
+	{
+		if (job.failed[k])
+			break;
+	}
+	if (k < job.n_threads)
+	{
+		for (i = 0; i < job.n_nodes; i++)
+		{
+			if (job.nodes[i])
+				mmc_msg_unref(job.nodes[i]);
+		}
+		ssc_msg_pool_destroy(&pool);
+		goto out;
+	}
+	ssc_msg_pool_run(&pool, job.n_threads, ssc_msg_link_part, &job);
+	ssc_msg_pool_destroy(&pool);
+	res = job.nodes[0];
+	
+out:
+	free(job.mem_len);
+	free(job.submsgs_len);
+	free(job.first);
+	free(job.nodes);
+	return res;
+}
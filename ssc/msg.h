@@ -21,10 +21,24 @@
 //Protocol?
 //Breadth-first order. Appearantly, that is easier. 
 
+#include <sys/uio.h>
+
 #define SSC_MSG_SUBMSG  (((uint32_t) 1) << 30)
 #define SSC_MSG_SIBLING (((uint32_t) 1) << 31)
 #define SSC_MSG_ALL     (SSC_MSG_SUBMSG | SSC_MSG_SIBLING)
 
+//A layout element holds the length of the memory block in the 
+//lower 30 bits. If they are all set, the length is instead in the 
+//next two elements (lower 32 bits, then upper 32 bits); this is only
+//used for blocks of SSC_MSG_EXTENDED bytes or more, so layouts 
+//without such blocks are the same as ever.
+#define SSC_MSG_EXTENDED (~SSC_MSG_ALL)
+
+//Largest block length an extended element may hold. Layouts with 
+//larger ones are rejected as invalid, so that no single length 
+//can come near wrapping a size_t.
+#define SSC_MSG_MAX_MEM_LEN (((uint64_t) 1) << 48)
+
 //Used to create arrays of memory blocks
 typedef struct
 {
@@ -34,10 +48,194 @@ typedef struct
 
 size_t ssc_msg_count(MmcMsg *msg);
 
+//Returns the no. of layout elements for a message tree; this is 
+//ssc_msg_count() unless there are blocks needing extended elements.
+size_t ssc_msg_layout_len(MmcMsg *msg);
+
+//Lengths of layouts are in elements, as ssc_msg_layout_len().
+//This is also the meaning of len wherever a message tree is walked 
+//(here, and ssc_msg_flatten() below): it is never less than the no.
+//of messages, so it is always enough room for them too.
 void ssc_msg_create_layout(MmcMsg *msg, size_t len, uint32_t *layout);
 
 MmcMsg *ssc_msg_alloc_by_layout(size_t len, uint32_t *layout);
 
+//Lists the nonempty memory blocks in breadth-first order, 
+//returning their no. len is as above, ssc_msg_count() also suffices.
 size_t ssc_msg_get_blocks(MmcMsg *msg, size_t len, SscMBlock *data);
 
+//Encodings of layouts on the wire
+typedef enum
+{
+	//One little endian uint32 per element
+	SSC_MSG_LAYOUT_FIXED = 0,
+	//One LEB128 varint per message: the length shifted left by 2, 
+	//or-ed with 1 if SSC_MSG_SUBMSG and 2 if SSC_MSG_SIBLING.
+	//Blocks under 32 bytes take 1 byte, under 8 KiB 2 bytes.
+	SSC_MSG_LAYOUT_VARINT = 1
+} SscMsgLayoutFormat;
+
+//Encodes a layout of len elements as varints into buf, 
+//returning the no. of bytes (only counting them if buf is NULL),
+//or 0 if the layout is invalid.
+size_t ssc_msg_layout_to_varint(uint32_t *layout, size_t len, void *buf);
+
+//Decodes len bytes of varints into layout, which needs room for 
+//len elements (always enough), and sets *n_layout to the no. of 
+//elements written. Fails if the input is malformed.
+MdslStatus ssc_msg_layout_from_varint
+	(void *buf, size_t len, uint32_t *layout, size_t *n_layout);
+
+//A layout decoded and validated once, for allocating many message 
+//trees of the same shape without walking the layout again
+typedef struct _SscMsgPlan SscMsgPlan;
+
+//Creates a plan from a layout of len elements.
+//Returns NULL if the layout is invalid.
+SscMsgPlan *ssc_msg_plan_new(size_t len, uint32_t *layout);
+
+//Gives the no. of messages in trees allocated by the plan
+size_t ssc_msg_plan_get_n_nodes(SscMsgPlan *plan);
+
+//Allocates a message tree as ssc_msg_alloc_by_layout() would. 
+//If nodes is not NULL, its messages are stored there in 
+//breadth-first order; otherwise the plan's own room is used for them,
+//so only one thread may use it at a time. Returns NULL if out of memory.
+MmcMsg *ssc_msg_plan_alloc(SscMsgPlan *plan, MmcMsg **nodes);
+
+void ssc_msg_plan_free(SscMsgPlan *plan);
+
+//Limits on message trees accepted from untrusted peers, 
+//checked against the layout before anything is allocated. 
+//Zero means unlimited. 
+typedef struct
+{
+	//Max. no. of messages in the tree
+	size_t max_nodes;
+	//Max. total size of the memory blocks
+	size_t max_bytes;
+	//Max. depth of the tree, the root being at depth 1
+	size_t max_depth;
+	//Max. size of any one memory block
+	size_t max_block;
+	
+	//No. of layouts rejected for each reason. 
+	//Updated without locking.
+	size_t n_invalid;
+	size_t n_over_nodes;
+	size_t n_over_bytes;
+	size_t n_over_depth;
+	size_t n_over_block;
+} SscMsgLimits;
+
+//Result of ssc_msg_limits_check()
+typedef enum
+{
+	SSC_MSG_LIMITS_OK = 0,
+	//Layout does not describe a tree
+	SSC_MSG_LIMITS_INVALID,
+	SSC_MSG_LIMITS_NODES,
+	SSC_MSG_LIMITS_BYTES,
+	SSC_MSG_LIMITS_DEPTH,
+	SSC_MSG_LIMITS_BLOCK
+} SscMsgLimitsResult;
+
+//Sets all limits to unlimited and all counters to zero
+void ssc_msg_limits_init(SscMsgLimits *limits);
+
+//Validates a layout of len elements and checks it against the limits
+//in a single pass, counting the reason if it is rejected.
+SscMsgLimitsResult ssc_msg_limits_check
+	(SscMsgLimits *limits, size_t len, uint32_t *layout);
+
+//Sizes of the arrays filled by ssc_msg_flatten()
+typedef struct
+{
+	//No. of messages in the tree
+	size_t n_nodes;
+	//No. of layout elements
+	size_t n_layout;
+	//No. of nonempty memory blocks, i.e. iovecs
+	size_t n_iov;
+	//Total size of the memory blocks
+	size_t n_bytes;
+} SscMsgFlatSize;
+
+//Flattens a message tree in a single breadth-first pass, 
+//writing layout elements (as ssc_msg_create_layout()) and 
+//iovecs for the memory blocks (as ssc_msg_get_blocks()) together.
+//Does not allocate: iov doubles as the traversal queue, so both
+//layout and iov must have room for len elements, len >= n_layout.
+//Fails if the layout needs more than len elements. 
+//If layout and iov are both NULL, only computes the sizes.
+//size, if not NULL, receives the sizes.
+MdslStatus ssc_msg_flatten(MmcMsg *msg, size_t len, 
+	uint32_t *layout, struct iovec *iov, SscMsgFlatSize *size);
+
+//As ssc_msg_flatten(), also computing the hash of the message tree 
+//(as ssc_msg_hash() without a memo) in the same pass, so that every 
+//block is read while it is being queued anyway. Size queries are not
+//supported.
+MdslStatus ssc_msg_flatten_hashed(MmcMsg *msg, size_t len, 
+	uint32_t *layout, struct iovec *iov, SscMsgFlatSize *size, 
+	SscMsgHash *hash);
+
+//As ssc_msg_flatten_hashed() if hash is not NULL, or ssc_msg_flatten()
+//otherwise, also continuing *crc (as ssc_crc32c()) over the memory 
+//blocks in order, if crc is not NULL. Size queries are not supported.
+MdslStatus ssc_msg_flatten_full(MmcMsg *msg, size_t len, 
+	uint32_t *layout, struct iovec *iov, SscMsgFlatSize *size, 
+	SscMsgHash *hash, uint32_t *crc);
+
+//A message tree reconstructed in place from a contiguous buffer 
+//holding the layout followed by the nonempty memory blocks in 
+//breadth-first order (i.e. what ssc_msg_flatten() describes).
+//All messages of the tree live in one allocation starting with 
+//the root, and their memory points into the buffer, which is not 
+//copied.
+//
+//The root is an ordinary message, of which the slab holds one 
+//reference: whoever takes another keeps the whole tree allocated 
+//until they drop it, even past ssc_msg_slab_free(). The other 
+//messages are part of the root's allocation; references to them 
+//may be taken and dropped, but not kept longer than one to the root.
+//The buffer must stay valid and unmodified as long as any message 
+//is in use, see ssc_msg_slab_in_use().
+typedef struct _SscMsgSlab SscMsgSlab;
+
+//Builds the message tree over buf. Returns NULL if the layout is 
+//invalid, or does not match the size of the buffer.
+SscMsgSlab *ssc_msg_slab_new(void *buf, size_t len);
+
+//Returns the root of the message tree
+MmcMsg *ssc_msg_slab_get_root(SscMsgSlab *slab);
+
+//Returns whether any message of the tree is referenced other than 
+//by the slab and the tree itself, i.e. whether the buffer is still 
+//needed after ssc_msg_slab_free()
+int ssc_msg_slab_in_use(SscMsgSlab *slab);
+
+//Drops the slab's reference to the root, freeing the message tree 
+//unless the root is still referenced. The buffer is left alone.
+void ssc_msg_slab_free(SscMsgSlab *slab);
+
+//Parallel variants for trees with very many messages. The tree is 
+//processed a breadth-first level at a time, each level split between
+//n_threads threads (at most SSC_MSG_MAX_THREADS). The threads are 
+//started once per call, when the first large enough level is reached, 
+//and wait at a barrier between passes. Levels and trees with fewer 
+//than SSC_MSG_PARALLEL_MIN messages are done by the calling thread 
+//alone, which also takes part in the work.
+#define SSC_MSG_MAX_THREADS 64
+#define SSC_MSG_PARALLEL_MIN 4096
+
+//As ssc_msg_flatten(), with the same output. Allocates its own 
+//queue, so iov only needs room for n_iov iovecs.
+MdslStatus ssc_msg_flatten_parallel(MmcMsg *msg, size_t len, 
+	uint32_t *layout, struct iovec *iov, SscMsgFlatSize *size,
+	unsigned int n_threads);
 
+//As ssc_msg_alloc_by_layout(). The layout is decoded on the calling 
+//thread; messages are allocated and linked in parallel.
+MmcMsg *ssc_msg_alloc_by_layout_parallel
+	(size_t len, uint32_t *layout, unsigned int n_threads);
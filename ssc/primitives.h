@@ -0,0 +1,220 @@
+/* primitives.h
+ * Serialization primitives, compiled into libssc or inlined
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Definitions of the serialization primitives declared in serialize.h.
+//serialize.c compiles them into libssc, and serialize.h includes them 
+//as static inline functions when SSC_HEADER_ONLY is defined.
+
+//Iterator
+SSC_PRIMITIVE void ssc_msg_iter_init(SscMsgIter *self, MmcMsg *msg)
+{
+	self->bytes = msg->mem;
+	self->bytes_lim = self->bytes + msg->mem_len;
+	self->submsgs = msg->submsgs;
+	self->submsgs_lim = self->submsgs + msg->submsgs_len;
+	self->submsgs_first = self->submsgs;
+	self->str_pool = NULL;
+}
+
+SSC_PRIMITIVE void ssc_msg_iter_init_mem
+	(SscMsgIter *self, void *mem, size_t mem_len,
+	 MmcMsg **submsgs, size_t submsgs_len)
+{
+	self->bytes = mem;
+	self->bytes_lim = self->bytes + mem_len;
+	self->submsgs = submsgs;
+	self->submsgs_lim = self->submsgs + submsgs_len;
+	self->submsgs_first = self->submsgs;
+	self->str_pool = NULL;
+}
+
+SSC_PRIMITIVE MdslStatus ssc_msg_iter_get_segment
+	(SscMsgIter *self, size_t n_bytes, size_t n_submsgs, 
+	 SscSegment *res)
+{
+	if (SSC_UNLIKELY(self->bytes + n_bytes > self->bytes_lim
+		|| self->submsgs + n_submsgs > self->submsgs_lim))
+		return MDSL_FAILURE;
+	
+	res->bytes = self->bytes;
+	res->submsgs = self->submsgs;
+	res->submsgs_first = self->submsgs_first;
+	res->str_pool = self->str_pool;
+	self->bytes += n_bytes;
+	self->submsgs += n_submsgs;
+	
+	return MDSL_SUCCESS;
+}
+
+//Strings
+SSC_PRIMITIVE void ssc_segment_write_string(SscSegment *seg, char *val)
+{
+	MmcMsg *submsg;
+	size_t len;
+	
+	if (seg->str_pool)
+	{
+		submsg = ssc_str_pool_intern(seg->str_pool, val, 
+			seg->submsgs - seg->submsgs_first);
+	}
+	else
+	{
+		//Copy string into submessage
+		len = strlen(val);
+		submsg = mmc_msg_newa(len, 0);
+		memcpy(submsg->mem, val, len);
+	}
+		
+	//Add to segment
+	*seg->submsgs = submsg;
+	seg->submsgs++;
+}
+
+SSC_PRIMITIVE char *ssc_segment_read_string(SscSegment *seg)
+{
+	MmcMsg *submsg;
+	int len, i;
+	char *check, *res;
+	
+	//Fetch it
+	submsg = *seg->submsgs;
+	len = submsg->mem_len;
+	check = (char *) submsg->mem;
+	
+	//Back-reference to an earlier string?
+	if (len > 0 && check[0] == '\0')
+	{
+		uint32_t index;
+		
+		if (len != SSC_STR_REF_SIZE)
+			return NULL;
+		index = ssc_uint32_load_le(check + 1);
+		if (index >= seg->submsgs - seg->submsgs_first)
+			return NULL;
+		
+		//The string itself is checked below, 
+		//which also rejects a reference to a reference
+		submsg = seg->submsgs_first[index];
+		len = submsg->mem_len;
+		check = (char *) submsg->mem;
+	}
+	
+	//get string and verify
+	if (submsg->submsgs_len > 0)
+		return NULL;
+	for (i = 0; i < len; i++)	
+		if (check[i] == '\0')
+			return NULL;
+	res = mdsl_tryalloc(len + 1);
+	if (SSC_UNLIKELY(! res))
+		return NULL;
+	memcpy(res, check, len);
+	res[len] = '\0';
+	
+	//Increment
+	seg->submsgs++;
+	
+	return res;
+}
+
+//Messages
+SSC_PRIMITIVE void ssc_segment_write_msg(SscSegment *seg, MmcMsg *msg)
+{
+	*seg->submsgs = msg;
+	mmc_msg_ref(msg);
+	seg->submsgs++;
+}
+
+SSC_PRIMITIVE MmcMsg *ssc_segment_read_msg(SscSegment *seg)
+{
+	MmcMsg *res = *seg->submsgs;
+	mmc_msg_ref(res);
+	seg->submsgs++;
+	return res;
+}
+
+//Floating point values
+SSC_PRIMITIVE void ssc_segment_write_flt32(SscSegment *seg, SscValFlt val)
+{
+	uint32_t inter;
+	
+	switch (val.type)
+	{
+	case SSC_FLT_ZERO:
+	case SSC_FLT_NORMAL:
+		inter = ssc_double_to_flt32(val.val);
+		break;
+	case SSC_FLT_NAN:
+		inter = ssc_flt32_nan;
+		break;
+	case SSC_FLT_INFINITE:
+		inter = ssc_flt32_infinity;
+		break;
+	case SSC_FLT_NEG_INFINITE:
+		inter = ssc_flt32_neg_infinity;
+		break;
+	default:
+		mdsl_context_error("SSC", "Invalid type %d", val.type);
+		inter = 0;
+	}
+	
+	ssc_segment_write_uint32(seg, inter);
+}
+
+SSC_PRIMITIVE void ssc_segment_read_flt32(SscSegment *seg, SscValFlt *val)
+{
+	uint32_t inter = ssc_segment_read_uint32(seg);
+	val->type = ssc_flt32_classify(inter);
+	val->val = ssc_double_from_flt32(inter);
+}
+
+SSC_PRIMITIVE void ssc_segment_write_flt64(SscSegment *seg, SscValFlt val)
+{
+	uint64_t inter;
+	
+	switch (val.type)
+	{
+	case SSC_FLT_ZERO:
+	case SSC_FLT_NORMAL:
+		inter = ssc_double_to_flt64(val.val);
+		break;
+	case SSC_FLT_NAN:
+		inter = ssc_flt64_nan;
+		break;
+	case SSC_FLT_INFINITE:
+		inter = ssc_flt64_infinity;
+		break;
+	case SSC_FLT_NEG_INFINITE:
+		inter = ssc_flt64_neg_infinity;
+		break;
+	default:
+		mdsl_context_error("SSC", "Invalid type %d", val.type);
+		inter = 0;
+	}
+	
+	ssc_segment_write_uint64(seg, inter);
+}
+
+SSC_PRIMITIVE void ssc_segment_read_flt64(SscSegment *seg, SscValFlt *val)
+{
+	uint64_t inter = ssc_segment_read_uint64(seg);
+	val->type = ssc_flt64_classify(inter);
+	val->val = ssc_double_from_flt64(inter);
+}
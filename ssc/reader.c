@@ -0,0 +1,948 @@
+/* reader.h
+ * Incremental parser for framed messages
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incl.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+typedef enum
+{
+	SSC_MSG_READER_HEADER,
+	SSC_MSG_READER_LAYOUT,
+	SSC_MSG_READER_BLOCKS,
+	SSC_MSG_READER_CHUNK_HEADER,
+	SSC_MSG_READER_CHUNK_DATA,
+	SSC_MSG_READER_TRAILER,
+	SSC_MSG_READER_MEMFD,
+	SSC_MSG_READER_ERROR
+} SscMsgReaderState;
+
+//Layout bytes read before the room for them is first doubled
+#define SSC_MSG_READER_LAYOUT_STEP 1024
+
+//Arrays with room for more elements than this are released 
+//after the frame that needed them
+#define SSC_MSG_READER_KEEP_LAYOUT 4096
+
+struct _SscMsgReader
+{
+	SscMsgReaderState state;
+	
+	//Where the next bytes go, and how many are still expected there
+	char *dest;
+	size_t dest_len;
+	
+	//Frame header
+	char header[SSC_MSG_FRAME_HEADER_SIZE];
+	size_t n_layout, n_nodes;
+	SscMsgLayoutFormat format;
+	
+	//CRC of the frame so far, if it has a trailer
+	int checksum;
+	uint32_t crc;
+	char trailer[SSC_MSG_FRAME_TRAILER_SIZE];
+	
+	//Cached shapes, and the no. of frames that defined one
+	SscMsgPlan *shapes[SSC_MSG_SHAPE_CACHE_SIZE];
+	size_t n_defined;
+	uint32_t shape_flags;
+	
+	//Compressed blocks: nonempty blocks, and the chunk being read, 
+	//starting chunk_offset bytes into blocks[cur_block]
+	int compressed;
+	struct iovec *blocks;
+	size_t n_blocks, cur_block, chunk_offset, chunk_len, n_span;
+	size_t chunk_stored;
+	SscMsgCodec codec;
+	char chunk_header[SSC_MSG_CHUNK_HEADER_SIZE];
+	
+	//Compressed chunk, and runs of blocks before they are scattered
+	char *cbuf, *scratch;
+	
+	//Varint encoded layout, decoded into layout when complete
+	uint8_t *varint;
+	size_t varint_len, varint_alloc;
+	
+	//Layout, read layout_end of layout_bytes bytes at a time
+	uint32_t *layout;
+	size_t layout_alloc, layout_bytes, layout_end;
+	
+	//Messages in breadth-first order; reused across frames
+	MmcMsg **nodes;
+	size_t alloc_len;
+	
+	//Message being filled
+	MmcMsg *root;
+	size_t cur_node;
+	
+	//Memory file frames: descriptors waiting for their frames, 
+	//from fds[fds_start] on, and the mapping of the last message
+	int fd_passing;
+	int fds[SSC_MSG_READER_MAX_FDS];
+	size_t fds_start, n_fds;
+	char memfd_len[SSC_MSG_FRAME_MEMFD_SIZE - SSC_MSG_FRAME_HEADER_SIZE];
+	SscMsgMapping *mapping;
+	
+	//Batch frames: whether the frame being read is one, and 
+	//the root of the last one, whose messages from batch_pos on 
+	//are still to be given
+	int batches, batch_frame;
+	MmcMsg *batch;
+	size_t batch_pos;
+	
+	SscMsgLimits *limits;
+};
+
+static void ssc_msg_reader_expect_header(SscMsgReader *reader)
+{
+	reader->state = SSC_MSG_READER_HEADER;
+	reader->dest = reader->header;
+	reader->dest_len = SSC_MSG_FRAME_HEADER_SIZE;
+}
+
+SscMsgReader *ssc_msg_reader_new(void)
+{
+	SscMsgReader *reader;
+	
+	reader = mdsl_new(SscMsgReader);
+	reader->layout = NULL;
+	reader->layout_alloc = 0;
+	reader->nodes = NULL;
+	reader->alloc_len = 0;
+	reader->format = SSC_MSG_LAYOUT_FIXED;
+	reader->checksum = 0;
+	reader->compressed = 0;
+	memset(reader->shapes, 0, sizeof(reader->shapes));
+	reader->n_defined = 0;
+	reader->shape_flags = 0;
+	reader->blocks = NULL;
+	reader->cbuf = NULL;
+	reader->scratch = NULL;
+	reader->varint = NULL;
+	reader->varint_alloc = 0;
+	reader->root = NULL;
+	reader->fd_passing = 0;
+	reader->fds_start = reader->n_fds = 0;
+	reader->mapping = NULL;
+	reader->batches = reader->batch_frame = 0;
+	reader->batch = NULL;
+	reader->limits = NULL;
+	ssc_msg_reader_expect_header(reader);
+	
+	return reader;
+}
+
+void ssc_msg_reader_reset(SscMsgReader *reader)
+{
+	size_t i;
+	
+	if (reader->root)
+	{
+		mmc_msg_unref(reader->root);
+		reader->root = NULL;
+	}
+	for (i = 0; i < SSC_MSG_SHAPE_CACHE_SIZE; i++)
+	{
+		if (reader->shapes[i])
+			ssc_msg_plan_free(reader->shapes[i]);
+		reader->shapes[i] = NULL;
+	}
+	reader->n_defined = 0;
+	if (reader->mapping)
+	{
+		ssc_msg_mapping_free(reader->mapping);
+		reader->mapping = NULL;
+	}
+	if (reader->batch)
+	{
+		mmc_msg_unref(reader->batch);
+		reader->batch = NULL;
+	}
+	for (i = 0; i < reader->n_fds; i++)
+		close(reader->fds[(reader->fds_start + i) 
+			% SSC_MSG_READER_MAX_FDS]);
+	reader->fds_start = reader->n_fds = 0;
+	ssc_msg_reader_expect_header(reader);
+}
+
+void ssc_msg_reader_set_limits(SscMsgReader *reader, SscMsgLimits *limits)
+{
+	reader->limits = limits;
+}
+
+void ssc_msg_reader_set_fd_passing(SscMsgReader *reader, int fd_passing)
+{
+	reader->fd_passing = fd_passing;
+}
+
+MdslStatus ssc_msg_reader_push_fd(SscMsgReader *reader, int fd)
+{
+	if (! reader->fd_passing || reader->n_fds == SSC_MSG_READER_MAX_FDS)
+	{
+		close(fd);
+		return MDSL_FAILURE;
+	}
+	
+	reader->fds[(reader->fds_start + reader->n_fds) 
+		% SSC_MSG_READER_MAX_FDS] = fd;
+	reader->n_fds++;
+	return MDSL_SUCCESS;
+}
+
+ssize_t ssc_msg_reader_recv
+	(SscMsgReader *reader, int fd, void *buf, size_t len)
+{
+	union
+	{
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * SSC_MSG_FRAME_MAX_FDS)];
+	} control;
+	struct msghdr mhdr;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	ssize_t res;
+	int ok = 1;
+	
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	memset(&mhdr, 0, sizeof(mhdr));
+	mhdr.msg_iov = &iov;
+	mhdr.msg_iovlen = 1;
+	mhdr.msg_control = control.buf;
+	mhdr.msg_controllen = sizeof(control.buf);
+	
+	res = recvmsg(fd, &mhdr, MSG_CMSG_CLOEXEC);
+	if (res < 0)
+		return res;
+	
+	//Descriptors are taken over even if some are refused, 
+	//so that none leak
+	for (cmsg = CMSG_FIRSTHDR(&mhdr); cmsg; 
+		cmsg = CMSG_NXTHDR(&mhdr, cmsg))
+	{
+		size_t i, n;
+		
+		if (cmsg->cmsg_level != SOL_SOCKET 
+			|| cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0; i < n; i++)
+		{
+			int rfd;
+			
+			memcpy(&rfd, CMSG_DATA(cmsg) + sizeof(int) * i, sizeof(int));
+			if (ssc_msg_reader_push_fd(reader, rfd) != MDSL_SUCCESS)
+				ok = 0;
+		}
+	}
+	if (mhdr.msg_flags & MSG_CTRUNC)
+		ok = 0;
+	
+	if (! ok)
+	{
+		errno = EBADMSG;
+		return -1;
+	}
+	return res;
+}
+
+SscMsgMapping *ssc_msg_reader_take_mapping(SscMsgReader *reader)
+{
+	SscMsgMapping *res = reader->mapping;
+	
+	reader->mapping = NULL;
+	return res;
+}
+
+void ssc_msg_reader_set_batches(SscMsgReader *reader, int batches)
+{
+	reader->batches = batches;
+}
+
+MmcMsg *ssc_msg_reader_next_batched(SscMsgReader *reader)
+{
+	MmcMsg *res;
+	
+	if (! reader->batch)
+		return NULL;
+	
+	res = reader->batch->submsgs[reader->batch_pos];
+	mmc_msg_ref(res);
+	reader->batch_pos++;
+	if (reader->batch_pos == reader->batch->submsgs_len)
+	{
+		mmc_msg_unref(reader->batch);
+		reader->batch = NULL;
+	}
+	
+	return res;
+}
+
+SscMsgLayoutFormat ssc_msg_reader_get_format(SscMsgReader *reader)
+{
+	return reader->format;
+}
+
+int ssc_msg_reader_get_checksum(SscMsgReader *reader)
+{
+	return reader->checksum;
+}
+
+int ssc_msg_reader_get_compressed(SscMsgReader *reader)
+{
+	return reader->compressed;
+}
+
+int ssc_msg_reader_get_shapes(SscMsgReader *reader)
+{
+	return reader->shape_flags ? 1 : 0;
+}
+
+void ssc_msg_reader_free(SscMsgReader *reader)
+{
+	ssc_msg_reader_reset(reader);
+	free(reader->layout);
+	free(reader->nodes);
+	free(reader->blocks);
+	free(reader->cbuf);
+	free(reader->scratch);
+	free(reader->varint);
+	free(reader);
+}
+
+//Called after the last block, returns the message 
+//unless the trailer is still to come
+static MmcMsg *ssc_msg_reader_finish(SscMsgReader *reader)
+{
+	MmcMsg *res;
+	
+	if (reader->checksum)
+	{
+		reader->state = SSC_MSG_READER_TRAILER;
+		reader->dest = reader->trailer;
+		reader->dest_len = SSC_MSG_FRAME_TRAILER_SIZE;
+		return NULL;
+	}
+	
+	res = reader->root;
+	reader->root = NULL;
+	ssc_msg_reader_expect_header(reader);
+	return res;
+}
+
+//Points the reader at the next nonempty memory block. 
+//Returns the message if there is none left.
+static MmcMsg *ssc_msg_reader_next_block(SscMsgReader *reader)
+{
+	while (reader->cur_node < reader->n_nodes)
+	{
+		MmcMsg *node = reader->nodes[reader->cur_node];
+		
+		reader->cur_node++;
+		if (node->mem_len > 0)
+		{
+			reader->dest = node->mem;
+			reader->dest_len = node->mem_len;
+			return NULL;
+		}
+	}
+	
+	return ssc_msg_reader_finish(reader);
+}
+
+//Points the reader at the header of the next chunk.
+//Returns the message if there is none left.
+static MmcMsg *ssc_msg_reader_next_chunk(SscMsgReader *reader)
+{
+	if (reader->cur_block == reader->n_blocks)
+		return ssc_msg_reader_finish(reader);
+	
+	reader->state = SSC_MSG_READER_CHUNK_HEADER;
+	reader->dest = reader->chunk_header;
+	reader->dest_len = SSC_MSG_CHUNK_HEADER_SIZE;
+	return NULL;
+}
+
+//Points the reader at the data of the chunk whose header was read
+static MdslStatus ssc_msg_reader_start_chunk(SscMsgReader *reader)
+{
+	struct iovec *block = reader->blocks + reader->cur_block;
+	uint32_t header;
+	
+	header = ssc_uint32_load_le(reader->chunk_header);
+	reader->codec = header >> 24;
+	reader->chunk_stored = header & 0xffffff;
+	reader->chunk_len = ssc_msg_chunk_span(block, 
+		reader->n_blocks - reader->cur_block, reader->chunk_offset, 
+		&reader->n_span);
+	
+	//Runs of blocks are put together aside
+	if (reader->n_span > 1 && ! reader->scratch)
+	{
+		reader->scratch = mdsl_tryalloc(SSC_MSG_CHUNK_SIZE);
+		if (! reader->scratch)
+			return MDSL_FAILURE;
+	}
+	
+	switch (reader->codec)
+	{
+	case SSC_MSG_CODEC_NONE:
+		if (reader->chunk_stored != reader->chunk_len)
+			return MDSL_FAILURE;
+		reader->dest = reader->n_span > 1 ? reader->scratch
+			: ((char *) block->iov_base) + reader->chunk_offset;
+		break;
+		
+	case SSC_MSG_CODEC_LZ4:
+		if (reader->chunk_stored == 0 
+			|| reader->chunk_stored > ssc_lz4_bound(reader->chunk_len))
+			return MDSL_FAILURE;
+		if (! reader->cbuf)
+		{
+			reader->cbuf = mdsl_tryalloc
+				(ssc_lz4_bound(SSC_MSG_CHUNK_SIZE));
+			if (! reader->cbuf)
+				return MDSL_FAILURE;
+		}
+		reader->dest = reader->cbuf;
+		break;
+		
+	default:
+		return MDSL_FAILURE;
+	}
+	
+	reader->state = SSC_MSG_READER_CHUNK_DATA;
+	reader->dest_len = reader->chunk_stored;
+	return MDSL_SUCCESS;
+}
+
+//Called when a chunk has been read; decompresses it straight into
+//its block if it is a piece of one
+static MdslStatus ssc_msg_reader_end_chunk(SscMsgReader *reader)
+{
+	struct iovec *block = reader->blocks + reader->cur_block;
+	char *out;
+	size_t i;
+	
+	out = reader->n_span > 1 ? reader->scratch
+		: ((char *) block->iov_base) + reader->chunk_offset;
+	if (reader->codec == SSC_MSG_CODEC_LZ4 
+		&& ssc_lz4_decompress(reader->cbuf, reader->chunk_stored, 
+			out, reader->chunk_len) != MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	
+	if (reader->n_span > 1)
+	{
+		for (i = 0; i < reader->n_span; i++)
+		{
+			memcpy(block[i].iov_base, out, block[i].iov_len);
+			out += block[i].iov_len;
+		}
+	}
+	
+	if (reader->n_span == 1 
+		&& reader->chunk_offset + reader->chunk_len < block->iov_len)
+	{
+		reader->chunk_offset += reader->chunk_len;
+	}
+	else
+	{
+		reader->cur_block += reader->n_span;
+		reader->chunk_offset = 0;
+	}
+	
+	return MDSL_SUCCESS;
+}
+
+//Called when the messages have been allocated and listed in nodes
+static MmcMsg *ssc_msg_reader_start_blocks(SscMsgReader *reader)
+{
+	size_t i;
+	
+	if (reader->compressed)
+	{
+		reader->n_blocks = 0;
+		for (i = 0; i < reader->n_nodes; i++)
+		{
+			MmcMsg *node = reader->nodes[i];
+			
+			if (node->mem_len > 0)
+			{
+				reader->blocks[reader->n_blocks].iov_base = node->mem;
+				reader->blocks[reader->n_blocks].iov_len = node->mem_len;
+				reader->n_blocks++;
+			}
+		}
+		reader->cur_block = 0;
+		reader->chunk_offset = 0;
+		return ssc_msg_reader_next_chunk(reader);
+	}
+	
+	reader->state = SSC_MSG_READER_BLOCKS;
+	reader->cur_node = 0;
+	return ssc_msg_reader_next_block(reader);
+}
+
+//Grows an array to room for n elements, keeping its contents
+static MdslStatus ssc_msg_reader_reserve
+	(void **array, size_t *alloc, size_t n, size_t el_size)
+{
+	void *new_array;
+	size_t new_alloc;
+	
+	if (n <= *alloc)
+		return MDSL_SUCCESS;
+	
+	new_alloc = *alloc * 2;
+	if (new_alloc < n)
+		new_alloc = n;
+	new_array = realloc(*array, new_alloc * el_size);
+	if (! new_array)
+		return MDSL_FAILURE;
+	*array = new_array;
+	*alloc = new_alloc;
+	
+	return MDSL_SUCCESS;
+}
+
+//Makes room for n messages, and as many memory blocks
+static MdslStatus ssc_msg_reader_reserve_nodes
+	(SscMsgReader *reader, size_t n)
+{
+	if (n <= reader->alloc_len)
+		return MDSL_SUCCESS;
+	
+	free(reader->nodes);
+	free(reader->blocks);
+	reader->nodes = mdsl_tryalloc(sizeof(MmcMsg *) * n);
+	reader->blocks = mdsl_tryalloc(sizeof(struct iovec) * n);
+	if (! reader->nodes || ! reader->blocks)
+	{
+		free(reader->nodes);
+		free(reader->blocks);
+		reader->nodes = NULL;
+		reader->blocks = NULL;
+		reader->alloc_len = 0;
+		return MDSL_FAILURE;
+	}
+	reader->alloc_len = n;
+	
+	return MDSL_SUCCESS;
+}
+
+//Releases arrays that a large frame left behind, 
+//once the message built in them has been given away
+static void ssc_msg_reader_trim(SscMsgReader *reader)
+{
+	if (reader->alloc_len > SSC_MSG_READER_KEEP_LAYOUT)
+	{
+		free(reader->nodes);
+		free(reader->blocks);
+		reader->nodes = NULL;
+		reader->blocks = NULL;
+		reader->alloc_len = 0;
+	}
+	if (reader->layout_alloc > SSC_MSG_READER_KEEP_LAYOUT)
+	{
+		free(reader->layout);
+		reader->layout = NULL;
+		reader->layout_alloc = 0;
+	}
+	if (reader->varint_alloc > SSC_MSG_READER_KEEP_LAYOUT)
+	{
+		free(reader->varint);
+		reader->varint = NULL;
+		reader->varint_alloc = 0;
+	}
+}
+
+//Fewest messages a frame header's count of layout units can describe:
+//an extended element takes 3 elements, a varint at most 10 bytes
+static size_t ssc_msg_reader_min_nodes(SscMsgReader *reader, uint32_t header)
+{
+	if (reader->format == SSC_MSG_LAYOUT_VARINT)
+		return (reader->n_layout + 9) / 10;
+	if (header & SSC_MSG_FRAME_EXTENDED)
+		return (reader->n_layout + 2) / 3;
+	return reader->n_layout;
+}
+
+//Points the reader at the next piece of the layout. Room is made 
+//as bytes arrive, doubling each time, so that a header alone 
+//cannot make the reader allocate much.
+static MdslStatus ssc_msg_reader_expect_layout(SscMsgReader *reader)
+{
+	size_t start = reader->layout_end;
+	char *buf;
+	
+	reader->layout_end = start * 2;
+	if (reader->layout_end < SSC_MSG_READER_LAYOUT_STEP)
+		reader->layout_end = SSC_MSG_READER_LAYOUT_STEP;
+	if (reader->layout_end > reader->layout_bytes)
+		reader->layout_end = reader->layout_bytes;
+	
+	if (reader->format == SSC_MSG_LAYOUT_VARINT)
+	{
+		if (ssc_msg_reader_reserve((void **) &reader->varint, 
+				&reader->varint_alloc, reader->layout_end, 1) 
+			!= MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		buf = (char *) reader->varint;
+	}
+	else
+	{
+		if (ssc_msg_reader_reserve((void **) &reader->layout, 
+				&reader->layout_alloc, 
+				reader->layout_end / sizeof(uint32_t), 
+				sizeof(uint32_t)) != MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		buf = (char *) reader->layout;
+	}
+	
+	reader->state = SSC_MSG_READER_LAYOUT;
+	reader->dest = buf + start;
+	reader->dest_len = reader->layout_end - start;
+	return MDSL_SUCCESS;
+}
+
+//Called when the expected bytes have all arrived
+static MdslStatus ssc_msg_reader_step(SscMsgReader *reader, MmcMsg **msg)
+{
+	size_t i, j, qlim;
+	uint32_t header;
+	uint64_t file_len;
+	SscMsgPlan *plan;
+	int fd;
+	
+	switch (reader->state)
+	{
+	case SSC_MSG_READER_HEADER:
+		//The caller is done with the last message by now
+		if (reader->mapping)
+		{
+			ssc_msg_mapping_free(reader->mapping);
+			reader->mapping = NULL;
+		}
+		if (reader->batch)
+		{
+			mmc_msg_unref(reader->batch);
+			reader->batch = NULL;
+		}
+		ssc_msg_reader_trim(reader);
+		
+		header = ssc_uint32_load_le(reader->header);
+		reader->format = (header & SSC_MSG_FRAME_VARINT) 
+			? SSC_MSG_LAYOUT_VARINT : SSC_MSG_LAYOUT_FIXED;
+		reader->checksum = (header & SSC_MSG_FRAME_CRC) ? 1 : 0;
+		reader->compressed = (header & SSC_MSG_FRAME_COMPRESSED) ? 1 : 0;
+		reader->shape_flags = header 
+			& (SSC_MSG_FRAME_SHAPE | SSC_MSG_FRAME_SHAPE_DEFINE);
+		if (reader->checksum)
+			reader->crc = ssc_crc32c(0, reader->header, 
+				SSC_MSG_FRAME_HEADER_SIZE);
+		reader->n_layout = header & (~SSC_MSG_FRAME_FLAGS);
+		reader->batch_frame = (header & SSC_MSG_FRAME_BATCH) ? 1 : 0;
+		if (reader->batch_frame && ! reader->batches)
+			return MDSL_FAILURE;
+		
+		//The rest of a memory file frame is its length
+		if (header & SSC_MSG_FRAME_MEMFD)
+		{
+			if (! reader->fd_passing || (header & SSC_MSG_FRAME_FLAGS 
+					& ~(SSC_MSG_FRAME_MEMFD | SSC_MSG_FRAME_EXTENDED)))
+				return MDSL_FAILURE;
+			if (reader->limits && reader->limits->max_nodes 
+				&& ssc_msg_reader_min_nodes(reader, header) 
+					> reader->limits->max_nodes)
+			{
+				reader->limits->n_over_nodes++;
+				return MDSL_FAILURE;
+			}
+			reader->state = SSC_MSG_READER_MEMFD;
+			reader->dest = reader->memfd_len;
+			reader->dest_len = sizeof(reader->memfd_len);
+			break;
+		}
+		
+		//Frames using a cached shape need room for its messages only,
+		//and their blocks follow right away
+		if (reader->shape_flags == SSC_MSG_FRAME_SHAPE)
+		{
+			if (reader->n_layout >= SSC_MSG_SHAPE_CACHE_SIZE)
+				return MDSL_FAILURE;
+			plan = reader->shapes[reader->n_layout];
+			if (! plan)
+				return MDSL_FAILURE;
+			if (ssc_msg_reader_reserve_nodes
+					(reader, ssc_msg_plan_get_n_nodes(plan)) 
+				!= MDSL_SUCCESS)
+				return MDSL_FAILURE;
+			reader->root = ssc_msg_plan_alloc(plan, reader->nodes);
+			if (! reader->root)
+				return MDSL_FAILURE;
+			reader->n_nodes = ssc_msg_plan_get_n_nodes(plan);
+			*msg = ssc_msg_reader_start_blocks(reader);
+			break;
+		}
+		
+		//Varint headers count bytes, their elements are checked once
+		//decoded
+		if (reader->shape_flags 
+			&& (reader->shape_flags != SSC_MSG_FRAME_SHAPE_DEFINE
+				|| (reader->format == SSC_MSG_LAYOUT_FIXED 
+					&& reader->n_layout > SSC_MSG_SHAPE_MAX_LAYOUT)))
+			return MDSL_FAILURE;
+		if (reader->n_layout < 1 
+			|| reader->n_layout > SSC_MSG_READER_MAX_LAYOUT)
+			return MDSL_FAILURE;
+		
+		//Too many messages for the limits, whatever the format
+		if (reader->limits && reader->limits->max_nodes 
+			&& ssc_msg_reader_min_nodes(reader, header) 
+				> reader->limits->max_nodes)
+		{
+			reader->limits->n_over_nodes++;
+			return MDSL_FAILURE;
+		}
+		
+		//The layout is read into room made as it arrives
+		reader->layout_bytes = reader->n_layout;
+		if (reader->format == SSC_MSG_LAYOUT_FIXED)
+			reader->layout_bytes *= sizeof(uint32_t);
+		reader->layout_end = 0;
+		if (ssc_msg_reader_expect_layout(reader) != MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		break;
+		
+	case SSC_MSG_READER_LAYOUT:
+		if (reader->layout_end < reader->layout_bytes)
+			return ssc_msg_reader_expect_layout(reader);
+		
+		//Varints decode into no more elements than there are bytes
+		if (reader->format == SSC_MSG_LAYOUT_VARINT)
+		{
+			reader->varint_len = reader->n_layout;
+			if (ssc_msg_reader_reserve((void **) &reader->layout, 
+					&reader->layout_alloc, reader->varint_len, 
+					sizeof(uint32_t)) != MDSL_SUCCESS)
+				return MDSL_FAILURE;
+			if (ssc_msg_layout_from_varint(reader->varint, 
+					reader->varint_len, reader->layout, &reader->n_layout)
+				!= MDSL_SUCCESS)
+				return MDSL_FAILURE;
+		}
+		
+		if (reader->limits && ssc_msg_limits_check(reader->limits, 
+				reader->n_layout, reader->layout) != SSC_MSG_LIMITS_OK)
+			return MDSL_FAILURE;
+		
+		//Messages are never more than layout elements
+		if (ssc_msg_reader_reserve_nodes(reader, reader->n_layout) 
+			!= MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		
+		//Cache the shape, and allocate by it
+		if (reader->shape_flags)
+		{
+			SscMsgPlan **slot;
+			
+			if (reader->n_layout > SSC_MSG_SHAPE_MAX_LAYOUT)
+				return MDSL_FAILURE;
+			plan = ssc_msg_plan_new(reader->n_layout, reader->layout);
+			if (! plan)
+				return MDSL_FAILURE;
+			slot = reader->shapes 
+				+ (reader->n_defined % SSC_MSG_SHAPE_CACHE_SIZE);
+			if (*slot)
+				ssc_msg_plan_free(*slot);
+			*slot = plan;
+			reader->n_defined++;
+			
+			reader->root = ssc_msg_plan_alloc(plan, reader->nodes);
+			if (! reader->root)
+				return MDSL_FAILURE;
+			reader->n_nodes = ssc_msg_plan_get_n_nodes(plan);
+			*msg = ssc_msg_reader_start_blocks(reader);
+			break;
+		}
+		
+		//Allocate all messages, this validates the layout
+		reader->root = ssc_msg_alloc_by_layout
+			(reader->n_layout, reader->layout);
+		if (! reader->root)
+			return MDSL_FAILURE;
+		
+		//List messages in breadth-first order, the order of blocks
+		reader->nodes[0] = reader->root;
+		qlim = 1;
+		for (i = 0; i < qlim; i++)
+		{
+			MmcMsg *node = reader->nodes[i];
+			
+			for (j = 0; j < node->submsgs_len; j++)
+				reader->nodes[qlim++] = node->submsgs[j];
+		}
+		reader->n_nodes = qlim;
+		*msg = ssc_msg_reader_start_blocks(reader);
+		break;
+		
+	case SSC_MSG_READER_BLOCKS:
+		*msg = ssc_msg_reader_next_block(reader);
+		break;
+		
+	case SSC_MSG_READER_CHUNK_HEADER:
+		if (ssc_msg_reader_start_chunk(reader) != MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		break;
+		
+	case SSC_MSG_READER_CHUNK_DATA:
+		if (ssc_msg_reader_end_chunk(reader) != MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		*msg = ssc_msg_reader_next_chunk(reader);
+		break;
+		
+	case SSC_MSG_READER_TRAILER:
+		if (ssc_uint32_load_le(reader->trailer) != reader->crc)
+			return MDSL_FAILURE;
+		
+		*msg = reader->root;
+		reader->root = NULL;
+		ssc_msg_reader_expect_header(reader);
+		break;
+		
+	case SSC_MSG_READER_MEMFD:
+		//The descriptor came along with this frame or earlier
+		if (reader->n_fds == 0)
+			return MDSL_FAILURE;
+		fd = reader->fds[reader->fds_start];
+		reader->fds_start = (reader->fds_start + 1) 
+			% SSC_MSG_READER_MAX_FDS;
+		reader->n_fds--;
+		
+		file_len = ssc_uint64_load_le(reader->memfd_len);
+		if (file_len != (size_t) file_len)
+		{
+			close(fd);
+			return MDSL_FAILURE;
+		}
+		reader->mapping = ssc_msg_mapping_new
+			(fd, reader->n_layout, file_len, reader->limits);
+		if (! reader->mapping)
+			return MDSL_FAILURE;
+		
+		*msg = ssc_msg_mapping_get_root(reader->mapping);
+		ssc_msg_reader_expect_header(reader);
+		break;
+		
+	default:
+		return MDSL_FAILURE;
+	}
+	
+	return MDSL_SUCCESS;
+}
+
+void ssc_msg_reader_get_buffer
+	(SscMsgReader *reader, void **buf, size_t *len)
+{
+	*buf = reader->dest;
+	*len = reader->dest_len;
+}
+
+MdslStatus ssc_msg_reader_advance
+	(SscMsgReader *reader, size_t n, MmcMsg **msg)
+{
+	*msg = NULL;
+	
+	if (reader->state == SSC_MSG_READER_ERROR || n > reader->dest_len)
+		goto fail;
+	
+	//Bytes are checksummed while they are still in cache
+	if (reader->checksum && reader->state != SSC_MSG_READER_HEADER
+		&& reader->state != SSC_MSG_READER_TRAILER)
+		reader->crc = ssc_crc32c(reader->crc, reader->dest, n);
+	
+	reader->dest += n;
+	reader->dest_len -= n;
+	
+	//Move on as long as nothing more is expected at the destination.
+	//A frame whose remaining blocks are all empty completes here too.
+	while (reader->dest_len == 0)
+	{
+		if (ssc_msg_reader_step(reader, msg) != MDSL_SUCCESS)
+			goto fail;
+		if (*msg)
+			break;
+	}
+	
+	//A batch is given a message at a time
+	if (*msg && reader->batch_frame)
+	{
+		if ((*msg)->mem_len != 0 || (*msg)->submsgs_len == 0)
+		{
+			mmc_msg_unref(*msg);
+			*msg = NULL;
+			goto fail;
+		}
+		reader->batch = *msg;
+		reader->batch_pos = 0;
+		*msg = ssc_msg_reader_next_batched(reader);
+	}
+	
+	return MDSL_SUCCESS;
+	
+fail:
+	if (reader->root)
+	{
+		mmc_msg_unref(reader->root);
+		reader->root = NULL;
+	}
+	reader->state = SSC_MSG_READER_ERROR;
+	reader->dest = reader->header;
+	reader->dest_len = SSC_MSG_FRAME_HEADER_SIZE;
+	return MDSL_FAILURE;
+}
+
+ssize_t ssc_msg_reader_feed
+	(SscMsgReader *reader, const void *data, size_t len, MmcMsg **msg)
+{
+	size_t consumed = 0;
+	
+	*msg = NULL;
+	
+	while (consumed < len)
+	{
+		size_t n;
+		
+		n = reader->dest_len;
+		if (n > len - consumed)
+			n = len - consumed;
+		memcpy(reader->dest, ((const char *) data) + consumed, n);
+		consumed += n;
+		
+		if (ssc_msg_reader_advance(reader, n, msg) != MDSL_SUCCESS)
+			return -1;
+		if (*msg)
+			break;
+	}
+	
+	return consumed;
+}
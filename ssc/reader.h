@@ -0,0 +1,221 @@
+/* reader.h
+ * Incremental parser for framed messages
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Frame format: 
+//  uint32 (little endian)    no. of layout elements (n_layout),
+//                            | SSC_MSG_FRAME_EXTENDED if any are 
+//                            extended (see msg.h)
+//  n_layout uint32           layout, as ssc_msg_create_layout()
+//  memory blocks             nonempty blocks in breadth-first order
+//A sender can write the header followed by what ssc_msg_flatten() 
+//gives. Without extended elements n_layout is the no. of messages, 
+//and readers predating them reject frames that have them.
+//With SSC_MSG_FRAME_VARINT set in the header, the rest of it is 
+//instead the no. of bytes of the layout, which is encoded 
+//as ssc_msg_layout_to_varint() gives.
+//Shapes (layouts) can be cached across frames of a stream: a frame 
+//with SSC_MSG_FRAME_SHAPE_DEFINE set in the header has its layout 
+//stored as shape no. (k % SSC_MSG_SHAPE_CACHE_SIZE) for the k-th 
+//such frame, replacing any earlier one. A frame with 
+//SSC_MSG_FRAME_SHAPE set has the rest of the header as a shape no. 
+//instead, and no layout; the blocks follow the header.
+//Layouts of more than SSC_MSG_SHAPE_MAX_LAYOUT elements are not cached.
+//With SSC_MSG_FRAME_COMPRESSED set in the header, the blocks are 
+//instead given as a stream of chunks (see compress.h).
+//With SSC_MSG_FRAME_CRC set in the header, the blocks are followed by
+//  uint32 (little endian)    ssc_crc32c() of everything before it in 
+//                            the frame, header included
+//With SSC_MSG_FRAME_BATCH set in the header, the root message is 
+//empty, and each of its submessages is a message of its own, so that
+//small messages share one frame (its header, layout encoding, trailer 
+//and chunks).
+//With SSC_MSG_FRAME_MEMFD set in the header (and no other flag but 
+//SSC_MSG_FRAME_EXTENDED), the frame is instead
+//  uint32 (little endian)    n_layout | flags
+//  uint64 (little endian)    length of the memory file
+//and the layout and blocks are in a memory file (see memfd.h) passed 
+//over a unix socket as SCM_RIGHTS along with the frame's bytes or 
+//earlier ones. Descriptors are taken by frames in the order they 
+//arrive, at most SSC_MSG_FRAME_MAX_FDS with each write.
+
+#define SSC_MSG_FRAME_HEADER_SIZE 4
+#define SSC_MSG_FRAME_EXTENDED (((uint32_t) 1) << 31)
+#define SSC_MSG_FRAME_VARINT (((uint32_t) 1) << 30)
+#define SSC_MSG_FRAME_CRC (((uint32_t) 1) << 29)
+#define SSC_MSG_FRAME_COMPRESSED (((uint32_t) 1) << 28)
+#define SSC_MSG_FRAME_SHAPE (((uint32_t) 1) << 27)
+#define SSC_MSG_FRAME_SHAPE_DEFINE (((uint32_t) 1) << 26)
+#define SSC_MSG_FRAME_MEMFD (((uint32_t) 1) << 25)
+#define SSC_MSG_FRAME_BATCH (((uint32_t) 1) << 24)
+#define SSC_MSG_FRAME_FLAGS (SSC_MSG_FRAME_EXTENDED | SSC_MSG_FRAME_VARINT \
+	| SSC_MSG_FRAME_CRC | SSC_MSG_FRAME_COMPRESSED \
+	| SSC_MSG_FRAME_SHAPE | SSC_MSG_FRAME_SHAPE_DEFINE \
+	| SSC_MSG_FRAME_MEMFD | SSC_MSG_FRAME_BATCH)
+
+#define SSC_MSG_SHAPE_CACHE_SIZE 64
+#define SSC_MSG_SHAPE_MAX_LAYOUT 1024
+#define SSC_MSG_FRAME_TRAILER_SIZE 4
+#define SSC_MSG_FRAME_MEMFD_SIZE 12
+#define SSC_MSG_FRAME_MAX_FDS 16
+
+//Largest no. of layout elements (or varint bytes) accepted in a frame
+#define SSC_MSG_READER_MAX_LAYOUT (1 << 20)
+
+//Largest no. of descriptors waiting for their frames
+#define SSC_MSG_READER_MAX_FDS 64
+
+//Writes frame header for a layout of n_layout elements 
+//describing n_nodes messages. n_layout must not exceed 
+//SSC_MSG_READER_MAX_LAYOUT, larger values are truncated 
+//rather than allowed to set flags.
+static inline void ssc_msg_frame_header_store
+	(void *header, size_t n_layout, size_t n_nodes)
+{
+	ssc_uint32_store_le(header, (n_layout & ~SSC_MSG_FRAME_FLAGS) 
+		| (n_layout != n_nodes ? SSC_MSG_FRAME_EXTENDED : 0));
+}
+
+//Writes frame header for a layout encoded into n_bytes of varints.
+//n_bytes must not exceed SSC_MSG_READER_MAX_LAYOUT either.
+static inline void ssc_msg_frame_header_store_varint
+	(void *header, size_t n_bytes)
+{
+	ssc_uint32_store_le(header, 
+		(n_bytes & ~SSC_MSG_FRAME_FLAGS) | SSC_MSG_FRAME_VARINT);
+}
+
+//Writes frame header for a frame using cached shape no. shape_id
+static inline void ssc_msg_frame_header_store_shape
+	(void *header, size_t shape_id)
+{
+	ssc_uint32_store_le(header, shape_id | SSC_MSG_FRAME_SHAPE);
+}
+
+//Sets flags (e.g. SSC_MSG_FRAME_CRC) in a frame header
+static inline void ssc_msg_frame_header_add_flags
+	(void *header, uint32_t flags)
+{
+	ssc_uint32_store_le(header, ssc_uint32_load_le(header) | flags);
+}
+
+//Writes a memory file frame for a file of len bytes holding a layout
+//of n_layout elements describing n_nodes messages. 
+//header must have room for SSC_MSG_FRAME_MEMFD_SIZE bytes.
+static inline void ssc_msg_frame_header_store_memfd
+	(void *header, size_t n_layout, size_t n_nodes, size_t len)
+{
+	ssc_msg_frame_header_store(header, n_layout, n_nodes);
+	ssc_msg_frame_header_add_flags(header, SSC_MSG_FRAME_MEMFD);
+	ssc_uint64_store_le(((char *) header) + SSC_MSG_FRAME_HEADER_SIZE, len);
+}
+
+//Push parser for framed messages. Bytes can be given in chunks of
+//any size as they arrive, e.g. from non-blocking reads. 
+//Memory blocks are placed directly into the messages being built.
+typedef struct _SscMsgReader SscMsgReader;
+
+//Creates a new reader, expecting the start of a frame
+SscMsgReader *ssc_msg_reader_new(void);
+
+//Frees the reader and any partially read message
+void ssc_msg_reader_free(SscMsgReader *reader);
+
+//Drops any partially read message, error state and cached shapes,
+//so that the reader expects the start of a new stream
+void ssc_msg_reader_reset(SscMsgReader *reader);
+
+//Checks frames against limits before allocating anything for them.
+//limits must outlive the reader; NULL removes them.
+void ssc_msg_reader_set_limits(SscMsgReader *reader, SscMsgLimits *limits);
+
+//Sets whether memory file frames are accepted (off by default, 
+//making them invalid). Their descriptors must be given to the reader 
+//with ssc_msg_reader_push_fd() (or ssc_msg_reader_recv()) no later 
+//than the frame's bytes.
+void ssc_msg_reader_set_fd_passing(SscMsgReader *reader, int fd_passing);
+
+//Gives the reader a descriptor received from the stream, which it 
+//takes over. Fails (closing it) if memory file frames are not 
+//accepted, or if SSC_MSG_READER_MAX_FDS descriptors are already 
+//waiting for their frames.
+MdslStatus ssc_msg_reader_push_fd(SscMsgReader *reader, int fd);
+
+//As recv() on a unix socket, also giving descriptors passed along 
+//with the bytes to the reader. The bytes are stored at buf, which 
+//need not be the reader's buffer. Returns -1 with errno set to 
+//EBADMSG if descriptors were not accepted or were cut off.
+ssize_t ssc_msg_reader_recv
+	(SscMsgReader *reader, int fd, void *buf, size_t len);
+
+//If the last message completed came from a memory file frame, 
+//returns its mapping, which the caller then frees instead of 
+//dropping the reference to the message. Otherwise returns NULL.
+//A mapping not taken is freed when the next frame starts, so callers
+//accepting memory file frames must check after every message.
+SscMsgMapping *ssc_msg_reader_take_mapping(SscMsgReader *reader);
+
+//Sets whether batch frames are accepted (off by default, 
+//making them invalid)
+void ssc_msg_reader_set_batches(SscMsgReader *reader, int batches);
+
+//After a message from a batch frame, gives the next message of 
+//the batch, or NULL if there are no more. Callers accepting batch 
+//frames must call this until it gives NULL after every message; 
+//messages not taken are dropped when the next frame starts.
+MmcMsg *ssc_msg_reader_next_batched(SscMsgReader *reader);
+
+//Gives the encoding of the layout of the last frame whose header 
+//was read, so that replies can use the same
+SscMsgLayoutFormat ssc_msg_reader_get_format(SscMsgReader *reader);
+
+//Gives whether the last frame whose header was read has a CRC trailer.
+//Frames with a trailer are verified as their bytes arrive, and 
+//a mismatch makes the stream invalid.
+int ssc_msg_reader_get_checksum(SscMsgReader *reader);
+
+//Gives whether the last frame whose header was read has its blocks
+//compressed. They are decompressed into the messages as they arrive.
+int ssc_msg_reader_get_compressed(SscMsgReader *reader);
+
+//Gives whether the last frame whose header was read 
+//defined or used a cached shape
+int ssc_msg_reader_get_shapes(SscMsgReader *reader);
+
+//Copies bytes into the reader. Consumes bytes up to the end of 
+//the current frame at most. If a message was completed, 
+//*msg is set to it (and NULL otherwise); call again with the rest 
+//of the bytes. Returns the number of bytes consumed, or -1 if 
+//the stream is invalid, after which the reader must be reset.
+ssize_t ssc_msg_reader_feed
+	(SscMsgReader *reader, const void *data, size_t len, MmcMsg **msg);
+
+//Gives the memory where the next bytes of the stream belong, so that
+//they can be read there directly (e.g. with read() or recv()) without
+//an intermediate copy. *len is at least 1.
+//Follow with ssc_msg_reader_advance() with the no. of bytes read.
+void ssc_msg_reader_get_buffer
+	(SscMsgReader *reader, void **buf, size_t *len);
+
+//Tells the reader that n bytes have been written to the memory 
+//given by ssc_msg_reader_get_buffer(). n must not exceed the length 
+//given. Sets *msg as ssc_msg_reader_feed() does. 
+//Returns MDSL_FAILURE if the stream is invalid.
+MdslStatus ssc_msg_reader_advance
+	(SscMsgReader *reader, size_t n, MmcMsg **msg);
@@ -0,0 +1,652 @@
+/* reclog.h
+ * Append-only record log files
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#define SSC_REC_LOG_MAGIC "SSCRLOG1"
+#define SSC_REC_LOG_FOOTER_MAGIC "SSCRIDX1"
+#define SSC_REC_LOG_VERSION 1
+#define SSC_REC_LOG_HEADER_SIZE 16
+#define SSC_REC_LOG_FOOTER_SIZE 16
+
+//Records start with their length and are 8 byte aligned
+#define SSC_REC_LOG_RECORD_HEADER 8
+#define SSC_REC_LOG_ALIGN(n) (((n) + 7) & (~((uint64_t) 7)))
+
+//Sparse index: offsets of every interval-th record
+typedef struct
+{
+	uint64_t *offsets;
+	size_t n_offsets, alloc;
+	size_t n_records;
+	size_t interval;
+} SscRecLogIndex;
+
+static void ssc_rec_log_index_init(SscRecLogIndex *index, size_t interval)
+{
+	index->offsets = NULL;
+	index->n_offsets = index->alloc = 0;
+	index->n_records = 0;
+	index->interval = interval;
+}
+
+//Counts a record starting at offset
+static MdslStatus ssc_rec_log_index_add
+	(SscRecLogIndex *index, uint64_t offset)
+{
+	if (index->n_records % index->interval == 0)
+	{
+		if (index->n_offsets == index->alloc)
+		{
+			uint64_t *offsets;
+			size_t alloc = index->alloc ? index->alloc * 2 : 16;
+			
+			offsets = realloc(index->offsets, sizeof(uint64_t) * alloc);
+			if (! offsets)
+				return MDSL_FAILURE;
+			index->offsets = offsets;
+			index->alloc = alloc;
+		}
+		index->offsets[index->n_offsets++] = offset;
+	}
+	index->n_records++;
+	
+	return MDSL_SUCCESS;
+}
+
+//Forgets records from rec_no onwards
+static void ssc_rec_log_index_truncate(SscRecLogIndex *index, size_t rec_no)
+{
+	index->n_records = rec_no;
+	index->n_offsets = (rec_no + index->interval - 1) / index->interval;
+}
+
+//Checks the file header, and gets the index interval
+static MdslStatus ssc_rec_log_header_check
+	(char *data, size_t len, size_t *interval)
+{
+	if (len < SSC_REC_LOG_HEADER_SIZE
+		|| memcmp(data, SSC_REC_LOG_MAGIC, 8) != 0
+		|| ssc_uint32_load_le(data + 8) != SSC_REC_LOG_VERSION)
+		return MDSL_FAILURE;
+	*interval = ssc_uint32_load_le(data + 12);
+	if (*interval == 0)
+		return MDSL_FAILURE;
+	
+	return MDSL_SUCCESS;
+}
+
+//Gets the offset just past the record at pos, or 0 if there is
+//no complete record there
+static uint64_t ssc_rec_log_record_end(char *data, size_t len, uint64_t pos)
+{
+	uint64_t rec_len;
+	
+	if (len - pos < SSC_REC_LOG_RECORD_HEADER)
+		return 0;
+	rec_len = ssc_uint64_load_le(data + pos);
+	if (rec_len < sizeof(uint32_t) || (rec_len & SSC_REC_LOG_INDEX)
+		|| rec_len > len - pos - SSC_REC_LOG_RECORD_HEADER)
+		return 0;
+	
+	return pos + SSC_REC_LOG_ALIGN(SSC_REC_LOG_RECORD_HEADER + rec_len);
+}
+
+//Reads the index written at close, returning the offset where 
+//it starts, or 0 if there is no intact index
+static uint64_t ssc_rec_log_index_load
+	(SscRecLogIndex *index, char *data, size_t len)
+{
+	uint64_t index_pos, index_len, n_records, i, n_offsets;
+	char *ptr;
+	
+	if (len < SSC_REC_LOG_HEADER_SIZE + SSC_REC_LOG_FOOTER_SIZE
+		|| memcmp(data + len - 8, SSC_REC_LOG_FOOTER_MAGIC, 8) != 0)
+		return 0;
+	index_pos = ssc_uint64_load_le(data + len - SSC_REC_LOG_FOOTER_SIZE);
+	if (index_pos < SSC_REC_LOG_HEADER_SIZE || index_pos % 8 != 0
+		|| index_pos > len - SSC_REC_LOG_FOOTER_SIZE 
+			- SSC_REC_LOG_RECORD_HEADER - 8)
+		return 0;
+	
+	//The index record must fill the space up to the footer
+	ptr = data + index_pos;
+	index_len = ssc_uint64_load_le(ptr);
+	n_records = ssc_uint64_load_le(ptr + 8);
+	if (index_len != (SSC_REC_LOG_INDEX | (len - SSC_REC_LOG_FOOTER_SIZE 
+			- index_pos - SSC_REC_LOG_RECORD_HEADER)))
+		return 0;
+	n_offsets = (n_records + index->interval - 1) / index->interval;
+	if (n_offsets != (len - SSC_REC_LOG_FOOTER_SIZE - index_pos 
+			- SSC_REC_LOG_RECORD_HEADER - 8) / 8)
+		return 0;
+	
+	for (i = 0; i < n_offsets; i++)
+	{
+		uint64_t offset = ssc_uint64_load_le(ptr + 16 + 8 * i);
+		
+		if (offset < SSC_REC_LOG_HEADER_SIZE || offset >= index_pos)
+			return 0;
+		index->n_records = i * index->interval;
+		if (ssc_rec_log_index_add(index, offset) != MDSL_SUCCESS)
+			return 0;
+	}
+	index->n_records = n_records;
+	
+	return index_pos;
+}
+
+//Builds the index of a log, from the one stored in it if intact, 
+//otherwise by scanning its records. Returns the end of the records.
+static uint64_t ssc_rec_log_index_build
+	(SscRecLogIndex *index, char *data, size_t len)
+{
+	uint64_t pos, next;
+	
+	pos = ssc_rec_log_index_load(index, data, len);
+	if (pos)
+		return pos;
+	
+	ssc_rec_log_index_truncate(index, 0);
+	pos = SSC_REC_LOG_HEADER_SIZE;
+	while ((next = ssc_rec_log_record_end(data, len, pos)) != 0)
+	{
+		//The padding of the last record may be missing
+		if (next > len)
+			break;
+		if (ssc_rec_log_index_add(index, pos) != MDSL_SUCCESS)
+			break;
+		pos = next;
+	}
+	
+	return pos;
+}
+
+//Writer
+
+//A queued record
+typedef struct
+{
+	MmcMsg *msg;
+	//Record header followed by layout
+	char *head;
+} SscRecLogEntry;
+
+struct _SscRecLogWriter
+{
+	int fd;
+	SscRecLogIndex index;
+	
+	//End of committed records, and of queued ones
+	uint64_t committed, end;
+	
+	//Queued records
+	SscRecLogEntry *entries;
+	size_t n_entries, entries_alloc;
+	struct iovec *iov;
+	size_t iov_len, iov_alloc;
+	
+	size_t max_records, max_bytes;
+	SscRecLogWriterStats stats;
+};
+
+static const char ssc_rec_log_zeros[8];
+
+//Writes all of the iovecs, starting at the current file position.
+//The iovecs are left as they were, so that a failed write 
+//can be retried.
+static MdslStatus ssc_rec_log_write_all
+	(int fd, struct iovec *iov, size_t n_iov, uint64_t *n_bytes)
+{
+	//Bytes of iov[0] already written
+	size_t skip = 0;
+	
+	while (n_iov > 0)
+	{
+		struct iovec saved = iov[0];
+		ssize_t res;
+		
+		iov[0].iov_base = ((char *) iov[0].iov_base) + skip;
+		iov[0].iov_len -= skip;
+		res = writev(fd, iov, n_iov > IOV_MAX ? IOV_MAX : n_iov);
+		iov[0] = saved;
+		if (res < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return MDSL_FAILURE;
+		}
+		*n_bytes += res;
+		
+		res += skip;
+		while (n_iov > 0 && (size_t) res >= iov->iov_len)
+		{
+			res -= iov->iov_len;
+			iov++;
+			n_iov--;
+		}
+		skip = res;
+	}
+	
+	return MDSL_SUCCESS;
+}
+
+SscRecLogWriter *ssc_rec_log_writer_open(const char *path, size_t interval)
+{
+	SscRecLogWriter *writer;
+	struct stat st;
+	int fd;
+	
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0)
+		goto fail_fd;
+	
+	writer = mdsl_new(SscRecLogWriter);
+	writer->fd = fd;
+	writer->entries = NULL;
+	writer->n_entries = writer->entries_alloc = 0;
+	writer->iov = NULL;
+	writer->iov_len = writer->iov_alloc = 0;
+	writer->max_records = 128;
+	writer->max_bytes = 1 << 20;
+	writer->stats.n_records = writer->stats.n_bytes 
+		= writer->stats.n_syncs = 0;
+	ssc_rec_log_index_init(&writer->index, 0);
+	
+	if (st.st_size == 0)
+	{
+		//New log
+		char header[SSC_REC_LOG_HEADER_SIZE];
+		struct iovec iov;
+		
+		if (interval == 0)
+			interval = SSC_REC_LOG_DEFAULT_INTERVAL;
+		if (interval > UINT32_MAX)
+			goto fail;
+		writer->index.interval = interval;
+		
+		memcpy(header, SSC_REC_LOG_MAGIC, 8);
+		ssc_uint32_store_le(header + 8, SSC_REC_LOG_VERSION);
+		ssc_uint32_store_le(header + 12, interval);
+		iov.iov_base = header;
+		iov.iov_len = sizeof(header);
+		if (ssc_rec_log_write_all(fd, &iov, 1, &writer->stats.n_bytes) 
+			!= MDSL_SUCCESS)
+			goto fail;
+		writer->end = SSC_REC_LOG_HEADER_SIZE;
+	}
+	else
+	{
+		//Existing log: find where its records end
+		char *data;
+		size_t len = st.st_size;
+		
+		if ((off_t) len != st.st_size)
+			goto fail;
+		data = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED)
+			goto fail;
+		if (ssc_rec_log_header_check(data, len, &interval) 
+			!= MDSL_SUCCESS)
+		{
+			munmap(data, len);
+			goto fail;
+		}
+		writer->index.interval = interval;
+		writer->end = ssc_rec_log_index_build(&writer->index, data, len);
+		munmap(data, len);
+		
+		//The index is rewritten on close
+		if (writer->end != len && ftruncate(fd, writer->end) != 0)
+			goto fail;
+		if (lseek(fd, writer->end, SEEK_SET) < 0)
+			goto fail;
+	}
+	
+	writer->committed = writer->end;
+	
+	return writer;
+	
+fail:
+	free(writer->index.offsets);
+	free(writer);
+fail_fd:
+	close(fd);
+	return NULL;
+}
+
+void ssc_rec_log_writer_set_batch
+	(SscRecLogWriter *writer, size_t max_records, size_t max_bytes)
+{
+	writer->max_records = max_records;
+	writer->max_bytes = max_bytes;
+}
+
+//Grows an array to hold at least n elements
+static MdslStatus ssc_rec_log_reserve
+	(void **array, size_t *alloc, size_t n, size_t el_size)
+{
+	void *new_array;
+	size_t new_alloc;
+	
+	if (n <= *alloc)
+		return MDSL_SUCCESS;
+	
+	new_alloc = *alloc * 2;
+	if (new_alloc < n)
+		new_alloc = n;
+	new_array = realloc(*array, new_alloc * el_size);
+	if (! new_array)
+		return MDSL_FAILURE;
+	*array = new_array;
+	*alloc = new_alloc;
+	
+	return MDSL_SUCCESS;
+}
+
+MdslStatus ssc_rec_log_writer_append(SscRecLogWriter *writer, MmcMsg *msg)
+{
+	SscMsgFlatSize size;
+	SscRecLogEntry *entry;
+	size_t head_len;
+	uint64_t rec_len, padding;
+	char *head;
+	struct iovec *iov;
+	
+	//Flatten needs room for all layout elements as its queue
+	ssc_msg_flatten(msg, 0, NULL, NULL, &size);
+	if (ssc_rec_log_reserve((void **) &writer->iov, &writer->iov_alloc, 
+			writer->iov_len + 2 + size.n_layout, sizeof(struct iovec)) 
+		!= MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	if (ssc_rec_log_reserve((void **) &writer->entries, 
+			&writer->entries_alloc, writer->n_entries + 1, 
+			sizeof(SscRecLogEntry)) != MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	
+	head_len = SSC_REC_LOG_RECORD_HEADER + sizeof(uint32_t) * size.n_layout;
+	head = mdsl_tryalloc(head_len);
+	if (! head)
+		return MDSL_FAILURE;
+	
+	iov = writer->iov + writer->iov_len;
+	if (ssc_msg_flatten(msg, size.n_layout, 
+			(uint32_t *) (head + SSC_REC_LOG_RECORD_HEADER), 
+			iov + 1, &size) != MDSL_SUCCESS)
+	{
+		free(head);
+		return MDSL_FAILURE;
+	}
+	if (ssc_rec_log_index_add(&writer->index, writer->end) != MDSL_SUCCESS)
+	{
+		free(head);
+		return MDSL_FAILURE;
+	}
+	
+	rec_len = sizeof(uint32_t) * size.n_layout + size.n_bytes;
+	ssc_uint64_store_le(head, rec_len);
+	iov[0].iov_base = head;
+	iov[0].iov_len = head_len;
+	padding = SSC_REC_LOG_ALIGN(rec_len) - rec_len;
+	if (padding)
+	{
+		iov[1 + size.n_iov].iov_base = (void *) ssc_rec_log_zeros;
+		iov[1 + size.n_iov].iov_len = padding;
+	}
+	writer->iov_len += 1 + size.n_iov + (padding ? 1 : 0);
+	writer->end += SSC_REC_LOG_RECORD_HEADER + rec_len + padding;
+	
+	entry = writer->entries + writer->n_entries;
+	mmc_msg_ref(msg);
+	entry->msg = msg;
+	entry->head = head;
+	writer->n_entries++;
+	
+	if ((writer->max_records && writer->n_entries >= writer->max_records)
+		|| (writer->max_bytes 
+			&& writer->end - writer->committed >= writer->max_bytes))
+		return ssc_rec_log_writer_commit(writer);
+	
+	return MDSL_SUCCESS;
+}
+
+MdslStatus ssc_rec_log_writer_commit(SscRecLogWriter *writer)
+{
+	size_t i;
+	
+	if (writer->n_entries == 0)
+		return MDSL_SUCCESS;
+	
+	if (ssc_rec_log_write_all(writer->fd, writer->iov, writer->iov_len, 
+			&writer->stats.n_bytes) != MDSL_SUCCESS
+		|| fdatasync(writer->fd) != 0)
+		goto fail;
+	writer->stats.n_syncs++;
+	
+	for (i = 0; i < writer->n_entries; i++)
+	{
+		mmc_msg_unref(writer->entries[i].msg);
+		free(writer->entries[i].head);
+	}
+	writer->stats.n_records += writer->n_entries;
+	writer->n_entries = 0;
+	writer->iov_len = 0;
+	writer->committed = writer->end;
+	
+	return MDSL_SUCCESS;
+	
+fail:
+	//Drop what may have been written, the records stay queued
+	if (ftruncate(writer->fd, writer->committed) == 0)
+		lseek(writer->fd, writer->committed, SEEK_SET);
+	
+	return MDSL_FAILURE;
+}
+
+size_t ssc_rec_log_writer_get_n_records(SscRecLogWriter *writer)
+{
+	return writer->index.n_records;
+}
+
+void ssc_rec_log_writer_get_stats
+	(SscRecLogWriter *writer, SscRecLogWriterStats *stats)
+{
+	*stats = writer->stats;
+}
+
+MdslStatus ssc_rec_log_writer_close(SscRecLogWriter *writer)
+{
+	MdslStatus status;
+	size_t i;
+	
+	status = ssc_rec_log_writer_commit(writer);
+	
+	//Index and footer
+	if (status == MDSL_SUCCESS)
+	{
+		SscRecLogIndex *index = &writer->index;
+		size_t buf_len;
+		char *buf, *ptr;
+		struct iovec iov;
+		
+		buf_len = SSC_REC_LOG_RECORD_HEADER + 8 + 8 * index->n_offsets 
+			+ SSC_REC_LOG_FOOTER_SIZE;
+		buf = mdsl_tryalloc(buf_len);
+		if (buf)
+		{
+			ptr = buf;
+			ssc_uint64_store_le(ptr, SSC_REC_LOG_INDEX 
+				| (8 + 8 * index->n_offsets));
+			ptr += SSC_REC_LOG_RECORD_HEADER;
+			ssc_uint64_store_le(ptr, index->n_records);
+			ptr += 8;
+			for (i = 0; i < index->n_offsets; i++, ptr += 8)
+				ssc_uint64_store_le(ptr, index->offsets[i]);
+			ssc_uint64_store_le(ptr, writer->end);
+			memcpy(ptr + 8, SSC_REC_LOG_FOOTER_MAGIC, 8);
+			
+			iov.iov_base = buf;
+			iov.iov_len = buf_len;
+			if (ssc_rec_log_write_all(writer->fd, &iov, 1, 
+					&writer->stats.n_bytes) != MDSL_SUCCESS
+				|| fdatasync(writer->fd) != 0)
+				status = MDSL_FAILURE;
+			free(buf);
+		}
+		else
+		{
+			status = MDSL_FAILURE;
+		}
+	}
+	
+	if (close(writer->fd) != 0)
+		status = MDSL_FAILURE;
+	for (i = 0; i < writer->n_entries; i++)
+	{
+		mmc_msg_unref(writer->entries[i].msg);
+		free(writer->entries[i].head);
+	}
+	free(writer->entries);
+	free(writer->iov);
+	free(writer->index.offsets);
+	free(writer);
+	
+	return status;
+}
+
+//Reader
+
+struct _SscRecLogReader
+{
+	char *data;
+	size_t len;
+	SscRecLogIndex index;
+	
+	//Offset and no. of the record ssc_rec_log_reader_next() gives
+	uint64_t pos;
+	size_t rec_no;
+};
+
+SscRecLogReader *ssc_rec_log_reader_open(const char *path)
+{
+	SscRecLogReader *reader;
+	struct stat st;
+	size_t interval;
+	char *data;
+	int fd;
+	
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size < SSC_REC_LOG_HEADER_SIZE
+		|| (off_t) (size_t) st.st_size != st.st_size)
+	{
+		close(fd);
+		return NULL;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+	
+	if (ssc_rec_log_header_check(data, st.st_size, &interval) 
+		!= MDSL_SUCCESS)
+	{
+		munmap(data, st.st_size);
+		return NULL;
+	}
+	
+	reader = mdsl_new(SscRecLogReader);
+	reader->data = data;
+	reader->len = st.st_size;
+	ssc_rec_log_index_init(&reader->index, interval);
+	ssc_rec_log_index_build(&reader->index, data, reader->len);
+	reader->pos = SSC_REC_LOG_HEADER_SIZE;
+	reader->rec_no = 0;
+	
+	return reader;
+}
+
+size_t ssc_rec_log_reader_get_n_records(SscRecLogReader *reader)
+{
+	return reader->index.n_records;
+}
+
+SscMsgSlab *ssc_rec_log_reader_get(SscRecLogReader *reader, size_t rec_no)
+{
+	SscRecLogIndex *index = &reader->index;
+	uint64_t pos;
+	size_t i;
+	
+	if (rec_no >= index->n_records)
+		return NULL;
+	
+	//Nearest indexed record, then skip forward
+	pos = index->offsets[rec_no / index->interval];
+	for (i = rec_no - rec_no % index->interval; i < rec_no; i++)
+	{
+		pos = ssc_rec_log_record_end(reader->data, reader->len, pos);
+		if (! pos)
+			return NULL;
+	}
+	
+	reader->pos = pos;
+	reader->rec_no = rec_no;
+	return ssc_rec_log_reader_next(reader);
+}
+
+SscMsgSlab *ssc_rec_log_reader_next(SscRecLogReader *reader)
+{
+	uint64_t next;
+	char *rec;
+	
+	if (reader->rec_no >= reader->index.n_records)
+		return NULL;
+	next = ssc_rec_log_record_end(reader->data, reader->len, reader->pos);
+	if (! next)
+		return NULL;
+	
+	rec = reader->data + reader->pos;
+	reader->rec_no++;
+	reader->pos = next;
+	return ssc_msg_slab_new(rec + SSC_REC_LOG_RECORD_HEADER, 
+		ssc_uint64_load_le(rec));
+}
+
+void ssc_rec_log_reader_free(SscRecLogReader *reader)
+{
+	munmap(reader->data, reader->len);
+	free(reader->index.offsets);
+	free(reader);
+}
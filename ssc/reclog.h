@@ -0,0 +1,119 @@
+/* reclog.h
+ * Append-only record log files
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Record log: a file of serialized message trees, appended to by one
+//writer and read back through a shared mapping without copying.
+//
+//File format (integers little endian):
+//  header      "SSCRLOG1", uint32 version (1), 
+//              uint32 index interval
+//  records     uint64 payload length, then the payload: 
+//              layout and memory blocks as ssc_msg_slab_new() reads,
+//              padded to a multiple of 8 bytes
+//  index       written when the writer is closed: a record whose
+//              length has SSC_REC_LOG_INDEX set, holding uint64 
+//              no. of records, and uint64 offsets of every 
+//              interval-th record starting with the first
+//  footer      uint64 offset of the index, "SSCRIDX1"
+//
+//A file without an intact index and footer (e.g. after a crash) is 
+//still readable: the records are scanned up to the first incomplete
+//one, and the writer truncates anything after that before appending.
+
+#define SSC_REC_LOG_INDEX (((uint64_t) 1) << 63)
+
+//Records between index entries, unless given otherwise
+#define SSC_REC_LOG_DEFAULT_INTERVAL 64
+
+//Writer
+
+typedef struct _SscRecLogWriter SscRecLogWriter;
+
+//Counters for a writer
+typedef struct
+{
+	//Records committed
+	uint64_t n_records;
+	//Bytes written
+	uint64_t n_bytes;
+	//fdatasync() calls
+	uint64_t n_syncs;
+} SscRecLogWriterStats;
+
+//Opens a record log for appending, creating it if it does not exist
+//with an index entry every interval records 
+//(SSC_REC_LOG_DEFAULT_INTERVAL if 0). An existing log keeps its 
+//interval; its index and any incomplete record are truncated away.
+//Returns NULL on failure.
+SscRecLogWriter *ssc_rec_log_writer_open(const char *path, size_t interval);
+
+//Commits after this many queued records or bytes, 0 for no limit.
+//The defaults are 128 records and 1 MiB.
+void ssc_rec_log_writer_set_batch
+	(SscRecLogWriter *writer, size_t max_records, size_t max_bytes);
+
+//Queues the message tree as the next record, holding a reference to it
+//until it is written. Records are not durable before they are 
+//committed, either explicitly or when the batch limits are reached;
+//this fails if that commit fails (the records stay queued).
+MdslStatus ssc_rec_log_writer_append(SscRecLogWriter *writer, MmcMsg *msg);
+
+//Writes all queued records with as few writev() calls as possible,
+//followed by one fdatasync(). On failure the file is truncated back 
+//to the last commit and the records stay queued.
+MdslStatus ssc_rec_log_writer_commit(SscRecLogWriter *writer);
+
+//Returns the no. of records in the log, queued ones included. 
+//The next record appended gets this number.
+size_t ssc_rec_log_writer_get_n_records(SscRecLogWriter *writer);
+
+//Gets the counters
+void ssc_rec_log_writer_get_stats
+	(SscRecLogWriter *writer, SscRecLogWriterStats *stats);
+
+//Commits queued records, writes the index, and closes the log.
+//The writer is freed even on failure.
+MdslStatus ssc_rec_log_writer_close(SscRecLogWriter *writer);
+
+//Reader
+
+typedef struct _SscRecLogReader SscRecLogReader;
+
+//Maps a record log for reading. Records appended later are not seen.
+//Returns NULL if the file cannot be mapped or is not a record log.
+SscRecLogReader *ssc_rec_log_reader_open(const char *path);
+
+//Returns the no. of records
+size_t ssc_rec_log_reader_get_n_records(SscRecLogReader *reader);
+
+//Returns a view of record rec_no, as with ssc_msg_slab_new(): 
+//messages point into the read-only mapping, which must not be 
+//written to. Free it with ssc_msg_slab_free(), and drop references 
+//kept to its messages, before freeing the reader. Returns NULL if 
+//there is no such record or it is invalid. Further 
+//ssc_rec_log_reader_next() calls continue after it.
+SscMsgSlab *ssc_rec_log_reader_get(SscRecLogReader *reader, size_t rec_no);
+
+//Returns a view of the record after the last one returned 
+//(the first one initially), or NULL after the last record.
+SscMsgSlab *ssc_rec_log_reader_next(SscRecLogReader *reader);
+
+//Unmaps the log
+void ssc_rec_log_reader_free(SscRecLogReader *reader);
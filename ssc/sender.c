@@ -0,0 +1,827 @@
+/* sender.h
+ * Batched transmission of framed messages
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incl.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+//A shape the peer has cached
+typedef struct
+{
+	uint32_t hash;
+	size_t n_layout;
+	uint32_t *layout;
+} SscMsgSenderShape;
+
+//A queued message
+typedef struct
+{
+	//NULL if sent as a memory file
+	MmcMsg *msg;
+	//Frame header followed by layout, and the CRC trailer if any
+	char *head;
+	//Index of the message's first iovec, and just past its last one
+	size_t iov_first, iov_end;
+	//Memory file to pass along, or -1
+	int fd;
+	int fd_sent;
+} SscMsgSenderEntry;
+
+struct _SscMsgSender
+{
+	//Pending iovecs, iov[iov_start] is the next to be written
+	//and may have been partially written already
+	struct iovec *iov;
+	size_t iov_start, iov_len, iov_alloc;
+	
+	//Queued messages, in order
+	SscMsgSenderEntry *entries;
+	size_t entries_start, entries_len, entries_alloc;
+	
+	size_t pending;
+	SscMsgSenderStats stats;
+	
+	//Layout encoding, and layout to encode varints from
+	SscMsgLayoutFormat format;
+	uint32_t *scratch;
+	size_t scratch_alloc;
+	
+	//Whether frames get a CRC trailer
+	int checksum;
+	
+	//Codec for blocks, and room to gather runs of blocks
+	SscMsgCodec codec;
+	char *chunk_buf;
+	
+	//Shapes, in the slots the peer puts them in
+	int shapes_on;
+	SscMsgSenderShape shapes[SSC_MSG_SHAPE_CACHE_SIZE];
+	size_t n_defined;
+	
+	//Size from which messages go as memory files (0 if never), 
+	//and no. of their descriptors not yet passed
+	size_t memfd_threshold;
+	size_t n_fds_unsent;
+	
+	//Coalescing: limits, messages held back for the next batch frame 
+	//and when the first of them was queued, and when the last frame 
+	//of small messages was queued (-1 if never), in microseconds
+	size_t max_batch;
+	int64_t max_delay;
+	MmcMsg **batch;
+	size_t n_batch, batch_alloc;
+	int64_t batch_start, last_small;
+};
+
+SscMsgSender *ssc_msg_sender_new(void)
+{
+	SscMsgSender *sender;
+	
+	sender = mdsl_new(SscMsgSender);
+	sender->iov = NULL;
+	sender->iov_start = sender->iov_len = sender->iov_alloc = 0;
+	sender->entries = NULL;
+	sender->entries_start = sender->entries_len 
+		= sender->entries_alloc = 0;
+	sender->pending = 0;
+	sender->stats.n_bytes = sender->stats.n_syscalls 
+		= sender->stats.n_msgs = 0;
+	sender->format = SSC_MSG_LAYOUT_FIXED;
+	sender->scratch = NULL;
+	sender->scratch_alloc = 0;
+	sender->checksum = 0;
+	sender->codec = SSC_MSG_CODEC_NONE;
+	sender->chunk_buf = NULL;
+	sender->shapes_on = 0;
+	memset(sender->shapes, 0, sizeof(sender->shapes));
+	sender->n_defined = 0;
+	sender->memfd_threshold = 0;
+	sender->n_fds_unsent = 0;
+	sender->max_batch = 0;
+	sender->max_delay = 0;
+	sender->batch = NULL;
+	sender->n_batch = sender->batch_alloc = 0;
+	sender->last_small = -1;
+	
+	return sender;
+}
+
+static void ssc_msg_sender_entry_release(SscMsgSenderEntry *entry)
+{
+	if (entry->msg)
+		mmc_msg_unref(entry->msg);
+	if (entry->fd >= 0)
+		close(entry->fd);
+	free(entry->head);
+}
+
+void ssc_msg_sender_free(SscMsgSender *sender)
+{
+	size_t i;
+	
+	for (i = sender->entries_start; i < sender->entries_len; i++)
+		ssc_msg_sender_entry_release(sender->entries + i);
+	free(sender->entries);
+	free(sender->iov);
+	free(sender->scratch);
+	free(sender->chunk_buf);
+	for (i = 0; i < SSC_MSG_SHAPE_CACHE_SIZE; i++)
+		free(sender->shapes[i].layout);
+	for (i = 0; i < sender->n_batch; i++)
+		mmc_msg_unref(sender->batch[i]);
+	free(sender->batch);
+	free(sender);
+}
+
+void ssc_msg_sender_set_format
+	(SscMsgSender *sender, SscMsgLayoutFormat format)
+{
+	sender->format = format;
+}
+
+void ssc_msg_sender_set_checksum(SscMsgSender *sender, int checksum)
+{
+	sender->checksum = checksum;
+}
+
+void ssc_msg_sender_set_codec(SscMsgSender *sender, SscMsgCodec codec)
+{
+	sender->codec = codec;
+}
+
+void ssc_msg_sender_set_shapes(SscMsgSender *sender, int shapes)
+{
+	sender->shapes_on = shapes;
+}
+
+void ssc_msg_sender_set_memfd(SscMsgSender *sender, size_t threshold)
+{
+	sender->memfd_threshold = threshold;
+}
+
+void ssc_msg_sender_set_coalescing
+	(SscMsgSender *sender, size_t max_batch, uint32_t max_delay_us)
+{
+	sender->max_batch = max_batch;
+	sender->max_delay = max_delay_us;
+}
+
+//Microseconds on the monotonic clock
+static int64_t ssc_msg_sender_now_us(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+//Gives the no. of the cached shape with the given layout, or -1
+static int ssc_msg_sender_find_shape(SscMsgSender *sender, 
+	uint32_t *layout, size_t n_layout, uint32_t hash)
+{
+	int i;
+	
+	for (i = 0; i < SSC_MSG_SHAPE_CACHE_SIZE; i++)
+	{
+		SscMsgSenderShape *shape = sender->shapes + i;
+		
+		if (shape->layout && shape->hash == hash 
+			&& shape->n_layout == n_layout
+			&& memcmp(shape->layout, layout, 
+				sizeof(uint32_t) * n_layout) == 0)
+			return i;
+	}
+	
+	return -1;
+}
+
+//Puts a shape where the peer puts it, taking over layout
+static void ssc_msg_sender_add_shape(SscMsgSender *sender, 
+	uint32_t *layout, size_t n_layout, uint32_t hash)
+{
+	SscMsgSenderShape *shape;
+	
+	shape = sender->shapes + (sender->n_defined % SSC_MSG_SHAPE_CACHE_SIZE);
+	free(shape->layout);
+	shape->hash = hash;
+	shape->n_layout = n_layout;
+	shape->layout = layout;
+	sender->n_defined++;
+}
+
+//Replaces the blocks after the head with a stream of chunks 
+//appended to it, leaving room for the trailer
+static char *ssc_msg_sender_compress(SscMsgSender *sender, 
+	char *head, size_t *head_len, struct iovec *iov, size_t n_iov, 
+	size_t trailer_len)
+{
+	char *res;
+	
+	if (! sender->chunk_buf)
+	{
+		sender->chunk_buf = mdsl_tryalloc(SSC_MSG_CHUNK_SIZE);
+		if (! sender->chunk_buf)
+			return NULL;
+	}
+	
+	res = realloc(head, *head_len + ssc_msg_chunks_bound(iov, n_iov) 
+		+ trailer_len);
+	if (! res)
+		return NULL;
+	
+	*head_len += ssc_msg_chunks_encode(iov, n_iov, sender->codec, 
+		sender->chunk_buf, res + *head_len);
+	ssc_msg_frame_header_add_flags(res, SSC_MSG_FRAME_COMPRESSED);
+	
+	return res;
+}
+
+//Moves pending iovecs and entries to the start of the arrays
+static void ssc_msg_sender_compact(SscMsgSender *sender)
+{
+	size_t i;
+	
+	if (sender->iov_start > 0)
+	{
+		memmove(sender->iov, sender->iov + sender->iov_start, 
+			sizeof(struct iovec) * (sender->iov_len - sender->iov_start));
+		sender->iov_len -= sender->iov_start;
+		for (i = sender->entries_start; i < sender->entries_len; i++)
+		{
+			sender->entries[i].iov_first -= sender->iov_start;
+			sender->entries[i].iov_end -= sender->iov_start;
+		}
+		sender->iov_start = 0;
+	}
+	
+	if (sender->entries_start > 0)
+	{
+		memmove(sender->entries, sender->entries + sender->entries_start,
+			sizeof(SscMsgSenderEntry) 
+			* (sender->entries_len - sender->entries_start));
+		sender->entries_len -= sender->entries_start;
+		sender->entries_start = 0;
+	}
+}
+
+//Grows an array to hold at least n elements
+static MdslStatus ssc_msg_sender_reserve
+	(void **array, size_t *alloc, size_t n, size_t el_size)
+{
+	void *new_array;
+	size_t new_alloc;
+	
+	if (n <= *alloc)
+		return MDSL_SUCCESS;
+	
+	new_alloc = *alloc * 2;
+	if (new_alloc < n)
+		new_alloc = n;
+	new_array = realloc(*array, new_alloc * el_size);
+	if (! new_array)
+		return MDSL_FAILURE;
+	*array = new_array;
+	*alloc = new_alloc;
+	
+	return MDSL_SUCCESS;
+}
+
+//Queues a memory file frame for a message, 
+//once the arrays have room for it
+static MdslStatus ssc_msg_sender_queue_memfd
+	(SscMsgSender *sender, MmcMsg *msg, SscMsgHash *hash)
+{
+	SscMsgFlatSize size;
+	SscMsgSenderEntry *entry;
+	char *head;
+	int fd;
+	
+	head = mdsl_tryalloc(SSC_MSG_FRAME_MEMFD_SIZE);
+	if (! head)
+		return MDSL_FAILURE;
+	fd = ssc_msg_memfd_new(msg, &size);
+	if (fd < 0)
+	{
+		free(head);
+		return MDSL_FAILURE;
+	}
+	if (hash)
+		ssc_msg_hash(msg, NULL, hash);
+	ssc_msg_frame_header_store_memfd(head, size.n_layout, size.n_nodes, 
+		sizeof(uint32_t) * size.n_layout + size.n_bytes);
+	
+	//The file holds a copy, so the message is not kept
+	entry = sender->entries + sender->entries_len;
+	entry->msg = NULL;
+	entry->head = head;
+	entry->iov_first = sender->iov_len;
+	entry->fd = fd;
+	entry->fd_sent = 0;
+	sender->iov[sender->iov_len].iov_base = head;
+	sender->iov[sender->iov_len].iov_len = SSC_MSG_FRAME_MEMFD_SIZE;
+	sender->iov_len++;
+	entry->iov_end = sender->iov_len;
+	sender->entries_len++;
+	
+	sender->pending += SSC_MSG_FRAME_MEMFD_SIZE;
+	sender->n_fds_unsent++;
+	
+	return MDSL_SUCCESS;
+}
+
+//Queues a message, hashing it if hash is not NULL, 
+//with flags added to the frame header
+static MdslStatus ssc_msg_sender_queue_full(SscMsgSender *sender, 
+	MmcMsg *msg, SscMsgHash *hash, uint32_t flags)
+{
+	SscMsgFlatSize size;
+	SscMsgSenderEntry *entry;
+	size_t head_len, trailer_len;
+	char *head;
+	uint32_t *layout, *shape_copy, shape_hash = 0, crc = 0;
+	int shape_id, compress;
+	struct iovec *iov;
+	
+	ssc_msg_sender_compact(sender);
+	
+	//Flatten needs room for all layout elements as its queue, 
+	//of which only n_iov iovecs remain, plus head and trailer
+	ssc_msg_flatten(msg, 0, NULL, NULL, &size);
+	trailer_len = sender->checksum ? SSC_MSG_FRAME_TRAILER_SIZE : 0;
+	if (ssc_msg_sender_reserve((void **) &sender->iov, 
+			&sender->iov_alloc, sender->iov_len + 2 + size.n_layout, 
+			sizeof(struct iovec)) != MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	if (ssc_msg_sender_reserve((void **) &sender->entries, 
+			&sender->entries_alloc, sender->entries_len + 1, 
+			sizeof(SscMsgSenderEntry)) != MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	
+	if (sender->memfd_threshold && ! flags 
+		&& size.n_layout <= ~SSC_MSG_FRAME_FLAGS
+		&& sizeof(uint32_t) * size.n_layout + size.n_bytes 
+			>= sender->memfd_threshold)
+		return ssc_msg_sender_queue_memfd(sender, msg, hash);
+	
+	//Larger layouts collide with the header flags, and readers 
+	//reject them anyway
+	if (size.n_layout > SSC_MSG_READER_MAX_LAYOUT)
+		return MDSL_FAILURE;
+	
+	if (sender->format == SSC_MSG_LAYOUT_VARINT || sender->shapes_on)
+	{
+		//Flatten aside, the header size is known after encoding
+		//or looking up the shape
+		if (ssc_msg_sender_reserve((void **) &sender->scratch, 
+				&sender->scratch_alloc, size.n_layout, 
+				sizeof(uint32_t)) != MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		head = NULL;
+		head_len = 0;
+		layout = sender->scratch;
+	}
+	else
+	{
+		head_len = SSC_MSG_FRAME_HEADER_SIZE 
+			+ sizeof(uint32_t) * size.n_layout;
+		head = mdsl_tryalloc(head_len + trailer_len);
+		if (! head)
+			return MDSL_FAILURE;
+		ssc_msg_frame_header_store(head, size.n_layout, size.n_nodes);
+		layout = (uint32_t *) (head + SSC_MSG_FRAME_HEADER_SIZE);
+	}
+	
+	//Uncompressed blocks are checksummed as the walk queues them; 
+	//compressed ones are part of the head
+	compress = sender->codec != SSC_MSG_CODEC_NONE 
+		&& size.n_bytes >= SSC_MSG_COMPRESS_MIN;
+	iov = sender->iov + sender->iov_len;
+	if (ssc_msg_flatten_full(msg, size.n_layout, layout, iov + 1, &size, 
+			hash, sender->checksum && ! compress ? &crc : NULL)
+		!= MDSL_SUCCESS)
+	{
+		free(head);
+		return MDSL_FAILURE;
+	}
+	
+	//A shape the peer has is sent as its no., a new one is defined
+	shape_id = -1;
+	shape_copy = NULL;
+	if (sender->shapes_on && size.n_layout <= SSC_MSG_SHAPE_MAX_LAYOUT)
+	{
+		shape_hash = ssc_crc32c(0, layout, 
+			sizeof(uint32_t) * size.n_layout);
+		shape_id = ssc_msg_sender_find_shape
+			(sender, layout, size.n_layout, shape_hash);
+		if (shape_id < 0)
+		{
+			shape_copy = mdsl_tryalloc(sizeof(uint32_t) * size.n_layout);
+			if (! shape_copy)
+				return MDSL_FAILURE;
+			memcpy(shape_copy, layout, sizeof(uint32_t) * size.n_layout);
+		}
+	}
+	
+	if (shape_id >= 0)
+	{
+		head_len = SSC_MSG_FRAME_HEADER_SIZE;
+		head = mdsl_tryalloc(head_len + trailer_len);
+		if (! head)
+			return MDSL_FAILURE;
+		ssc_msg_frame_header_store_shape(head, shape_id);
+	}
+	else if (sender->format == SSC_MSG_LAYOUT_VARINT)
+	{
+		size_t n_bytes;
+		
+		n_bytes = ssc_msg_layout_to_varint(layout, size.n_layout, NULL);
+		if (! n_bytes || n_bytes > SSC_MSG_READER_MAX_LAYOUT)
+			goto fail;
+		head_len = SSC_MSG_FRAME_HEADER_SIZE + n_bytes;
+		head = mdsl_tryalloc(head_len + trailer_len);
+		if (! head)
+			goto fail;
+		ssc_msg_frame_header_store_varint(head, n_bytes);
+		ssc_msg_layout_to_varint(layout, size.n_layout, 
+			head + SSC_MSG_FRAME_HEADER_SIZE);
+	}
+	else if (! head)
+	{
+		head_len = SSC_MSG_FRAME_HEADER_SIZE 
+			+ sizeof(uint32_t) * size.n_layout;
+		head = mdsl_tryalloc(head_len + trailer_len);
+		if (! head)
+			goto fail;
+		ssc_msg_frame_header_store(head, size.n_layout, size.n_nodes);
+		memcpy(head + SSC_MSG_FRAME_HEADER_SIZE, layout, 
+			sizeof(uint32_t) * size.n_layout);
+	}
+	if (shape_copy)
+		ssc_msg_frame_header_add_flags(head, SSC_MSG_FRAME_SHAPE_DEFINE);
+	ssc_msg_frame_header_add_flags(head, flags);
+	
+	//Compressed blocks go along with the head
+	if (compress)
+	{
+		char *new_head;
+		
+		new_head = ssc_msg_sender_compress(sender, head, &head_len, 
+			iov + 1, size.n_iov, trailer_len);
+		if (! new_head)
+		{
+			free(head);
+			goto fail;
+		}
+		head = new_head;
+		size.n_iov = 0;
+		size.n_bytes = 0;
+	}
+	
+	iov[0].iov_base = head;
+	iov[0].iov_len = head_len;
+	sender->iov_len += 1 + size.n_iov;
+	
+	//The head goes before the blocks checksummed by the walk
+	if (sender->checksum)
+	{
+		ssc_msg_frame_header_add_flags(head, SSC_MSG_FRAME_CRC);
+		crc = ssc_crc32c_combine
+			(ssc_crc32c(0, head, head_len), crc, size.n_bytes);
+		ssc_uint32_store_le(head + head_len, crc);
+		
+		iov[1 + size.n_iov].iov_base = head + head_len;
+		iov[1 + size.n_iov].iov_len = trailer_len;
+		sender->iov_len++;
+	}
+	
+	entry = sender->entries + sender->entries_len;
+	mmc_msg_ref(msg);
+	entry->msg = msg;
+	entry->head = head;
+	entry->iov_first = iov - sender->iov;
+	entry->iov_end = sender->iov_len;
+	entry->fd = -1;
+	entry->fd_sent = 0;
+	sender->entries_len++;
+	
+	sender->pending += head_len + size.n_bytes + trailer_len;
+	
+	//The peer caches the shape once it reads the frame
+	if (shape_copy)
+		ssc_msg_sender_add_shape
+			(sender, shape_copy, size.n_layout, shape_hash);
+	
+	return MDSL_SUCCESS;
+	
+fail:
+	free(shape_copy);
+	return MDSL_FAILURE;
+}
+
+MdslStatus ssc_msg_sender_close_batch(SscMsgSender *sender, int force)
+{
+	MmcMsg *root;
+	MdslStatus res;
+	size_t i;
+	
+	if (! sender->n_batch)
+		return MDSL_SUCCESS;
+	if (! force && ssc_msg_sender_now_us() - sender->batch_start 
+			< sender->max_delay)
+		return MDSL_SUCCESS;
+	
+	//A lone message needs no batch
+	if (sender->n_batch == 1)
+	{
+		res = ssc_msg_sender_queue_full
+			(sender, sender->batch[0], NULL, 0);
+		if (res != MDSL_SUCCESS)
+			return res;
+		mmc_msg_unref(sender->batch[0]);
+	}
+	else
+	{
+		root = mmc_msg_try_newa(0, sender->n_batch);
+		if (! root)
+			return MDSL_FAILURE;
+		for (i = 0; i < sender->n_batch; i++)
+		{
+			mmc_msg_ref(sender->batch[i]);
+			root->submsgs[i] = sender->batch[i];
+		}
+		res = ssc_msg_sender_queue_full
+			(sender, root, NULL, SSC_MSG_FRAME_BATCH);
+		mmc_msg_unref(root);
+		if (res != MDSL_SUCCESS)
+			return res;
+		for (i = 0; i < sender->n_batch; i++)
+			mmc_msg_unref(sender->batch[i]);
+	}
+	
+	sender->n_batch = 0;
+	sender->last_small = ssc_msg_sender_now_us();
+	return MDSL_SUCCESS;
+}
+
+int64_t ssc_msg_sender_get_timeout(SscMsgSender *sender)
+{
+	int64_t res;
+	
+	if (! sender->n_batch)
+		return -1;
+	
+	res = sender->batch_start + sender->max_delay 
+		- ssc_msg_sender_now_us();
+	return res > 0 ? res : 0;
+}
+
+//Holds a small message back for the next batch frame, unless the 
+//stream has been idle, when it goes right away
+static MdslStatus ssc_msg_sender_coalesce
+	(SscMsgSender *sender, MmcMsg *msg)
+{
+	int64_t now;
+	
+	now = ssc_msg_sender_now_us();
+	if (! sender->n_batch && (sender->last_small < 0 
+			|| now - sender->last_small >= sender->max_delay))
+	{
+		if (ssc_msg_sender_queue_full(sender, msg, NULL, 0) 
+			!= MDSL_SUCCESS)
+			return MDSL_FAILURE;
+		sender->last_small = now;
+		return MDSL_SUCCESS;
+	}
+	
+	if (ssc_msg_sender_reserve((void **) &sender->batch, 
+			&sender->batch_alloc, sender->n_batch + 1, 
+			sizeof(MmcMsg *)) != MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	mmc_msg_ref(msg);
+	sender->batch[sender->n_batch] = msg;
+	sender->n_batch++;
+	if (sender->n_batch == 1)
+		sender->batch_start = now;
+	
+	if (sender->n_batch >= sender->max_batch)
+		return ssc_msg_sender_close_batch(sender, 1);
+	return MDSL_SUCCESS;
+}
+
+MdslStatus ssc_msg_sender_queue(SscMsgSender *sender, MmcMsg *msg)
+{
+	if (sender->max_batch > 1)
+	{
+		SscMsgFlatSize size;
+		
+		ssc_msg_flatten(msg, 0, NULL, NULL, &size);
+		if (sizeof(uint32_t) * size.n_layout + size.n_bytes 
+			<= SSC_MSG_COALESCE_MAX)
+			return ssc_msg_sender_coalesce(sender, msg);
+	}
+	
+	//Messages held back go first
+	if (ssc_msg_sender_close_batch(sender, 1) != MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	return ssc_msg_sender_queue_full(sender, msg, NULL, 0);
+}
+
+MdslStatus ssc_msg_sender_queue_hashed
+	(SscMsgSender *sender, MmcMsg *msg, SscMsgHash *hash)
+{
+	if (ssc_msg_sender_close_batch(sender, 1) != MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	return ssc_msg_sender_queue_full(sender, msg, hash, 0);
+}
+
+void ssc_msg_sender_get_iov
+	(SscMsgSender *sender, struct iovec **iov, size_t *n_iov)
+{
+	*iov = sender->iov + sender->iov_start;
+	*n_iov = sender->iov_len - sender->iov_start;
+	if (*n_iov > IOV_MAX)
+		*n_iov = IOV_MAX;
+}
+
+void ssc_msg_sender_get_iov_fds(SscMsgSender *sender, 
+	struct iovec **iov, size_t *n_iov, int *fds, size_t *n_fds)
+{
+	size_t i;
+	
+	ssc_msg_sender_get_iov(sender, iov, n_iov);
+	*n_fds = 0;
+	if (! sender->n_fds_unsent)
+		return;
+	
+	//The first frame needing a descriptor always gets it
+	for (i = sender->entries_start; i < sender->entries_len; i++)
+	{
+		SscMsgSenderEntry *entry = sender->entries + i;
+		
+		if (entry->iov_first >= sender->iov_start + *n_iov)
+			break;
+		if (entry->fd < 0 || entry->fd_sent)
+			continue;
+		if (*n_fds == SSC_MSG_FRAME_MAX_FDS)
+		{
+			*n_iov = entry->iov_first - sender->iov_start;
+			break;
+		}
+		fds[*n_fds] = entry->fd;
+		(*n_fds)++;
+	}
+}
+
+void ssc_msg_sender_consume_fds(SscMsgSender *sender, size_t n_fds)
+{
+	size_t i;
+	
+	for (i = sender->entries_start; n_fds > 0; i++)
+	{
+		SscMsgSenderEntry *entry = sender->entries + i;
+		
+		if (entry->fd < 0 || entry->fd_sent)
+			continue;
+		entry->fd_sent = 1;
+		sender->n_fds_unsent--;
+		n_fds--;
+	}
+}
+
+void ssc_msg_sender_consume(SscMsgSender *sender, size_t n_bytes)
+{
+	sender->stats.n_bytes += n_bytes;
+	sender->pending -= n_bytes;
+	
+	//Skip over completely written iovecs, 
+	//then trim the partially written one
+	while (n_bytes > 0 
+		&& n_bytes >= sender->iov[sender->iov_start].iov_len)
+	{
+		n_bytes -= sender->iov[sender->iov_start].iov_len;
+		sender->iov_start++;
+	}
+	if (n_bytes > 0)
+	{
+		struct iovec *part = sender->iov + sender->iov_start;
+		
+		part->iov_base = ((char *) part->iov_base) + n_bytes;
+		part->iov_len -= n_bytes;
+	}
+	
+	//Release completely written messages
+	while (sender->entries_start < sender->entries_len
+		&& sender->entries[sender->entries_start].iov_end 
+			<= sender->iov_start)
+	{
+		ssc_msg_sender_entry_release
+			(sender->entries + sender->entries_start);
+		sender->entries_start++;
+		sender->stats.n_msgs++;
+	}
+	
+	if (sender->iov_start == sender->iov_len)
+	{
+		sender->iov_start = sender->iov_len = 0;
+		sender->entries_start = sender->entries_len = 0;
+	}
+}
+
+//Writes iovecs with descriptors attached
+static ssize_t ssc_msg_sender_sendmsg(int fd, 
+	struct iovec *iov, size_t n_iov, int *fds, size_t n_fds)
+{
+	union
+	{
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * SSC_MSG_FRAME_MAX_FDS)];
+	} control;
+	struct msghdr mhdr;
+	struct cmsghdr *cmsg;
+	
+	memset(&mhdr, 0, sizeof(mhdr));
+	memset(&control, 0, sizeof(control));
+	mhdr.msg_iov = iov;
+	mhdr.msg_iovlen = n_iov;
+	mhdr.msg_control = control.buf;
+	mhdr.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+	cmsg = CMSG_FIRSTHDR(&mhdr);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+	
+	return sendmsg(fd, &mhdr, 0);
+}
+
+MdslStatus ssc_msg_sender_flush(SscMsgSender *sender, int fd)
+{
+	if (ssc_msg_sender_close_batch(sender, 0) != MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	
+	while (sender->pending > 0)
+	{
+		struct iovec *iov;
+		int fds[SSC_MSG_FRAME_MAX_FDS];
+		size_t n_iov, n_fds;
+		ssize_t res;
+		
+		ssc_msg_sender_get_iov_fds(sender, &iov, &n_iov, fds, &n_fds);
+		if (n_fds > 0)
+			res = ssc_msg_sender_sendmsg(fd, iov, n_iov, fds, n_fds);
+		else
+			res = writev(fd, iov, n_iov);
+		sender->stats.n_syscalls++;
+		if (res < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return MDSL_FAILURE;
+		}
+		
+		//Descriptors go with the first byte written
+		if (res > 0 && n_fds > 0)
+			ssc_msg_sender_consume_fds(sender, n_fds);
+		ssc_msg_sender_consume(sender, res);
+	}
+	
+	return MDSL_SUCCESS;
+}
+
+size_t ssc_msg_sender_get_pending(SscMsgSender *sender)
+{
+	return sender->pending;
+}
+
+void ssc_msg_sender_get_stats
+	(SscMsgSender *sender, SscMsgSenderStats *stats)
+{
+	*stats = sender->stats;
+}
@@ -0,0 +1,140 @@
+/* sender.h
+ * Batched transmission of framed messages
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Sends whole message trees as frames (see reader.h), gathering
+//the frame headers, layouts and memory blocks of all queued messages
+//into as few writev() calls as possible.
+typedef struct _SscMsgSender SscMsgSender;
+
+//Counters kept by the sender
+typedef struct
+{
+	//Bytes written
+	size_t n_bytes;
+	//writev() calls made, including ones that wrote nothing
+	size_t n_syscalls;
+	//Messages completely written
+	size_t n_msgs;
+} SscMsgSenderStats;
+
+//Creates a new sender with nothing queued
+SscMsgSender *ssc_msg_sender_new(void);
+
+//Frees the sender, dropping any messages not yet sent
+void ssc_msg_sender_free(SscMsgSender *sender);
+
+//Sets the encoding of layouts in messages queued from now on
+//(SSC_MSG_LAYOUT_FIXED by default)
+void ssc_msg_sender_set_format
+	(SscMsgSender *sender, SscMsgLayoutFormat format);
+
+//Sets whether messages queued from now on are followed by 
+//a CRC trailer (see reader.h), computed while queueing (off by default)
+void ssc_msg_sender_set_checksum(SscMsgSender *sender, int checksum);
+
+//Sets the codec for blocks of messages queued from now on 
+//(SSC_MSG_CODEC_NONE by default). Compressed frames (see compress.h)
+//are built in a separate buffer while queueing. Messages with fewer 
+//than SSC_MSG_COMPRESS_MIN bytes in blocks are sent as is.
+void ssc_msg_sender_set_codec(SscMsgSender *sender, SscMsgCodec codec);
+
+//Sets whether messages queued from now on use shapes cached by 
+//the peer (see reader.h) when the peer has seen their layout, 
+//sending only the shape no. instead of the layout (off by default).
+//Shapes are remembered for the life of the sender, which must be 
+//the only one writing to the stream.
+void ssc_msg_sender_set_shapes(SscMsgSender *sender, int shapes);
+
+//Sets the size (of layout and blocks) from which messages queued 
+//from now on are sent as memory files (see memfd.h), 0 for never 
+//(the default). The message is copied into the file while queueing,
+//and the descriptor passed along with the frame, so the stream must 
+//be a unix socket written with ssc_msg_sender_flush() or with 
+//the descriptors from ssc_msg_sender_get_iov_fds().
+void ssc_msg_sender_set_memfd(SscMsgSender *sender, size_t threshold);
+
+//Messages with at most this many bytes of layout and blocks 
+//are coalesced
+#define SSC_MSG_COALESCE_MAX 1024
+
+//Sets up coalescing of small messages queued from now on into batch 
+//frames (see reader.h) of at most max_batch messages; 0 or 1 turns 
+//it off (the default). A small message queued at least max_delay_us 
+//after the last frame of small messages is sent right away; 
+//otherwise it is held back until the batch is full, or for at most 
+//max_delay_us after the first message of the batch, when 
+//ssc_msg_sender_flush() queues it. Other messages are sent after 
+//the ones held back. The peer must accept batch frames.
+void ssc_msg_sender_set_coalescing
+	(SscMsgSender *sender, size_t max_batch, uint32_t max_delay_us);
+
+//Gives the no. of microseconds until messages held back are due, 
+//0 if they are due now, or -1 if none are held back. Messages held 
+//back are not counted as pending. 
+int64_t ssc_msg_sender_get_timeout(SscMsgSender *sender);
+
+//Queues messages held back as a batch frame, if they are due 
+//or if force is set. ssc_msg_sender_flush() does this first.
+MdslStatus ssc_msg_sender_close_batch(SscMsgSender *sender, int force);
+
+//Queues a message for sending. The sender takes a reference, 
+//and the message must not be modified until it is sent.
+MdslStatus ssc_msg_sender_queue(SscMsgSender *sender, MmcMsg *msg);
+
+//As ssc_msg_sender_queue(), also computing the hash of the message 
+//tree (see hash.h) while flattening it
+MdslStatus ssc_msg_sender_queue_hashed
+	(SscMsgSender *sender, MmcMsg *msg, SscMsgHash *hash);
+
+//Writes out as much of the queue as the file descriptor accepts.
+//Partial writes are continued; on a non-blocking descriptor, 
+//returns successfully when it would block, leaving the rest queued.
+//Returns MDSL_FAILURE on any other error (errno is left as set by 
+//writev()).
+MdslStatus ssc_msg_sender_flush(SscMsgSender *sender, int fd);
+
+//For writing by other means (e.g. asynchronously): gets the pending
+//iovecs, at most IOV_MAX. The first one may be partially written.
+//They stay valid until the next call to a function of the sender.
+void ssc_msg_sender_get_iov
+	(SscMsgSender *sender, struct iovec **iov, size_t *n_iov);
+
+//As ssc_msg_sender_get_iov(), also giving the descriptors to pass 
+//along with the iovecs as SCM_RIGHTS (at most SSC_MSG_FRAME_MAX_FDS, 
+//fds must have room for that many). The iovecs end before any frame 
+//whose descriptor is not among them. Once anything is written, 
+//call ssc_msg_sender_consume_fds() before ssc_msg_sender_consume().
+void ssc_msg_sender_get_iov_fds(SscMsgSender *sender, 
+	struct iovec **iov, size_t *n_iov, int *fds, size_t *n_fds);
+
+//Marks the first n_fds descriptors given by 
+//ssc_msg_sender_get_iov_fds() as passed
+void ssc_msg_sender_consume_fds(SscMsgSender *sender, size_t n_fds);
+
+//Marks n_bytes from the start of the pending iovecs as written,
+//releasing messages that are completely written.
+void ssc_msg_sender_consume(SscMsgSender *sender, size_t n_bytes);
+
+//Returns the no. of bytes queued and not yet written
+size_t ssc_msg_sender_get_pending(SscMsgSender *sender);
+
+//Gets the counters
+void ssc_msg_sender_get_stats
+	(SscMsgSender *sender, SscMsgSenderStats *stats);
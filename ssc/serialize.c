@@ -21,152 +21,208 @@
 
 #include "incl.h"
 
+//Serialization primitives, also available header-only
+#include "primitives.h"
 
-void ssc_msg_iter_init(SscMsgIter *self, MmcMsg *msg)
+
+//String pool
+#define SSC_STR_POOL_PTR_CACHE_LEN 64
+#define SSC_STR_POOL_INIT_LEN 64
+
+//A distinct string written to the message
+typedef struct
 {
-	self->bytes = msg->mem;
-	self->bytes_lim = self->bytes + msg->mem_len;
-	self->submsgs = msg->submsgs;
-	self->submsgs_lim = self->submsgs + msg->submsgs_len;
-}
+	uint32_t hash;
+	//Submessage holding the string
+	MmcMsg *submsg;
+	//Back-reference to the string, created on its first repetition
+	MmcMsg *ref;
+	//Index of the submessage the string was first written at
+	uint32_t index;
+} SscStrPoolEntry;
+
+struct _SscStrPool
+{
+	//Distinct strings in the order they were written
+	SscStrPoolEntry *entries;
+	size_t len, entries_alloc_len;
+	
+	//Open addressing hash table indexed by string contents,
+	//holding 1 + index in entries, or 0 for empty slots
+	uint32_t *table;
+	size_t alloc_len;
+	
+	//Direct mapped cache indexed by string pointer,
+	//so that a repeated pointer does not need strlen() or hashing
+	struct
+	{
+		const char *str;
+		uint32_t entry;
+	} ptr_cache[SSC_STR_POOL_PTR_CACHE_LEN];
+};
 
-MdslStatus ssc_msg_iter_get_segment
-	(SscMsgIter *self, size_t n_bytes, size_t n_submsgs, 
-	 SscSegment *res)
+SscStrPool *ssc_str_pool_new(void)
 {
-	if (self->bytes + n_bytes > self->bytes_lim
-		|| self->submsgs + n_submsgs > self->submsgs_lim)
-		return MDSL_FAILURE;
+	SscStrPool *pool;
 	
-	res->bytes = self->bytes;
-	res->submsgs = self->submsgs;
-	self->bytes += n_bytes;
-	self->submsgs += n_submsgs;
+	pool = mdsl_new(SscStrPool);
+	pool->entries_alloc_len = SSC_STR_POOL_INIT_LEN / 2;
+	pool->entries = mdsl_alloc
+		(sizeof(SscStrPoolEntry) * pool->entries_alloc_len);
+	pool->len = 0;
+	pool->alloc_len = SSC_STR_POOL_INIT_LEN;
+	pool->table = mdsl_alloc(sizeof(uint32_t) * pool->alloc_len);
+	memset(pool->table, 0, sizeof(uint32_t) * pool->alloc_len);
+	memset(pool->ptr_cache, 0, sizeof(pool->ptr_cache));
 	
-	return MDSL_SUCCESS;
+	return pool;
 }
 
-//Floating point values
-void ssc_segment_write_flt32(SscSegment *seg, SscValFlt val)
+void ssc_str_pool_reset(SscStrPool *pool)
 {
-	uint32_t inter;
+	size_t i;
 	
-	switch (val.type)
+	if (pool->len)
 	{
-	case SSC_FLT_ZERO:
-	case SSC_FLT_NORMAL:
-		inter = ssc_double_to_flt32(val.val);
-		break;
-	case SSC_FLT_NAN:
-		inter = ssc_flt32_nan;
-		break;
-	case SSC_FLT_INFINITE:
-		inter = ssc_flt32_infinity;
-		break;
-	case SSC_FLT_NEG_INFINITE:
-		inter = ssc_flt32_neg_infinity;
-	default:
-		ssc_error("Invalid type %d", val.type);
+		for (i = 0; i < pool->len; i++)
+		{
+			mmc_msg_unref(pool->entries[i].submsg);
+			if (pool->entries[i].ref)
+				mmc_msg_unref(pool->entries[i].ref);
+		}
+		pool->len = 0;
+		memset(pool->table, 0, sizeof(uint32_t) * pool->alloc_len);
+		memset(pool->ptr_cache, 0, sizeof(pool->ptr_cache));
 	}
-	
-	ssc_segment_write_uint32(seg, inter);
 }
 
-void ssc_segment_read_flt32(SscSegment *seg, SscValFlt *val)
+void ssc_str_pool_free(SscStrPool *pool)
 {
-	uint32_t inter = ssc_segment_read_uint32(seg);
-	val->type = ssc_flt32_classify(inter);
-	val->val = ssc_double_from_flt32(inter);
+	ssc_str_pool_reset(pool);
+	free(pool->entries);
+	free(pool->table);
+	free(pool);
 }
 
-void ssc_segment_write_flt64(SscSegment *seg, SscValFlt val)
+//FNV-1a
+static uint32_t ssc_str_hash(const char *str, size_t len)
 {
-	uint64_t inter;
+	uint32_t hash = 2166136261u;
+	size_t i;
 	
-	switch (val.type)
+	for (i = 0; i < len; i++)
 	{
-	case SSC_FLT_ZERO:
-	case SSC_FLT_NORMAL:
-		inter = ssc_double_to_flt64(val.val);
-		break;
-	case SSC_FLT_NAN:
-		inter = ssc_flt64_nan;
-		break;
-	case SSC_FLT_INFINITE:
-		inter = ssc_flt64_infinity;
-		break;
-	case SSC_FLT_NEG_INFINITE:
-		inter = ssc_flt64_neg_infinity;
-	default:
-		ssc_error("Invalid type %d", val.type);
+		hash ^= (uint8_t) str[i];
+		hash *= 16777619u;
 	}
 	
-	ssc_segment_write_uint64(seg, inter);
+	return hash;
 }
 
-void ssc_segment_read_flt64(SscSegment *seg, SscValFlt *val)
+static void ssc_str_pool_grow(SscStrPool *pool)
 {
-	uint64_t inter = ssc_segment_read_uint64(seg);
-	val->type = ssc_flt64_classify(inter);
-	val->val = ssc_double_from_flt64(inter);
+	SscStrPoolEntry *old = pool->entries;
+	size_t i, j, mask;
+	
+	pool->entries_alloc_len *= 2;
+	pool->entries = mdsl_alloc
+		(sizeof(SscStrPoolEntry) * pool->entries_alloc_len);
+	memcpy(pool->entries, old, sizeof(SscStrPoolEntry) * pool->len);
+	free(old);
+	
+	pool->alloc_len *= 2;
+	mask = pool->alloc_len - 1;
+	free(pool->table);
+	pool->table = mdsl_alloc(sizeof(uint32_t) * pool->alloc_len);
+	memset(pool->table, 0, sizeof(uint32_t) * pool->alloc_len);
+	
+	for (i = 0; i < pool->len; i++)
+	{
+		for (j = pool->entries[i].hash & mask; pool->table[j]; 
+				j = (j + 1) & mask)
+			;
+		pool->table[j] = i + 1;
+	}
 }
 
-//Strings
-void ssc_segment_write_string(SscSegment *seg, char *val)
+MmcMsg *ssc_str_pool_intern
+	(SscStrPool *pool, const char *val, size_t index)
 {
+	size_t len, i, mask, cache_idx;
+	uint32_t hash;
+	SscStrPoolEntry *entry;
 	MmcMsg *submsg;
-	size_t len;
 	
-	//Copy string into submessage
+	//Same pointer as before?
+	cache_idx = (((uintptr_t) val) >> 3) % SSC_STR_POOL_PTR_CACHE_LEN;
+	if (pool->ptr_cache[cache_idx].str == val)
+	{
+		entry = pool->entries + pool->ptr_cache[cache_idx].entry;
+		goto repeated;
+	}
+	
+	//Same contents as before?
 	len = strlen(val);
+	hash = ssc_str_hash(val, len);
+	mask = pool->alloc_len - 1;
+	for (i = hash & mask; pool->table[i]; i = (i + 1) & mask)
+	{
+		entry = pool->entries + pool->table[i] - 1;
+		
+		if (entry->hash == hash && entry->submsg->mem_len == len 
+			&& memcmp(entry->submsg->mem, val, len) == 0)
+		{
+			pool->ptr_cache[cache_idx].str = val;
+			pool->ptr_cache[cache_idx].entry = entry - pool->entries;
+			goto repeated;
+		}
+	}
+	
+	//New string, copy it into submessage
 	submsg = mmc_msg_newa(len, 0);
 	memcpy(submsg->mem, val, len);
-		
-	//Add to segment
-	*seg->submsgs = submsg;
-	seg->submsgs++;
-}
-
-char *ssc_segment_read_string(SscSegment *seg)
-{
-	MmcMsg *submsg;
-	int len, i;
-	char *check, *res;
-	
-	//Fetch it
-	submsg = *seg->submsgs;
-	len = submsg->mem_len;
-	
-	//get string and verify
-	if (submsg->submsgs_len > 0)
-		return NULL;
-	check = (char *) submsg->mem;
-	for (i = 0; i < len; i++)	
-		if (check[i] == '\0')
-			return NULL;
-	res = mdsl_tryalloc(len + 1);
-	memcpy(res, check, len);
-	res[len] = '\0';
-	
-	//Increment
-	seg->submsgs++;
 	
-	return res;
-}
-
-void ssc_segment_write_msg(SscSegment *seg, MmcMsg *msg)
-{
-	*seg->submsgs = msg;
-	mmc_msg_ref(msg);
-	seg->submsgs++;
-}
-
-MmcMsg *ssc_segment_read_msg(SscSegment *seg)
-{
-	MmcMsg *res = *seg->submsgs;
-	mmc_msg_ref(res);
-	seg->submsgs++;
-	return res;
+	//Only strings at indices back-references can hold are remembered
+	if (index > UINT32_MAX)
+		return submsg;
+	
+	if ((pool->len + 1) * 2 > pool->alloc_len)
+	{
+		ssc_str_pool_grow(pool);
+		mask = pool->alloc_len - 1;
+		for (i = hash & mask; pool->table[i]; i = (i + 1) & mask)
+			;
+	}
+	
+	entry = pool->entries + pool->len;
+	entry->hash = hash;
+	entry->submsg = submsg;
+	entry->ref = NULL;
+	entry->index = index;
+	pool->table[i] = pool->len + 1;
+	pool->ptr_cache[cache_idx].str = val;
+	pool->ptr_cache[cache_idx].entry = pool->len;
+	pool->len++;
+	
+	mmc_msg_ref(submsg);
+	return submsg;
+	
+repeated:
+	//Short strings are cheaper to send again than to refer to
+	if (entry->submsg->mem_len <= SSC_STR_REF_SIZE)
+	{
+		mmc_msg_ref(entry->submsg);
+		return entry->submsg;
+	}
+	
+	if (! entry->ref)
+	{
+		entry->ref = mmc_msg_newa(SSC_STR_REF_SIZE, 0);
+		((char *) entry->ref->mem)[0] = '\0';
+		ssc_uint32_store_le(((char *) entry->ref->mem) + 1, entry->index);
+	}
+	mmc_msg_ref(entry->ref);
+	return entry->ref;
 }
 
 uint16_t ssc_get_fn_idx(MmcMsg *msg)
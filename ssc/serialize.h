@@ -19,6 +19,59 @@
  */
 
 
+//Compiler hints used by generated code
+#ifdef __GNUC__
+///Marks a condition that is expected to be true.
+#define SSC_LIKELY(x) __builtin_expect(!!(x), 1)
+///Marks a condition that is expected to be false, e.g. a failure check.
+#define SSC_UNLIKELY(x) __builtin_expect(!!(x), 0)
+///Marks a function that is rarely called, e.g. error cleanup, 
+///so that it is kept out of the hot path.
+#define SSC_COLD __attribute__((cold, noinline))
+#else
+#define SSC_LIKELY(x) (x)
+#define SSC_UNLIKELY(x) (x)
+#define SSC_COLD
+#endif
+
+///Marks an intentional fallthrough to the next case label.
+#if defined(__has_attribute)
+#if __has_attribute(fallthrough)
+#define SSC_FALLTHROUGH __attribute__((fallthrough))
+#endif
+#endif
+#ifndef SSC_FALLTHROUGH
+#define SSC_FALLTHROUGH do {} while (0)
+#endif
+
+#if defined(__cplusplus)
+#ifdef __GNUC__
+#define SSC_RESTRICT __restrict__
+#else
+#define SSC_RESTRICT
+#endif
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+///Marks a pointer that does not alias other pointer arguments.
+#define SSC_RESTRICT restrict
+#else
+#define SSC_RESTRICT
+#endif
+
+/**Linkage of the serialization primitives (segment reads and writes). 
+ * They are compiled into libssc. If SSC_HEADER_ONLY is defined before 
+ * including <ssc/ssc.h>, they are instead defined static inline 
+ * in the header, so that the compiler can inline them into 
+ * generated code (see sidc --inline). SSC_PRIMITIVES_INLINE is then 
+ * defined too, so that headers generated with sidc --inline can 
+ * detect <ssc/ssc.h> having been included without SSC_HEADER_ONLY.
+ */
+#ifdef SSC_HEADER_ONLY
+#define SSC_PRIMITIVE static inline
+#define SSC_PRIMITIVES_INLINE
+#else
+#define SSC_PRIMITIVE
+#endif
+
 /**
  * \addtogroup ssc_msg_iter
  * \{
@@ -54,6 +107,19 @@ typedef struct
 #define ssc_dlen_zero(self) \
 	(self)->n_bytes = (self)->n_submsgs = 0
 
+/**A table of strings written to a message so far, used to serialize 
+ * each distinct string only once. A repeated string is written as 
+ * a back-reference to its first occurrence.
+ */
+typedef struct _SscStrPool SscStrPool;
+
+/**Size of a string back-reference: a zero byte (which cannot occur 
+ * in a string) followed by the uint32 index of the submessage 
+ * holding the string, counted from the first submessage of the 
+ * message. Only earlier submessages can be referred to.
+ */
+#define SSC_STR_REF_SIZE 5
+
 /**A structure to iterate over message. This can be used in
  * [de]serialization. 
  */
@@ -68,6 +134,11 @@ typedef struct
 	///A pointer that points just after the last element in array of 
 	///submessages
 	MmcMsg **submsgs_lim;
+	///First element of array of submessages, 
+	///what string back-references count from
+	MmcMsg **submsgs_first;
+	///String pool used while writing, or NULL
+	SscStrPool *str_pool;
 } SscMsgIter;
 
 /**A segment popped off an iterator
@@ -78,13 +149,41 @@ typedef struct
 	char *bytes;
 	///Current position in block stream
 	MmcMsg **submsgs;
+	///First element of array of submessages of the message
+	MmcMsg **submsgs_first;
+	///String pool used while writing, or NULL
+	SscStrPool *str_pool;
 } SscSegment;
 
 /**Initializes the iterator to the start of the given message.
  * \param self The iterator
  * \param msg The message whose contents to iterate
  */
-void ssc_msg_iter_init(SscMsgIter *self, MmcMsg *msg);
+SSC_PRIMITIVE void ssc_msg_iter_init(SscMsgIter *self, MmcMsg *msg);
+
+/**Initializes the iterator over caller-provided storage instead of 
+ * a message. Serializers can then write to a stack or static buffer 
+ * without allocating a message.
+ * \param self The iterator
+ * \param mem Memory block to iterate over
+ * \param mem_len Size of the memory block in bytes
+ * \param submsgs Array of submessages to iterate over
+ * \param submsgs_len No. of elements in the array of submessages
+ */
+SSC_PRIMITIVE void ssc_msg_iter_init_mem
+	(SscMsgIter *self, void *mem, size_t mem_len,
+	 MmcMsg **submsgs, size_t submsgs_len);
+
+/**Makes all segments subsequently taken from the iterator
+ * write strings through the given string pool.
+ * \param self The iterator
+ * \param pool The string pool, or NULL to write every string separately
+ */
+static inline void ssc_msg_iter_set_str_pool
+	(SscMsgIter *self, SscStrPool *pool)
+{
+	self->str_pool = pool;
+}
 
 /**Gets a segment from a iterator, advancing its position forward. 
  * \param self The iterator
@@ -93,10 +192,30 @@ void ssc_msg_iter_init(SscMsgIter *self, MmcMsg *msg);
  * \param res Pointer to the resulting segment struct
  * \return an MdslStatus to state whether the operation was successful.
  */
-MdslStatus ssc_msg_iter_get_segment
+SSC_PRIMITIVE MdslStatus ssc_msg_iter_get_segment
 	(SscMsgIter *self, size_t n_bytes, size_t n_submsgs, 
 	 SscSegment *res);
 
+/**Gets a segment from a iterator like ssc_msg_iter_get_segment(),
+ * but without bounds checking. Serializers use it to write into 
+ * a message whose size has already been computed.
+ * \param self The iterator
+ * \param n_bytes The number of bytes to take from the byte stream
+ * \param n_submsgs The number of submsgs to take from the block stream
+ * \param res Pointer to the resulting segment struct
+ */
+static inline void ssc_msg_iter_take_segment
+	(SscMsgIter *self, size_t n_bytes, size_t n_submsgs, 
+	 SscSegment *res)
+{
+	res->bytes = self->bytes;
+	res->submsgs = self->submsgs;
+	res->submsgs_first = self->submsgs_first;
+	res->str_pool = self->str_pool;
+	self->bytes += n_bytes;
+	self->submsgs += n_submsgs;
+}
+
 /**Determines whether the iterator is at the end.*/
 static inline int ssc_msg_iter_at_end(SscMsgIter *self)
 {
@@ -324,50 +443,90 @@ typedef struct
  * \param seg Pointer to the segment
  * \param val The value to store
  */
-void ssc_segment_write_flt32(SscSegment *seg, SscValFlt val);
+SSC_PRIMITIVE void ssc_segment_write_flt32(SscSegment *seg, SscValFlt val);
 
 /**Retrives a floating point value from current segment position
  * in IEEE 754 32-bit format and increments the position accordingly. 
  * \param seg Pointer to the segment
  * \param val  Pointer indicating where to store the value
  */
-void ssc_segment_read_flt32(SscSegment *seg, SscValFlt *val);
+SSC_PRIMITIVE void ssc_segment_read_flt32(SscSegment *seg, SscValFlt *val);
 
 /**Stores the given floating point value at current segment position 
  * in IEEE 754 64-bit format and increments the position accordingly.
  * \param seg Pointer to the segment
  * \param val The value to store
  */
-void ssc_segment_write_flt64(SscSegment *seg, SscValFlt val);
+SSC_PRIMITIVE void ssc_segment_write_flt64(SscSegment *seg, SscValFlt val);
 
 /**Retrives a floating point value from current segment position
  * in IEEE 754 64-bit format and increments the position accordingly. 
  * \param seg Pointer to the segment
  * \param val  Pointer indicating where to store the value
  */
-void ssc_segment_read_flt64(SscSegment *seg, SscValFlt *val);
+SSC_PRIMITIVE void ssc_segment_read_flt64(SscSegment *seg, SscValFlt *val);
+
+/**Creates a new string pool.
+ * 
+ * A string pool can be passed to generated *__serialize_pooled() 
+ * functions so that a string that occurs many times in a message 
+ * (the same pointer or identical text) is copied and sent only once. 
+ * Later occurrences longer than SSC_STR_REF_SIZE become 
+ * back-references, which all share one submessage; shorter ones share
+ * the submessage of the string itself. The pool is emptied after 
+ * each message, so it can be reused for the next one without 
+ * further allocations.
+ * \return A new string pool. Free it using ssc_str_pool_free().
+ */
+SscStrPool *ssc_str_pool_new(void);
+
+/**Drops all strings from the pool.
+ * \param pool The string pool
+ */
+void ssc_str_pool_reset(SscStrPool *pool);
+
+/**Frees the string pool.
+ * \param pool The string pool
+ */
+void ssc_str_pool_free(SscStrPool *pool);
+
+/**Returns the submessage to write for the given string: the string
+ * itself, adding it to the pool if it is not there yet, or 
+ * a back-reference to it. Used by ssc_segment_write_string().
+ * \param pool The string pool
+ * \param val The null-terminated string
+ * \param index Index of the submessage being written, 
+ *              counted from the first submessage of the message
+ * \return The submessage, with a new reference
+ */
+MmcMsg *ssc_str_pool_intern
+	(SscStrPool *pool, const char *val, size_t index);
 
 /**Adds a null-terminated string to the current segment position 
  * and increments the segment accordingly.
+ * 
+ * If the segment has a string pool, a string already written to 
+ * the message is reused instead of being copied again.
  * \param seg Pointer to the segment.
  * \param val The null-terminated string to add
  */
-void ssc_segment_write_string(SscSegment *seg, char *val);
+SSC_PRIMITIVE void ssc_segment_write_string(SscSegment *seg, char *val);
 
 /**Retrieves a null-terminated string from the current segment position 
- * and increments the segment accordingly.
+ * and increments the segment accordingly. A back-reference is 
+ * resolved to a copy of the earlier string it refers to.
  * \param seg Pointer to the segment.
  * \return The string just read off or NULL if operation failed. 
  *         Use free() to free it. 
  */
-char *ssc_segment_read_string(SscSegment *seg);
+SSC_PRIMITIVE char *ssc_segment_read_string(SscSegment *seg);
 
 /**Adds a message to the current segment position and increments 
  * the segment appropriately.
  * \param seg Pointer to the segment.
  * \param msg The message to add
  */
-void ssc_segment_write_msg(SscSegment *seg, MmcMsg *msg);
+SSC_PRIMITIVE void ssc_segment_write_msg(SscSegment *seg, MmcMsg *msg);
 
 /**Retrives a message off the segment and increments its position 
  * accordingly.
@@ -375,7 +534,7 @@ void ssc_segment_write_msg(SscSegment *seg, MmcMsg *msg);
  * \param msg A reference to the message. When done, drop reference
  *            using mmc_msg_unref().
  */
-MmcMsg *ssc_segment_read_msg(SscSegment *seg);
+SSC_PRIMITIVE MmcMsg *ssc_segment_read_msg(SscSegment *seg);
 
 
 #define SSC_FN_IDX_INVALID (0xFFFF)
@@ -386,6 +545,11 @@ MmcMsg *ssc_segment_read_msg(SscSegment *seg);
  */
 uint16_t ssc_get_fn_idx(MmcMsg *msg);
 
+//Header-only primitives
+#ifdef SSC_HEADER_ONLY
+#include "primitives.h"
+#endif
+
 
 
 ///\}
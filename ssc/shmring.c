@@ -0,0 +1,420 @@
+/* shmring.h
+ * Shared memory ring buffer transport
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "incl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define SSC_SHM_RING_MAGIC 0x52435353
+#define SSC_SHM_RING_HEADER_SIZE 4096
+#define SSC_SHM_RING_MIN_CAPACITY 4096
+#define SSC_SHM_RING_MAX_CAPACITY (((size_t) 1) << 30)
+
+//Records are 8 byte aligned, starting with a header
+#define SSC_SHM_RING_RECORD_HEADER 8
+#define SSC_SHM_RING_ALIGN(n) (((n) + 7) & (~((uint64_t) 7)))
+
+//Record header flag: padding up to the end of the ring
+#define SSC_SHM_RING_PAD (((uint32_t) 1) << 31)
+
+//Spins before yielding while waiting on other senders
+#define SSC_SHM_RING_SPINS 1024
+
+//Start of the shared memory. Positions count bytes ever written
+//and never wrap; each is on its own cache line.
+typedef struct
+{
+	uint32_t magic;
+	uint32_t pad0;
+	uint64_t capacity;
+	char pad1[48];
+	
+	//End of space reserved by senders
+	uint64_t reserve;
+	char pad2[56];
+	
+	//End of records completely written; 
+	//senders commit in the order they reserved
+	uint64_t commit;
+	char pad3[56];
+	
+	//End of records released by the receiver
+	uint64_t head;
+	char pad4[56];
+	
+	//Futex, incremented on every commit, 
+	//and no. of receivers sleeping on it
+	uint32_t seq;
+	uint32_t waiters;
+} SscShmRingShared;
+
+struct _SscShmRing
+{
+	int fd;
+	void *mem;
+	size_t mem_len;
+	SscShmRingShared *shared;
+	char *data;
+	uint64_t mask;
+	
+	SscShmRingWait wait;
+	
+	//Scratch iovecs for flattening
+	struct iovec *iov;
+	size_t iov_alloc;
+	
+	//End of the record held by the receiver
+	uint64_t recv_end;
+	int recv_held;
+};
+
+static SscShmRing *ssc_shm_ring_map(int fd, size_t mem_len)
+{
+	SscShmRing *ring;
+	void *mem;
+	
+	mem = mmap(NULL, mem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED)
+		return NULL;
+	
+	ring = mdsl_new(SscShmRing);
+	ring->fd = fd;
+	ring->mem = mem;
+	ring->mem_len = mem_len;
+	ring->shared = (SscShmRingShared *) mem;
+	ring->data = ((char *) mem) + SSC_SHM_RING_HEADER_SIZE;
+	ring->mask = mem_len - SSC_SHM_RING_HEADER_SIZE - 1;
+	ring->wait = SSC_SHM_RING_FUTEX;
+	ring->iov = NULL;
+	ring->iov_alloc = 0;
+	ring->recv_held = 0;
+	
+	return ring;
+}
+
+SscShmRing *ssc_shm_ring_new(size_t capacity)
+{
+	SscShmRing *ring;
+	size_t real_capacity;
+	int fd;
+	
+	if (capacity > SSC_SHM_RING_MAX_CAPACITY)
+		return NULL;
+	real_capacity = SSC_SHM_RING_MIN_CAPACITY;
+	while (real_capacity < capacity)
+		real_capacity *= 2;
+	
+	fd = memfd_create("ssc-shm-ring", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, SSC_SHM_RING_HEADER_SIZE + real_capacity) < 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	//The file is zero-filled, only the fixed fields need setting
+	ring = ssc_shm_ring_map(fd, SSC_SHM_RING_HEADER_SIZE + real_capacity);
+	if (! ring)
+	{
+		close(fd);
+		return NULL;
+	}
+	ring->shared->capacity = real_capacity;
+	__atomic_store_n(&ring->shared->magic, SSC_SHM_RING_MAGIC, 
+		__ATOMIC_RELEASE);
+	
+	return ring;
+}
+
+SscShmRing *ssc_shm_ring_open(int fd)
+{
+	SscShmRing *ring;
+	struct stat st;
+	uint64_t capacity;
+	int own_fd;
+	
+	if (fstat(fd, &st) < 0 || st.st_size <= SSC_SHM_RING_HEADER_SIZE)
+		return NULL;
+	capacity = st.st_size - SSC_SHM_RING_HEADER_SIZE;
+	if (capacity < SSC_SHM_RING_MIN_CAPACITY 
+		|| capacity > SSC_SHM_RING_MAX_CAPACITY
+		|| (capacity & (capacity - 1)) != 0)
+		return NULL;
+	
+	own_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (own_fd < 0)
+		return NULL;
+	ring = ssc_shm_ring_map(own_fd, st.st_size);
+	if (! ring)
+	{
+		close(own_fd);
+		return NULL;
+	}
+	
+	if (__atomic_load_n(&ring->shared->magic, __ATOMIC_ACQUIRE) 
+			!= SSC_SHM_RING_MAGIC
+		|| ring->shared->capacity != capacity)
+	{
+		ssc_shm_ring_free(ring);
+		return NULL;
+	}
+	
+	return ring;
+}
+
+int ssc_shm_ring_get_fd(SscShmRing *ring)
+{
+	return ring->fd;
+}
+
+void ssc_shm_ring_set_wait(SscShmRing *ring, SscShmRingWait wait)
+{
+	ring->wait = wait;
+}
+
+//Writes a record header
+static void ssc_shm_ring_set_header
+	(SscShmRing *ring, uint64_t pos, uint32_t val)
+{
+	ssc_uint32_store_le(ring->data + (pos & ring->mask), val);
+}
+
+MdslStatus ssc_shm_ring_send(SscShmRing *ring, MmcMsg *msg)
+{
+	SscShmRingShared *shared = ring->shared;
+	SscMsgFlatSize size;
+	uint64_t capacity, payload, need, pad, pos, head, end;
+	char *rec;
+	size_t i;
+	int spins;
+	
+	capacity = ring->mask + 1;
+	ssc_msg_flatten(msg, 0, NULL, NULL, &size);
+	payload = sizeof(uint32_t) * size.n_layout + size.n_bytes;
+	need = SSC_SHM_RING_RECORD_HEADER + SSC_SHM_RING_ALIGN(payload);
+	if (need > capacity)
+		return MDSL_FAILURE;
+	
+	//Flatten needs room for all layout elements as its queue
+	if (ring->iov_alloc < size.n_layout)
+	{
+		free(ring->iov);
+		ring->iov_alloc = size.n_layout;
+		ring->iov = mdsl_tryalloc(sizeof(struct iovec) * ring->iov_alloc);
+		if (! ring->iov)
+		{
+			ring->iov_alloc = 0;
+			return MDSL_FAILURE;
+		}
+	}
+	
+	//Reserve space; a record never wraps around, 
+	//the end of the ring is padded instead
+	pos = __atomic_load_n(&shared->reserve, __ATOMIC_RELAXED);
+	do
+	{
+		uint64_t off = pos & ring->mask;
+		
+		pad = off + need > capacity ? capacity - off : 0;
+		end = pos + pad + need;
+		head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+		if (end - head > capacity)
+			return MDSL_FAILURE;
+	} while (! __atomic_compare_exchange_n(&shared->reserve, &pos, end, 
+			1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+	
+	//Write the record
+	if (pad)
+		ssc_shm_ring_set_header(ring, pos, 
+			SSC_SHM_RING_PAD | (pad - SSC_SHM_RING_RECORD_HEADER));
+	ssc_shm_ring_set_header(ring, pos + pad, payload);
+	rec = ring->data + ((pos + pad) & ring->mask) 
+		+ SSC_SHM_RING_RECORD_HEADER;
+	ssc_msg_flatten(msg, size.n_layout, (uint32_t *) rec, ring->iov, NULL);
+	rec += sizeof(uint32_t) * size.n_layout;
+	for (i = 0; i < size.n_iov; i++)
+	{
+		memcpy(rec, ring->iov[i].iov_base, ring->iov[i].iov_len);
+		rec += ring->iov[i].iov_len;
+	}
+	
+	//Commit after senders that reserved earlier
+	for (spins = 0; 
+		__atomic_load_n(&shared->commit, __ATOMIC_ACQUIRE) != pos; 
+		spins++)
+	{
+		if (spins >= SSC_SHM_RING_SPINS)
+			sched_yield();
+	}
+	__atomic_store_n(&shared->commit, end, __ATOMIC_RELEASE);
+	
+	//Wake the receiver if sleeping
+	__atomic_add_fetch(&shared->seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&shared->waiters, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &shared->seq, FUTEX_WAKE, INT_MAX, 
+			NULL, NULL, 0);
+	
+	return MDSL_SUCCESS;
+}
+
+//Milliseconds on the monotonic clock
+static int64_t ssc_shm_ring_now_ms(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t) ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+//Waits until a record is committed past pos, 
+//returning 0 on timeout
+static int ssc_shm_ring_wait(SscShmRing *ring, uint64_t pos, 
+	int64_t deadline)
+{
+	SscShmRingShared *shared = ring->shared;
+	unsigned int spins = 0;
+	
+	while (__atomic_load_n(&shared->commit, __ATOMIC_ACQUIRE) == pos)
+	{
+		int64_t now;
+		
+		if (ring->wait == SSC_SHM_RING_BUSY_POLL)
+		{
+			//Let the sender run if it shares the CPU
+			spins++;
+			if ((spins % SSC_SHM_RING_SPINS) != 0)
+				continue;
+			sched_yield();
+			if (deadline >= 0 && ssc_shm_ring_now_ms() >= deadline)
+				return 0;
+		}
+		else
+		{
+			struct timespec ts, *tsp = NULL;
+			uint32_t seq;
+			
+			if (deadline >= 0)
+			{
+				now = ssc_shm_ring_now_ms();
+				if (now >= deadline)
+					return 0;
+				ts.tv_sec = (deadline - now) / 1000;
+				ts.tv_nsec = ((deadline - now) % 1000) * 1000000L;
+				tsp = &ts;
+			}
+			
+			//Senders bump seq after committing, so sleeping only
+			//while it is unchanged cannot miss a commit
+			__atomic_add_fetch(&shared->waiters, 1, __ATOMIC_SEQ_CST);
+			seq = __atomic_load_n(&shared->seq, __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&shared->commit, __ATOMIC_SEQ_CST) == pos)
+				syscall(SYS_futex, &shared->seq, FUTEX_WAIT, seq, 
+					tsp, NULL, 0);
+			__atomic_sub_fetch(&shared->waiters, 1, __ATOMIC_SEQ_CST);
+		}
+	}
+	
+	return 1;
+}
+
+SscMsgSlab *ssc_shm_ring_recv(SscShmRing *ring, int timeout_ms)
+{
+	SscShmRingShared *shared = ring->shared;
+	int64_t deadline = -1;
+	uint64_t head;
+	
+	ssc_assert(! ring->recv_held, 
+		"ssc_shm_ring_done() must be called before receiving again");
+	
+	if (timeout_ms >= 0)
+		deadline = ssc_shm_ring_now_ms() + timeout_ms;
+	
+	head = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+	while (1)
+	{
+		SscMsgSlab *slab;
+		uint32_t header;
+		uint64_t end, commit;
+		char *rec;
+		
+		if (! ssc_shm_ring_wait(ring, head, deadline))
+			return NULL;
+		
+		rec = ring->data + (head & ring->mask);
+		header = ssc_uint32_load_le(rec);
+		end = head + SSC_SHM_RING_RECORD_HEADER 
+			+ SSC_SHM_RING_ALIGN(header & (~SSC_SHM_RING_PAD));
+		
+		//A record reaching past what is committed is garbage,
+		//and so is everything after it
+		commit = __atomic_load_n(&shared->commit, __ATOMIC_ACQUIRE);
+		if (end > commit || end < head)
+		{
+			__atomic_store_n(&shared->head, commit, __ATOMIC_RELEASE);
+			return NULL;
+		}
+		
+		if (header & SSC_SHM_RING_PAD)
+		{
+			head = end;
+			__atomic_store_n(&shared->head, head, __ATOMIC_RELEASE);
+			continue;
+		}
+		
+		slab = ssc_msg_slab_new(rec + SSC_SHM_RING_RECORD_HEADER, header);
+		if (! slab)
+		{
+			__atomic_store_n(&shared->head, end, __ATOMIC_RELEASE);
+			return NULL;
+		}
+		
+		ring->recv_end = end;
+		ring->recv_held = 1;
+		return slab;
+	}
+}
+
+void ssc_shm_ring_done(SscShmRing *ring, SscMsgSlab *slab)
+{
+	ssc_msg_slab_free(slab);
+	__atomic_store_n(&ring->shared->head, ring->recv_end, 
+		__ATOMIC_RELEASE);
+	ring->recv_held = 0;
+}
+
+void ssc_shm_ring_free(SscShmRing *ring)
+{
+	munmap(ring->mem, ring->mem_len);
+	close(ring->fd);
+	free(ring->iov);
+	free(ring);
+}
@@ -0,0 +1,74 @@
+/* shmring.h
+ * Shared memory ring buffer transport
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Ring buffer in a memfd shared between processes on the same host.
+//Senders flatten messages directly into the ring, and the receiver 
+//gets the message tree as a view over the ring memory (an SscMsgSlab),
+//so nothing passes through the kernel. 
+//
+//Any number of handles may send concurrently (records are committed
+//in order of reservation); only one handle may receive.
+//A handle must only be used by one thread at a time.
+typedef struct _SscShmRing SscShmRing;
+
+//How the receiver waits for messages
+typedef enum
+{
+	//Sleep on a futex, senders wake the receiver
+	SSC_SHM_RING_FUTEX = 0,
+	//Spin, for lowest latency at the cost of a busy CPU
+	SSC_SHM_RING_BUSY_POLL = 1
+} SscShmRingWait;
+
+//Creates a new ring with room for at least capacity bytes of records
+//(rounded up to a power of 2). Returns NULL on failure.
+SscShmRing *ssc_shm_ring_new(size_t capacity);
+
+//Opens a ring created by another handle, given its file descriptor
+//(e.g. received over a unix socket or inherited). The descriptor 
+//is duplicated, and may be closed afterwards. 
+//Returns NULL if it does not hold a ring.
+SscShmRing *ssc_shm_ring_open(int fd);
+
+//Returns the file descriptor of the ring, to share it with 
+//other processes. It stays owned by the handle.
+int ssc_shm_ring_get_fd(SscShmRing *ring);
+
+//Sets how ssc_shm_ring_recv() waits
+void ssc_shm_ring_set_wait(SscShmRing *ring, SscShmRingWait wait);
+
+//Copies the message tree into the ring. Does not wait: fails if 
+//the ring does not have room for it now (or ever).
+MdslStatus ssc_shm_ring_send(SscShmRing *ring, MmcMsg *msg);
+
+//Waits for at most timeout_ms milliseconds (indefinitely if negative)
+//for a message, and returns a view of it in the ring. 
+//Returns NULL on timeout, or if the record is invalid 
+//(it is then dropped). The messages point into the ring, as with 
+//ssc_msg_slab_new(); pass the slab to ssc_shm_ring_done() 
+//before receiving the next one, once none of them is in use.
+SscMsgSlab *ssc_shm_ring_recv(SscShmRing *ring, int timeout_ms);
+
+//Frees the slab returned by ssc_shm_ring_recv(), 
+//giving its space in the ring back to senders
+void ssc_shm_ring_done(SscShmRing *ring, SscMsgSlab *slab);
+
+//Unmaps the ring and closes the handle's descriptor
+void ssc_shm_ring_free(SscShmRing *ring);
@@ -0,0 +1,229 @@
+/* stream.c
+ * Chunked transfer of stream fields
+ *
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ *
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incl.h"
+
+static uint64_t ssc_stream_last_id = 0;
+
+uint64_t ssc_stream_new_id(void)
+{
+	return __atomic_add_fetch(&ssc_stream_last_id, 1, __ATOMIC_RELAXED);
+}
+
+uint64_t ssc_stream_chunk_get_id(MmcMsg *msg)
+{
+	//The stream no. is the chunk structure's first field
+	if (msg->mem_len < 8)
+		return 0;
+	return ssc_uint64_load_le(msg->mem);
+}
+
+//Sending
+
+void ssc_stream_writer_init(SscStreamWriter *writer, uint64_t id,
+	size_t el_size, size_t max_len, SscStreamCreateChunkFn create_chunk,
+	SscStreamSendFn send, void *send_data)
+{
+	ssc_assert(max_len > 0, "Chunks should hold some elements");
+	
+	writer->id = id;
+	writer->index = 0;
+	writer->el_size = el_size;
+	writer->max_len = max_len;
+	writer->create_chunk = create_chunk;
+	writer->send = send;
+	writer->send_data = send_data;
+	
+	writer->buf = (char *) mdsl_alloc(el_size * max_len);
+	writer->len = 0;
+	writer->finished = 0;
+}
+
+static MdslStatus ssc_stream_writer_send_chunk
+	(SscStreamWriter *writer, void *elems, size_t n, int last)
+{
+	MmcMsg *chunk;
+	MdslStatus res;
+	
+	chunk = writer->create_chunk(writer->id, writer->index, elems, n, last);
+	if (! chunk)
+		return MDSL_FAILURE;
+	
+	res = writer->send(writer->send_data, chunk);
+	mmc_msg_unref(chunk);
+	
+	writer->index++;
+	return res;
+}
+
+MdslStatus ssc_stream_writer_put
+	(SscStreamWriter *writer, const void *elems, size_t n)
+{
+	const char *iter = (const char *) elems;
+	
+	if (writer->finished)
+		return MDSL_FAILURE;
+	
+	while (n > 0)
+	{
+		size_t take;
+		
+		//Full chunks straight from the caller's elements
+		if (writer->len == 0 && n >= writer->max_len)
+		{
+			if (ssc_stream_writer_send_chunk
+					(writer, (void *) iter, writer->max_len, 0)
+				!= MDSL_SUCCESS)
+				return MDSL_FAILURE;
+			
+			iter += writer->el_size * writer->max_len;
+			n -= writer->max_len;
+			continue;
+		}
+		
+		take = writer->max_len - writer->len;
+		if (take > n)
+			take = n;
+		memcpy(writer->buf + writer->el_size * writer->len,
+			iter, writer->el_size * take);
+		writer->len += take;
+		iter += writer->el_size * take;
+		n -= take;
+		
+		if (writer->len == writer->max_len)
+		{
+			writer->len = 0;
+			if (ssc_stream_writer_send_chunk
+					(writer, writer->buf, writer->max_len, 0)
+				!= MDSL_SUCCESS)
+				return MDSL_FAILURE;
+		}
+	}
+	
+	return MDSL_SUCCESS;
+}
+
+MdslStatus ssc_stream_writer_finish(SscStreamWriter *writer)
+{
+	size_t len = writer->len;
+	
+	if (writer->finished)
+		return MDSL_FAILURE;
+	
+	writer->finished = 1;
+	writer->len = 0;
+	return ssc_stream_writer_send_chunk(writer, writer->buf, len, 1);
+}
+
+void ssc_stream_writer_clear(SscStreamWriter *writer)
+{
+	free(writer->buf);
+	writer->buf = NULL;
+	writer->len = 0;
+	writer->finished = 1;
+}
+
+MdslStatus ssc_stream_send_to_sender(void *send_data, MmcMsg *chunk)
+{
+	return ssc_msg_sender_queue((SscMsgSender *) send_data, chunk);
+}
+
+//Receiving
+
+void ssc_stream_reader_init(SscStreamReader *reader, uint64_t id,
+	size_t el_size, size_t chunk_size, SscStreamReadChunkFn read_chunk,
+	SscStreamFreeChunkFn free_chunk)
+{
+	reader->id = id;
+	reader->index = 0;
+	reader->el_size = el_size;
+	reader->read_chunk = read_chunk;
+	reader->free_chunk = free_chunk;
+	
+	//Room for the current chunk and the one being read,
+	//so that a bad chunk leaves the current one alone
+	reader->mem = mdsl_alloc(chunk_size * 2);
+	reader->chunk = reader->mem;
+	reader->spare = (char *) reader->mem + chunk_size;
+	reader->has_chunk = 0;
+	reader->elems = NULL;
+	reader->len = reader->pos = 0;
+	reader->finished = 0;
+}
+
+MdslStatus ssc_stream_reader_feed(SscStreamReader *reader, MmcMsg *msg)
+{
+	uint64_t id, index;
+	void *elems, *tmp;
+	size_t n;
+	int last;
+	
+	if (reader->finished)
+		return MDSL_FAILURE;
+	
+	if (reader->read_chunk(msg, reader->spare, &id, &index, &elems, &n, &last)
+		!= MDSL_SUCCESS)
+		return MDSL_FAILURE;
+	if (id != reader->id || index != reader->index)
+	{
+		reader->free_chunk(reader->spare);
+		return MDSL_FAILURE;
+	}
+	
+	if (reader->has_chunk)
+		reader->free_chunk(reader->chunk);
+	tmp = reader->chunk;
+	reader->chunk = reader->spare;
+	reader->spare = tmp;
+	reader->has_chunk = 1;
+	
+	reader->elems = (char *) elems;
+	reader->len = n;
+	reader->pos = 0;
+	reader->index++;
+	reader->finished = last;
+	
+	return MDSL_SUCCESS;
+}
+
+void *ssc_stream_reader_next(SscStreamReader *reader)
+{
+	if (reader->pos == reader->len)
+		return NULL;
+	
+	return reader->elems + reader->el_size * (reader->pos++);
+}
+
+int ssc_stream_reader_is_finished(SscStreamReader *reader)
+{
+	return reader->finished;
+}
+
+void ssc_stream_reader_clear(SscStreamReader *reader)
+{
+	if (reader->has_chunk)
+		reader->free_chunk(reader->chunk);
+	
+	free(reader->mem);
+	reader->chunk = reader->spare = reader->mem = NULL;
+	reader->has_chunk = 0;
+	reader->elems = NULL;
+	reader->len = reader->pos = 0;
+}
@@ -0,0 +1,141 @@
+/* stream.h
+ * Chunked transfer of stream fields
+ *
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ *
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//A field declared as stream(N) T name, in a structure or an argument
+//list, holds a stream no. (uint64_t) instead of the elements. The
+//elements are sent apart as chunk messages of up to N elements, each
+//carrying the stream no. and its index in the stream, the last one
+//marked. sidc generates the chunk structure <Owner>__name__Chunk and
+//typed helpers around SscStreamWriter and SscStreamReader:
+//
+//  <Owner>__name__open(value, writer, send, send_data)
+//      gives value->name a new stream no. and sets up writer
+//  <Owner>__name__put(writer, elems, n)
+//  <Owner>__name__accept(value, reader)
+//      sets up reader for the stream no. in value->name
+//  <Owner>__name__next(reader)
+//
+//The sender produces elements as it goes, sending each chunk as soon
+//as it is full, and the receiver consumes a chunk at a time as they
+//arrive, so neither holds more than a chunk of the stream at once.
+//Chunks travel beside the message holding the stream no., e.g. after
+//it on the same SscMsgSender; ssc_stream_chunk_get_id() tells which
+//stream a chunk belongs to when several are interleaved.
+
+//Gets a new stream no., unique within the process and never 0
+uint64_t ssc_stream_new_id(void);
+
+//Gets the stream no. of a chunk message without decoding it,
+//0 if the message cannot be a chunk
+uint64_t ssc_stream_chunk_get_id(MmcMsg *msg);
+
+//Sending
+
+//Sends a chunk message, taking its own reference if it keeps it
+typedef MdslStatus (*SscStreamSendFn)(void *send_data, MmcMsg *chunk);
+
+//Serializes a chunk of n elements (generated by sidc)
+typedef MmcMsg *(*SscStreamCreateChunkFn)
+	(uint64_t id, uint64_t index, void *elems, size_t n, int last);
+
+typedef struct
+{
+	uint64_t id, index;
+	size_t el_size, max_len;
+	SscStreamCreateChunkFn create_chunk;
+	SscStreamSendFn send;
+	void *send_data;
+
+	//Elements of the chunk being filled
+	char *buf;
+	size_t len;
+	int finished;
+} SscStreamWriter;
+
+//Sets up a writer for max_len elements of el_size bytes per chunk.
+//Called by the generated <Owner>__name__open().
+void ssc_stream_writer_init(SscStreamWriter *writer, uint64_t id,
+	size_t el_size, size_t max_len, SscStreamCreateChunkFn create_chunk,
+	SscStreamSendFn send, void *send_data);
+
+//Adds n elements, copied as by memcpy(), sending each chunk that
+//fills up. Whatever the elements point to (strings, structures) has
+//to stay valid until their chunk is sent, at the latest by
+//ssc_stream_writer_finish(). Fails if the stream was finished, or a
+//chunk could not be created or sent; the stream is broken then.
+MdslStatus ssc_stream_writer_put
+	(SscStreamWriter *writer, const void *elems, size_t n);
+
+//Sends the remaining elements as the last chunk, which may be empty
+MdslStatus ssc_stream_writer_finish(SscStreamWriter *writer);
+
+//Frees the writer's storage, dropping elements not sent
+void ssc_stream_writer_clear(SscStreamWriter *writer);
+
+//SscStreamSendFn queueing chunks on the SscMsgSender send_data
+MdslStatus ssc_stream_send_to_sender(void *send_data, MmcMsg *chunk);
+
+//Receiving
+
+//Deserializes a chunk into the chunk structure at chunk and gets
+//its contents (generated by sidc)
+typedef MdslStatus (*SscStreamReadChunkFn)(MmcMsg *msg, void *chunk,
+	uint64_t *id, uint64_t *index, void **elems, size_t *n, int *last);
+
+//Frees a chunk structure filled by SscStreamReadChunkFn
+typedef void (*SscStreamFreeChunkFn)(void *chunk);
+
+typedef struct
+{
+	uint64_t id, index;
+	size_t el_size;
+	SscStreamReadChunkFn read_chunk;
+	SscStreamFreeChunkFn free_chunk;
+
+	//Chunk being read, whose elements from pos on are still to be got,
+	//and room to deserialize the next one into
+	void *chunk, *spare, *mem;
+	int has_chunk;
+	char *elems;
+	size_t len, pos;
+	int finished;
+} SscStreamReader;
+
+//Sets up a reader for elements of el_size bytes, keeping chunks
+//in chunk_size bytes. Called by the generated <Owner>__name__accept().
+void ssc_stream_reader_init(SscStreamReader *reader, uint64_t id,
+	size_t el_size, size_t chunk_size, SscStreamReadChunkFn read_chunk,
+	SscStreamFreeChunkFn free_chunk);
+
+//Takes the next chunk of the stream, freeing the previous one along
+//with the elements got from it. Fails, leaving the reader as it was,
+//if msg is not a valid chunk of the stream, or not the next one,
+//or the last chunk was already taken.
+MdslStatus ssc_stream_reader_feed(SscStreamReader *reader, MmcMsg *msg);
+
+//Gets the next element of the current chunk,
+//NULL once all of them were got
+void *ssc_stream_reader_next(SscStreamReader *reader);
+
+//Returns whether the last chunk of the stream was taken
+int ssc_stream_reader_is_finished(SscStreamReader *reader);
+
+//Frees the current chunk and the reader's storage
+void ssc_stream_reader_clear(SscStreamReader *reader);
@@ -0,0 +1,549 @@
+/* table.c
+ * Table-driven serialization interpreter
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incl.h"
+
+//Serialized size of each field type, excluding structures
+static const SscDLen ssc_table_wire_sizes[] =
+{
+	{0, 0},
+	{1, 0}, {2, 0}, {4, 0}, {8, 0},
+	{1, 0}, {2, 0}, {4, 0}, {8, 0},
+	{4, 0}, {8, 0},
+	{0, 1}, {0, 1}
+};
+
+//Size in memory of each field type, excluding structures
+static const size_t ssc_table_mem_sizes[] =
+{
+	0,
+	sizeof(uint8_t), sizeof(uint16_t), sizeof(uint32_t), sizeof(uint64_t),
+	sizeof(int8_t), sizeof(int16_t), sizeof(int32_t), sizeof(int64_t),
+	sizeof(SscValFlt), sizeof(SscValFlt),
+	sizeof(char *), sizeof(MmcMsg *)
+};
+
+//Layout of a sequence field, same for every element type
+typedef struct
+{
+	void *data;
+	uint32_t len;
+} SscTableSeq;
+
+#define ssc_table_field_ptr(value, field) \
+	((void *) (((char *) (value)) + (field)->offset))
+
+static inline SscDLen ssc_table_elem_wire_size(const SscFieldDesc *field)
+{
+	if (field->type == SSC_FIELD_STRUCT)
+		return field->desc->base_size;
+	return ssc_table_wire_sizes[field->type];
+}
+
+static inline size_t ssc_table_elem_mem_size(const SscFieldDesc *field)
+{
+	if (field->type == SSC_FIELD_STRUCT)
+		return field->desc->size;
+	return ssc_table_mem_sizes[field->type];
+}
+
+//Tells whether the element needs ssc_table_count()
+static inline int ssc_table_elem_is_dynamic(const SscFieldDesc *field)
+{
+	return field->type == SSC_FIELD_STRUCT && ! field->desc->constsize;
+}
+
+//Tells whether the element needs to be freed
+static inline int ssc_table_elem_requires_free(const SscFieldDesc *field)
+{
+	return field->type >= SSC_FIELD_STRING;
+}
+
+//Tells whether an optional field is stored as the value itself
+//rather than a pointer to it
+static inline int ssc_table_optional_is_baseless
+	(const SscFieldDesc *field)
+{
+	return field->type == SSC_FIELD_STRING || field->type == SSC_FIELD_MSG;
+}
+
+//Adds dynamic size of n elements
+static void ssc_table_count_elems
+	(const SscFieldDesc *field, const char *elems, size_t n, 
+	 SscDLen *size)
+{
+	size_t i, stride;
+	SscDLen onesize;
+	
+	stride = field->desc->size;
+	for (i = 0; i < n; i++)
+	{
+		onesize = ssc_table_count(field->desc, elems + i * stride);
+		size->n_bytes += onesize.n_bytes;
+		size->n_submsgs += onesize.n_submsgs;
+	}
+}
+
+SscDLen ssc_table_count(const SscStructDesc *desc, const void *value)
+{
+	SscDLen size = {0, 0};
+	uint32_t i;
+	
+	for (i = 0; i < desc->n_fields; i++)
+	{
+		const SscFieldDesc *field = desc->fields + i;
+		void *ptr = ssc_table_field_ptr(value, field);
+		
+		if (field->complexity == SSC_FIELD_SEQ)
+		{
+			SscTableSeq *seq = (SscTableSeq *) ptr;
+			SscDLen base = ssc_table_elem_wire_size(field);
+			
+			size.n_bytes += base.n_bytes * seq->len;
+			size.n_submsgs += base.n_submsgs * seq->len;
+			if (ssc_table_elem_is_dynamic(field))
+				ssc_table_count_elems(field, seq->data, seq->len, &size);
+		}
+		else if (field->complexity == SSC_FIELD_OPTIONAL)
+		{
+			void *opt = *(void **) ptr;
+			SscDLen base;
+			
+			if (! opt)
+				continue;
+			base = ssc_table_elem_wire_size(field);
+			size.n_bytes += base.n_bytes;
+			size.n_submsgs += base.n_submsgs;
+			if (ssc_table_elem_is_dynamic(field))
+				ssc_table_count_elems(field, opt, 1, &size);
+		}
+		else if (ssc_table_elem_is_dynamic(field))
+		{
+			ssc_table_count_elems(field, ptr, 
+				field->complexity > 0 ? field->complexity : 1, &size);
+		}
+	}
+	
+	return size;
+}
+
+//Writes n elements
+static void ssc_table_write_elems
+	(const SscFieldDesc *field, const char *elems, size_t n,
+	 SscSegment *seg, SscMsgIter *msg_iter)
+{
+	size_t i;
+	
+	switch (field->type)
+	{
+	case SSC_FIELD_UINT8:
+	case SSC_FIELD_INT8:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_uint8(seg, ((uint8_t *) elems)[i]);
+		break;
+	case SSC_FIELD_UINT16:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_uint16(seg, ((uint16_t *) elems)[i]);
+		break;
+	case SSC_FIELD_INT16:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_int16(seg, ((int16_t *) elems)[i]);
+		break;
+	case SSC_FIELD_UINT32:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_uint32(seg, ((uint32_t *) elems)[i]);
+		break;
+	case SSC_FIELD_INT32:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_int32(seg, ((int32_t *) elems)[i]);
+		break;
+	case SSC_FIELD_UINT64:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_uint64(seg, ((uint64_t *) elems)[i]);
+		break;
+	case SSC_FIELD_INT64:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_int64(seg, ((int64_t *) elems)[i]);
+		break;
+	case SSC_FIELD_FLT32:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_flt32(seg, ((SscValFlt *) elems)[i]);
+		break;
+	case SSC_FIELD_FLT64:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_flt64(seg, ((SscValFlt *) elems)[i]);
+		break;
+	case SSC_FIELD_STRING:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_string(seg, ((char **) elems)[i]);
+		break;
+	case SSC_FIELD_MSG:
+		for (i = 0; i < n; i++)
+			ssc_segment_write_msg(seg, ((MmcMsg **) elems)[i]);
+		break;
+	case SSC_FIELD_STRUCT:
+		for (i = 0; i < n; i++)
+			ssc_table_write(field->desc, elems + i * field->desc->size,
+				seg, msg_iter);
+		break;
+	}
+}
+
+int ssc_table_check_bounds(const SscStructDesc *desc, const void *value)
+{
+	uint32_t i;
+	
+	for (i = 0; i < desc->n_fields; i++)
+	{
+		const SscFieldDesc *field = desc->fields + i;
+		void *ptr = ssc_table_field_ptr(value, field);
+		const char *elems = ptr;
+		size_t j, n = 1;
+		
+		if (field->complexity == SSC_FIELD_SEQ)
+		{
+			SscTableSeq *seq = (SscTableSeq *) ptr;
+			
+			if (SSC_UNLIKELY(field->bound && seq->len > field->bound))
+				return 0;
+			elems = seq->data;
+			n = seq->len;
+		}
+		else if (field->complexity == SSC_FIELD_OPTIONAL)
+		{
+			elems = *(void **) ptr;
+			if (! elems)
+				continue;
+		}
+		else if (field->complexity > 0)
+		{
+			n = field->complexity;
+		}
+		
+		if (field->type != SSC_FIELD_STRUCT)
+			continue;
+		for (j = 0; j < n; j++)
+		{
+			if (! ssc_table_check_bounds
+					(field->desc, elems + j * field->desc->size))
+				return 0;
+		}
+	}
+	
+	return 1;
+}
+
+void ssc_table_write(const SscStructDesc *desc, const void *value,
+	SscSegment *seg, SscMsgIter *msg_iter)
+{
+	uint32_t i;
+	
+	for (i = 0; i < desc->n_fields; i++)
+	{
+		const SscFieldDesc *field = desc->fields + i;
+		void *ptr = ssc_table_field_ptr(value, field);
+		
+		if (field->complexity == SSC_FIELD_SEQ)
+		{
+			SscTableSeq *seq = (SscTableSeq *) ptr;
+			SscDLen base = ssc_table_elem_wire_size(field);
+			SscSegment sub_seg;
+			
+			ssc_segment_write_uint32(seg, seq->len);
+			ssc_msg_iter_take_segment(msg_iter, 
+				base.n_bytes * seq->len, base.n_submsgs * seq->len,
+				&sub_seg);
+			ssc_table_write_elems(field, seq->data, seq->len, 
+				&sub_seg, msg_iter);
+		}
+		else if (field->complexity == SSC_FIELD_OPTIONAL)
+		{
+			void *opt = *(void **) ptr;
+			SscDLen base;
+			SscSegment sub_seg;
+			
+			if (! opt)
+			{
+				ssc_segment_write_uint8(seg, 0);
+				continue;
+			}
+			
+			ssc_segment_write_uint8(seg, 1);
+			base = ssc_table_elem_wire_size(field);
+			ssc_msg_iter_take_segment(msg_iter, 
+				base.n_bytes, base.n_submsgs, &sub_seg);
+			ssc_table_write_elems(field, 
+				ssc_table_optional_is_baseless(field) ? ptr : opt, 1, 
+				&sub_seg, msg_iter);
+		}
+		else
+		{
+			ssc_table_write_elems(field, ptr, 
+				field->complexity > 0 ? field->complexity : 1, 
+				seg, msg_iter);
+		}
+	}
+}
+
+//Frees n elements
+static void ssc_table_free_elems
+	(const SscFieldDesc *field, char *elems, size_t n)
+{
+	size_t i;
+	
+	switch (field->type)
+	{
+	case SSC_FIELD_STRING:
+		for (i = 0; i < n; i++)
+			free(((char **) elems)[i]);
+		break;
+	case SSC_FIELD_MSG:
+		for (i = 0; i < n; i++)
+			mmc_msg_unref(((MmcMsg **) elems)[i]);
+		break;
+	case SSC_FIELD_STRUCT:
+		for (i = 0; i < n; i++)
+			ssc_table_free(field->desc, elems + i * field->desc->size);
+		break;
+	}
+}
+
+//Frees a field
+static void ssc_table_free_field(const SscFieldDesc *field, void *ptr)
+{
+	if (field->complexity == SSC_FIELD_SEQ)
+	{
+		SscTableSeq *seq = (SscTableSeq *) ptr;
+		
+		if (ssc_table_elem_requires_free(field))
+			ssc_table_free_elems(field, seq->data, seq->len);
+		free(seq->data);
+	}
+	else if (field->complexity == SSC_FIELD_OPTIONAL)
+	{
+		void *opt = *(void **) ptr;
+		
+		if (! opt)
+			return;
+		if (ssc_table_optional_is_baseless(field))
+		{
+			ssc_table_free_elems(field, ptr, 1);
+		}
+		else
+		{
+			if (ssc_table_elem_requires_free(field))
+				ssc_table_free_elems(field, opt, 1);
+			free(opt);
+		}
+	}
+	else if (ssc_table_elem_requires_free(field))
+	{
+		ssc_table_free_elems(field, ptr, 
+			field->complexity > 0 ? field->complexity : 1);
+	}
+}
+
+void ssc_table_free(const SscStructDesc *desc, void *value)
+{
+	uint32_t i;
+	
+	for (i = 0; i < desc->n_fields; i++)
+		ssc_table_free_field(desc->fields + i, 
+			ssc_table_field_ptr(value, desc->fields + i));
+}
+
+//Reads n elements. On failure, elements already read are freed.
+static MdslStatus ssc_table_read_elems
+	(const SscFieldDesc *field, char *elems, size_t n,
+	 SscSegment *seg, SscMsgIter *msg_iter)
+{
+	size_t i;
+	
+	switch (field->type)
+	{
+	case SSC_FIELD_UINT8:
+	case SSC_FIELD_INT8:
+		for (i = 0; i < n; i++)
+			((uint8_t *) elems)[i] = ssc_segment_read_uint8(seg);
+		break;
+	case SSC_FIELD_UINT16:
+		for (i = 0; i < n; i++)
+			((uint16_t *) elems)[i] = ssc_segment_read_uint16(seg);
+		break;
+	case SSC_FIELD_INT16:
+		for (i = 0; i < n; i++)
+			((int16_t *) elems)[i] = ssc_segment_read_int16(seg);
+		break;
+	case SSC_FIELD_UINT32:
+		for (i = 0; i < n; i++)
+			((uint32_t *) elems)[i] = ssc_segment_read_uint32(seg);
+		break;
+	case SSC_FIELD_INT32:
+		for (i = 0; i < n; i++)
+			((int32_t *) elems)[i] = ssc_segment_read_int32(seg);
+		break;
+	case SSC_FIELD_UINT64:
+		for (i = 0; i < n; i++)
+			((uint64_t *) elems)[i] = ssc_segment_read_uint64(seg);
+		break;
+	case SSC_FIELD_INT64:
+		for (i = 0; i < n; i++)
+			((int64_t *) elems)[i] = ssc_segment_read_int64(seg);
+		break;
+	case SSC_FIELD_FLT32:
+		for (i = 0; i < n; i++)
+			ssc_segment_read_flt32(seg, ((SscValFlt *) elems) + i);
+		break;
+	case SSC_FIELD_FLT64:
+		for (i = 0; i < n; i++)
+			ssc_segment_read_flt64(seg, ((SscValFlt *) elems) + i);
+		break;
+	case SSC_FIELD_STRING:
+		for (i = 0; i < n; i++)
+		{
+			if (SSC_UNLIKELY(! (((char **) elems)[i] 
+					= ssc_segment_read_string(seg))))
+			{
+				ssc_table_free_elems(field, elems, i);
+				return MDSL_FAILURE;
+			}
+		}
+		break;
+	case SSC_FIELD_MSG:
+		for (i = 0; i < n; i++)
+			((MmcMsg **) elems)[i] = ssc_segment_read_msg(seg);
+		break;
+	case SSC_FIELD_STRUCT:
+		for (i = 0; i < n; i++)
+		{
+			if (SSC_UNLIKELY(ssc_table_read(field->desc, 
+					elems + i * field->desc->size, seg, msg_iter)
+				!= MDSL_SUCCESS))
+			{
+				ssc_table_free_elems(field, elems, i);
+				return MDSL_FAILURE;
+			}
+		}
+		break;
+	}
+	
+	return MDSL_SUCCESS;
+}
+
+//Reads a field. On failure, nothing is left allocated.
+static MdslStatus ssc_table_read_field
+	(const SscFieldDesc *field, void *ptr, 
+	 SscSegment *seg, SscMsgIter *msg_iter)
+{
+	if (field->complexity == SSC_FIELD_SEQ)
+	{
+		SscTableSeq *seq = (SscTableSeq *) ptr;
+		SscDLen base = ssc_table_elem_wire_size(field);
+		SscSegment sub_seg;
+		
+		seq->len = ssc_segment_read_uint32(seg);
+		if (SSC_UNLIKELY(field->bound && seq->len > field->bound))
+			return MDSL_FAILURE;
+		if (SSC_UNLIKELY(ssc_msg_iter_get_segment(msg_iter, 
+				base.n_bytes * seq->len, base.n_submsgs * seq->len, 
+				&sub_seg) == MDSL_FAILURE))
+			return MDSL_FAILURE;
+		if (seq->len == 0)
+		{
+			seq->data = NULL;
+			return MDSL_SUCCESS;
+		}
+		
+		seq->data = mdsl_tryalloc(ssc_table_elem_mem_size(field) * seq->len);
+		if (SSC_UNLIKELY(! seq->data))
+			return MDSL_FAILURE;
+		if (SSC_UNLIKELY(ssc_table_read_elems(field, seq->data, seq->len,
+				&sub_seg, msg_iter) != MDSL_SUCCESS))
+		{
+			free(seq->data);
+			return MDSL_FAILURE;
+		}
+	}
+	else if (field->complexity == SSC_FIELD_OPTIONAL)
+	{
+		SscDLen base;
+		SscSegment sub_seg;
+		void *opt;
+		
+		if (! ssc_segment_read_uint8(seg))
+		{
+			*(void **) ptr = NULL;
+			return MDSL_SUCCESS;
+		}
+		
+		base = ssc_table_elem_wire_size(field);
+		if (SSC_UNLIKELY(ssc_msg_iter_get_segment(msg_iter, 
+				base.n_bytes, base.n_submsgs, &sub_seg) == MDSL_FAILURE))
+			return MDSL_FAILURE;
+		
+		if (ssc_table_optional_is_baseless(field))
+			return ssc_table_read_elems(field, ptr, 1, &sub_seg, msg_iter);
+		
+		opt = mdsl_tryalloc(ssc_table_elem_mem_size(field));
+		if (SSC_UNLIKELY(! opt))
+			return MDSL_FAILURE;
+		if (SSC_UNLIKELY(ssc_table_read_elems(field, opt, 1, 
+				&sub_seg, msg_iter) != MDSL_SUCCESS))
+		{
+			free(opt);
+			return MDSL_FAILURE;
+		}
+		*(void **) ptr = opt;
+	}
+	else
+	{
+		return ssc_table_read_elems(field, ptr, 
+			field->complexity > 0 ? field->complexity : 1, 
+			seg, msg_iter);
+	}
+	
+	return MDSL_SUCCESS;
+}
+
+MdslStatus ssc_table_read(const SscStructDesc *desc, void *value,
+	SscSegment *seg, SscMsgIter *msg_iter)
+{
+	uint32_t i;
+	
+	for (i = 0; i < desc->n_fields; i++)
+	{
+		if (SSC_UNLIKELY(ssc_table_read_field(desc->fields + i, 
+				ssc_table_field_ptr(value, desc->fields + i), 
+				seg, msg_iter) != MDSL_SUCCESS))
+			goto fail;
+	}
+	
+	return MDSL_SUCCESS;
+	
+fail:
+	//Free the fields read before the failing one
+	while (i > 0)
+	{
+		i--;
+		ssc_table_free_field(desc->fields + i, 
+			ssc_table_field_ptr(value, desc->fields + i));
+	}
+	return MDSL_FAILURE;
+}
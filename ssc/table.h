@@ -0,0 +1,135 @@
+/* table.h
+ * Table-driven serialization
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \addtogroup ssc_table
+ * \{
+ *
+ * Instead of unrolled code for every structure, sidc --table emits
+ * a compact descriptor table for each structure, and the generated
+ * __count, __write, __read and __free functions call the generic
+ * interpreter below. The wire format is the same in both modes.
+ *
+ * This trades some speed for much smaller code when there are
+ * many types.
+ */
+
+///Type of a field, numbered as in sidc
+typedef enum
+{
+	SSC_FIELD_UINT8 = 1,
+	SSC_FIELD_UINT16 = 2,
+	SSC_FIELD_UINT32 = 3,
+	SSC_FIELD_UINT64 = 4,
+	SSC_FIELD_INT8 = 5,
+	SSC_FIELD_INT16 = 6,
+	SSC_FIELD_INT32 = 7,
+	SSC_FIELD_INT64 = 8,
+	SSC_FIELD_FLT32 = 9,
+	SSC_FIELD_FLT64 = 10,
+	SSC_FIELD_STRING = 11,
+	SSC_FIELD_MSG = 12,
+	///User-defined structure, described by SscFieldDesc::desc
+	SSC_FIELD_STRUCT = 13
+} SscFieldType;
+
+///Field is a single value
+#define SSC_FIELD_PLAIN 0
+///Field is a sequence, struct {T *data; uint32_t len;}
+#define SSC_FIELD_SEQ (-1)
+///Field is optional, a pointer (or the value itself for strings
+///and messages) that is NULL when absent
+#define SSC_FIELD_OPTIONAL (-2)
+
+typedef struct _SscStructDesc SscStructDesc;
+
+///Describes one field of a structure
+typedef struct
+{
+	///Type of the field (SscFieldType)
+	uint8_t type;
+	///SSC_FIELD_PLAIN, SSC_FIELD_SEQ, SSC_FIELD_OPTIONAL,
+	///or the length for arrays
+	int32_t complexity;
+	///Maximum length for sequences, 0 if unbounded
+	uint32_t bound;
+	///Offset of the field in the structure
+	uint32_t offset;
+	///Descriptor of the structure for SSC_FIELD_STRUCT, otherwise NULL
+	const SscStructDesc *desc;
+} SscFieldDesc;
+
+///Describes a structure
+struct _SscStructDesc
+{
+	///sizeof() the structure
+	uint32_t size;
+	///Nonzero if the serialized size does not depend on the value
+	uint32_t constsize;
+	///Serialized size, excluding dynamic parts
+	SscDLen base_size;
+	///No. of fields
+	uint32_t n_fields;
+	///Fields
+	const SscFieldDesc *fields;
+};
+
+/**Computes the dynamic part of the serialized size of a structure.
+ * \param desc Descriptor of the structure
+ * \param value The structure
+ * \return Dynamic size, to be added to desc->base_size
+ */
+SscDLen ssc_table_count(const SscStructDesc *desc, const void *value);
+
+/**Checks that no sequence of a structure, including those of 
+ * nested structures, is longer than its bound.
+ * \param desc Descriptor of the structure
+ * \param value The structure
+ * \return 1 if all bounds are met, 0 otherwise
+ */
+int ssc_table_check_bounds(const SscStructDesc *desc, const void *value);
+
+/**Serializes a structure into a segment.
+ * \param desc Descriptor of the structure
+ * \param value The structure
+ * \param seg Segment of desc->base_size to write fixed part into
+ * \param msg_iter The iterator to take segments for dynamic parts from
+ */
+void ssc_table_write(const SscStructDesc *desc, const void *value,
+	SscSegment *seg, SscMsgIter *msg_iter);
+
+/**Deserializes a structure from a segment. On failure, everything
+ * allocated so far is freed.
+ * \param desc Descriptor of the structure
+ * \param value The structure to fill
+ * \param seg Segment of desc->base_size to read fixed part from
+ * \param msg_iter The iterator to take segments for dynamic parts from
+ * \return MDSL_SUCCESS or MDSL_FAILURE
+ */
+MdslStatus ssc_table_read(const SscStructDesc *desc, void *value,
+	SscSegment *seg, SscMsgIter *msg_iter);
+
+/**Frees the contents of a deserialized structure.
+ * \param desc Descriptor of the structure
+ * \param value The structure
+ */
+void ssc_table_free(const SscStructDesc *desc, void *value);
+
+///\}
@@ -0,0 +1,979 @@
+/* transport.h
+ * Serving framed messages over stream sockets
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "incl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#ifdef SSC_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+//epoll: blocks at least this long are read directly into the message,
+//anything shorter goes through the staging buffer
+#define SSC_TRANSPORT_DIRECT_MIN 4096
+#define SSC_TRANSPORT_STAGING_SIZE 16384
+#define SSC_TRANSPORT_MAX_EVENTS 64
+
+//io_uring: ring size, and receive buffers (no. must be a power of 2)
+#define SSC_TRANSPORT_RING_ENTRIES 256
+#define SSC_TRANSPORT_N_BUFS 64
+#define SSC_TRANSPORT_BUF_SIZE 16384
+#define SSC_TRANSPORT_BGID 0
+
+//io_uring: operation, kept in the low bits of user_data 
+//next to the connection pointer
+#define SSC_TRANSPORT_OP_RECV 1
+#define SSC_TRANSPORT_OP_SEND 2
+#define SSC_TRANSPORT_OP_MASK 3
+
+typedef struct _SscTransportConn SscTransportConn;
+
+struct _SscTransportConn
+{
+	//Replier given to the servant, must be first
+	MmcReplier replier;
+	
+	SscTransport *transport;
+	int fd;
+	SscMsgReader *reader;
+	SscMsgSender *sender;
+	
+	//List of all connections
+	SscTransportConn *prev, *next;
+	
+	//Set when the connection is to be closed
+	int closing;
+	
+	//epoll: EPOLLOUT is being waited for
+	int want_out;
+	
+	//epoll: mappings of messages received as memory files, kept 
+	//until the replies queued while they were in use are written
+	//and the servant is done with them
+	SscMsgMapping **held;
+	size_t n_held, held_alloc;
+	
+	//io_uring: operations in flight, and list of connections 
+	//having replies to send
+	int recv_armed, send_inflight, dirty;
+	SscTransportConn *dirty_next;
+	struct msghdr send_hdr;
+};
+
+#ifdef SSC_HAVE_IO_URING
+typedef struct
+{
+	int fd;
+	
+	//Mapped rings
+	void *ring_mem;
+	size_t ring_mem_len;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	
+	//Submission queue
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned sq_entries, sq_local_tail;
+	
+	//Completion queue
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	
+	//Receive buffers registered with the kernel
+	struct io_uring_buf_ring *buf_ring;
+	char *bufs;
+	unsigned short buf_tail;
+} SscUring;
+#endif
+
+struct _SscTransport
+{
+	SscTransportBackend backend;
+	MmcServant *servant;
+	
+	SscTransportConn *conns;
+	size_t n_conns;
+	int n_dispatched;
+	SscMsgLimits *limits;
+	size_t memfd_threshold;
+	
+	//Mappings the servant still uses, of connections that are gone
+	SscMsgMapping **held;
+	size_t n_held, held_alloc;
+	
+	//epoll
+	int epfd;
+	char *staging;
+	
+#ifdef SSC_HAVE_IO_URING
+	//io_uring
+	SscUring uring;
+	SscTransportConn *dirty;
+#endif
+};
+
+//Connections
+
+//Grows an array of mappings to room for n
+static MdslStatus ssc_transport_reserve_held
+	(SscMsgMapping ***held, size_t *held_alloc, size_t n)
+{
+	size_t new_alloc;
+	SscMsgMapping **new_held;
+	
+	if (n <= *held_alloc)
+		return MDSL_SUCCESS;
+	
+	new_alloc = *held_alloc ? *held_alloc * 2 : 4;
+	if (new_alloc < n)
+		new_alloc = n;
+	new_held = realloc(*held, sizeof(SscMsgMapping *) * new_alloc);
+	if (! new_held)
+		return MDSL_FAILURE;
+	*held = new_held;
+	*held_alloc = new_alloc;
+	
+	return MDSL_SUCCESS;
+}
+
+//Frees the mappings the servant is done with, keeping the rest
+static void ssc_transport_release_held(SscMsgMapping **held, size_t *n_held)
+{
+	size_t i, n_kept = 0;
+	
+	for (i = 0; i < *n_held; i++)
+	{
+		if (ssc_msg_mapping_in_use(held[i]))
+			held[n_kept++] = held[i];
+		else
+			ssc_msg_mapping_free(held[i]);
+	}
+	*n_held = n_kept;
+}
+
+//Keeps a mapping the servant still uses after its connection is gone.
+//Without room it is leaked, as unmapping it would pull the memory 
+//out from under the servant.
+static void ssc_transport_keep_mapping
+	(SscTransport *transport, SscMsgMapping *mapping)
+{
+	if (ssc_transport_reserve_held(&transport->held, 
+			&transport->held_alloc, transport->n_held + 1) 
+		!= MDSL_SUCCESS)
+		return;
+	transport->held[transport->n_held++] = mapping;
+}
+
+static void ssc_transport_conn_release_held(SscTransportConn *conn)
+{
+	ssc_transport_release_held(conn->held, &conn->n_held);
+}
+
+static void ssc_transport_conn_destroy(SscTransportConn *conn)
+{
+	SscTransport *transport = conn->transport;
+	size_t i;
+	
+	if (transport->backend == SSC_TRANSPORT_EPOLL)
+		epoll_ctl(transport->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+	close(conn->fd);
+	
+	if (conn->prev)
+		conn->prev->next = conn->next;
+	else
+		transport->conns = conn->next;
+	if (conn->next)
+		conn->next->prev = conn->prev;
+	transport->n_conns--;
+	
+	ssc_msg_reader_free(conn->reader);
+	ssc_msg_sender_free(conn->sender);
+	ssc_transport_conn_release_held(conn);
+	for (i = 0; i < conn->n_held; i++)
+		ssc_transport_keep_mapping(transport, conn->held[i]);
+	free(conn->held);
+	free(conn);
+}
+
+static void ssc_transport_conn_close(SscTransportConn *conn)
+{
+	if (conn->closing)
+		return;
+	conn->closing = 1;
+	
+	//Operations in flight complete as soon as the socket is shut down
+	if (conn->transport->backend == SSC_TRANSPORT_IO_URING)
+		shutdown(conn->fd, SHUT_RDWR);
+}
+
+#ifdef SSC_HAVE_IO_URING
+static void ssc_transport_conn_mark_dirty(SscTransportConn *conn)
+{
+	SscTransport *transport = conn->transport;
+	
+	if (conn->dirty)
+		return;
+	conn->dirty = 1;
+	conn->dirty_next = transport->dirty;
+	transport->dirty = conn;
+}
+#endif
+
+static void ssc_transport_conn_reply(MmcReplier *p_replier, MmcMsg *reply)
+{
+	SscTransportConn *conn = (SscTransportConn *) p_replier;
+	
+	if (conn->closing)
+		return;
+	
+	if (ssc_msg_sender_queue(conn->sender, reply) != MDSL_SUCCESS)
+	{
+		ssc_transport_conn_close(conn);
+		return;
+	}
+	
+	//epoll flushes after reading, io_uring before the next submission
+#ifdef SSC_HAVE_IO_URING
+	if (conn->transport->backend == SSC_TRANSPORT_IO_URING)
+		ssc_transport_conn_mark_dirty(conn);
+#endif
+}
+
+static void ssc_transport_dispatch(SscTransportConn *conn, MmcMsg *msg)
+{
+	SscMsgMapping *mapping;
+	
+	//Messages in memory files point into the mapping, and replies 
+	//or the servant may refer to them after the call, 
+	//so room to keep it is made first
+	mapping = ssc_msg_reader_take_mapping(conn->reader);
+	if (mapping && ssc_transport_reserve_held(&conn->held, 
+			&conn->held_alloc, conn->n_held + 1) != MDSL_SUCCESS)
+	{
+		ssc_msg_mapping_free(mapping);
+		ssc_transport_conn_close(conn);
+		return;
+	}
+	
+	//Replies use the layout encoding, checksumming, compression 
+	//and shape caching the peer chose
+	ssc_msg_sender_set_format(conn->sender, 
+		ssc_msg_reader_get_format(conn->reader));
+	ssc_msg_sender_set_checksum(conn->sender, 
+		ssc_msg_reader_get_checksum(conn->reader));
+	ssc_msg_sender_set_codec(conn->sender, 
+		ssc_msg_reader_get_compressed(conn->reader) 
+			? SSC_MSG_CODEC_LZ4 : SSC_MSG_CODEC_NONE);
+	ssc_msg_sender_set_shapes(conn->sender, 
+		ssc_msg_reader_get_shapes(conn->reader));
+	mmc_servant_call(conn->transport->servant, msg, &conn->replier);
+	if (! mapping)
+		mmc_msg_unref(msg);
+	else if (ssc_msg_sender_get_pending(conn->sender) == 0 
+		&& ! ssc_msg_mapping_in_use(mapping))
+		ssc_msg_mapping_free(mapping);
+	else
+		conn->held[conn->n_held++] = mapping;
+	conn->transport->n_dispatched++;
+}
+
+//Dispatches a message, and the rest of its batch if any
+static void ssc_transport_dispatch_all(SscTransportConn *conn, MmcMsg *msg)
+{
+	do
+	{
+		ssc_transport_dispatch(conn, msg);
+	} while (! conn->closing 
+		&& (msg = ssc_msg_reader_next_batched(conn->reader)));
+}
+
+//Passes received bytes to the reader, 
+//calling the servant for every complete message
+static void ssc_transport_conn_feed
+	(SscTransportConn *conn, const char *data, size_t len)
+{
+	while (len > 0 && ! conn->closing)
+	{
+		MmcMsg *msg;
+		ssize_t n;
+		
+		n = ssc_msg_reader_feed(conn->reader, data, len, &msg);
+		if (n < 0)
+		{
+			ssc_transport_conn_close(conn);
+			break;
+		}
+		data += n;
+		len -= n;
+		if (msg)
+			ssc_transport_dispatch_all(conn, msg);
+	}
+}
+
+//io_uring backend
+
+#ifdef SSC_HAVE_IO_URING
+
+#define SSC_URING_FEATURES \
+	(IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP \
+	| IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_EXT_ARG)
+
+static void ssc_uring_provide(SscUring *uring, unsigned short bid)
+{
+	struct io_uring_buf *buf;
+	
+	buf = uring->buf_ring->bufs 
+		+ (uring->buf_tail & (SSC_TRANSPORT_N_BUFS - 1));
+	buf->addr = (uintptr_t) (uring->bufs 
+		+ ((size_t) bid) * SSC_TRANSPORT_BUF_SIZE);
+	buf->len = SSC_TRANSPORT_BUF_SIZE;
+	buf->bid = bid;
+	uring->buf_tail++;
+	__atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, 
+		__ATOMIC_RELEASE);
+}
+
+static void ssc_uring_destroy(SscUring *uring)
+{
+	if (uring->fd >= 0)
+		close(uring->fd);
+	if (uring->ring_mem)
+		munmap(uring->ring_mem, uring->ring_mem_len);
+	if (uring->sqes)
+		munmap(uring->sqes, uring->sqes_len);
+	free(uring->buf_ring);
+	free(uring->bufs);
+}
+
+static MdslStatus ssc_uring_init(SscUring *uring)
+{
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	size_t cq_len;
+	char *ring;
+	void *buf_ring;
+	unsigned i;
+	
+	uring->ring_mem = NULL;
+	uring->sqes = NULL;
+	uring->buf_ring = NULL;
+	uring->bufs = NULL;
+	
+	memset(&p, 0, sizeof(p));
+	uring->fd = syscall(__NR_io_uring_setup, 
+		SSC_TRANSPORT_RING_ENTRIES, &p);
+	if (uring->fd < 0)
+		return MDSL_FAILURE;
+	if ((p.features & SSC_URING_FEATURES) != SSC_URING_FEATURES)
+		goto fail;
+	
+	//Map both queues at once
+	uring->ring_mem_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (cq_len > uring->ring_mem_len)
+		uring->ring_mem_len = cq_len;
+	ring = mmap(NULL, uring->ring_mem_len, PROT_READ | PROT_WRITE, 
+		MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED)
+		goto fail;
+	uring->ring_mem = ring;
+	
+	uring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	uring->sqes = mmap(NULL, uring->sqes_len, PROT_READ | PROT_WRITE, 
+		MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+	if (uring->sqes == MAP_FAILED)
+	{
+		uring->sqes = NULL;
+		goto fail;
+	}
+	
+	uring->sq_head = (unsigned *) (ring + p.sq_off.head);
+	uring->sq_tail = (unsigned *) (ring + p.sq_off.tail);
+	uring->sq_mask = (unsigned *) (ring + p.sq_off.ring_mask);
+	uring->sq_array = (unsigned *) (ring + p.sq_off.array);
+	uring->sq_entries = p.sq_entries;
+	uring->sq_local_tail = *uring->sq_tail;
+	uring->cq_head = (unsigned *) (ring + p.cq_off.head);
+	uring->cq_tail = (unsigned *) (ring + p.cq_off.tail);
+	uring->cq_mask = (unsigned *) (ring + p.cq_off.ring_mask);
+	uring->cqes = (struct io_uring_cqe *) (ring + p.cq_off.cqes);
+	
+	//Register receive buffers
+	if (posix_memalign(&buf_ring, sysconf(_SC_PAGESIZE), 
+			SSC_TRANSPORT_N_BUFS * sizeof(struct io_uring_buf)) != 0)
+		goto fail;
+	uring->buf_ring = buf_ring;
+	memset(buf_ring, 0, SSC_TRANSPORT_N_BUFS * sizeof(struct io_uring_buf));
+	uring->bufs = mdsl_tryalloc
+		(SSC_TRANSPORT_N_BUFS * SSC_TRANSPORT_BUF_SIZE);
+	if (! uring->bufs)
+		goto fail;
+	
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t) buf_ring;
+	reg.ring_entries = SSC_TRANSPORT_N_BUFS;
+	reg.bgid = SSC_TRANSPORT_BGID;
+	if (syscall(__NR_io_uring_register, uring->fd, 
+			IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		goto fail;
+	
+	uring->buf_tail = 0;
+	for (i = 0; i < SSC_TRANSPORT_N_BUFS; i++)
+		ssc_uring_provide(uring, i);
+	
+	return MDSL_SUCCESS;
+	
+fail:
+	ssc_uring_destroy(uring);
+	return MDSL_FAILURE;
+}
+
+//Submits queued entries, and if wait is set, waits for at least one
+//completion for at most timeout_ms (indefinitely if negative)
+static int ssc_uring_enter(SscUring *uring, int wait, int timeout_ms)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned to_submit, flags = 0;
+	
+	to_submit = uring->sq_local_tail 
+		- __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+	
+	memset(&arg, 0, sizeof(arg));
+	if (wait)
+	{
+		flags |= IORING_ENTER_GETEVENTS;
+		if (timeout_ms >= 0)
+		{
+			ts.tv_sec = timeout_ms / 1000;
+			ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+			arg.ts = (uintptr_t) &ts;
+		}
+	}
+	
+	return syscall(__NR_io_uring_enter, uring->fd, to_submit, 
+		wait ? 1 : 0, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+//Gets a cleared submission queue entry, 
+//to be queued with ssc_uring_push()
+static struct io_uring_sqe *ssc_uring_get_sqe(SscUring *uring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned idx;
+	
+	//Make room by submitting everything if full
+	while (uring->sq_local_tail 
+		- __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) 
+		>= uring->sq_entries)
+	{
+		if (ssc_uring_enter(uring, 0, 0) < 0 && errno != EINTR)
+			return NULL;
+	}
+	
+	idx = uring->sq_local_tail & *uring->sq_mask;
+	sqe = uring->sqes + idx;
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	uring->sq_array[idx] = idx;
+	
+	return sqe;
+}
+
+static void ssc_uring_push(SscUring *uring)
+{
+	uring->sq_local_tail++;
+	__atomic_store_n(uring->sq_tail, uring->sq_local_tail, 
+		__ATOMIC_RELEASE);
+}
+
+static void ssc_transport_uring_arm_recv(SscTransportConn *conn)
+{
+	SscUring *uring = &conn->transport->uring;
+	struct io_uring_sqe *sqe;
+	
+	sqe = ssc_uring_get_sqe(uring);
+	if (! sqe)
+	{
+		ssc_transport_conn_close(conn);
+		return;
+	}
+	
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = conn->fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = SSC_TRANSPORT_BGID;
+	sqe->user_data = ((uintptr_t) conn) | SSC_TRANSPORT_OP_RECV;
+	ssc_uring_push(uring);
+	conn->recv_armed = 1;
+}
+
+static void ssc_transport_uring_send(SscTransportConn *conn)
+{
+	SscUring *uring = &conn->transport->uring;
+	struct io_uring_sqe *sqe;
+	struct iovec *iov;
+	size_t n_iov;
+	
+	sqe = ssc_uring_get_sqe(uring);
+	if (! sqe)
+	{
+		ssc_transport_conn_close(conn);
+		return;
+	}
+	
+	//The iovecs only need to last until submission
+	ssc_msg_sender_get_iov(conn->sender, &iov, &n_iov);
+	memset(&conn->send_hdr, 0, sizeof(struct msghdr));
+	conn->send_hdr.msg_iov = iov;
+	conn->send_hdr.msg_iovlen = n_iov;
+	
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = conn->fd;
+	sqe->addr = (uintptr_t) &conn->send_hdr;
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = ((uintptr_t) conn) | SSC_TRANSPORT_OP_SEND;
+	ssc_uring_push(uring);
+	conn->send_inflight = 1;
+}
+
+//Destroys the connection if closing and nothing is in flight
+static void ssc_transport_uring_check(SscTransportConn *conn)
+{
+	if (conn->closing && ! conn->recv_armed && ! conn->send_inflight 
+		&& ! conn->dirty)
+		ssc_transport_conn_destroy(conn);
+}
+
+static void ssc_transport_uring_complete
+	(SscTransport *transport, struct io_uring_cqe *cqe)
+{
+	SscTransportConn *conn;
+	int op;
+	
+	conn = (SscTransportConn *) (uintptr_t) 
+		(cqe->user_data & ~((uint64_t) SSC_TRANSPORT_OP_MASK));
+	op = cqe->user_data & SSC_TRANSPORT_OP_MASK;
+	
+	if (op == SSC_TRANSPORT_OP_RECV)
+	{
+		if (cqe->flags & IORING_CQE_F_BUFFER)
+		{
+			unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			
+			if (cqe->res > 0)
+				ssc_transport_conn_feed(conn, transport->uring.bufs 
+					+ ((size_t) bid) * SSC_TRANSPORT_BUF_SIZE, cqe->res);
+			ssc_uring_provide(&transport->uring, bid);
+		}
+		
+		if (! (cqe->flags & IORING_CQE_F_MORE))
+			conn->recv_armed = 0;
+		
+		//Receive stops when out of buffers, 
+		//and is started again now that one has been returned
+		if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS))
+			ssc_transport_conn_close(conn);
+		else if (! conn->recv_armed && ! conn->closing)
+			ssc_transport_uring_arm_recv(conn);
+	}
+	else if (op == SSC_TRANSPORT_OP_SEND)
+	{
+		conn->send_inflight = 0;
+		if (cqe->res < 0)
+			ssc_transport_conn_close(conn);
+		else
+		{
+			ssc_msg_sender_consume(conn->sender, cqe->res);
+			if (ssc_msg_sender_get_pending(conn->sender) > 0)
+				ssc_transport_conn_mark_dirty(conn);
+		}
+	}
+	
+	ssc_transport_uring_check(conn);
+}
+
+//Starts sends for connections that have replies queued
+static void ssc_transport_uring_start_sends(SscTransport *transport)
+{
+	while (transport->dirty)
+	{
+		SscTransportConn *conn = transport->dirty;
+		
+		transport->dirty = conn->dirty_next;
+		conn->dirty = 0;
+		if (! conn->closing && ! conn->send_inflight 
+			&& ssc_msg_sender_get_pending(conn->sender) > 0)
+			ssc_transport_uring_send(conn);
+		ssc_transport_uring_check(conn);
+	}
+}
+
+static int ssc_transport_uring_run_once
+	(SscTransport *transport, int timeout_ms)
+{
+	SscUring *uring = &transport->uring;
+	unsigned head, tail;
+	
+	ssc_transport_uring_start_sends(transport);
+	
+	if (ssc_uring_enter(uring, timeout_ms != 0, timeout_ms) < 0)
+	{
+		if (errno != ETIME && errno != EINTR 
+			&& errno != EAGAIN && errno != EBUSY)
+			return -1;
+	}
+	
+	head = *uring->cq_head;
+	tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+	while (head != tail)
+	{
+		struct io_uring_cqe cqe = uring->cqes[head & *uring->cq_mask];
+		
+		head++;
+		__atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+		ssc_transport_uring_complete(transport, &cqe);
+	}
+	
+	return 0;
+}
+
+#endif //SSC_HAVE_IO_URING
+
+//epoll backend
+
+//Reads from the socket, taking descriptors passed along 
+//if memory files are on
+static ssize_t ssc_transport_epoll_recv
+	(SscTransportConn *conn, void *buf, size_t len)
+{
+	if (conn->transport->memfd_threshold)
+		return ssc_msg_reader_recv(conn->reader, conn->fd, buf, len);
+	return read(conn->fd, buf, len);
+}
+
+//Reads everything available
+static void ssc_transport_epoll_read(SscTransportConn *conn)
+{
+	while (! conn->closing)
+	{
+		void *dest;
+		size_t dest_len;
+		ssize_t res;
+		
+		ssc_msg_reader_get_buffer(conn->reader, &dest, &dest_len);
+		if (dest_len >= SSC_TRANSPORT_DIRECT_MIN)
+		{
+			MmcMsg *msg;
+			
+			//Large block, read straight into the message
+			res = ssc_transport_epoll_recv(conn, dest, dest_len);
+			if (res > 0)
+			{
+				if (ssc_msg_reader_advance(conn->reader, res, &msg) 
+					!= MDSL_SUCCESS)
+					ssc_transport_conn_close(conn);
+				else if (msg)
+					ssc_transport_dispatch_all(conn, msg);
+				continue;
+			}
+		}
+		else
+		{
+			res = ssc_transport_epoll_recv(conn, conn->transport->staging, 
+				SSC_TRANSPORT_STAGING_SIZE);
+			if (res > 0)
+			{
+				ssc_transport_conn_feed
+					(conn, conn->transport->staging, res);
+				continue;
+			}
+		}
+		
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			ssc_transport_conn_close(conn);
+		break;
+	}
+}
+
+//Writes queued replies, waiting for EPOLLOUT if they don't fit
+static void ssc_transport_epoll_flush(SscTransportConn *conn)
+{
+	struct epoll_event event;
+	int want_out;
+	
+	if (conn->closing)
+		return;
+	
+	if (ssc_msg_sender_flush(conn->sender, conn->fd) != MDSL_SUCCESS)
+	{
+		ssc_transport_conn_close(conn);
+		return;
+	}
+	
+	want_out = ssc_msg_sender_get_pending(conn->sender) > 0;
+	if (! want_out)
+		ssc_transport_conn_release_held(conn);
+	if (want_out != conn->want_out)
+	{
+		event.events = EPOLLIN | (want_out ? EPOLLOUT : 0);
+		event.data.ptr = conn;
+		if (epoll_ctl(conn->transport->epfd, EPOLL_CTL_MOD, conn->fd, 
+				&event) < 0)
+			ssc_transport_conn_close(conn);
+		conn->want_out = want_out;
+	}
+}
+
+static int ssc_transport_epoll_run_once
+	(SscTransport *transport, int timeout_ms)
+{
+	struct epoll_event events[SSC_TRANSPORT_MAX_EVENTS];
+	int n, i;
+	
+	n = epoll_wait(transport->epfd, events, SSC_TRANSPORT_MAX_EVENTS, 
+		timeout_ms);
+	if (n < 0)
+		return errno == EINTR ? 0 : -1;
+	
+	for (i = 0; i < n; i++)
+	{
+		SscTransportConn *conn = events[i].data.ptr;
+		
+		if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			ssc_transport_epoll_read(conn);
+		ssc_transport_epoll_flush(conn);
+		if (conn->closing)
+			ssc_transport_conn_destroy(conn);
+	}
+	
+	return 0;
+}
+
+//Public functions
+
+SscTransport *ssc_transport_new
+	(SscTransportBackend backend, MmcServant *servant)
+{
+	SscTransport *transport;
+	
+	transport = mdsl_new(SscTransport);
+	transport->servant = servant;
+	transport->conns = NULL;
+	transport->n_conns = 0;
+	transport->limits = NULL;
+	transport->memfd_threshold = 0;
+	transport->held = NULL;
+	transport->n_held = transport->held_alloc = 0;
+	transport->epfd = -1;
+	transport->staging = NULL;
+	
+#ifdef SSC_HAVE_IO_URING
+	transport->dirty = NULL;
+	if (backend != SSC_TRANSPORT_EPOLL)
+	{
+		if (ssc_uring_init(&transport->uring) == MDSL_SUCCESS)
+		{
+			transport->backend = SSC_TRANSPORT_IO_URING;
+			return transport;
+		}
+	}
+#endif
+	if (backend == SSC_TRANSPORT_IO_URING)
+	{
+		free(transport);
+		return NULL;
+	}
+	
+	transport->backend = SSC_TRANSPORT_EPOLL;
+	transport->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (transport->epfd < 0)
+	{
+		free(transport);
+		return NULL;
+	}
+	transport->staging = mdsl_alloc(SSC_TRANSPORT_STAGING_SIZE);
+	
+	return transport;
+}
+
+SscTransportBackend ssc_transport_get_backend(SscTransport *transport)
+{
+	return transport->backend;
+}
+
+void ssc_transport_set_limits
+	(SscTransport *transport, SscMsgLimits *limits)
+{
+	SscTransportConn *conn;
+	
+	transport->limits = limits;
+	for (conn = transport->conns; conn; conn = conn->next)
+		ssc_msg_reader_set_limits(conn->reader, limits);
+}
+
+MdslStatus ssc_transport_set_fd_passing
+	(SscTransport *transport, size_t threshold)
+{
+	SscTransportConn *conn;
+	
+	//Multishot receives do not carry descriptors
+	if (transport->backend != SSC_TRANSPORT_EPOLL)
+		return MDSL_FAILURE;
+	
+	transport->memfd_threshold = threshold;
+	for (conn = transport->conns; conn; conn = conn->next)
+	{
+		ssc_msg_reader_set_fd_passing(conn->reader, threshold != 0);
+		ssc_msg_sender_set_memfd(conn->sender, threshold);
+	}
+	
+	return MDSL_SUCCESS;
+}
+
+MdslStatus ssc_transport_add(SscTransport *transport, int fd)
+{
+	SscTransportConn *conn;
+	int flags;
+	
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return MDSL_FAILURE;
+	
+	conn = mdsl_new(SscTransportConn);
+	memset(conn, 0, sizeof(SscTransportConn));
+	conn->replier.call = ssc_transport_conn_reply;
+	conn->transport = transport;
+	conn->fd = fd;
+	
+	if (transport->backend == SSC_TRANSPORT_EPOLL)
+	{
+		struct epoll_event event;
+		
+		event.events = EPOLLIN;
+		event.data.ptr = conn;
+		if (epoll_ctl(transport->epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+		{
+			free(conn);
+			return MDSL_FAILURE;
+		}
+	}
+	
+	conn->reader = ssc_msg_reader_new();
+	ssc_msg_reader_set_limits(conn->reader, transport->limits);
+	ssc_msg_reader_set_batches(conn->reader, 1);
+	ssc_msg_reader_set_fd_passing(conn->reader, 
+		transport->memfd_threshold != 0);
+	conn->sender = ssc_msg_sender_new();
+	ssc_msg_sender_set_memfd(conn->sender, transport->memfd_threshold);
+	conn->next = transport->conns;
+	if (conn->next)
+		conn->next->prev = conn;
+	transport->conns = conn;
+	transport->n_conns++;
+	
+#ifdef SSC_HAVE_IO_URING
+	//Gets submitted with the next ssc_transport_run_once()
+	if (transport->backend == SSC_TRANSPORT_IO_URING)
+	{
+		ssc_transport_uring_arm_recv(conn);
+		ssc_transport_uring_check(conn);
+	}
+#endif
+	
+	return MDSL_SUCCESS;
+}
+
+size_t ssc_transport_get_n_conns(SscTransport *transport)
+{
+	return transport->n_conns;
+}
+
+int ssc_transport_run_once(SscTransport *transport, int timeout_ms)
+{
+	int res;
+	
+	transport->n_dispatched = 0;
+	ssc_transport_release_held(transport->held, &transport->n_held);
+	
+#ifdef SSC_HAVE_IO_URING
+	if (transport->backend == SSC_TRANSPORT_IO_URING)
+		res = ssc_transport_uring_run_once(transport, timeout_ms);
+	else
+#endif
+		res = ssc_transport_epoll_run_once(transport, timeout_ms);
+	
+	if (res < 0)
+		return -1;
+	return transport->n_dispatched;
+}
+
+void ssc_transport_free(SscTransport *transport)
+{
+	SscTransportConn *conn;
+	size_t i;
+	
+#ifdef SSC_HAVE_IO_URING
+	if (transport->backend == SSC_TRANSPORT_IO_URING)
+	{
+		//The kernel may use connections and buffers until 
+		//everything in flight has completed
+		for (conn = transport->conns; conn; conn = conn->next)
+			ssc_transport_conn_close(conn);
+		ssc_transport_uring_start_sends(transport);
+		conn = transport->conns;
+		while (conn)
+		{
+			SscTransportConn *next = conn->next;
+			
+			ssc_transport_uring_check(conn);
+			conn = next;
+		}
+		while (transport->conns)
+		{
+			if (ssc_transport_uring_run_once(transport, -1) < 0)
+				break;
+		}
+		
+		ssc_uring_destroy(&transport->uring);
+	}
+#endif
+	
+	while (transport->conns)
+		ssc_transport_conn_destroy(transport->conns);
+	for (i = 0; i < transport->n_held; i++)
+		ssc_msg_mapping_free(transport->held[i]);
+	free(transport->held);
+	
+	if (transport->epfd >= 0)
+		close(transport->epfd);
+	free(transport->staging);
+	free(transport);
+}
@@ -0,0 +1,90 @@
+/* transport.h
+ * Serving framed messages over stream sockets
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//A transport owns a set of connected stream sockets, reads frames 
+//(see reader.h) from them, calls a servant with each message, 
+//and sends the replies back as frames on the same socket, 
+//with the same layout encoding as the request, and a CRC trailer, 
+//compressed blocks and cached shapes if the request had them. 
+//Batch frames are accepted, and their messages passed to the servant
+//one by one; replies to them are sent as separate frames.
+//One thread drives any number of connections with 
+//ssc_transport_run_once().
+//
+//Where available, io_uring is used: one multishot receive per 
+//connection into a ring of buffers registered with the kernel, 
+//and sendmsg() of batched replies, all submitted together. 
+//Otherwise epoll with nonblocking reads and writev() is used.
+
+//Event notification mechanism
+typedef enum
+{
+	//io_uring if available, epoll otherwise
+	SSC_TRANSPORT_AUTO = 0,
+	//io_uring (needs Linux 6.0 or later)
+	SSC_TRANSPORT_IO_URING = 1,
+	//epoll
+	SSC_TRANSPORT_EPOLL = 2
+} SscTransportBackend;
+
+typedef struct _SscTransport SscTransport;
+
+//Creates a new transport calling servant for every message received.
+//The servant must outlive the transport. Replies must be given 
+//before mmc_servant_call() returns; the transport sends them.
+//Returns NULL if the backend is not available.
+SscTransport *ssc_transport_new
+	(SscTransportBackend backend, MmcServant *servant);
+
+//Returns the backend in use, never SSC_TRANSPORT_AUTO
+SscTransportBackend ssc_transport_get_backend(SscTransport *transport);
+
+//Checks frames received on all connections against limits,
+//which must outlive the transport. NULL removes them.
+void ssc_transport_set_limits
+	(SscTransport *transport, SscMsgLimits *limits);
+
+//Lets peers on the same host pass messages as memory files 
+//(see memfd.h) over unix sockets, and sends replies of at least 
+//threshold bytes (of layout and blocks) that way; 0 turns it off. 
+//Messages received as memory files point into the mapped file, 
+//which is kept until the replies queued during the call are written
+//and the servant holds no more references to the messages; 
+//references kept past the call must be dropped before the transport
+//is freed. Fails with io_uring, whose receives do not carry 
+//descriptors.
+MdslStatus ssc_transport_set_fd_passing
+	(SscTransport *transport, size_t threshold);
+
+//Adds a connected stream socket. The transport makes it nonblocking,
+//and closes it when the peer closes its side, on errors, 
+//on invalid frames, or when the transport is freed.
+MdslStatus ssc_transport_add(SscTransport *transport, int fd);
+
+//Returns the no. of connections open
+size_t ssc_transport_get_n_conns(SscTransport *transport);
+
+//Waits for events for at most timeout_ms milliseconds 
+//(indefinitely if negative), and handles them. 
+//Returns the no. of messages passed to the servant, or -1 on error.
+int ssc_transport_run_once(SscTransport *transport, int timeout_ms);
+
+//Closes all connections and frees the transport
+void ssc_transport_free(SscTransport *transport);
@@ -259,7 +259,7 @@ static inline void ssc_uint16_store_le(void *le, uint16_t v)
 	union 
 	{
 		uint16_t v;
-		uint8_t a[sizeof(uint16_t)/8];
+		uint8_t a[sizeof(uint16_t)];
 	} h;
 	h.v = v;
 	le_a[SSC_BYTE_SIGNIFICANCE(uint16_t, 0)] = h.a[0];
@@ -277,7 +277,7 @@ static inline void ssc_uint32_store_le(void *le, uint32_t v)
 	union 
 	{
 		uint32_t v;
-		uint8_t a[sizeof(uint32_t)/8];
+		uint8_t a[sizeof(uint32_t)];
 	} h;
 	h.v = v;
 	le_a[SSC_BYTE_SIGNIFICANCE(uint32_t, 0)] = h.a[0];
@@ -297,7 +297,7 @@ static inline void ssc_uint64_store_le(void *le, uint64_t v)
 	union 
 	{
 		uint64_t v;
-		uint8_t a[sizeof(uint64_t)/8];
+		uint8_t a[sizeof(uint64_t)];
 	} h;
 	h.v = v;
 	le_a[SSC_BYTE_SIGNIFICANCE(uint64_t, 0)] = h.a[0];
@@ -0,0 +1,130 @@
+/* main.c
+ * Codec benchmark
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Measures the throughput of generated serializers and deserializers.
+//Not run as part of the test suite, timings depend on the machine.
+//Usage: main [iterations]
+//Built as main (unrolled codec) and main_table (sidc --table).
+
+#include <tests/libtest.h>
+#ifdef BENCH_TABLE
+#include "idl_table.h"
+#define BENCH_CODEC "table-driven"
+#else
+#include "idl.h"
+#define BENCH_CODEC "unrolled"
+#endif
+
+#include <time.h>
+
+#define N_RECORDS 256
+
+static int32_t values[64];
+static Point points[16];
+static char *tags[] = {"alpha", "beta", "gamma", "delta"};
+static char names[N_RECORDS][32];
+static Record records[N_RECORDS];
+
+static double bench_now()
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_init(Batch *batch)
+{
+	int i;
+	
+	for (i = 0; i < 64; i++)
+		values[i] = i * 7 - 100;
+	for (i = 0; i < 16; i++)
+	{
+		points[i].x = i;
+		points[i].y = -i;
+	}
+	
+	for (i = 0; i < N_RECORDS; i++)
+	{
+		Record *r = records + i;
+		
+		sprintf(names[i], "record-%d", i);
+		r->id = i * 1000003ULL;
+		r->a = i;
+		r->b = -i;
+		r->c = i * i;
+		r->weight.type = SSC_FLT_NORMAL;
+		r->weight.val = i * 0.5;
+		r->name = names[i];
+		r->origin = i % 2 ? points + (i % 16) : NULL;
+		r->values.data = values;
+		r->values.len = i % 64;
+		r->path.data = points;
+		r->path.len = i % 16;
+		r->tags.data = tags;
+		r->tags.len = i % 4;
+	}
+	
+	batch->records.data = records;
+	batch->records.len = N_RECORDS;
+}
+
+int main(int argc, char *argv[])
+{
+	Batch batch, res;
+	MmcMsg *msg;
+	int i, n_iter = 200;
+	double start, ser_time, deser_time;
+	
+	if (argc > 1)
+		n_iter = atoi(argv[1]);
+	
+	bench_init(&batch);
+	
+	//Serialization
+	start = bench_now();
+	for (i = 0; i < n_iter; i++)
+	{
+		msg = Batch__serialize(&batch);
+		mmc_msg_unref(msg);
+	}
+	ser_time = bench_now() - start;
+	
+	//Deserialization
+	msg = Batch__serialize(&batch);
+	start = bench_now();
+	for (i = 0; i < n_iter; i++)
+	{
+		if (Batch__deserialize(msg, &res) != MDSL_SUCCESS)
+			ssc_error("Deserialization failed");
+		Batch__free(&res);
+	}
+	deser_time = bench_now() - start;
+	mmc_msg_unref(msg);
+	
+	printf("codec:       %s\n", BENCH_CODEC);
+	printf("serialize:   %8.1f ns/record\n", 
+		ser_time * 1e9 / ((double) n_iter * N_RECORDS));
+	printf("deserialize: %8.1f ns/record\n", 
+		deser_time * 1e9 / ((double) n_iter * N_RECORDS));
+	
+	return 0;
+}
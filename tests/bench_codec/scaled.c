@@ -0,0 +1,125 @@
+/* scaled.c
+ * Codec benchmark on the test schemas
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Measures generated serializers and deserializers on the schemas of 
+//tests/test_seq and tests/test_string, with values scaled up.
+//Not run as part of the test suite, timings depend on the machine.
+//Usage: main_seq [iterations] [sequence length]
+//       main_string [iterations] [string length]
+
+#include <tests/libtest.h>
+#ifdef BENCH_SEQ
+#include "idl_seq.h"
+#define BENCH_SCHEMA "test_seq"
+#define BENCH_DEFAULT_LEN 65536
+#else
+#include "idl_string.h"
+#define BENCH_SCHEMA "test_string"
+#define BENCH_DEFAULT_LEN 64
+#endif
+
+#include <time.h>
+
+//No. of values in a batch, each serialized into its own message
+#define N_VALUES 256
+
+static double bench_now()
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_init(TestStruct *values, int len)
+{
+	int i, j;
+	
+	for (i = 0; i < N_VALUES; i++)
+	{
+#ifdef BENCH_SEQ
+		values[i].s.data = mdsl_alloc(sizeof(int32_t) * len);
+		values[i].s.len = len;
+		for (j = 0; j < len; j++)
+			values[i].s.data[j] = i * 7 + j;
+#else
+		values[i].t1 = mdsl_alloc(len + 1);
+		for (j = 0; j < len; j++)
+			values[i].t1[j] = 'a' + (i + j) % 26;
+		values[i].t1[len] = '\0';
+#endif
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static TestStruct values[N_VALUES];
+	static MmcMsg *msgs[N_VALUES];
+	TestStruct res;
+	int i, j, n_iter = 200, len = BENCH_DEFAULT_LEN;
+	double start, ser_time, deser_time;
+	
+	if (argc > 1)
+		n_iter = atoi(argv[1]);
+	if (argc > 2)
+		len = atoi(argv[2]);
+	
+	bench_init(values, len);
+	
+	//Serialization
+	start = bench_now();
+	for (i = 0; i < n_iter; i++)
+	{
+		for (j = 0; j < N_VALUES; j++)
+			msgs[j] = TestStruct__serialize(values + j);
+		for (j = 0; j < N_VALUES; j++)
+			mmc_msg_unref(msgs[j]);
+	}
+	ser_time = bench_now() - start;
+	
+	//Deserialization
+	for (j = 0; j < N_VALUES; j++)
+		msgs[j] = TestStruct__serialize(values + j);
+	start = bench_now();
+	for (i = 0; i < n_iter; i++)
+	{
+		for (j = 0; j < N_VALUES; j++)
+		{
+			if (TestStruct__deserialize(msgs[j], &res) != MDSL_SUCCESS)
+				ssc_error("Deserialization failed");
+			TestStruct__free(&res);
+		}
+	}
+	deser_time = bench_now() - start;
+	
+	for (j = 0; j < N_VALUES; j++)
+	{
+		mmc_msg_unref(msgs[j]);
+		TestStruct__free(values + j);
+	}
+	
+	printf("schema:      %s (length %d)\n", BENCH_SCHEMA, len);
+	printf("serialize:   %8.1f ns/message\n", 
+		ser_time * 1e9 / ((double) n_iter * N_VALUES));
+	printf("deserialize: %8.1f ns/message\n", 
+		deser_time * 1e9 / ((double) n_iter * N_VALUES));
+	
+	return 0;
+}
@@ -0,0 +1,161 @@
+/* main.c
+ * Layout encoding benchmark
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Compares the fixed and varint layout encodings (see msg.h) in size
+//and decoding time, on the test_string and test_seq schemas 
+//scaled up to many items.
+//Not run as part of the test suite, timings depend on the machine.
+//Usage: main [iterations]
+
+#include <tests/libtest.h>
+#include "idl.h"
+
+#include <time.h>
+
+#define N_ITEMS 1024
+
+static char strings[N_ITEMS][48];
+static StringItem string_items[N_ITEMS];
+static int32_t values[256];
+static SeqItem seq_items[N_ITEMS];
+
+static double bench_now()
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_layout(const char *name, MmcMsg *msg, int n_iter)
+{
+	SscMsgFlatSize size;
+	uint32_t *layout, *decoded;
+	uint8_t *varint;
+	struct iovec *iov;
+	size_t n_varint, n_decoded;
+	double start, fixed_time, varint_time, parse_time;
+	int i;
+	
+	ssc_msg_flatten(msg, 0, NULL, NULL, &size);
+	layout = mdsl_alloc(sizeof(uint32_t) * size.n_layout);
+	iov = mdsl_alloc(sizeof(struct iovec) * size.n_layout);
+	if (ssc_msg_flatten(msg, size.n_layout, layout, iov, &size) 
+		!= MDSL_SUCCESS)
+		ssc_error("Flattening failed");
+	
+	n_varint = ssc_msg_layout_to_varint(layout, size.n_layout, NULL);
+	varint = mdsl_alloc(n_varint);
+	decoded = mdsl_alloc(sizeof(uint32_t) * n_varint);
+	ssc_msg_layout_to_varint(layout, size.n_layout, varint);
+	
+	//Warm up the allocator
+	mmc_msg_unref(ssc_msg_alloc_by_layout(size.n_layout, layout));
+	
+	//Fixed: the layout is used as received
+	start = bench_now();
+	for (i = 0; i < n_iter; i++)
+	{
+		MmcMsg *res = ssc_msg_alloc_by_layout(size.n_layout, layout);
+		
+		if (! res)
+			ssc_error("Decoding failed");
+		mmc_msg_unref(res);
+	}
+	fixed_time = bench_now() - start;
+	
+	//Varint: decoded into a layout first
+	start = bench_now();
+	for (i = 0; i < n_iter; i++)
+	{
+		if (ssc_msg_layout_from_varint(varint, n_varint, decoded, 
+				&n_decoded) != MDSL_SUCCESS)
+			ssc_error("Decoding failed");
+	}
+	parse_time = bench_now() - start;
+	start = bench_now();
+	for (i = 0; i < n_iter; i++)
+	{
+		MmcMsg *res;
+		
+		if (ssc_msg_layout_from_varint(varint, n_varint, decoded, 
+				&n_decoded) != MDSL_SUCCESS)
+			ssc_error("Decoding failed");
+		res = ssc_msg_alloc_by_layout(n_decoded, decoded);
+		if (! res)
+			ssc_error("Decoding failed");
+		mmc_msg_unref(res);
+	}
+	varint_time = bench_now() - start;
+	
+	printf("%s: %zu messages, %zu bytes of blocks\n", 
+		name, size.n_nodes, size.n_bytes);
+	printf("  layout bytes:  fixed %8zu  varint %8zu  (%.1f%% of frame)\n",
+		sizeof(uint32_t) * size.n_layout, n_varint, 
+		100.0 * (sizeof(uint32_t) * size.n_layout - n_varint)
+		/ (SSC_MSG_FRAME_HEADER_SIZE 
+			+ sizeof(uint32_t) * size.n_layout + size.n_bytes));
+	printf("  varint decode: %8.2f ns/message\n", 
+		parse_time * 1e9 / ((double) n_iter * size.n_nodes));
+	printf("  allocation:    fixed %8.2f  varint %8.2f ns/message\n", 
+		fixed_time * 1e9 / ((double) n_iter * size.n_nodes), 
+		varint_time * 1e9 / ((double) n_iter * size.n_nodes));
+	
+	free(layout);
+	free(iov);
+	free(varint);
+	free(decoded);
+}
+
+int main(int argc, char *argv[])
+{
+	Strings strs;
+	Seqs seqs;
+	MmcMsg *msg;
+	int i, n_iter = 200;
+	
+	if (argc > 1)
+		n_iter = atoi(argv[1]);
+	
+	for (i = 0; i < 256; i++)
+		values[i] = i * 7 - 100;
+	for (i = 0; i < N_ITEMS; i++)
+	{
+		sprintf(strings[i], "item-%d-%.*s", i, i % 32, 
+			"abcdefghijklmnopqrstuvwxyz012345");
+		string_items[i].t1 = strings[i];
+		seq_items[i].s.data = values;
+		seq_items[i].s.len = (i * 37) % 256;
+	}
+	strs.items.data = string_items;
+	strs.items.len = N_ITEMS;
+	seqs.items.data = seq_items;
+	seqs.items.len = N_ITEMS;
+	
+	msg = Strings__serialize(&strs);
+	bench_layout("strings", msg, n_iter);
+	mmc_msg_unref(msg);
+	
+	msg = Seqs__serialize(&seqs);
+	bench_layout("seqs", msg, n_iter);
+	mmc_msg_unref(msg);
+	
+	return 0;
+}
@@ -0,0 +1,125 @@
+/* main.c
+ * Parallel flattening benchmark
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Measures how ssc_msg_flatten_parallel() and 
+//ssc_msg_alloc_by_layout_parallel() scale with the no. of threads,
+//on a message with two strings per row.
+//Not run as part of the test suite, timings depend on the machine.
+//Usage: main [rows [max threads [iterations]]]
+
+#include <tests/libtest.h>
+#include "idl.h"
+
+#include <time.h>
+#include <unistd.h>
+
+static double bench_now()
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+	Table table;
+	Row *rows;
+	char *strings;
+	MmcMsg *msg;
+	SscMsgFlatSize size;
+	uint32_t *layout;
+	struct iovec *iov;
+	double base_flatten = 0, base_alloc = 0;
+	int n_rows = 100000, max_threads, n_iter = 5, i;
+	unsigned int n_threads;
+	
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (argc > 1)
+		n_rows = atoi(argv[1]);
+	if (argc > 2)
+		max_threads = atoi(argv[2]);
+	if (argc > 3)
+		n_iter = atoi(argv[3]);
+	if (max_threads < 1)
+		max_threads = 1;
+	
+	rows = mdsl_alloc(sizeof(Row) * n_rows);
+	strings = mdsl_alloc(32 * n_rows);
+	for (i = 0; i < n_rows; i++)
+	{
+		sprintf(strings + 32 * i, "key-%d", i);
+		rows[i].id = i;
+		rows[i].key = strings + 32 * i;
+		rows[i].value = strings + 32 * i + 4;
+	}
+	table.rows.data = rows;
+	table.rows.len = n_rows;
+	msg = Table__serialize(&table);
+	
+	ssc_msg_flatten(msg, 0, NULL, NULL, &size);
+	layout = mdsl_alloc(sizeof(uint32_t) * size.n_layout);
+	iov = mdsl_alloc(sizeof(struct iovec) * size.n_layout);
+	printf("%zu messages, %zu bytes\n", size.n_nodes, size.n_bytes);
+	printf("threads   flatten ms  speedup     alloc ms  speedup\n");
+	
+	for (n_threads = 1; n_threads <= (unsigned int) max_threads; n_threads++)
+	{
+		double start, flatten_time, alloc_time;
+		
+		start = bench_now();
+		for (i = 0; i < n_iter; i++)
+		{
+			if (ssc_msg_flatten_parallel(msg, size.n_layout, layout, iov, 
+					NULL, n_threads) != MDSL_SUCCESS)
+				ssc_error("Flattening failed");
+		}
+		flatten_time = (bench_now() - start) / n_iter;
+		
+		start = bench_now();
+		for (i = 0; i < n_iter; i++)
+		{
+			MmcMsg *res = ssc_msg_alloc_by_layout_parallel
+				(size.n_layout, layout, n_threads);
+			
+			if (! res)
+				ssc_error("Allocation failed");
+			mmc_msg_unref(res);
+		}
+		alloc_time = (bench_now() - start) / n_iter;
+		
+		if (n_threads == 1)
+		{
+			base_flatten = flatten_time;
+			base_alloc = alloc_time;
+		}
+		printf("%7u  %11.2f  %7.2f  %11.2f  %7.2f\n", n_threads, 
+			flatten_time * 1e3, base_flatten / flatten_time, 
+			alloc_time * 1e3, base_alloc / alloc_time);
+	}
+	
+	free(layout);
+	free(iov);
+	mmc_msg_unref(msg);
+	free(rows);
+	free(strings);
+	
+	return 0;
+}
@@ -0,0 +1,212 @@
+/* main.c
+ * Bounded size test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+#include "idl.h"
+
+int32_t array[] = {0, 1, 2, 3, 4, 5};
+Point point = {-1, 1};
+Sample samples[] = 
+{
+	{{array, 4}, &point, {{1, 2}, {3, 4}}},
+	{{array + 2, 1}, NULL, {{0, 0}, {-5, 5}}},
+	{{NULL, 0}, NULL, {{0, 0}, {0, 0}}}
+};
+TestStruct testcases[] = 
+{
+	{{array, 4}, &point, "Hello, World!"},
+	{{array + 2, 1}, NULL, ""},
+	{{NULL, 0}, NULL, "x"}
+};
+
+int TestStruct__equal(TestStruct *a, TestStruct *b)
+{
+	int i;
+	
+	if (a->s.len != b->s.len)
+		return 0;
+	for (i = 0; i < a->s.len; i++)
+	{
+		if (a->s.data[i] != b->s.data[i])
+			return 0;
+	}
+	
+	if (a->p && b->p)
+	{
+		if (a->p->x != b->p->x || a->p->y != b->p->y)
+			return 0;
+	}
+	else if (a->p || b->p)
+		return 0;
+	
+	return strcmp(a->name, b->name) == 0;
+}
+
+//Replies with the first sample, which may exceed its bound
+static void bounded_iface_impl
+	(SscServant *servant, MmcReplier *replier, int method_id, void *argp,
+	 void *user_data)
+{
+	BoundedIface__put__in_args *args = argp;
+	BoundedIface__put__out_args out_args;
+	
+	out_args.out = args->in.data[0];
+	if (user_data)
+		out_args.out.s.len = 5;
+	ssc_servant_return(servant, method_id, replier, &out_args);
+}
+
+int main()
+{
+	int i;
+	
+	test_struct_drive();
+	
+	//Check the computed bounds
+	ssc_assert(Point__MAX_WIRE_SIZE_BYTES == 8, "Test failed");
+	ssc_assert(Point__MAX_WIRE_SIZE_SUBMSGS == 0, "Test failed");
+	ssc_assert(Sample__MAX_WIRE_SIZE_BYTES == 4 + 4 * 4 + 1 + 8 + 2 * 8, 
+		"Test failed");
+	ssc_assert(Sample__MAX_WIRE_SIZE_SUBMSGS == 0, "Test failed");
+	ssc_assert(BoundedIface__put__in_args__MAX_WIRE_SIZE_BYTES 
+		== 4 + 2 * Sample__MAX_WIRE_SIZE_BYTES + SSC_PREFIX_SIZE, 
+		"Test failed");
+	
+	//Strings can be of any length
+#ifdef TestStruct__MAX_WIRE_SIZE_BYTES
+	ssc_error("Test failed");
+#endif
+	
+	//Serialize into stack buffers, 
+	//result should match the heap-allocated message
+	for (i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+	{
+		char mem[Sample__MAX_WIRE_SIZE_BYTES];
+		SscDLen size;
+		MmcMsg *msg;
+		
+		if (Sample__serialize_to(samples + i, mem, sizeof(mem), 
+				NULL, 0, &size)
+			!= MDSL_SUCCESS)
+			ssc_error("Test failed");
+		
+		msg = Sample__serialize(samples + i);
+		ssc_assert(msg->mem_len == size.n_bytes, "Test failed");
+		ssc_assert(msg->submsgs_len == 0, "Test failed");
+		ssc_assert(memcmp(msg->mem, mem, size.n_bytes) == 0, 
+			"Test failed");
+		mmc_msg_unref(msg);
+	}
+	
+	//Submessages written by __serialize_to are owned by the caller
+	{
+		char mem[64];
+		MmcMsg *submsgs[1];
+		
+		if (TestStruct__serialize_to(testcases, mem, sizeof(mem), 
+				submsgs, 1, NULL)
+			!= MDSL_SUCCESS)
+			ssc_error("Test failed");
+		mmc_msg_unref(submsgs[0]);
+	}
+	
+	//Too small buffer must be rejected
+	{
+		char mem[4];
+		
+		if (Sample__serialize_to(samples, mem, sizeof(mem), 
+				NULL, 0, NULL)
+			!= MDSL_FAILURE)
+			ssc_error("Test failed");
+	}
+	
+	//Sequence exceeding the bound must not be serialized, 
+	//even in a nested structure
+	{
+		char mem[Sample__MAX_WIRE_SIZE_BYTES + 4];
+		TestStruct big = {{array, 5}, NULL, "x"};
+		Sample big_sample = {{array, 5}, NULL, {{0, 0}, {0, 0}}};
+		Sample nested_samples[2] = {samples[0], big_sample};
+		Nested nested = {{nested_samples, 2}};
+		
+		ssc_assert(! TestStruct__serialize(&big), "Test failed");
+		ssc_assert(Sample__serialize_to(&big_sample, mem, sizeof(mem), 
+				NULL, 0, NULL) == MDSL_FAILURE, "Test failed");
+		ssc_assert(! Nested__serialize(&nested), "Test failed");
+		
+		nested.samples.len = 1;
+		ssc_assert(Nested__check_bounds(&nested), "Test failed");
+	}
+	
+	//Sequence exceeding the bound must not be deserialized
+	{
+		TestStructUnbounded big = {{array, 5}, NULL, "x"};
+		TestStruct res;
+		MmcMsg *msg;
+		
+		msg = TestStructUnbounded__serialize(&big);
+		if (TestStruct__deserialize(msg, &res) != MDSL_FAILURE)
+			ssc_error("Test failed");
+		mmc_msg_unref(msg);
+	}
+	
+	//Bounds of arguments
+	{
+		BoundedIface__put__in_args in_args = {{samples, 3}};
+		BoundedIface__put__out_args out_args;
+		char mem[BoundedIface__put__in_args__MAX_WIRE_SIZE_BYTES];
+		SscServant *servant;
+		TestReplier replier;
+		MmcMsg *msg;
+		
+		ssc_assert(! BoundedIface__put__create_msg(&in_args), 
+			"Test failed");
+		ssc_assert(BoundedIface__put__create_msg_to(&in_args, 
+				mem, sizeof(mem), NULL, 0, NULL) == MDSL_FAILURE, 
+			"Test failed");
+		in_args.in.len = 2;
+		ssc_assert(BoundedIface__put__create_msg_to(&in_args, 
+				mem, sizeof(mem), NULL, 0, NULL) == MDSL_SUCCESS, 
+			"Test failed");
+		
+		//Reply within bounds
+		servant = ssc_servant_new(BoundedIface, bounded_iface_impl, NULL);
+		msg = BoundedIface__put__create_msg(&in_args);
+		test_replier_init(&replier);
+		mmc_servant_call((MmcServant *) servant, msg, (MmcReplier *) &replier);
+		ssc_assert(BoundedIface__put__read_reply(replier.reply, &out_args)
+			== MDSL_SUCCESS, "Test failed");
+		ssc_assert(out_args.out.s.len == 4, "Test failed");
+		BoundedIface__put__out_args_free(&out_args);
+		mmc_msg_unref(replier.reply);
+		mmc_servant_unref((MmcServant *) servant);
+		
+		//Reply exceeding the bound turns into an error
+		servant = ssc_servant_new(BoundedIface, bounded_iface_impl, array);
+		test_replier_init(&replier);
+		mmc_servant_call((MmcServant *) servant, msg, (MmcReplier *) &replier);
+		ssc_assert(ssc_read_prefix(replier.reply) == 1, "Test failed");
+		mmc_msg_unref(replier.reply);
+		mmc_servant_unref((MmcServant *) servant);
+		mmc_msg_unref(msg);
+	}
+	
+	return 0;
+}
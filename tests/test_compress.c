@@ -0,0 +1,158 @@
+/* test_compress.c
+ * Block compression test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+
+//Fills buf with data of the given kind
+static void fill(uint8_t *buf, size_t len, int kind, uint32_t seed)
+{
+	static const char *words[] = {"alpha ", "beta ", "gamma ", "delta ", 
+		"log=", "level=info ", "\n"};
+	size_t i, j;
+	
+	for (i = 0; i < len; )
+	{
+		seed = seed * 1103515245 + 12345;
+		switch (kind)
+		{
+		case 0:
+			//Incompressible
+			buf[i++] = seed >> 16;
+			break;
+		case 1:
+			//Text-like
+			for (j = 0; words[(seed >> 16) % 7][j] && i < len; j++)
+				buf[i++] = words[(seed >> 16) % 7][j];
+			break;
+		default:
+			//Runs, which give overlapping matches
+			for (j = 0; j < ((seed >> 16) % 300) && i < len; j++)
+				buf[i++] = seed >> 24;
+			break;
+		}
+	}
+}
+
+static void test_lz4(void)
+{
+	static uint8_t src[SSC_MSG_CHUNK_SIZE], out[SSC_MSG_CHUNK_SIZE];
+	static uint8_t comp[SSC_MSG_CHUNK_SIZE + SSC_MSG_CHUNK_SIZE / 255 + 16];
+	size_t len, comp_len, i;
+	int kind;
+	
+	for (kind = 0; kind < 3; kind++)
+	{
+		for (len = 0; len <= SSC_MSG_CHUNK_SIZE; 
+			len = len < 40 ? len + 1 : len * 3 + 7)
+		{
+			fill(src, len, kind, len);
+			comp_len = ssc_lz4_compress(src, len, comp, ssc_lz4_bound(len));
+			ssc_assert(comp_len > 0 && comp_len <= ssc_lz4_bound(len), 
+				"Test failed");
+			if (kind > 0 && len >= 1000)
+				ssc_assert(comp_len < len / 2, "Test failed");
+			if (ssc_lz4_decompress(comp, comp_len, out, len) 
+				!= MDSL_SUCCESS)
+				ssc_error("Test failed");
+			ssc_assert(memcmp(src, out, len) == 0, "Test failed");
+			
+			//Wrong expected length
+			if (ssc_lz4_decompress(comp, comp_len, out, len + 1) 
+				!= MDSL_FAILURE)
+				ssc_error("Test failed");
+			
+			//Too little room
+			if (len > 100)
+				ssc_assert(ssc_lz4_compress(src, len, comp, 10) == 0, 
+					"Test failed");
+		}
+	}
+	
+	//Damaged input must be rejected or give garbage, 
+	//but never go out of bounds
+	len = 5000;
+	fill(src, len, 1, 7);
+	comp_len = ssc_lz4_compress(src, len, comp, sizeof(comp));
+	for (i = 0; i < comp_len; i++)
+	{
+		comp[i] ^= 0x5a;
+		ssc_lz4_decompress(comp, comp_len, out, len);
+		ssc_lz4_decompress(comp, i, out, len);
+		comp[i] ^= 0x5a;
+	}
+	
+	//Too long
+	ssc_assert(ssc_lz4_compress(src, SSC_MSG_CHUNK_SIZE + 1, comp, 
+		sizeof(comp)) == 0, "Test failed");
+}
+
+static void test_chunks(void)
+{
+	static uint8_t mem[3 * SSC_MSG_CHUNK_SIZE];
+	static uint8_t stream[4 * SSC_MSG_CHUNK_SIZE];
+	static uint8_t scratch[SSC_MSG_CHUNK_SIZE];
+	struct iovec iov[6];
+	size_t n_span, len, stream_len;
+	
+	iov[0].iov_len = 10;
+	iov[1].iov_len = 100;
+	iov[2].iov_len = SSC_MSG_CHUNK_SIZE - 50;
+	iov[3].iov_len = 2 * SSC_MSG_CHUNK_SIZE + 5;
+	iov[4].iov_len = 1;
+	iov[5].iov_len = 2;
+	iov[0].iov_base = iov[1].iov_base = iov[2].iov_base 
+		= iov[4].iov_base = iov[5].iov_base = mem;
+	iov[3].iov_base = mem;
+	fill(mem, sizeof(mem), 1, 3);
+	
+	//Tiny blocks together, until one does not fit
+	len = ssc_msg_chunk_span(iov, 6, 0, &n_span);
+	ssc_assert(len == 110 && n_span == 2, "Test failed");
+	len = ssc_msg_chunk_span(iov + 2, 4, 0, &n_span);
+	ssc_assert(len == SSC_MSG_CHUNK_SIZE - 50 && n_span == 1, 
+		"Test failed");
+	
+	//Large block in pieces
+	len = ssc_msg_chunk_span(iov + 3, 3, 0, &n_span);
+	ssc_assert(len == SSC_MSG_CHUNK_SIZE && n_span == 1, "Test failed");
+	len = ssc_msg_chunk_span(iov + 3, 3, 2 * SSC_MSG_CHUNK_SIZE, &n_span);
+	ssc_assert(len == 5 && n_span == 1, "Test failed");
+	len = ssc_msg_chunk_span(iov + 4, 2, 0, &n_span);
+	ssc_assert(len == 3 && n_span == 2, "Test failed");
+	
+	//Compressible text shrinks, and every chunk has a header
+	ssc_assert(ssc_msg_chunks_bound(iov, 6) <= sizeof(stream), 
+		"Test failed");
+	stream_len = ssc_msg_chunks_encode(iov, 6, SSC_MSG_CODEC_LZ4, 
+		scratch, stream);
+	ssc_assert(stream_len < 3 * SSC_MSG_CHUNK_SIZE / 2, "Test failed");
+	stream_len = ssc_msg_chunks_encode(iov, 6, SSC_MSG_CODEC_NONE, 
+		scratch, stream);
+	ssc_assert(stream_len == 3 * SSC_MSG_CHUNK_SIZE + 68 
+		+ 6 * SSC_MSG_CHUNK_HEADER_SIZE, "Test failed");
+}
+
+int main()
+{
+	test_lz4();
+	test_chunks();
+	
+	return 0;
+}
@@ -0,0 +1,74 @@
+/* test_crc32c.c
+ * CRC32C test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+
+#define BUF_LEN (3 * 3 * 1024 + 100)
+
+int main()
+{
+	uint8_t buf[BUF_LEN + 8];
+	size_t len, off, split;
+	uint32_t crc;
+	
+	//Known values (RFC 3720)
+	ssc_assert(ssc_crc32c(0, "123456789", 9) == 0xE3069283, "Test failed");
+	memset(buf, 0, 32);
+	ssc_assert(ssc_crc32c(0, buf, 32) == 0x8A9136AA, "Test failed");
+	ssc_assert(ssc_crc32c_portable(0, buf, 32) == 0x8A9136AA, 
+		"Test failed");
+	memset(buf, 0xff, 32);
+	ssc_assert(ssc_crc32c(0, buf, 32) == 0x62A8AB43, "Test failed");
+	ssc_assert(ssc_crc32c(0, buf, 0) == 0, "Test failed");
+	
+	for (off = 0; off < sizeof(buf); off++)
+		buf[off] = (off * 131) ^ (off >> 7);
+	
+	//Whichever implementation is used agrees with the portable one,
+	//at any alignment and across the interleaved stretches
+	for (len = 0; len <= BUF_LEN; len += (len < 64 ? 1 : 61))
+	{
+		for (off = 0; off < 8; off++)
+		{
+			crc = ssc_crc32c_portable(0x12345678, buf + off, len);
+			ssc_assert(ssc_crc32c(0x12345678, buf + off, len) == crc, 
+				"Test failed");
+		}
+	}
+	
+	//Continuing a checksum is the same as computing it at once
+	crc = ssc_crc32c(0, buf, BUF_LEN);
+	for (split = 0; split <= BUF_LEN; split += 997)
+	{
+		ssc_assert(ssc_crc32c(ssc_crc32c(0, buf, split), 
+			buf + split, BUF_LEN - split) == crc, "Test failed");
+	}
+	
+	//So is combining the checksums of two parts
+	for (split = 0; split <= BUF_LEN; split += 997)
+	{
+		ssc_assert(ssc_crc32c_combine(ssc_crc32c(0, buf, split), 
+			ssc_crc32c(0, buf + split, BUF_LEN - split), BUF_LEN - split)
+			== crc, "Test failed");
+	}
+	ssc_assert(ssc_crc32c_combine(crc, 0, 0) == crc, "Test failed");
+	
+	return 0;
+}
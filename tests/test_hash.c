@@ -0,0 +1,252 @@
+/* test_hash.c
+ * Content hashing test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+
+#define N_INPUTS 20000
+
+//Builds a tree of messages, 
+//each node having mem_len bytes filled with its id
+static MmcMsg *build_tree(int depth, int fanout, int *id)
+{
+	MmcMsg *msg;
+	int i, n_sub, mem_len;
+	
+	n_sub = depth > 0 ? fanout : 0;
+	mem_len = (*id % 3) * 50;
+	msg = mmc_msg_newa(mem_len, n_sub);
+	memset(msg->mem, *id, mem_len);
+	(*id)++;
+	for (i = 0; i < n_sub; i++)
+		msg->submsgs[i] = build_tree(depth - 1, fanout - i, id);
+	
+	return msg;
+}
+
+static int hash_equal(SscMsgHash *a, SscMsgHash *b)
+{
+	return a->lo == b->lo && a->hi == b->hi;
+}
+
+static int hash_cmp(const void *a, const void *b)
+{
+	const SscMsgHash *ha = a, *hb = b;
+	
+	if (ha->lo != hb->lo)
+		return ha->lo < hb->lo ? -1 : 1;
+	if (ha->hi != hb->hi)
+		return ha->hi < hb->hi ? -1 : 1;
+	return 0;
+}
+
+static void test_bytes(void)
+{
+	static uint8_t buf[1000 + 8];
+	static SscMsgHash hashes[N_INPUTS];
+	SscMsgHash a, b;
+	size_t i, len, off;
+	
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 13 + (i >> 5);
+	
+	//Independent of alignment
+	for (len = 0; len <= 1000; len += 7)
+	{
+		ssc_hash128(buf, len, 0, &a);
+		memmove(buf + 3, buf, len);
+		ssc_hash128(buf + 3, len, 0, &b);
+		memmove(buf, buf + 3, len);
+		ssc_assert(hash_equal(&a, &b), "Test failed");
+	}
+	
+	//Distinct inputs differing in a few bits: no collisions
+	memset(buf, 0, sizeof(buf));
+	for (i = 0; i < N_INPUTS; i++)
+	{
+		len = 20 + i % 7;
+		off = i % 16;
+		ssc_uint32_store_le(buf, i);
+		buf[4 + off] = 1;
+		ssc_hash128(buf, len, i % 3, hashes + i);
+		buf[4 + off] = 0;
+	}
+	qsort(hashes, N_INPUTS, sizeof(SscMsgHash), hash_cmp);
+	for (i = 1; i < N_INPUTS; i++)
+	{
+		ssc_assert(hashes[i - 1].lo != hashes[i].lo 
+			&& hashes[i - 1].hi != hashes[i].hi, "Test failed");
+	}
+}
+
+static void test_trees(void)
+{
+	SscMsgHashMemo *memo;
+	SscMsgSender *sender;
+	SscMsgHash a, b, c;
+	SscMsgFlatSize size;
+	MmcMsg *tree, *shared, *parents[2];
+	uint32_t *layout;
+	struct iovec *iov;
+	int id, depth, k;
+	
+	memo = ssc_msg_hash_memo_new(4);
+	sender = ssc_msg_sender_new();
+	
+	for (depth = 0; depth < 5; depth++)
+	{
+		id = 0;
+		tree = build_tree(depth, 3, &id);
+		
+		//Flattening, the sender, and memoized or not all agree
+		ssc_msg_hash(tree, NULL, &a);
+		ssc_msg_flatten(tree, 0, NULL, NULL, &size);
+		layout = mdsl_alloc(sizeof(uint32_t) * size.n_layout);
+		iov = mdsl_alloc(sizeof(struct iovec) * size.n_layout);
+		if (ssc_msg_flatten_hashed(tree, size.n_layout, layout, iov, 
+				&size, &b) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(hash_equal(&a, &b), "Test failed");
+		if (ssc_msg_sender_queue_hashed(sender, tree, &b) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(hash_equal(&a, &b), "Test failed");
+		ssc_msg_sender_consume(sender, ssc_msg_sender_get_pending(sender));
+		for (k = 0; k < 2; k++)
+		{
+			ssc_msg_hash(tree, memo, &b);
+			ssc_assert(hash_equal(&a, &b), "Test failed");
+		}
+		
+		//Content changes show, once forgotten
+		if (depth > 0)
+		{
+			MmcMsg *leaf = tree->submsgs[0];
+			
+			while (leaf->submsgs_len)
+				leaf = leaf->submsgs[leaf->submsgs_len - 1];
+			if (leaf->mem_len == 0)
+				leaf = tree;
+			((char *) leaf->mem)[0] ^= 1;
+			ssc_msg_hash_memo_clear(memo);
+			ssc_msg_hash(tree, memo, &b);
+			ssc_assert(! hash_equal(&a, &b), "Test failed");
+			((char *) leaf->mem)[0] ^= 1;
+			ssc_msg_hash_memo_forget(memo, tree);
+			ssc_msg_hash(tree, NULL, &b);
+			ssc_assert(hash_equal(&a, &b), "Test failed");
+		}
+		
+		free(layout);
+		free(iov);
+		mmc_msg_unref(tree);
+	}
+	
+	//Shape changes show: a block moved to a submessage
+	tree = mmc_msg_newa(4, 1);
+	memcpy(tree->mem, "abcd", 4);
+	tree->submsgs[0] = mmc_msg_newa(0, 0);
+	ssc_msg_hash(tree, NULL, &a);
+	mmc_msg_unref(tree);
+	tree = mmc_msg_newa(0, 1);
+	tree->submsgs[0] = mmc_msg_newa(4, 0);
+	memcpy(tree->submsgs[0]->mem, "abcd", 4);
+	ssc_msg_hash(tree, NULL, &b);
+	ssc_assert(! hash_equal(&a, &b), "Test failed");
+	mmc_msg_unref(tree);
+	
+	//Shared submessage is hashed once, and order matters
+	id = 0;
+	shared = build_tree(6, 3, &id);
+	for (k = 0; k < 2; k++)
+	{
+		parents[k] = mmc_msg_newa(0, 2);
+		parents[k]->submsgs[k] = shared;
+		parents[k]->submsgs[1 - k] = mmc_msg_newa(1, 0);
+		mmc_msg_ref(shared);
+	}
+	ssc_msg_hash_memo_free(memo);
+	memo = ssc_msg_hash_memo_new(1000);
+	ssc_msg_hash(parents[0], memo, &a);
+	ssc_msg_hash(parents[1], NULL, &b);
+	ssc_msg_hash(parents[1], memo, &c);
+	ssc_assert(hash_equal(&b, &c) && ! hash_equal(&a, &b), "Test failed");
+	
+	//The memo keeps what it holds alive
+	mmc_msg_unref(shared);
+	mmc_msg_unref(parents[0]);
+	mmc_msg_unref(parents[1]);
+	ssc_msg_hash_memo_free(memo);
+	ssc_msg_sender_free(sender);
+}
+
+//A chain as deep as readers accept hashes the same memoized or not, 
+//and as when flattened
+static void test_deep(void)
+{
+	SscMsgHashMemo *memo;
+	SscMsgHash a, b;
+	SscMsgFlatSize size;
+	MmcMsg *chain, *cur, *next;
+	uint32_t *layout;
+	struct iovec *iov;
+	size_t i, n = SSC_MSG_READER_MAX_LAYOUT;
+	
+	chain = cur = mmc_msg_newa(1, 1);
+	for (i = 1; i < n; i++)
+	{
+		memset(cur->mem, i, 1);
+		cur->submsgs[0] = mmc_msg_newa(1, i < n - 1 ? 1 : 0);
+		cur = cur->submsgs[0];
+	}
+	memset(cur->mem, 0, 1);
+	
+	ssc_msg_hash(chain, NULL, &a);
+	memo = ssc_msg_hash_memo_new(1000);
+	ssc_msg_hash(chain, memo, &b);
+	ssc_assert(hash_equal(&a, &b), "Test failed");
+	ssc_msg_hash(chain, memo, &b);
+	ssc_assert(hash_equal(&a, &b), "Test failed");
+	ssc_msg_hash_memo_free(memo);
+	
+	layout = mdsl_alloc(sizeof(uint32_t) * n);
+	iov = mdsl_alloc(sizeof(struct iovec) * n);
+	if (ssc_msg_flatten_hashed(chain, n, layout, iov, &size, &b) 
+		!= MDSL_SUCCESS)
+		ssc_error("Test failed");
+	ssc_assert(size.n_nodes == n && hash_equal(&a, &b), "Test failed");
+	free(layout);
+	free(iov);
+	
+	//Freed a message at a time, as unreferencing would recurse
+	for (cur = chain; cur; cur = next)
+	{
+		next = cur->submsgs_len ? cur->submsgs[0] : NULL;
+		cur->submsgs_len = 0;
+		mmc_msg_unref(cur);
+	}
+}
+
+int main()
+{
+	test_bytes();
+	test_trees();
+	test_deep();
+	
+	return 0;
+}
@@ -33,6 +33,15 @@ void test_iface_impl
 			TestIface__increment__in_args *args = argp;
 			TestIface__increment__out_args  out_args;
 
+			//A nested call does not get the arguments of this one
+			if (args->in == 100)
+			{
+				TEST_CALL(TestIface, decrement, 
+					{ in_args.in = 7; }, 
+					{ ssc_assert(out_args.out == 6, "Test failed"); });
+				ssc_assert(args->in == 100, "Test failed");
+			}
+
 			out_args.out = args->in + 1;
 
 			ssc_servant_return(servant, method_id, replier, &out_args);
@@ -51,6 +60,21 @@ void test_iface_impl
 	}
 }
 
+//Skeleton with more functions than batches allow, replying with 
+//the prefix of the method called
+static SscSStub wide_sstubs[SSC_BATCH_PREFIX + 1];
+static const SscSkel wide_skel = {SSC_BATCH_PREFIX + 1, wide_sstubs, 0};
+
+static void wide_impl
+	(SscServant *servant, MmcReplier *replier, int method_id, void *argp,
+	 void *user_data)
+{
+	MmcMsg *reply_msg = ssc_create_prefixed_empty_msg(method_id);
+	
+	mmc_replier_call(replier, reply_msg);
+	mmc_msg_unref(reply_msg);
+}
+
 
 int main()
 {
@@ -63,6 +87,85 @@ int main()
 	TEST_CALL(TestIface, decrement, 
 		{ in_args.in = 2; }, { ssc_assert(out_args.out == 1, "Test failed"); });
 
+	TEST_CALL(TestIface, increment, 
+		{ in_args.in = 100; }, { ssc_assert(out_args.out == 101, "Test failed"); });
+
+	TEST_CALL(TestIface, increment, 
+		{ in_args.in = 3; }, { ssc_assert(out_args.out == 4, "Test failed"); });
+
+	//Batch of calls to different methods, with per-call status
+	{
+		TestReplier replier;
+		SscBatch batch[1];
+		TestIface__increment__in_args inc_in;
+		TestIface__decrement__in_args dec_in;
+		TestIface__increment__out_args inc_out;
+		TestIface__decrement__out_args dec_out;
+		MmcMsg *msg;
+		
+		ssc_batch_init(batch);
+		inc_in.in = 1;
+		ssc_assert(TestIface__increment__batch_add(batch, &inc_in) 
+			== MDSL_SUCCESS, "Test failed");
+		dec_in.in = 5;
+		ssc_assert(TestIface__decrement__batch_add(batch, &dec_in) 
+			== MDSL_SUCCESS, "Test failed");
+		ssc_assert(ssc_batch_add(batch, ssc_create_prefixed_empty_msg(77))
+			== MDSL_SUCCESS, "Test failed");
+		inc_in.in = 100;
+		ssc_assert(TestIface__increment__batch_add(batch, &inc_in) 
+			== MDSL_SUCCESS, "Test failed");
+		ssc_assert(ssc_batch_add(batch, 
+			ssc_create_prefixed_empty_msg(SSC_BATCH_PREFIX))
+			== MDSL_SUCCESS, "Test failed");
+		msg = ssc_batch_finish(batch);
+		ssc_assert(msg, "Test failed");
+		ssc_assert(! ssc_batch_finish(batch), "Test failed");
+		
+		test_replier_init(&replier);
+		mmc_servant_call((MmcServant *) servant, msg, (MmcReplier *) &replier);
+		mmc_msg_unref(msg);
+		
+		ssc_assert(ssc_batch_reply_len(replier.reply) == 5, "Test failed");
+		ssc_assert(TestIface__increment__read_batch_reply
+			(replier.reply, 0, &inc_out) == MDSL_SUCCESS, "Test failed");
+		ssc_assert(inc_out.out == 2, "Test failed");
+		ssc_assert(TestIface__decrement__read_batch_reply
+			(replier.reply, 1, &dec_out) == MDSL_SUCCESS, "Test failed");
+		ssc_assert(dec_out.out == 4, "Test failed");
+		ssc_assert(ssc_read_prefix(ssc_batch_reply_get(replier.reply, 2)) 
+			== 1, "Test failed");
+		ssc_assert(TestIface__increment__read_batch_reply
+			(replier.reply, 3, &inc_out) == MDSL_SUCCESS, "Test failed");
+		ssc_assert(inc_out.out == 101, "Test failed");
+		ssc_assert(TestIface__increment__read_batch_reply
+			(replier.reply, 4, &inc_out) == MDSL_FAILURE, "Test failed");
+		ssc_assert(TestIface__increment__read_batch_reply
+			(replier.reply, 5, &inc_out) == MDSL_FAILURE, "Test failed");
+		mmc_msg_unref(replier.reply);
+		
+		//Dropping calls that were never sent
+		ssc_assert(TestIface__increment__batch_add(batch, &inc_in) 
+			== MDSL_SUCCESS, "Test failed");
+		ssc_batch_clear(batch);
+	}
+
+	//With too many functions for batches, the last prefix is a method
+	{
+		SscServant *wide = ssc_servant_new(&wide_skel, wide_impl, NULL);
+		TestReplier replier;
+		MmcMsg *msg;
+		
+		test_replier_init(&replier);
+		msg = ssc_create_prefixed_empty_msg(SSC_BATCH_PREFIX);
+		mmc_servant_call((MmcServant *) wide, msg, (MmcReplier *) &replier);
+		mmc_msg_unref(msg);
+		ssc_assert(ssc_read_prefix(replier.reply) == SSC_BATCH_PREFIX, 
+			"Test failed");
+		mmc_msg_unref(replier.reply);
+		mmc_servant_unref((MmcServant *) wide);
+	}
+
 	//Garbage collect
 	mmc_servant_unref((MmcServant *) servant);
 	
@@ -0,0 +1,101 @@
+/* main.c
+ * Inline codec test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//Use header-only primitives, like the generated code does
+#define SSC_HEADER_ONLY
+#include <tests/libtest.h>
+#include "idl.h"
+
+Point points[] = {{0, 0}, {1, -1}, {-2, 2}, {3, 4}};
+Line lines[] = 
+{
+	{{0, 0}, {1, 1}, "first"},
+	{{-1, 2}, {3, -4}, NULL},
+	{{5, 5}, {6, 6}, ""}
+};
+TestStruct testcases[] = 
+{
+	{{lines, 3}, {points, 4}, "Hello, World!"},
+	{{lines + 1, 1}, {NULL, 0}, ""},
+	{{NULL, 0}, {points, 1}, "x"}
+};
+
+static int Point__equal(Point *a, Point *b)
+{
+	return a->x == b->x && a->y == b->y;
+}
+
+static int Line__equal(Line *a, Line *b)
+{
+	if (! Point__equal(&a->a, &b->a) || ! Point__equal(&a->b, &b->b))
+		return 0;
+	
+	if (a->label && b->label)
+		return strcmp(a->label, b->label) == 0;
+	
+	return a->label == b->label;
+}
+
+int TestStruct__equal(TestStruct *a, TestStruct *b)
+{
+	int i;
+	
+	if (a->lines.len != b->lines.len || a->pts.len != b->pts.len)
+		return 0;
+	for (i = 0; i < a->lines.len; i++)
+	{
+		if (! Line__equal(a->lines.data + i, b->lines.data + i))
+			return 0;
+	}
+	for (i = 0; i < a->pts.len; i++)
+	{
+		if (! Point__equal(a->pts.data + i, b->pts.data + i))
+			return 0;
+	}
+	
+	return strcmp(a->name, b->name) == 0;
+}
+
+int main()
+{
+	test_struct_drive();
+	
+	//An invalid string in the last line must be rejected, 
+	//freeing the lines read before it
+	{
+		TestStruct res;
+		MmcMsg *msg, *bad_str;
+		
+		msg = TestStruct__serialize(testcases);
+		
+		//Submessages are the labels of lines 0 and 2, then the name
+		bad_str = mmc_msg_newa(1, 0);
+		((char *) bad_str->mem)[0] = '\0';
+		mmc_msg_unref(msg->submsgs[1]);
+		msg->submsgs[1] = bad_str;
+		
+		if (TestStruct__deserialize(msg, &res) != MDSL_FAILURE)
+			ssc_error("Test failed");
+		
+		mmc_msg_unref(msg);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,344 @@
+/* test_memfd.c
+ * Test for passing messages as memory files
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <tests/libtest.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define N_MSGS 40
+#define THRESHOLD 4096
+
+//Messages the servant keeps past the call: every other request, 
+//or its first submessage if it has one
+static MmcMsg *kept[N_MSGS];
+static int n_calls = 0;
+
+//Servant that replies with the request itself
+static void echo_servant_call
+	(MmcServant *servant, MmcMsg *msg, MmcReplier *replier)
+{
+	if (n_calls % 2 == 1)
+	{
+		kept[n_calls] = msg->submsgs_len ? msg->submsgs[0] : msg;
+		mmc_msg_ref(kept[n_calls]);
+	}
+	n_calls++;
+	mmc_replier_call(replier, msg);
+}
+
+static void echo_servant_destroy(MmcServant *servant)
+{
+	
+}
+
+//Builds a tree of messages, 
+//each node having mem_len bytes filled with its id
+static MmcMsg *build_tree(int depth, int fanout, int mem_len, int *id)
+{
+	MmcMsg *msg;
+	int i, n_sub;
+	
+	n_sub = depth > 0 ? fanout : 0;
+	msg = mmc_msg_newa(mem_len, n_sub);
+	memset(msg->mem, *id, mem_len);
+	(*id)++;
+	for (i = 0; i < n_sub; i++)
+		msg->submsgs[i] = build_tree(depth - 1, fanout - i, 
+			(mem_len * (i + 1)) % 3001, id);
+	
+	return msg;
+}
+
+static int tree_equal(MmcMsg *a, MmcMsg *b)
+{
+	size_t i;
+	
+	if (a->mem_len != b->mem_len || a->submsgs_len != b->submsgs_len)
+		return 0;
+	if (memcmp(a->mem, b->mem, a->mem_len) != 0)
+		return 0;
+	for (i = 0; i < a->submsgs_len; i++)
+	{
+		if (! tree_equal(a->submsgs[i], b->submsgs[i]))
+			return 0;
+	}
+	
+	return 1;
+}
+
+//Small messages, and large and huge ones sent as memory files
+static MmcMsg *build_msg(int i, int *id)
+{
+	switch (i % 4)
+	{
+	case 0:
+		return build_tree(1, 3, 100, id);
+	case 1:
+		return build_tree(2, 3, 2000, id);
+	case 2:
+		return build_tree(0, 0, 10000, id);
+	default:
+		return build_tree(2, 2, 3 << 20, id);
+	}
+}
+
+//Files: sealing, and what the receiver accepts
+static void test_file(void)
+{
+	SscMsgFlatSize size;
+	SscMsgMapping *mapping;
+	MmcMsg *msg;
+	size_t len;
+	void *mem;
+	int fd, plain, seals, id = 0;
+	
+	msg = build_tree(3, 3, 1000, &id);
+	fd = ssc_msg_memfd_new(msg, &size);
+	ssc_assert(fd >= 0, "Test failed");
+	len = sizeof(uint32_t) * size.n_layout + size.n_bytes;
+	
+	//The file cannot be changed any more
+	seals = fcntl(fd, F_GET_SEALS);
+	ssc_assert((seals & (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE 
+		| F_SEAL_SEAL)) == (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE 
+		| F_SEAL_SEAL), "Test failed");
+	ssc_assert(pwrite(fd, "x", 1, 0) < 0, "Test failed");
+	ssc_assert(ftruncate(fd, len + 1) < 0, "Test failed");
+	
+	//A copy without seals is refused
+	plain = memfd_create("test", MFD_CLOEXEC);
+	ssc_assert(plain >= 0, "Test failed");
+	ssc_assert(ftruncate(plain, len) == 0, "Test failed");
+	mem = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	ssc_assert(mem != MAP_FAILED, "Test failed");
+	ssc_assert(pwrite(plain, mem, len, 0) == (ssize_t) len, "Test failed");
+	munmap(mem, len);
+	ssc_assert(ssc_msg_mapping_new(plain, size.n_layout, len, NULL) == NULL,
+		"Test failed");
+	
+	//So is a wrong length
+	ssc_assert(ssc_msg_mapping_new(dup(fd), size.n_layout, len - 1, NULL) 
+		== NULL, "Test failed");
+	ssc_assert(ssc_msg_mapping_new(dup(fd), len, len, NULL) == NULL, 
+		"Test failed");
+	
+	mapping = ssc_msg_mapping_new(fd, size.n_layout, len, NULL);
+	ssc_assert(mapping != NULL, "Test failed");
+	ssc_assert(tree_equal(msg, ssc_msg_mapping_get_root(mapping)), 
+		"Test failed");
+	ssc_msg_mapping_free(mapping);
+	
+	mmc_msg_unref(msg);
+}
+
+//Reads everything available, checking messages against expected
+static void drain(int fd, SscMsgReader *reader, MmcMsg **expected, 
+	int *n_recvd, int *n_mapped)
+{
+	char buf[4096];
+	ssize_t len, off, n;
+	
+	while ((len = ssc_msg_reader_recv(reader, fd, buf, sizeof(buf))) > 0)
+	{
+		for (off = 0; off < len; off += n)
+		{
+			SscMsgMapping *mapping;
+			MmcMsg *res;
+			
+			n = ssc_msg_reader_feed(reader, buf + off, len - off, &res);
+			ssc_assert(n > 0, "Test failed");
+			if (! res)
+				continue;
+			
+			ssc_assert(*n_recvd < N_MSGS, "Test failed");
+			ssc_assert(tree_equal(expected[*n_recvd], res), "Test failed");
+			mapping = ssc_msg_reader_take_mapping(reader);
+			if (mapping)
+			{
+				ssc_msg_mapping_free(mapping);
+				(*n_mapped)++;
+			}
+			else
+				mmc_msg_unref(res);
+			(*n_recvd)++;
+		}
+	}
+	ssc_assert(len < 0 && errno == EAGAIN, "Test failed");
+}
+
+//A stream mixing normal frames and memory file frames, 
+//more of the latter than go with one write
+static void test_stream(void)
+{
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	MmcMsg *msgs[N_MSGS];
+	int fds[2], i, id = 0, n_recvd = 0, n_mapped = 0, iter;
+	
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		ssc_error("socketpair() failed");
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	
+	sender = ssc_msg_sender_new();
+	ssc_msg_sender_set_memfd(sender, THRESHOLD);
+	reader = ssc_msg_reader_new();
+	ssc_msg_reader_set_fd_passing(reader, 1);
+	
+	for (i = 0; i < N_MSGS; i++)
+	{
+		msgs[i] = build_msg(i, &id);
+		if (ssc_msg_sender_queue(sender, msgs[i]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+	}
+	
+	for (iter = 0; n_recvd < N_MSGS; iter++)
+	{
+		ssc_assert(iter < 100000, "Test failed");
+		if (ssc_msg_sender_flush(sender, fds[0]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		drain(fds[1], reader, msgs, &n_recvd, &n_mapped);
+	}
+	ssc_assert(n_mapped == 3 * N_MSGS / 4, "Test failed");
+	
+	for (i = 0; i < N_MSGS; i++)
+		mmc_msg_unref(msgs[i]);
+	ssc_msg_sender_free(sender);
+	ssc_msg_reader_free(reader);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+//Memory file frames are invalid unless accepted, 
+//and need a descriptor
+static void test_refused(void)
+{
+	SscMsgReader *reader;
+	char frame[SSC_MSG_FRAME_MEMFD_SIZE];
+	MmcMsg *msg;
+	
+	ssc_msg_frame_header_store_memfd(frame, 1, 1, 4);
+	
+	reader = ssc_msg_reader_new();
+	ssc_assert(ssc_msg_reader_feed(reader, frame, sizeof(frame), &msg) < 0,
+		"Test failed");
+	ssc_assert(ssc_msg_reader_push_fd(reader, dup(0)) == MDSL_FAILURE, 
+		"Test failed");
+	
+	ssc_msg_reader_reset(reader);
+	ssc_msg_reader_set_fd_passing(reader, 1);
+	ssc_assert(ssc_msg_reader_feed(reader, frame, sizeof(frame), &msg) < 0,
+		"Test failed");
+	ssc_msg_reader_free(reader);
+}
+
+//The transport passes large requests and replies as memory files
+static void test_transport(void)
+{
+	MmcServant servant;
+	SscTransport *transport;
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	MmcMsg *msgs[N_MSGS];
+	int fds[2], i, id = 0, n_recvd = 0, n_mapped = 0, n_dispatched, iter;
+	
+	memset(&servant, 0, sizeof(servant));
+	mdsl_rc_init(&servant);
+	servant.destroy = echo_servant_destroy;
+	servant.call = echo_servant_call;
+	
+	//Not with io_uring
+	transport = ssc_transport_new(SSC_TRANSPORT_IO_URING, &servant);
+	if (transport)
+	{
+		ssc_assert(ssc_transport_set_fd_passing(transport, THRESHOLD) 
+			== MDSL_FAILURE, "Test failed");
+		ssc_transport_free(transport);
+	}
+	
+	transport = ssc_transport_new(SSC_TRANSPORT_EPOLL, &servant);
+	ssc_assert(transport != NULL, "Test failed");
+	ssc_assert(ssc_transport_set_fd_passing(transport, THRESHOLD) 
+		== MDSL_SUCCESS, "Test failed");
+	
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		ssc_error("socketpair() failed");
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	if (ssc_transport_add(transport, fds[1]) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	
+	sender = ssc_msg_sender_new();
+	ssc_msg_sender_set_memfd(sender, THRESHOLD);
+	reader = ssc_msg_reader_new();
+	ssc_msg_reader_set_fd_passing(reader, 1);
+	for (i = 0; i < N_MSGS; i++)
+	{
+		msgs[i] = build_msg(i, &id);
+		if (ssc_msg_sender_queue(sender, msgs[i]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+	}
+	
+	n_dispatched = 0;
+	for (iter = 0; n_recvd < N_MSGS; iter++)
+	{
+		int res;
+		
+		ssc_assert(iter < 100000, "Test failed");
+		if (ssc_msg_sender_flush(sender, fds[0]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		res = ssc_transport_run_once(transport, 10);
+		ssc_assert(res >= 0, "Test failed");
+		n_dispatched += res;
+		drain(fds[0], reader, msgs, &n_recvd, &n_mapped);
+	}
+	ssc_assert(n_dispatched == N_MSGS, "Test failed");
+	ssc_assert(n_mapped == 3 * N_MSGS / 4, "Test failed");
+	
+	//Messages kept by the servant stay mapped after the replies
+	for (i = 1; i < N_MSGS; i += 2)
+	{
+		ssc_assert(tree_equal(kept[i], msgs[i]->submsgs_len 
+			? msgs[i]->submsgs[0] : msgs[i]), "Test failed");
+		mmc_msg_unref(kept[i]);
+	}
+	
+	ssc_transport_free(transport);
+	for (i = 0; i < N_MSGS; i++)
+		mmc_msg_unref(msgs[i]);
+	ssc_msg_sender_free(sender);
+	ssc_msg_reader_free(reader);
+	close(fds[0]);
+}
+
+int main()
+{
+	test_file();
+	test_stream();
+	test_refused();
+	test_transport();
+	
+	return 0;
+}
@@ -0,0 +1,1419 @@
+/* test_msg.c
+ * Message flattening test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//Builds a tree of messages, 
+//each node having mem_len bytes filled with its id
+static MmcMsg *build_tree(int depth, int fanout, int *id)
+{
+	MmcMsg *msg;
+	int i, n_sub, mem_len;
+	
+	n_sub = depth > 0 ? fanout : 0;
+	mem_len = (*id % 3) * 5;
+	msg = mmc_msg_newa(mem_len, n_sub);
+	memset(msg->mem, *id, mem_len);
+	(*id)++;
+	for (i = 0; i < n_sub; i++)
+		msg->submsgs[i] = build_tree(depth - 1, fanout - i, id);
+	
+	return msg;
+}
+
+static int tree_equal(MmcMsg *a, MmcMsg *b)
+{
+	size_t i;
+	
+	if (a->mem_len != b->mem_len || a->submsgs_len != b->submsgs_len)
+		return 0;
+	if (memcmp(a->mem, b->mem, a->mem_len) != 0)
+		return 0;
+	for (i = 0; i < a->submsgs_len; i++)
+	{
+		if (! tree_equal(a->submsgs[i], b->submsgs[i]))
+			return 0;
+	}
+	
+	return 1;
+}
+
+static void test_tree(MmcMsg *msg)
+{
+	SscMsgFlatSize size;
+	uint32_t *layout, *ref_layout;
+	struct iovec *iov;
+	SscMBlock *blocks;
+	size_t n_blocks, i, n_bytes;
+	
+	//Size query
+	ssc_msg_flatten(msg, 0, NULL, NULL, &size);
+	ssc_assert(size.n_nodes == ssc_msg_count(msg), "Test failed");
+	
+	//Reference output from the older functions
+	ssc_assert(size.n_layout == ssc_msg_layout_len(msg), "Test failed");
+	ref_layout = mdsl_alloc(sizeof(uint32_t) * size.n_layout);
+	ssc_msg_create_layout(msg, size.n_layout, ref_layout);
+	blocks = mdsl_alloc(sizeof(SscMBlock) * size.n_nodes);
+	n_blocks = ssc_msg_get_blocks(msg, size.n_nodes, blocks);
+	ssc_assert(n_blocks == size.n_iov, "Test failed");
+	
+	//Flatten must agree with them
+	layout = mdsl_alloc(sizeof(uint32_t) * size.n_layout);
+	iov = mdsl_alloc(sizeof(struct iovec) * size.n_layout);
+	if (ssc_msg_flatten(msg, size.n_layout, layout, iov, &size) 
+		!= MDSL_SUCCESS)
+		ssc_error("Test failed");
+	ssc_assert(size.n_iov == n_blocks, "Test failed");
+	ssc_assert(memcmp(layout, ref_layout, 
+		sizeof(uint32_t) * size.n_layout) == 0, "Test failed");
+	n_bytes = 0;
+	for (i = 0; i < n_blocks; i++)
+	{
+		ssc_assert(iov[i].iov_base == blocks[i].mem, "Test failed");
+		ssc_assert(iov[i].iov_len == blocks[i].len, "Test failed");
+		n_bytes += iov[i].iov_len;
+	}
+	ssc_assert(size.n_bytes == n_bytes, "Test failed");
+	
+	//The checksum kept by the walk is that of the blocks
+	{
+		uint32_t crc = 1, ref_crc = 1;
+		
+		for (i = 0; i < n_blocks; i++)
+			ref_crc = ssc_crc32c(ref_crc, blocks[i].mem, blocks[i].len);
+		if (ssc_msg_flatten_full(msg, size.n_layout, layout, iov, NULL, 
+				NULL, &crc) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(crc == ref_crc, "Test failed");
+	}
+	
+	//Layout must be readable back
+	{
+		MmcMsg *copy = ssc_msg_alloc_by_layout(size.n_layout, layout);
+		
+		ssc_assert(copy != NULL, "Test failed");
+		ssc_assert(ssc_msg_count(copy) == size.n_nodes, "Test failed");
+		mmc_msg_unref(copy);
+	}
+	
+	//Varint encoding must decode to the same layout
+	{
+		uint32_t *decoded;
+		uint8_t *varint;
+		size_t n_varint, n_decoded;
+		
+		n_varint = ssc_msg_layout_to_varint(layout, size.n_layout, NULL);
+		ssc_assert(n_varint >= size.n_layout, "Test failed");
+		varint = mdsl_alloc(n_varint);
+		decoded = mdsl_alloc(sizeof(uint32_t) * n_varint);
+		ssc_assert(ssc_msg_layout_to_varint(layout, size.n_layout, varint)
+			== n_varint, "Test failed");
+		if (ssc_msg_layout_from_varint(varint, n_varint, decoded, 
+				&n_decoded) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(n_decoded == size.n_layout, "Test failed");
+		ssc_assert(memcmp(decoded, layout, 
+			sizeof(uint32_t) * size.n_layout) == 0, "Test failed");
+		
+		//Truncated varint
+		if (varint[n_varint - 1] == 0)
+		{
+			varint[n_varint - 1] = 0x80;
+			ssc_assert(ssc_msg_layout_from_varint(varint, n_varint, 
+				decoded, &n_decoded) == MDSL_FAILURE, "Test failed");
+		}
+		
+		free(varint);
+		free(decoded);
+	}
+	
+	//Contiguous buffer must be readable back without copying
+	{
+		SscMsgSlab *slab;
+		char *buf, *ptr;
+		size_t buf_len;
+		
+		buf_len = sizeof(uint32_t) * size.n_layout + size.n_bytes;
+		buf = mdsl_alloc(buf_len);
+		memcpy(buf, layout, sizeof(uint32_t) * size.n_layout);
+		ptr = buf + sizeof(uint32_t) * size.n_layout;
+		for (i = 0; i < size.n_iov; i++)
+		{
+			memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
+			ptr += iov[i].iov_len;
+		}
+		
+		slab = ssc_msg_slab_new(buf, buf_len);
+		ssc_assert(slab != NULL, "Test failed");
+		ssc_assert(tree_equal(msg, ssc_msg_slab_get_root(slab)), 
+			"Test failed");
+		if (size.n_bytes > 0)
+			ssc_assert(ssc_msg_slab_get_root(slab)->mem == 
+				buf + sizeof(uint32_t) * size.n_layout 
+				|| msg->mem_len == 0, "Test failed");
+		ssc_msg_slab_free(slab);
+		
+		//References may be kept past the slab, to the root, 
+		//or to other messages paired with ones to the root
+		{
+			MmcMsg *root, *sub = NULL;
+			
+			slab = ssc_msg_slab_new(buf, buf_len);
+			ssc_assert(! ssc_msg_slab_in_use(slab), "Test failed");
+			root = ssc_msg_slab_get_root(slab);
+			mmc_msg_ref(root);
+			ssc_assert(ssc_msg_slab_in_use(slab), "Test failed");
+			mmc_msg_unref(root);
+			if (root->submsgs_len)
+			{
+				sub = root->submsgs[root->submsgs_len - 1];
+				mmc_msg_ref(sub);
+				ssc_assert(ssc_msg_slab_in_use(slab), "Test failed");
+			}
+			mmc_msg_ref(root);
+			ssc_msg_slab_free(slab);
+			ssc_assert(tree_equal(msg, root), "Test failed");
+			if (sub)
+				mmc_msg_unref(sub);
+			mmc_msg_unref(root);
+		}
+		
+		//Sizes not matching the layout must be rejected
+		ssc_assert(ssc_msg_slab_new(buf, buf_len - 1) == NULL, 
+			"Test failed");
+		ssc_assert(ssc_msg_slab_new(buf, buf_len + 1) == NULL, 
+			"Test failed");
+		
+		free(buf);
+	}
+	
+	//Frames must be parsable from chunks of any size
+	{
+		SscMsgReader *reader;
+		MmcMsg *res;
+		char *buf, *ptr;
+		size_t frame_len, total_len, n_varint, chunk, off;
+		ssize_t n;
+		int n_msgs;
+		
+		//Two frames back to back, the second with a varint layout
+		n_varint = ssc_msg_layout_to_varint(layout, size.n_layout, NULL);
+		frame_len = SSC_MSG_FRAME_HEADER_SIZE 
+			+ sizeof(uint32_t) * size.n_layout + size.n_bytes;
+		total_len = frame_len * 2 
+			- sizeof(uint32_t) * size.n_layout + n_varint;
+		buf = mdsl_alloc(total_len);
+		ptr = buf;
+		ssc_msg_frame_header_store(ptr, size.n_layout, size.n_nodes);
+		ptr += SSC_MSG_FRAME_HEADER_SIZE;
+		memcpy(ptr, layout, sizeof(uint32_t) * size.n_layout);
+		ptr += sizeof(uint32_t) * size.n_layout;
+		for (i = 0; i < size.n_iov; i++)
+		{
+			memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
+			ptr += iov[i].iov_len;
+		}
+		ssc_msg_frame_header_store_varint(ptr, n_varint);
+		ptr += SSC_MSG_FRAME_HEADER_SIZE;
+		ssc_msg_layout_to_varint(layout, size.n_layout, ptr);
+		ptr += n_varint;
+		memcpy(ptr, buf + frame_len - size.n_bytes, size.n_bytes);
+		
+		reader = ssc_msg_reader_new();
+		for (chunk = 1; chunk <= total_len; chunk += 3)
+		{
+			n_msgs = 0;
+			for (off = 0; off < total_len; off += chunk)
+			{
+				size_t lim = chunk;
+				size_t sub = 0;
+				
+				if (lim > total_len - off)
+					lim = total_len - off;
+				while (sub < lim)
+				{
+					n = ssc_msg_reader_feed
+						(reader, buf + off + sub, lim - sub, &res);
+					ssc_assert(n > 0, "Test failed");
+					sub += n;
+					if (res)
+					{
+						ssc_assert(tree_equal(msg, res), "Test failed");
+						mmc_msg_unref(res);
+						n_msgs++;
+					}
+				}
+			}
+			ssc_assert(n_msgs == 2, "Test failed");
+		}
+		
+		//Reading directly into the reader's memory
+		n_msgs = 0;
+		off = 0;
+		while (off < total_len)
+		{
+			void *dest;
+			size_t dest_len;
+			
+			ssc_msg_reader_get_buffer(reader, &dest, &dest_len);
+			ssc_assert(dest_len > 0, "Test failed");
+			if (dest_len > 2)
+				dest_len = 2;
+			if (dest_len > total_len - off)
+				dest_len = total_len - off;
+			memcpy(dest, buf + off, dest_len);
+			off += dest_len;
+			if (ssc_msg_reader_advance(reader, dest_len, &res) 
+				!= MDSL_SUCCESS)
+				ssc_error("Test failed");
+			if (res)
+			{
+				ssc_assert(tree_equal(msg, res), "Test failed");
+				ssc_assert(ssc_msg_reader_get_format(reader) 
+					== (n_msgs ? SSC_MSG_LAYOUT_VARINT 
+						: SSC_MSG_LAYOUT_FIXED), "Test failed");
+				mmc_msg_unref(res);
+				n_msgs++;
+			}
+		}
+		ssc_assert(n_msgs == 2, "Test failed");
+		
+		//Partial frame is dropped on reset, invalid header is rejected
+		n = ssc_msg_reader_feed(reader, buf, frame_len - 1, &res);
+		ssc_assert(n == (ssize_t) (frame_len - 1) && ! res, 
+			"Test failed");
+		ssc_msg_reader_reset(reader);
+		ssc_msg_frame_header_store(buf, 0, 0);
+		n = ssc_msg_reader_feed(reader, buf, frame_len, &res);
+		ssc_assert(n < 0 && ! res, "Test failed");
+		
+		ssc_msg_reader_free(reader);
+		free(buf);
+	}
+	
+	//Too small arrays must be detected
+	if (size.n_layout > 1)
+	{
+		if (ssc_msg_flatten(msg, size.n_layout - 1, layout, iov, NULL)
+			!= MDSL_FAILURE)
+			ssc_error("Test failed");
+	}
+	
+	free(ref_layout);
+	free(blocks);
+	free(layout);
+	free(iov);
+}
+
+//Sends many messages over a nonblocking socket, 
+//receiving them on the other end with a reader
+static void test_sender(void)
+{
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	SscMsgSenderStats stats;
+	MmcMsg *msgs[100];
+	int fds[2], id, n_recvd, i;
+	size_t n_iov = 0;
+	
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		ssc_error("socketpair() failed");
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	
+	//Small buffer, so that writes are partial
+	i = 2048;
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &i, sizeof(i));
+	
+	sender = ssc_msg_sender_new();
+	reader = ssc_msg_reader_new();
+	id = 0;
+	for (i = 0; i < 100; i++)
+	{
+		SscMsgFlatSize size;
+		
+		msgs[i] = build_tree(i % 4, 3, &id);
+		ssc_msg_flatten(msgs[i], 0, NULL, NULL, &size);
+		n_iov += 1 + size.n_iov;
+		ssc_msg_sender_set_format(sender, i % 2 
+			? SSC_MSG_LAYOUT_VARINT : SSC_MSG_LAYOUT_FIXED);
+		ssc_msg_sender_set_checksum(sender, i % 3 == 0);
+		if (ssc_msg_sender_queue(sender, msgs[i]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+	}
+	
+	n_recvd = 0;
+	while (n_recvd < 100)
+	{
+		char buf[4096];
+		ssize_t len, off, n;
+		
+		if (ssc_msg_sender_flush(sender, fds[0]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		
+		while ((len = read(fds[1], buf, sizeof(buf))) > 0)
+		{
+			for (off = 0; off < len; off += n)
+			{
+				MmcMsg *res;
+				
+				n = ssc_msg_reader_feed(reader, buf + off, len - off, &res);
+				ssc_assert(n > 0, "Test failed");
+				if (res)
+				{
+					ssc_assert(n_recvd < 100, "Test failed");
+					ssc_assert(tree_equal(msgs[n_recvd], res), 
+						"Test failed");
+					mmc_msg_unref(res);
+					n_recvd++;
+				}
+			}
+		}
+	}
+	
+	ssc_assert(ssc_msg_sender_get_pending(sender) == 0, "Test failed");
+	ssc_msg_sender_get_stats(sender, &stats);
+	ssc_assert(stats.n_msgs == 100, "Test failed");
+	ssc_assert(stats.n_syscalls < n_iov, "Test failed");
+	
+	//Layouts too large for the frame header are refused, 
+	//whether counted in elements or in varint bytes
+	{
+		MmcMsg *big, *child;
+		size_t n_sub;
+		
+		n_sub = SSC_MSG_READER_MAX_LAYOUT / 2;
+		child = mmc_msg_newa(32, 0);
+		memset(child->mem, 0, 32);
+		big = mmc_msg_newa(0, n_sub);
+		for (i = 0; i < n_sub; i++)
+		{
+			mmc_msg_ref(child);
+			big->submsgs[i] = child;
+		}
+		
+		ssc_msg_sender_set_format(sender, SSC_MSG_LAYOUT_VARINT);
+		ssc_assert(ssc_msg_sender_queue(sender, big) == MDSL_FAILURE,
+			"Test failed");
+		mmc_msg_unref(big);
+		
+		big = mmc_msg_newa(0, SSC_MSG_READER_MAX_LAYOUT);
+		for (i = 0; i < SSC_MSG_READER_MAX_LAYOUT; i++)
+		{
+			mmc_msg_ref(child);
+			big->submsgs[i] = child;
+		}
+		ssc_msg_sender_set_format(sender, SSC_MSG_LAYOUT_FIXED);
+		ssc_assert(ssc_msg_sender_queue(sender, big) == MDSL_FAILURE,
+			"Test failed");
+		ssc_assert(ssc_msg_sender_get_pending(sender) == 0, 
+			"Test failed");
+		mmc_msg_unref(big);
+		mmc_msg_unref(child);
+	}
+	
+	ssc_msg_sender_free(sender);
+	ssc_msg_reader_free(reader);
+	for (i = 0; i < 100; i++)
+		mmc_msg_unref(msgs[i]);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+//Frames with CRC trailers are verified, and damage anywhere is detected
+static void test_checksum(void)
+{
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	MmcMsg *msg, *res;
+	struct iovec *iov;
+	size_t n_iov, total_len, off, i;
+	char *buf;
+	ssize_t n;
+	int id, format;
+	
+	for (format = 0; format < 2; format++)
+	{
+		id = 0;
+		msg = build_tree(3, 3, &id);
+		sender = ssc_msg_sender_new();
+		ssc_msg_sender_set_format(sender, format 
+			? SSC_MSG_LAYOUT_VARINT : SSC_MSG_LAYOUT_FIXED);
+		ssc_msg_sender_set_checksum(sender, 1);
+		if (ssc_msg_sender_queue(sender, msg) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		
+		total_len = ssc_msg_sender_get_pending(sender);
+		buf = mdsl_alloc(total_len);
+		ssc_msg_sender_get_iov(sender, &iov, &n_iov);
+		for (i = 0, off = 0; i < n_iov; i++)
+		{
+			memcpy(buf + off, iov[i].iov_base, iov[i].iov_len);
+			off += iov[i].iov_len;
+		}
+		ssc_assert(off == total_len, "Test failed");
+		ssc_assert(ssc_uint32_load_le(buf) & SSC_MSG_FRAME_CRC, 
+			"Test failed");
+		ssc_msg_sender_consume(sender, total_len);
+		
+		//Intact frame, a byte at a time
+		reader = ssc_msg_reader_new();
+		res = NULL;
+		for (off = 0; off < total_len; off++)
+		{
+			n = ssc_msg_reader_feed(reader, buf + off, 1, &res);
+			ssc_assert(n == 1, "Test failed");
+			ssc_assert(! res || off == total_len - 1, "Test failed");
+		}
+		ssc_assert(res && tree_equal(msg, res), "Test failed");
+		ssc_assert(ssc_msg_reader_get_checksum(reader), "Test failed");
+		mmc_msg_unref(res);
+		
+		//A flipped bit past the header fails the frame
+		for (off = SSC_MSG_FRAME_HEADER_SIZE; off < total_len; off++)
+		{
+			buf[off] ^= 0x10;
+			ssc_msg_reader_reset(reader);
+			n = ssc_msg_reader_feed(reader, buf, total_len, &res);
+			if (n >= 0)
+			{
+				//Layout damage may still be a valid layout
+				ssc_assert(! res, "Test failed");
+			}
+			buf[off] ^= 0x10;
+		}
+		
+		ssc_msg_reader_free(reader);
+		ssc_msg_sender_free(sender);
+		free(buf);
+		mmc_msg_unref(msg);
+	}
+}
+
+//Compressed frames: tiny, compressible, incompressible and 
+//multi-chunk blocks survive, and the frame shrinks
+static void test_compression(void)
+{
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	MmcMsg *msg, *res;
+	struct iovec *iov;
+	size_t n_iov, total_len, off, chunk, i;
+	char *buf;
+	ssize_t n;
+	int variant, n_msgs;
+	uint32_t seed = 1;
+	
+	msg = mmc_msg_newa(0, 5);
+	msg->submsgs[0] = mmc_msg_newa(3, 0);
+	memcpy(msg->submsgs[0]->mem, "abc", 3);
+	msg->submsgs[1] = mmc_msg_newa(200000, 0);
+	for (i = 0; i < 200000; i++)
+		((char *) msg->submsgs[1]->mem)[i] = "log line\n"[i % 9];
+	msg->submsgs[2] = mmc_msg_newa(0, 0);
+	msg->submsgs[3] = mmc_msg_newa(5000, 0);
+	for (i = 0; i < 5000; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		((char *) msg->submsgs[3]->mem)[i] = seed >> 16;
+	}
+	msg->submsgs[4] = mmc_msg_newa(7, 0);
+	memcpy(msg->submsgs[4]->mem, "defghij", 7);
+	
+	for (variant = 0; variant < 4; variant++)
+	{
+		sender = ssc_msg_sender_new();
+		ssc_msg_sender_set_format(sender, (variant & 1) 
+			? SSC_MSG_LAYOUT_VARINT : SSC_MSG_LAYOUT_FIXED);
+		ssc_msg_sender_set_checksum(sender, variant & 2);
+		ssc_msg_sender_set_codec(sender, SSC_MSG_CODEC_LZ4);
+		if (ssc_msg_sender_queue(sender, msg) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_msg_sender_set_codec(sender, SSC_MSG_CODEC_NONE);
+		if (ssc_msg_sender_queue(sender, msg) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		
+		total_len = ssc_msg_sender_get_pending(sender);
+		buf = mdsl_alloc(total_len);
+		ssc_msg_sender_get_iov(sender, &iov, &n_iov);
+		for (i = 0, off = 0; i < n_iov; i++)
+		{
+			memcpy(buf + off, iov[i].iov_base, iov[i].iov_len);
+			off += iov[i].iov_len;
+		}
+		ssc_assert(off == total_len, "Test failed");
+		ssc_msg_sender_consume(sender, total_len);
+		
+		//The compressed frame comes first, with the raw one after it
+		ssc_assert(ssc_uint32_load_le(buf) & SSC_MSG_FRAME_COMPRESSED, 
+			"Test failed");
+		ssc_assert(total_len < 205012 + 5000 + 5000, "Test failed");
+		
+		reader = ssc_msg_reader_new();
+		for (chunk = 1000; chunk <= total_len; chunk *= 7)
+		{
+			n_msgs = 0;
+			for (off = 0; off < total_len; off += n)
+			{
+				size_t lim = total_len - off;
+				
+				n = ssc_msg_reader_feed(reader, buf + off, 
+					lim < chunk ? lim : chunk, &res);
+				ssc_assert(n > 0, "Test failed");
+				if (res)
+				{
+					ssc_assert(tree_equal(msg, res), "Test failed");
+					ssc_assert(ssc_msg_reader_get_compressed(reader) 
+						== (n_msgs == 0), "Test failed");
+					mmc_msg_unref(res);
+					n_msgs++;
+				}
+			}
+			ssc_assert(n_msgs == 2, "Test failed");
+		}
+		
+		//Damaged chunk header is rejected
+		ssc_msg_reader_reset(reader);
+		off = SSC_MSG_FRAME_HEADER_SIZE + ((variant & 1) ? 
+			((uint32_t) (ssc_uint32_load_le(buf) & 0xfffff)) : 6 * 4);
+		buf[off + 3] = 7;
+		n = ssc_msg_reader_feed(reader, buf, total_len, &res);
+		ssc_assert(n < 0 && ! res, "Test failed");
+		
+		ssc_msg_reader_free(reader);
+		ssc_msg_sender_free(sender);
+		free(buf);
+	}
+	
+	mmc_msg_unref(msg);
+}
+
+//Message sent i-th in test_shapes(): first cycling through more 
+//shapes than are cached, then through fewer, with an uncacheable 
+//one now and then
+static int shape_msg_index(size_t i)
+{
+	if (i % 50 == 0)
+		return 80;
+	return (i * 7) % (i < 200 ? 80 : 40);
+}
+
+//Shape plans allocate as layouts do; shapes cached across frames 
+//replace layouts, including after being evicted and defined again
+static void test_shapes(void)
+{
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	SscMsgPlan *plan;
+	MmcMsg *msgs[81], *res, *nodes[64];
+	struct iovec *iov;
+	uint32_t layout[64];
+	size_t n_iov, total_len, off, i, len, lens[2];
+	char *buf, bad[SSC_MSG_FRAME_HEADER_SIZE];
+	ssize_t n;
+	int id, k, variant, n_recvd;
+	
+	//Plans
+	id = 0;
+	msgs[0] = build_tree(3, 3, &id);
+	len = ssc_msg_layout_len(msgs[0]);
+	ssc_msg_create_layout(msgs[0], len, layout);
+	plan = ssc_msg_plan_new(len, layout);
+	ssc_assert(plan && ssc_msg_plan_get_n_nodes(plan) == len, 
+		"Test failed");
+	for (k = 0; k < 2; k++)
+	{
+		uint32_t res_layout[64];
+		
+		res = ssc_msg_plan_alloc(plan, k ? nodes : NULL);
+		ssc_assert(res && ssc_msg_layout_len(res) == len, "Test failed");
+		ssc_assert(! k || (nodes[0] == res 
+			&& nodes[1] == res->submsgs[0]), "Test failed");
+		ssc_msg_create_layout(res, len, res_layout);
+		ssc_assert(memcmp(layout, res_layout, sizeof(uint32_t) * len) 
+			== 0, "Test failed");
+		mmc_msg_unref(res);
+	}
+	ssc_msg_plan_free(plan);
+	ssc_assert(! ssc_msg_plan_new(len - 1, layout), "Test failed");
+	mmc_msg_unref(msgs[0]);
+	
+	//80 shapes, more than are cached, and one too large to cache
+	for (k = 0; k < 80; k++)
+	{
+		msgs[k] = mmc_msg_newa(k, 2);
+		memset(msgs[k]->mem, k, k);
+		msgs[k]->submsgs[0] = mmc_msg_newa(3, 0);
+		memcpy(msgs[k]->submsgs[0]->mem, "abc", 3);
+		msgs[k]->submsgs[1] = mmc_msg_newa(k % 5, 0);
+		memset(msgs[k]->submsgs[1]->mem, 'x', k % 5);
+	}
+	msgs[80] = mmc_msg_newa(0, SSC_MSG_SHAPE_MAX_LAYOUT);
+	for (i = 0; i < SSC_MSG_SHAPE_MAX_LAYOUT; i++)
+		msgs[80]->submsgs[i] = mmc_msg_newa(1, 0);
+	
+	for (variant = 0; variant < 8; variant++)
+	{
+		//Same messages with and without shapes
+		for (k = 0; k < 2; k++)
+		{
+			sender = ssc_msg_sender_new();
+			ssc_msg_sender_set_format(sender, (variant & 1) 
+				? SSC_MSG_LAYOUT_VARINT : SSC_MSG_LAYOUT_FIXED);
+			ssc_msg_sender_set_checksum(sender, variant & 2);
+			ssc_msg_sender_set_codec(sender, (variant & 4) 
+				? SSC_MSG_CODEC_LZ4 : SSC_MSG_CODEC_NONE);
+			ssc_msg_sender_set_shapes(sender, k);
+			for (i = 0; i < 400; i++)
+			{
+				if (ssc_msg_sender_queue(sender, msgs[shape_msg_index(i)]) 
+					!= MDSL_SUCCESS)
+					ssc_error("Test failed");
+			}
+			
+			lens[k] = total_len = ssc_msg_sender_get_pending(sender);
+			if (! k)
+			{
+				ssc_msg_sender_free(sender);
+				continue;
+			}
+			
+			buf = mdsl_alloc(total_len);
+			off = 0;
+			while (ssc_msg_sender_get_pending(sender) > 0)
+			{
+				ssc_msg_sender_get_iov(sender, &iov, &n_iov);
+				for (i = 0; i < n_iov; i++)
+				{
+					memcpy(buf + off, iov[i].iov_base, iov[i].iov_len);
+					off += iov[i].iov_len;
+					ssc_msg_sender_consume(sender, iov[i].iov_len);
+				}
+			}
+			ssc_assert(off == total_len, "Test failed");
+			ssc_msg_sender_free(sender);
+			
+			reader = ssc_msg_reader_new();
+			n_recvd = 0;
+			for (off = 0; off < total_len; off += n)
+			{
+				len = total_len - off;
+				if (len > 77)
+					len = 77;
+				n = ssc_msg_reader_feed(reader, buf + off, len, &res);
+				ssc_assert(n > 0, "Test failed");
+				if (res)
+				{
+					i = n_recvd;
+					ssc_assert(tree_equal(res, msgs[shape_msg_index(i)]), 
+						"Test failed");
+					ssc_assert(ssc_msg_reader_get_shapes(reader) 
+						== (i % 50 != 0), "Test failed");
+					mmc_msg_unref(res);
+					n_recvd++;
+				}
+			}
+			ssc_assert(n_recvd == 400, "Test failed");
+			
+			//Shapes are forgotten on reset
+			ssc_msg_reader_reset(reader);
+			ssc_msg_frame_header_store_shape(bad, 0);
+			n = ssc_msg_reader_feed(reader, bad, sizeof(bad), &res);
+			ssc_assert(n < 0 && ! res, "Test failed");
+			
+			ssc_msg_reader_free(reader);
+			free(buf);
+		}
+		
+		ssc_assert(lens[1] < lens[0], "Test failed");
+	}
+	
+	for (k = 0; k < 81; k++)
+		mmc_msg_unref(msgs[k]);
+}
+
+//Collects the pending bytes of a sender
+static char *drain_sender(SscMsgSender *sender, size_t *total_len)
+{
+	struct iovec *iov;
+	size_t n_iov, off, i;
+	char *buf;
+	
+	*total_len = ssc_msg_sender_get_pending(sender);
+	buf = mdsl_alloc(*total_len);
+	off = 0;
+	while (ssc_msg_sender_get_pending(sender) > 0)
+	{
+		ssc_msg_sender_get_iov(sender, &iov, &n_iov);
+		for (i = 0; i < n_iov; i++)
+		{
+			memcpy(buf + off, iov[i].iov_base, iov[i].iov_len);
+			off += iov[i].iov_len;
+			ssc_msg_sender_consume(sender, iov[i].iov_len);
+		}
+	}
+	ssc_assert(off == *total_len, "Test failed");
+	
+	return buf;
+}
+
+//Varint shapes with more layout bytes than SSC_MSG_SHAPE_MAX_LAYOUT, 
+//but no more elements, are defined and then reused
+static void test_varint_shapes(void)
+{
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	MmcMsg *msg, *res;
+	uint32_t *layout;
+	size_t len, total_len, off, i;
+	char *buf;
+	ssize_t n;
+	int n_recvd;
+	
+	msg = mmc_msg_newa(0, 600);
+	for (i = 0; i < 600; i++)
+	{
+		msg->submsgs[i] = mmc_msg_newa(40, 0);
+		memset(msg->submsgs[i]->mem, i, 40);
+	}
+	len = ssc_msg_layout_len(msg);
+	layout = mdsl_alloc(sizeof(uint32_t) * len);
+	ssc_msg_create_layout(msg, len, layout);
+	ssc_assert(len <= SSC_MSG_SHAPE_MAX_LAYOUT 
+		&& ssc_msg_layout_to_varint(layout, len, NULL) 
+			> SSC_MSG_SHAPE_MAX_LAYOUT, "Test failed");
+	free(layout);
+	
+	sender = ssc_msg_sender_new();
+	ssc_msg_sender_set_format(sender, SSC_MSG_LAYOUT_VARINT);
+	ssc_msg_sender_set_shapes(sender, 1);
+	for (i = 0; i < 2; i++)
+	{
+		if (ssc_msg_sender_queue(sender, msg) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+	}
+	buf = drain_sender(sender, &total_len);
+	ssc_msg_sender_free(sender);
+	
+	reader = ssc_msg_reader_new();
+	n_recvd = 0;
+	for (off = 0; off < total_len; off += n)
+	{
+		n = ssc_msg_reader_feed(reader, buf + off, total_len - off, &res);
+		ssc_assert(n > 0, "Test failed");
+		if (res)
+		{
+			ssc_assert(tree_equal(res, msg) 
+				&& ssc_msg_reader_get_shapes(reader), "Test failed");
+			mmc_msg_unref(res);
+			n_recvd++;
+		}
+	}
+	ssc_assert(n_recvd == 2, "Test failed");
+	ssc_msg_reader_free(reader);
+	free(buf);
+	
+	mmc_msg_unref(msg);
+}
+
+//Small messages packed into batch frames
+static void test_coalescing(void)
+{
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	MmcMsg *msgs[23], *res;
+	SscMsgSenderStats stats;
+	size_t total_len, off, len, lens[2];
+	char *buf;
+	ssize_t n;
+	int id, i, k, variant, n_recvd;
+	
+	//20 small messages between two large ones, and one more small one
+	id = 0;
+	for (i = 0; i < 23; i++)
+	{
+		if (i == 0 || i == 21)
+		{
+			msgs[i] = mmc_msg_newa(SSC_MSG_COALESCE_MAX, 0);
+			memset(msgs[i]->mem, i, SSC_MSG_COALESCE_MAX);
+		}
+		else
+			msgs[i] = build_tree(i % 3, 2, &id);
+	}
+	
+	for (variant = 0; variant < 8; variant++)
+	{
+		for (k = 0; k < 2; k++)
+		{
+			sender = ssc_msg_sender_new();
+			ssc_msg_sender_set_format(sender, (variant & 1) 
+				? SSC_MSG_LAYOUT_VARINT : SSC_MSG_LAYOUT_FIXED);
+			ssc_msg_sender_set_checksum(sender, variant & 2);
+			ssc_msg_sender_set_codec(sender, (variant & 4) 
+				? SSC_MSG_CODEC_LZ4 : SSC_MSG_CODEC_NONE);
+			
+			//Nothing is ever due, so batches are full ones but for 
+			//the messages before the large one, and the first small 
+			//one goes right away
+			ssc_msg_sender_set_coalescing(sender, k ? 8 : 0, 100000000);
+			for (i = 0; i < 23; i++)
+			{
+				if (ssc_msg_sender_queue(sender, msgs[i]) != MDSL_SUCCESS)
+					ssc_error("Test failed");
+			}
+			ssc_assert((ssc_msg_sender_get_timeout(sender) > 0) == k, 
+				"Test failed");
+			if (ssc_msg_sender_close_batch(sender, 1) != MDSL_SUCCESS)
+				ssc_error("Test failed");
+			ssc_assert(ssc_msg_sender_get_timeout(sender) == -1, 
+				"Test failed");
+			
+			buf = drain_sender(sender, &total_len);
+			lens[k] = total_len;
+			ssc_msg_sender_get_stats(sender, &stats);
+			ssc_assert(stats.n_msgs == (k ? 1 + 1 + 2 + 1 + 1 + 1 : 23), 
+				"Test failed");
+			ssc_msg_sender_free(sender);
+			
+			//Batch frames are invalid unless accepted
+			reader = ssc_msg_reader_new();
+			if (k)
+			{
+				off = 0;
+				do
+				{
+					n = ssc_msg_reader_feed
+						(reader, buf + off, total_len - off, &res);
+					if (res)
+						mmc_msg_unref(res);
+					off += n;
+				} while (n > 0 && off < total_len);
+				ssc_assert(n < 0, "Test failed");
+				ssc_msg_reader_reset(reader);
+			}
+			
+			ssc_msg_reader_set_batches(reader, 1);
+			n_recvd = 0;
+			for (off = 0; off < total_len; off += n)
+			{
+				len = total_len - off;
+				if (len > 13)
+					len = 13;
+				n = ssc_msg_reader_feed(reader, buf + off, len, &res);
+				ssc_assert(n > 0, "Test failed");
+				while (res)
+				{
+					ssc_assert(n_recvd < 23, "Test failed");
+					ssc_assert(tree_equal(res, msgs[n_recvd]), 
+						"Test failed");
+					mmc_msg_unref(res);
+					n_recvd++;
+					res = ssc_msg_reader_next_batched(reader);
+				}
+			}
+			ssc_assert(n_recvd == 23, "Test failed");
+			
+			ssc_msg_reader_free(reader);
+			free(buf);
+		}
+		
+		ssc_assert(lens[1] < lens[0], "Test failed");
+	}
+	
+	//Messages are held back for at most the delay
+	sender = ssc_msg_sender_new();
+	ssc_msg_sender_set_coalescing(sender, 8, 2000);
+	for (i = 1; i < 3; i++)
+	{
+		if (ssc_msg_sender_queue(sender, msgs[i]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+	}
+	ssc_assert(ssc_msg_sender_get_timeout(sender) <= 2000, "Test failed");
+	if (ssc_msg_sender_close_batch(sender, 0) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	usleep(3000);
+	ssc_assert(ssc_msg_sender_get_timeout(sender) == 0, "Test failed");
+	if (ssc_msg_sender_close_batch(sender, 0) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	ssc_assert(ssc_msg_sender_get_timeout(sender) == -1, "Test failed");
+	
+	//After that, the stream is idle again
+	usleep(3000);
+	if (ssc_msg_sender_queue(sender, msgs[3]) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	ssc_assert(ssc_msg_sender_get_timeout(sender) == -1, "Test failed");
+	ssc_msg_sender_free(sender);
+	
+	for (i = 0; i < 23; i++)
+		mmc_msg_unref(msgs[i]);
+}
+
+//Layouts checked against limits
+static void test_limits(void)
+{
+	SscMsgLimits limits;
+	MmcMsg *msg;
+	uint32_t layout[64];
+	size_t n_nodes;
+	int id;
+	
+	//Tree of depth 3 (root, 3 children, 3 + 2 + 1 grandchildren)
+	id = 0;
+	msg = build_tree(2, 3, &id);
+	n_nodes = ssc_msg_count(msg);
+	ssc_msg_create_layout(msg, n_nodes, layout);
+	
+	ssc_msg_limits_init(&limits);
+	ssc_assert(ssc_msg_limits_check(&limits, n_nodes, layout) 
+		== SSC_MSG_LIMITS_OK, "Test failed");
+	
+	limits.max_depth = 3;
+	ssc_assert(ssc_msg_limits_check(&limits, n_nodes, layout) 
+		== SSC_MSG_LIMITS_OK, "Test failed");
+	limits.max_depth = 2;
+	ssc_assert(ssc_msg_limits_check(&limits, n_nodes, layout) 
+		== SSC_MSG_LIMITS_DEPTH, "Test failed");
+	limits.max_depth = 0;
+	
+	limits.max_nodes = n_nodes - 1;
+	ssc_assert(ssc_msg_limits_check(&limits, n_nodes, layout) 
+		== SSC_MSG_LIMITS_NODES, "Test failed");
+	limits.max_nodes = 0;
+	
+	limits.max_bytes = 10;
+	ssc_assert(ssc_msg_limits_check(&limits, n_nodes, layout) 
+		== SSC_MSG_LIMITS_BYTES, "Test failed");
+	limits.max_bytes = 0;
+	
+	limits.max_block = 9;
+	ssc_assert(ssc_msg_limits_check(&limits, n_nodes, layout) 
+		== SSC_MSG_LIMITS_BLOCK, "Test failed");
+	limits.max_block = 10;
+	ssc_assert(ssc_msg_limits_check(&limits, n_nodes, layout) 
+		== SSC_MSG_LIMITS_OK, "Test failed");
+	
+	//Layouts not describing a tree
+	ssc_assert(ssc_msg_limits_check(&limits, n_nodes - 1, layout) 
+		== SSC_MSG_LIMITS_INVALID, "Test failed");
+	ssc_assert(ssc_msg_limits_check(&limits, n_nodes + 1, layout) 
+		== SSC_MSG_LIMITS_INVALID, "Test failed");
+	
+	ssc_assert(limits.n_over_depth == 1 && limits.n_over_nodes == 1
+		&& limits.n_over_bytes == 1 && limits.n_over_block == 1
+		&& limits.n_invalid == 2, "Test failed");
+	
+	//Lengths adding up past SIZE_MAX must not wrap the byte count
+	{
+		SscMsgReader *reader;
+		MmcMsg *res;
+		uint32_t *wide;
+		char frame[SSC_MSG_FRAME_HEADER_SIZE + 5 * sizeof(uint32_t)];
+		size_t n_wide, i;
+		
+		//A 10 byte block, then one of 2^64 - 5 bytes
+		limits.max_block = 0;
+		limits.max_bytes = 1000;
+		ssc_msg_frame_header_store(frame, 5, 3);
+		wide = (uint32_t *) (frame + SSC_MSG_FRAME_HEADER_SIZE);
+		ssc_uint32_store_le(wide, SSC_MSG_SUBMSG);
+		ssc_uint32_store_le(wide + 1, 10 | SSC_MSG_SIBLING);
+		ssc_uint32_store_le(wide + 2, SSC_MSG_EXTENDED);
+		ssc_uint32_store_le(wide + 3, 0xfffffffb);
+		ssc_uint32_store_le(wide + 4, 0xffffffff);
+		ssc_assert(ssc_msg_limits_check(&limits, 5, wide) 
+			== SSC_MSG_LIMITS_INVALID, "Test failed");
+		
+		reader = ssc_msg_reader_new();
+		ssc_msg_reader_set_limits(reader, &limits);
+		ssc_assert(ssc_msg_reader_feed(reader, frame, sizeof(frame), &res)
+			< 0, "Test failed");
+		ssc_msg_reader_free(reader);
+		ssc_assert(limits.n_invalid == 4, "Test failed");
+		
+		//Blocks of the largest length allowed, adding up to 2^64
+		n_wide = 1 + 3 * (((size_t) 1) << 16);
+		wide = mdsl_alloc(sizeof(uint32_t) * n_wide);
+		ssc_uint32_store_le(wide, SSC_MSG_SUBMSG);
+		for (i = 1; i < n_wide; i += 3)
+		{
+			ssc_uint32_store_le(wide + i, SSC_MSG_EXTENDED 
+				| (i + 3 < n_wide ? SSC_MSG_SIBLING : 0));
+			ssc_uint32_store_le(wide + i + 1, 
+				(uint32_t) SSC_MSG_MAX_MEM_LEN);
+			ssc_uint32_store_le(wide + i + 2, 
+				(uint32_t) (SSC_MSG_MAX_MEM_LEN >> 32));
+		}
+		limits.max_bytes = SIZE_MAX;
+		ssc_assert(ssc_msg_limits_check(&limits, n_wide, wide) 
+			== SSC_MSG_LIMITS_BYTES, "Test failed");
+		ssc_assert(limits.n_over_bytes == 2, "Test failed");
+		free(wide);
+		
+		limits.max_bytes = 0;
+		limits.max_block = 10;
+	}
+	
+	//Reader rejects a huge block before allocating it
+	{
+		SscMsgReader *reader;
+		MmcMsg *res;
+		char frame[SSC_MSG_FRAME_HEADER_SIZE + sizeof(uint32_t)];
+		
+		reader = ssc_msg_reader_new();
+		ssc_msg_reader_set_limits(reader, &limits);
+		ssc_msg_frame_header_store(frame, 1, 1);
+		ssc_uint32_store_le(frame + SSC_MSG_FRAME_HEADER_SIZE, 
+			SSC_MSG_EXTENDED - 1);
+		ssc_assert(ssc_msg_reader_feed(reader, frame, sizeof(frame), &res)
+			< 0, "Test failed");
+		ssc_assert(limits.n_over_block == 2, "Test failed");
+		
+		//Too many nodes is rejected at the header
+		limits.max_nodes = 4;
+		ssc_msg_reader_reset(reader);
+		ssc_msg_frame_header_store(frame, 5, 5);
+		ssc_assert(ssc_msg_reader_feed(reader, frame, 
+			SSC_MSG_FRAME_HEADER_SIZE, &res) < 0, "Test failed");
+		ssc_assert(limits.n_over_nodes == 2, "Test failed");
+		
+		//Also with extended elements or varints, by the fewest 
+		//messages the layout can describe
+		ssc_msg_reader_reset(reader);
+		ssc_msg_frame_header_store(frame, 15, 14);
+		ssc_assert(ssc_msg_reader_feed(reader, frame, 
+			SSC_MSG_FRAME_HEADER_SIZE, &res) < 0, "Test failed");
+		ssc_assert(limits.n_over_nodes == 3, "Test failed");
+		ssc_msg_reader_reset(reader);
+		ssc_msg_frame_header_store_varint(frame, 41);
+		ssc_assert(ssc_msg_reader_feed(reader, frame, 
+			SSC_MSG_FRAME_HEADER_SIZE, &res) < 0, "Test failed");
+		ssc_assert(limits.n_over_nodes == 4, "Test failed");
+		
+		ssc_msg_reader_free(reader);
+	}
+	
+	mmc_msg_unref(msg);
+}
+
+//Layouts many times larger than the room first made for them
+static void test_large_layout(void)
+{
+	SscMsgReader *reader;
+	SscMsgFlatSize size;
+	MmcMsg *msg, *child, *res;
+	uint32_t *layout;
+	struct iovec *iov;
+	char *buf;
+	size_t n_varint, buf_len, off, n_sub, i;
+	ssize_t n;
+	int format, n_msgs;
+	
+	n_sub = 5000;
+	child = mmc_msg_newa(1, 0);
+	memset(child->mem, 7, 1);
+	msg = mmc_msg_newa(0, n_sub);
+	for (i = 0; i < n_sub; i++)
+	{
+		mmc_msg_ref(child);
+		msg->submsgs[i] = child;
+	}
+	mmc_msg_unref(child);
+	
+	ssc_msg_flatten(msg, 0, NULL, NULL, &size);
+	layout = mdsl_alloc(sizeof(uint32_t) * size.n_layout);
+	iov = mdsl_alloc(sizeof(struct iovec) * size.n_layout);
+	if (ssc_msg_flatten(msg, size.n_layout, layout, iov, &size) 
+		!= MDSL_SUCCESS)
+		ssc_error("Test failed");
+	n_varint = ssc_msg_layout_to_varint(layout, size.n_layout, NULL);
+	buf = mdsl_alloc(SSC_MSG_FRAME_HEADER_SIZE 
+		+ sizeof(uint32_t) * size.n_layout + size.n_bytes);
+	
+	reader = ssc_msg_reader_new();
+	for (format = 0; format < 2; format++)
+	{
+		char *ptr = buf;
+		
+		if (format)
+		{
+			ssc_msg_frame_header_store_varint(ptr, n_varint);
+			ptr += SSC_MSG_FRAME_HEADER_SIZE;
+			ssc_msg_layout_to_varint(layout, size.n_layout, ptr);
+			ptr += n_varint;
+		}
+		else
+		{
+			ssc_msg_frame_header_store(ptr, size.n_layout, size.n_nodes);
+			ptr += SSC_MSG_FRAME_HEADER_SIZE;
+			memcpy(ptr, layout, sizeof(uint32_t) * size.n_layout);
+			ptr += sizeof(uint32_t) * size.n_layout;
+		}
+		for (i = 0; i < size.n_iov; i++)
+		{
+			memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
+			ptr += iov[i].iov_len;
+		}
+		buf_len = ptr - buf;
+		
+		//Fed in pieces not matching those the layout is read in
+		n_msgs = 0;
+		for (off = 0; off < buf_len; off += n)
+		{
+			size_t lim = buf_len - off < 999 ? buf_len - off : 999;
+			
+			n = ssc_msg_reader_feed(reader, buf + off, lim, &res);
+			ssc_assert(n > 0, "Test failed");
+			if (res)
+			{
+				ssc_assert(tree_equal(msg, res), "Test failed");
+				mmc_msg_unref(res);
+				n_msgs++;
+			}
+		}
+		ssc_assert(n_msgs == 1, "Test failed");
+	}
+	
+	ssc_msg_reader_free(reader);
+	free(buf);
+	free(iov);
+	free(layout);
+	mmc_msg_unref(msg);
+}
+
+//Layouts with extended elements
+static void test_extended(void)
+{
+	uint32_t layout[4];
+	MmcMsg *msg;
+	
+	//Extended elements are accepted for small blocks too
+	layout[0] = ssc_uint32_to_le(SSC_MSG_EXTENDED | SSC_MSG_SUBMSG);
+	layout[1] = ssc_uint32_to_le(100);
+	layout[2] = 0;
+	layout[3] = ssc_uint32_to_le(5);
+	msg = ssc_msg_alloc_by_layout(4, layout);
+	ssc_assert(msg != NULL, "Test failed");
+	ssc_assert(msg->mem_len == 100 && msg->submsgs_len == 1
+		&& msg->submsgs[0]->mem_len == 5, "Test failed");
+	mmc_msg_unref(msg);
+	
+	//Truncated extended element
+	ssc_assert(ssc_msg_alloc_by_layout(2, layout) == NULL, "Test failed");
+	
+	//A block too large for a plain element, without allocating it
+	if (sizeof(size_t) >= 8)
+	{
+		SscMsgFlatSize size;
+		SscMsgLimits limits;
+		SscMsgSlab *slab;
+		uint32_t big_layout[8];
+		struct iovec iov[8];
+		size_t big_len = ((size_t) 5) << 30;
+		size_t buf_len;
+		char *buf;
+		MmcMsg *child;
+		void *child_mem;
+		
+		msg = mmc_msg_newa(10, 1);
+		child = msg->submsgs[0] = mmc_msg_newa(0, 0);
+		child_mem = child->mem;
+		
+		buf_len = 4 * sizeof(uint32_t) + 10 + big_len;
+		buf = mmap(NULL, buf_len, PROT_READ | PROT_WRITE, 
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		ssc_assert(buf != MAP_FAILED, "mmap() failed");
+		child->mem = buf + 4 * sizeof(uint32_t) + 10;
+		child->mem_len = big_len;
+		
+		ssc_assert(ssc_msg_layout_len(msg) == 4, "Test failed");
+		if (ssc_msg_flatten(msg, 8, big_layout, iov, &size) 
+			!= MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(size.n_nodes == 2 && size.n_layout == 4
+			&& size.n_bytes == 10 + big_len, "Test failed");
+		ssc_assert((ssc_uint32_from_le(big_layout[1]) & (~SSC_MSG_ALL)) 
+			== SSC_MSG_EXTENDED, "Test failed");
+		
+		//Its three elements do not fit in one, even as the root
+		ssc_assert(ssc_msg_flatten(child, 1, big_layout, iov, &size) 
+			== MDSL_FAILURE, "Test failed");
+		if (ssc_msg_flatten(child, 3, big_layout, iov, &size) 
+			!= MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(size.n_layout == 3, "Test failed");
+		if (ssc_msg_flatten(msg, 8, big_layout, iov, &size) 
+			!= MDSL_SUCCESS)
+			ssc_error("Test failed");
+		
+		//Blocks can be listed with room for the layout elements
+		{
+			SscMBlock blocks[4];
+			
+			ssc_assert(ssc_msg_get_blocks(msg, 4, blocks) == 2, 
+				"Test failed");
+			ssc_assert(blocks[1].mem == child->mem 
+				&& blocks[1].len == big_len, "Test failed");
+		}
+		
+		//Varint encoding keeps the length
+		{
+			uint32_t decoded[16];
+			uint8_t varint[16];
+			size_t n_varint, n_decoded;
+			
+			n_varint = ssc_msg_layout_to_varint(big_layout, 4, varint);
+			ssc_assert(n_varint == 6, "Test failed");
+			if (ssc_msg_layout_from_varint(varint, n_varint, decoded, 
+					&n_decoded) != MDSL_SUCCESS)
+				ssc_error("Test failed");
+			ssc_assert(n_decoded == 4 && memcmp(decoded, big_layout, 
+				4 * sizeof(uint32_t)) == 0, "Test failed");
+		}
+		
+		ssc_msg_limits_init(&limits);
+		ssc_assert(ssc_msg_limits_check(&limits, 4, big_layout)
+			== SSC_MSG_LIMITS_OK, "Test failed");
+		limits.max_block = ((size_t) 1) << 30;
+		ssc_assert(ssc_msg_limits_check(&limits, 4, big_layout)
+			== SSC_MSG_LIMITS_BLOCK, "Test failed");
+		
+		//The view over a buffer sees the whole block
+		memcpy(buf, big_layout, 4 * sizeof(uint32_t));
+		slab = ssc_msg_slab_new(buf, buf_len);
+		ssc_assert(slab != NULL, "Test failed");
+		ssc_assert(ssc_msg_slab_get_root(slab)->submsgs[0]->mem_len 
+			== big_len, "Test failed");
+		ssc_assert(ssc_msg_slab_get_root(slab)->submsgs[0]->mem 
+			== child->mem, "Test failed");
+		ssc_msg_slab_free(slab);
+		
+		munmap(buf, buf_len);
+		child->mem = child_mem;
+		child->mem_len = 0;
+		mmc_msg_unref(msg);
+	}
+}
+
+//Wide trees, split between threads
+static void test_parallel(void)
+{
+	SscMsgFlatSize size, par_size;
+	uint32_t *layout, *par_layout;
+	struct iovec *iov, *par_iov;
+	MmcMsg *msg;
+	unsigned int n_threads;
+	int id, i;
+	
+	id = 0;
+	msg = mmc_msg_newa(3, 5000);
+	memset(msg->mem, 0, 3);
+	for (i = 0; i < 5000; i++)
+		msg->submsgs[i] = build_tree(i % 3, 2, &id);
+	
+	ssc_msg_flatten(msg, 0, NULL, NULL, &size);
+	layout = mdsl_alloc(sizeof(uint32_t) * size.n_layout);
+	iov = mdsl_alloc(sizeof(struct iovec) * size.n_layout);
+	par_layout = mdsl_alloc(sizeof(uint32_t) * size.n_layout);
+	par_iov = mdsl_alloc(sizeof(struct iovec) * size.n_layout);
+	if (ssc_msg_flatten(msg, size.n_layout, layout, iov, NULL) 
+		!= MDSL_SUCCESS)
+		ssc_error("Test failed");
+	
+	for (n_threads = 1; n_threads <= 4; n_threads++)
+	{
+		MmcMsg *copy;
+		
+		//Same output as the serial version
+		if (ssc_msg_flatten_parallel(msg, size.n_layout, par_layout, 
+				par_iov, &par_size, n_threads) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(memcmp(&size, &par_size, sizeof(size)) == 0, 
+			"Test failed");
+		ssc_assert(memcmp(layout, par_layout, 
+			sizeof(uint32_t) * size.n_layout) == 0, "Test failed");
+		ssc_assert(memcmp(iov, par_iov, 
+			sizeof(struct iovec) * size.n_iov) == 0, "Test failed");
+		
+		//Too small arrays
+		ssc_assert(ssc_msg_flatten_parallel(msg, size.n_layout - 1, 
+			par_layout, par_iov, NULL, n_threads) == MDSL_FAILURE, 
+			"Test failed");
+		
+		//Allocated tree has the same layout
+		copy = ssc_msg_alloc_by_layout_parallel
+			(size.n_layout, layout, n_threads);
+		ssc_assert(copy != NULL, "Test failed");
+		if (ssc_msg_flatten(copy, size.n_layout, par_layout, par_iov, 
+				&par_size) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(par_size.n_nodes == size.n_nodes, "Test failed");
+		ssc_assert(memcmp(layout, par_layout, 
+			sizeof(uint32_t) * size.n_layout) == 0, "Test failed");
+		mmc_msg_unref(copy);
+		
+		//Invalid layouts
+		ssc_assert(ssc_msg_alloc_by_layout_parallel
+			(size.n_layout - 1, layout, n_threads) == NULL, "Test failed");
+		layout[size.n_layout - 1] |= ssc_uint32_to_le(SSC_MSG_SIBLING);
+		ssc_assert(ssc_msg_alloc_by_layout_parallel
+			(size.n_layout, layout, n_threads) == NULL, "Test failed");
+		layout[size.n_layout - 1] &= ssc_uint32_to_le(~SSC_MSG_SIBLING);
+	}
+	
+	free(layout);
+	free(iov);
+	free(par_layout);
+	free(par_iov);
+	mmc_msg_unref(msg);
+}
+
+int main()
+{
+	int depth, id;
+	
+	for (depth = 0; depth < 4; depth++)
+	{
+		MmcMsg *msg;
+		
+		id = 0;
+		msg = build_tree(depth, 3, &id);
+		test_tree(msg);
+		mmc_msg_unref(msg);
+	}
+	
+	test_sender();
+	test_checksum();
+	test_compression();
+	test_shapes();
+	test_varint_shapes();
+	test_coalescing();
+	test_limits();
+	test_large_layout();
+	test_extended();
+	test_parallel();
+	
+	return 0;
+}
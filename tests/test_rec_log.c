@@ -0,0 +1,198 @@
+/* test_rec_log.c
+ * Record log test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define N_RECORDS 1000
+#define N_MORE 37
+
+//Builds a tree of messages, 
+//each node having mem_len bytes filled with its id
+static MmcMsg *build_tree(int depth, int fanout, int *id)
+{
+	MmcMsg *msg;
+	int i, n_sub, mem_len;
+	
+	n_sub = depth > 0 ? fanout : 0;
+	mem_len = (*id % 7) * 3;
+	msg = mmc_msg_newa(mem_len, n_sub);
+	memset(msg->mem, *id, mem_len);
+	(*id)++;
+	for (i = 0; i < n_sub; i++)
+		msg->submsgs[i] = build_tree(depth - 1, fanout - i, id);
+	
+	return msg;
+}
+
+static int tree_equal(MmcMsg *a, MmcMsg *b)
+{
+	size_t i;
+	
+	if (a->mem_len != b->mem_len || a->submsgs_len != b->submsgs_len)
+		return 0;
+	if (memcmp(a->mem, b->mem, a->mem_len) != 0)
+		return 0;
+	for (i = 0; i < a->submsgs_len; i++)
+	{
+		if (! tree_equal(a->submsgs[i], b->submsgs[i]))
+			return 0;
+	}
+	
+	return 1;
+}
+
+static MmcMsg *msgs[N_RECORDS + N_MORE];
+
+//Checks that the log holds the first n_records messages, 
+//reading them in order and out of order
+static void check_log(const char *path, size_t n_records)
+{
+	SscRecLogReader *reader;
+	SscMsgSlab *slab;
+	size_t i;
+	
+	reader = ssc_rec_log_reader_open(path);
+	ssc_assert(reader != NULL, "Test failed");
+	ssc_assert(ssc_rec_log_reader_get_n_records(reader) == n_records, 
+		"Test failed");
+	
+	for (i = 0; i < n_records; i++)
+	{
+		slab = ssc_rec_log_reader_next(reader);
+		ssc_assert(slab != NULL, "Test failed");
+		ssc_assert(tree_equal(msgs[i], ssc_msg_slab_get_root(slab)), 
+			"Test failed");
+		ssc_msg_slab_free(slab);
+	}
+	ssc_assert(ssc_rec_log_reader_next(reader) == NULL, "Test failed");
+	
+	for (i = 0; i < n_records; i++)
+	{
+		size_t rec_no = (i * 7919) % n_records;
+		
+		slab = ssc_rec_log_reader_get(reader, rec_no);
+		ssc_assert(slab != NULL, "Test failed");
+		ssc_assert(tree_equal(msgs[rec_no], ssc_msg_slab_get_root(slab)), 
+			"Test failed");
+		ssc_msg_slab_free(slab);
+	}
+	ssc_assert(ssc_rec_log_reader_get(reader, n_records) == NULL, 
+		"Test failed");
+	
+	//Continues after the record last got
+	slab = ssc_rec_log_reader_get(reader, n_records / 2);
+	ssc_msg_slab_free(slab);
+	slab = ssc_rec_log_reader_next(reader);
+	ssc_assert(tree_equal(msgs[n_records / 2 + 1], 
+		ssc_msg_slab_get_root(slab)), "Test failed");
+	ssc_msg_slab_free(slab);
+	
+	ssc_rec_log_reader_free(reader);
+}
+
+int main()
+{
+	SscRecLogWriter *writer;
+	SscRecLogWriterStats stats;
+	char path[] = "test_rec_log.XXXXXX";
+	off_t size, trailer;
+	int fd, id, i;
+	
+	fd = mkstemp(path);
+	ssc_assert(fd >= 0, "mkstemp() failed");
+	close(fd);
+	
+	id = 0;
+	for (i = 0; i < N_RECORDS + N_MORE; i++)
+		msgs[i] = build_tree(i % 4, 3, &id);
+	
+	//Commits in batches
+	writer = ssc_rec_log_writer_open(path, 16);
+	ssc_assert(writer != NULL, "Test failed");
+	ssc_rec_log_writer_set_batch(writer, 100, 0);
+	for (i = 0; i < N_RECORDS; i++)
+	{
+		ssc_assert(ssc_rec_log_writer_get_n_records(writer) == (size_t) i,
+			"Test failed");
+		if (ssc_rec_log_writer_append(writer, msgs[i]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+	}
+	ssc_rec_log_writer_get_stats(writer, &stats);
+	ssc_assert(stats.n_records == N_RECORDS && stats.n_syncs == 10, 
+		"Test failed");
+	if (ssc_rec_log_writer_close(writer) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	check_log(path, N_RECORDS);
+	
+	//Appending replaces the index
+	writer = ssc_rec_log_writer_open(path, 0);
+	ssc_assert(writer != NULL, "Test failed");
+	ssc_assert(ssc_rec_log_writer_get_n_records(writer) == N_RECORDS,
+		"Test failed");
+	for (i = N_RECORDS; i < N_RECORDS + N_MORE; i++)
+	{
+		if (ssc_rec_log_writer_append(writer, msgs[i]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+	}
+	if (ssc_rec_log_writer_commit(writer) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	ssc_rec_log_writer_get_stats(writer, &stats);
+	ssc_assert(stats.n_syncs == 1, "Test failed");
+	if (ssc_rec_log_writer_close(writer) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	check_log(path, N_RECORDS + N_MORE);
+	
+	//A damaged footer makes readers scan the records
+	fd = open(path, O_RDWR);
+	ssc_assert(fd >= 0, "Test failed");
+	size = lseek(fd, 0, SEEK_END);
+	ssc_assert(ftruncate(fd, size - 1) == 0, "Test failed");
+	check_log(path, N_RECORDS + N_MORE);
+	
+	//An incomplete last record is dropped
+	trailer = 8 + 8 + 8 * ((N_RECORDS + N_MORE + 15) / 16) + 16;
+	ssc_assert(ftruncate(fd, size - trailer - 1) == 0, "Test failed");
+	close(fd);
+	check_log(path, N_RECORDS + N_MORE - 1);
+	
+	//and replaced by the writer
+	writer = ssc_rec_log_writer_open(path, 0);
+	ssc_assert(writer != NULL, "Test failed");
+	ssc_assert(ssc_rec_log_writer_get_n_records(writer) 
+		== N_RECORDS + N_MORE - 1, "Test failed");
+	if (ssc_rec_log_writer_append(writer, msgs[N_RECORDS + N_MORE - 1]) 
+		!= MDSL_SUCCESS)
+		ssc_error("Test failed");
+	if (ssc_rec_log_writer_close(writer) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	check_log(path, N_RECORDS + N_MORE);
+	
+	//Not a record log
+	ssc_assert(ssc_rec_log_reader_open("/dev/null") == NULL, "Test failed");
+	
+	unlink(path);
+	for (i = 0; i < N_RECORDS + N_MORE; i++)
+		mmc_msg_unref(msgs[i]);
+	
+	return 0;
+}
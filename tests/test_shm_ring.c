@@ -0,0 +1,285 @@
+/* test_shm_ring.c
+ * Shared memory ring buffer test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define N_THREADS 3
+#define N_THREAD_MSGS 2000
+#define N_PINGS 200
+
+//Builds a tree of messages, 
+//each node having mem_len bytes filled with its id
+static MmcMsg *build_tree(int depth, int fanout, int *id)
+{
+	MmcMsg *msg;
+	int i, n_sub, mem_len;
+	
+	n_sub = depth > 0 ? fanout : 0;
+	mem_len = (*id % 11) * 37;
+	msg = mmc_msg_newa(mem_len, n_sub);
+	memset(msg->mem, *id, mem_len);
+	(*id)++;
+	for (i = 0; i < n_sub; i++)
+		msg->submsgs[i] = build_tree(depth - 1, fanout - i, id);
+	
+	return msg;
+}
+
+static int tree_equal(MmcMsg *a, MmcMsg *b)
+{
+	size_t i;
+	
+	if (a->mem_len != b->mem_len || a->submsgs_len != b->submsgs_len)
+		return 0;
+	if (memcmp(a->mem, b->mem, a->mem_len) != 0)
+		return 0;
+	for (i = 0; i < a->submsgs_len; i++)
+	{
+		if (! tree_equal(a->submsgs[i], b->submsgs[i]))
+			return 0;
+	}
+	
+	return 1;
+}
+
+//Single process: wrapping around, and running full
+static void test_wrap(void)
+{
+	SscShmRing *ring;
+	SscMsgSlab *slab;
+	MmcMsg *msgs[64];
+	int i, j, id, n_queued;
+	
+	ring = ssc_shm_ring_new(1);
+	ssc_assert(ring != NULL, "Test failed");
+	
+	//Nothing to receive
+	ssc_assert(ssc_shm_ring_recv(ring, 0) == NULL, "Test failed");
+	
+	//One at a time, many times around the ring
+	id = 0;
+	for (i = 0; i < 1000; i++)
+	{
+		MmcMsg *msg = build_tree(i % 3, 3, &id);
+		
+		if (ssc_shm_ring_send(ring, msg) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		slab = ssc_shm_ring_recv(ring, 0);
+		ssc_assert(slab != NULL, "Test failed");
+		ssc_assert(tree_equal(msg, ssc_msg_slab_get_root(slab)), 
+			"Test failed");
+		ssc_shm_ring_done(ring, slab);
+		mmc_msg_unref(msg);
+	}
+	
+	//Fill it up, then drain
+	for (j = 0; j < 10; j++)
+	{
+		for (n_queued = 0; n_queued < 64; n_queued++)
+		{
+			msgs[n_queued] = build_tree(2, 3, &id);
+			if (ssc_shm_ring_send(ring, msgs[n_queued]) != MDSL_SUCCESS)
+			{
+				mmc_msg_unref(msgs[n_queued]);
+				break;
+			}
+		}
+		ssc_assert(n_queued > 0 && n_queued < 64, "Test failed");
+		
+		for (i = 0; i < n_queued; i++)
+		{
+			slab = ssc_shm_ring_recv(ring, 0);
+			ssc_assert(slab != NULL, "Test failed");
+			ssc_assert(tree_equal(msgs[i], ssc_msg_slab_get_root(slab)), 
+				"Test failed");
+			ssc_shm_ring_done(ring, slab);
+			mmc_msg_unref(msgs[i]);
+		}
+		ssc_assert(ssc_shm_ring_recv(ring, 0) == NULL, "Test failed");
+	}
+	
+	//Messages larger than the ring are rejected
+	{
+		MmcMsg *msg = mmc_msg_newa(8192, 0);
+		
+		memset(msg->mem, 0, 8192);
+		if (ssc_shm_ring_send(ring, msg) != MDSL_FAILURE)
+			ssc_error("Test failed");
+		mmc_msg_unref(msg);
+	}
+	
+	ssc_shm_ring_free(ring);
+}
+
+//Multiple senders: each thread sends its index and a sequence number
+typedef struct
+{
+	int fd;
+	uint32_t index;
+} SenderArgs;
+
+static void *sender_thread(void *data)
+{
+	SenderArgs *args = data;
+	SscShmRing *ring;
+	uint32_t i;
+	
+	ring = ssc_shm_ring_open(args->fd);
+	ssc_assert(ring != NULL, "Test failed");
+	
+	for (i = 0; i < N_THREAD_MSGS; i++)
+	{
+		MmcMsg *msg = mmc_msg_newa(8 + (i % 50), 0);
+		
+		memset(msg->mem, 0, msg->mem_len);
+		ssc_uint32_store_le(msg->mem, args->index);
+		ssc_uint32_store_le(((char *) msg->mem) + 4, i);
+		while (ssc_shm_ring_send(ring, msg) != MDSL_SUCCESS)
+			sched_yield();
+		mmc_msg_unref(msg);
+	}
+	
+	ssc_shm_ring_free(ring);
+	return NULL;
+}
+
+static void test_senders(SscShmRingWait wait)
+{
+	SscShmRing *ring;
+	pthread_t threads[N_THREADS];
+	SenderArgs args[N_THREADS];
+	uint32_t next[N_THREADS];
+	int i;
+	
+	ring = ssc_shm_ring_new(16384);
+	ssc_assert(ring != NULL, "Test failed");
+	ssc_shm_ring_set_wait(ring, wait);
+	
+	for (i = 0; i < N_THREADS; i++)
+	{
+		args[i].fd = ssc_shm_ring_get_fd(ring);
+		args[i].index = i;
+		next[i] = 0;
+		pthread_create(threads + i, NULL, sender_thread, args + i);
+	}
+	
+	//Messages from each sender arrive in order
+	for (i = 0; i < N_THREADS * N_THREAD_MSGS; i++)
+	{
+		SscMsgSlab *slab;
+		MmcMsg *msg;
+		uint32_t index;
+		
+		slab = ssc_shm_ring_recv(ring, 10000);
+		ssc_assert(slab != NULL, "Test failed");
+		msg = ssc_msg_slab_get_root(slab);
+		index = ssc_uint32_load_le(msg->mem);
+		ssc_assert(index < N_THREADS, "Test failed");
+		ssc_assert(ssc_uint32_load_le(((char *) msg->mem) + 4) 
+			== next[index], "Test failed");
+		ssc_assert(msg->mem_len == 8 + (next[index] % 50), "Test failed");
+		next[index]++;
+		ssc_shm_ring_done(ring, slab);
+	}
+	
+	for (i = 0; i < N_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	ssc_assert(ssc_shm_ring_recv(ring, 0) == NULL, "Test failed");
+	
+	ssc_shm_ring_free(ring);
+}
+
+//Across processes: the child echoes every message back
+static void test_fork(SscShmRingWait wait)
+{
+	SscShmRing *req, *rep;
+	pid_t pid;
+	int i, id, status;
+	
+	req = ssc_shm_ring_new(65536);
+	rep = ssc_shm_ring_new(65536);
+	ssc_assert(req && rep, "Test failed");
+	
+	pid = fork();
+	ssc_assert(pid >= 0, "fork() failed");
+	if (pid == 0)
+	{
+		SscShmRing *c_req, *c_rep;
+		
+		//Use the descriptors only, as another process would
+		c_req = ssc_shm_ring_open(ssc_shm_ring_get_fd(req));
+		c_rep = ssc_shm_ring_open(ssc_shm_ring_get_fd(rep));
+		if (! c_req || ! c_rep)
+			_exit(1);
+		ssc_shm_ring_set_wait(c_req, wait);
+		for (i = 0; i < N_PINGS; i++)
+		{
+			SscMsgSlab *slab = ssc_shm_ring_recv(c_req, 10000);
+			
+			if (! slab)
+				_exit(1);
+			if (ssc_shm_ring_send(c_rep, ssc_msg_slab_get_root(slab)) 
+				!= MDSL_SUCCESS)
+				_exit(1);
+			ssc_shm_ring_done(c_req, slab);
+		}
+		_exit(0);
+	}
+	
+	ssc_shm_ring_set_wait(rep, wait);
+	id = 0;
+	for (i = 0; i < N_PINGS; i++)
+	{
+		MmcMsg *msg = build_tree(i % 3, 3, &id);
+		SscMsgSlab *slab;
+		
+		if (ssc_shm_ring_send(req, msg) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		slab = ssc_shm_ring_recv(rep, 10000);
+		ssc_assert(slab != NULL, "Test failed");
+		ssc_assert(tree_equal(msg, ssc_msg_slab_get_root(slab)), 
+			"Test failed");
+		ssc_shm_ring_done(rep, slab);
+		mmc_msg_unref(msg);
+	}
+	
+	ssc_assert(waitpid(pid, &status, 0) == pid, "Test failed");
+	ssc_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0, 
+		"Test failed");
+	
+	ssc_shm_ring_free(req);
+	ssc_shm_ring_free(rep);
+}
+
+int main()
+{
+	test_wrap();
+	test_senders(SSC_SHM_RING_FUTEX);
+	test_senders(SSC_SHM_RING_BUSY_POLL);
+	test_fork(SSC_SHM_RING_FUTEX);
+	test_fork(SSC_SHM_RING_BUSY_POLL);
+	
+	return 0;
+}
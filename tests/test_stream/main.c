@@ -0,0 +1,346 @@
+/* main.c
+ * Streamed sequence test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+#include "idl.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define N_VALUES 12345
+#define N_SAMPLES 250
+#define N_FETCHED 2500
+
+static int32_t value_at(int i)
+{
+	return i * 31 - 7;
+}
+
+//Chunks sent through collect()
+typedef struct
+{
+	MmcMsg *msgs[8];
+	int len;
+} Collected;
+
+static MdslStatus collect(void *send_data, MmcMsg *chunk)
+{
+	Collected *collected = (Collected *) send_data;
+	
+	if (collected->len == 8)
+		return MDSL_FAILURE;
+	mmc_msg_ref(chunk);
+	collected->msgs[collected->len++] = chunk;
+	return MDSL_SUCCESS;
+}
+
+static void collected_clear(Collected *collected)
+{
+	int i;
+	
+	for (i = 0; i < collected->len; i++)
+		mmc_msg_unref(collected->msgs[i]);
+	collected->len = 0;
+}
+
+//Receives a Series header and then its value chunks from the socket, 
+//checking that values continue from *n_recvd. 
+//Returns 1 once the last chunk was taken.
+static int recv_values(int fd, SscMsgReader *reader, 
+	SscStreamReader *stream, int *have_header, int *n_recvd)
+{
+	char buf[4096];
+	ssize_t len, off, n;
+	
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+	{
+		for (off = 0; off < len; off += n)
+		{
+			MmcMsg *msg;
+			int32_t *value;
+			
+			n = ssc_msg_reader_feed(reader, buf + off, len - off, &msg);
+			ssc_assert(n > 0, "Test failed");
+			if (! msg)
+				continue;
+			
+			if (! *have_header)
+			{
+				Series series;
+				
+				if (Series__deserialize(msg, &series) != MDSL_SUCCESS)
+					ssc_error("Test failed");
+				ssc_assert(series.id == 7, "Test failed");
+				Series__values__accept(&series, stream);
+				Series__free(&series);
+				*have_header = 1;
+			}
+			else
+			{
+				ssc_assert(ssc_stream_chunk_get_id(msg) == stream->id, 
+					"Test failed");
+				if (ssc_stream_reader_feed(stream, msg) != MDSL_SUCCESS)
+					ssc_error("Test failed");
+				
+				//A chunk at a time is held
+				ssc_assert(stream->len <= 1000, "Test failed");
+				while ((value = Series__values__next(stream)))
+					ssc_assert(*value == value_at((*n_recvd)++), 
+						"Test failed");
+			}
+			mmc_msg_unref(msg);
+		}
+	}
+	
+	return *have_header && ssc_stream_reader_is_finished(stream);
+}
+
+int main()
+{
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	SscStreamWriter writer;
+	SscStreamReader stream;
+	Series series;
+	MmcMsg *msg;
+	int fds[2], i, n_sent, n_recvd, have_header, done;
+	
+	//Stream fields are in the structures, as their stream nos.
+	ssc_assert(sizeof(series.samples) == sizeof(uint64_t)
+		&& sizeof(series.values) == sizeof(uint64_t), "Test failed");
+	
+	//Values are produced, sent and consumed a chunk at a time, 
+	//after the header
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		ssc_error("socketpair() failed");
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	sender = ssc_msg_sender_new();
+	reader = ssc_msg_reader_new();
+	
+	series.id = 7;
+	series.samples = 0;
+	Series__values__open(&series, &writer, ssc_stream_send_to_sender, sender);
+	ssc_assert(series.values != 0, "Test failed");
+	msg = Series__serialize(&series);
+	if (ssc_msg_sender_queue(sender, msg) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	mmc_msg_unref(msg);
+	
+	n_sent = n_recvd = have_header = done = 0;
+	while (! done)
+	{
+		if (n_sent < N_VALUES && ssc_msg_sender_get_pending(sender) < 65536)
+		{
+			int32_t values[300];
+			int n;
+			
+			for (n = 0; n < 300 && n_sent < N_VALUES; n++)
+				values[n] = value_at(n_sent++);
+			if (Series__values__put(&writer, values, n) != MDSL_SUCCESS)
+				ssc_error("Test failed");
+			if (n_sent == N_VALUES 
+				&& ssc_stream_writer_finish(&writer) != MDSL_SUCCESS)
+				ssc_error("Test failed");
+		}
+		
+		if (ssc_msg_sender_flush(sender, fds[0]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		done = recv_values(fds[1], reader, &stream, &have_header, &n_recvd);
+	}
+	ssc_assert(n_recvd == N_VALUES, "Test failed");
+	ssc_assert(writer.index == (N_VALUES + 999) / 1000, "Test failed");
+	
+	//Nothing more once finished
+	ssc_assert(Series__values__put(&writer, &n_sent, 1) == MDSL_FAILURE
+		&& ssc_stream_writer_finish(&writer) == MDSL_FAILURE, 
+		"Test failed");
+	ssc_stream_writer_clear(&writer);
+	ssc_stream_reader_clear(&stream);
+	
+	ssc_msg_sender_free(sender);
+	ssc_msg_reader_free(reader);
+	close(fds[0]);
+	close(fds[1]);
+	
+	//Structures, whose strings only have to last until 
+	//their chunk is sent
+	{
+		Collected collected = {{NULL}, 0};
+		char names[100][16];
+		Sample *res;
+		int n = 0, n_got = 0;
+		
+		Series__samples__open(&series, &writer, collect, &collected);
+		Series__samples__accept(&series, &stream);
+		
+		for (n = 0; n < N_SAMPLES; n++)
+		{
+			Sample sample;
+			
+			sprintf(names[n % 100], "sample-%d", n);
+			sample.a = n;
+			sample.s = names[n % 100];
+			if (Series__samples__put(&writer, &sample, 1) != MDSL_SUCCESS)
+				ssc_error("Test failed");
+			
+			//Each chunk is sent as soon as it is full
+			ssc_assert(collected.len == (n + 1) / 100, "Test failed");
+		}
+		if (ssc_stream_writer_finish(&writer) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_stream_writer_clear(&writer);
+		ssc_assert(collected.len == 3, "Test failed");
+		
+		for (i = 0; i < collected.len; i++)
+		{
+			if (ssc_stream_reader_feed(&stream, collected.msgs[i]) 
+				!= MDSL_SUCCESS)
+				ssc_error("Test failed");
+			while ((res = Series__samples__next(&stream)))
+			{
+				char name[16];
+				
+				sprintf(name, "sample-%d", n_got);
+				ssc_assert(res->a == n_got++ && strcmp(res->s, name) == 0, 
+					"Test failed");
+			}
+		}
+		ssc_assert(n_got == N_SAMPLES 
+			&& ssc_stream_reader_is_finished(&stream), "Test failed");
+		ssc_stream_reader_clear(&stream);
+		collected_clear(&collected);
+	}
+	
+	//Stream out-argument, its chunks following the reply
+	{
+		Collected collected = {{NULL}, 0};
+		Source__fetch__out_args out, got;
+		int32_t *value;
+		int n_got = 0;
+		
+		out.n_values = N_FETCHED;
+		Source__fetch__out_args__values__open
+			(&out, &writer, collect, &collected);
+		msg = Source__fetch__create_reply(&out);
+		for (i = 0; i < N_FETCHED; i++)
+		{
+			int32_t one = value_at(i);
+			
+			if (Source__fetch__out_args__values__put(&writer, &one, 1) 
+				!= MDSL_SUCCESS)
+				ssc_error("Test failed");
+		}
+		if (ssc_stream_writer_finish(&writer) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_stream_writer_clear(&writer);
+		
+		if (Source__fetch__read_reply(msg, &got) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		mmc_msg_unref(msg);
+		ssc_assert(got.n_values == N_FETCHED && got.values == out.values, 
+			"Test failed");
+		Source__fetch__out_args__values__accept(&got, &stream);
+		Source__fetch__out_args_free(&got);
+		
+		for (i = 0; i < collected.len; i++)
+		{
+			if (ssc_stream_reader_feed(&stream, collected.msgs[i]) 
+				!= MDSL_SUCCESS)
+				ssc_error("Test failed");
+			while ((value = Source__fetch__out_args__values__next(&stream)))
+				ssc_assert(*value == value_at(n_got++), "Test failed");
+		}
+		ssc_assert(n_got == N_FETCHED 
+			&& ssc_stream_reader_is_finished(&stream), "Test failed");
+		ssc_stream_reader_clear(&stream);
+		collected_clear(&collected);
+	}
+	
+	//Chunks of other streams, out of order or after the last one 
+	//are rejected, leaving the current chunk alone
+	{
+		Collected collected = {{NULL}, 0}, other = {{NULL}, 0};
+		SscStreamWriter other_writer;
+		Series other_series;
+		int32_t values[2500];
+		
+		for (i = 0; i < 2500; i++)
+			values[i] = value_at(i);
+		Series__values__open(&series, &writer, collect, &collected);
+		Series__values__open(&other_series, &other_writer, collect, &other);
+		ssc_assert(series.values != other_series.values, "Test failed");
+		if (Series__values__put(&writer, values, 2500) != MDSL_SUCCESS
+			|| ssc_stream_writer_finish(&writer) != MDSL_SUCCESS
+			|| Series__values__put(&other_writer, values, 1) != MDSL_SUCCESS
+			|| ssc_stream_writer_finish(&other_writer) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_stream_writer_clear(&writer);
+		ssc_stream_writer_clear(&other_writer);
+		ssc_assert(collected.len == 3 && other.len == 1, "Test failed");
+		
+		Series__values__accept(&series, &stream);
+		ssc_assert(ssc_stream_reader_feed(&stream, collected.msgs[1]) 
+				== MDSL_FAILURE
+			&& ssc_stream_reader_feed(&stream, other.msgs[0]) 
+				== MDSL_FAILURE, 
+			"Test failed");
+		if (ssc_stream_reader_feed(&stream, collected.msgs[0]) 
+			!= MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(*Series__values__next(&stream) == value_at(0), 
+			"Test failed");
+		ssc_assert(ssc_stream_reader_feed(&stream, collected.msgs[2]) 
+			== MDSL_FAILURE, "Test failed");
+		ssc_assert(*Series__values__next(&stream) == value_at(1), 
+			"Test failed");
+		if (ssc_stream_reader_feed(&stream, collected.msgs[1]) 
+				!= MDSL_SUCCESS
+			|| ssc_stream_reader_feed(&stream, collected.msgs[2]) 
+				!= MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(stream.len == 500 && ssc_stream_reader_is_finished(&stream)
+			&& ssc_stream_reader_feed(&stream, collected.msgs[2]) 
+				== MDSL_FAILURE, 
+			"Test failed");
+		ssc_stream_reader_clear(&stream);
+		collected_clear(&collected);
+		collected_clear(&other);
+	}
+	
+	//Chunks longer than declared are rejected
+	{
+		int32_t big[1001];
+		Series__values__Chunk chunk;
+		
+		for (i = 0; i < 1001; i++)
+			big[i] = i;
+		chunk.stream = 1;
+		chunk.index = 0;
+		chunk.data.data = big;
+		chunk.data.len = 1001;
+		chunk.last = 1;
+		ssc_assert(! Series__values__Chunk__serialize(&chunk), 
+			"Test failed");
+	}
+	
+	return 0;
+}
@@ -0,0 +1,201 @@
+/* main.c
+ * String pool test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+#include "idl.h"
+
+char host[] = "example.org";
+char host_copy[] = "example.org";
+char *lines[] = {host, "a", host_copy, "b", "a", ""};
+TestStruct testcases[] = 
+{
+	{host, {lines, 6}},
+	{"", {lines, 0}},
+	{"b", {lines + 3, 3}}
+};
+
+int TestStruct__equal(TestStruct *a, TestStruct *b)
+{
+	int i;
+	
+	if (strcmp(a->host, b->host) != 0)
+		return 0;
+	if (a->lines.len != b->lines.len)
+		return 0;
+	for (i = 0; i < a->lines.len; i++)
+	{
+		if (strcmp(a->lines.data[i], b->lines.data[i]) != 0)
+			return 0;
+	}
+	
+	return 1;
+}
+
+//Creates a back-reference to the string at given index
+static MmcMsg *create_ref(uint32_t index, size_t len)
+{
+	MmcMsg *ref = mmc_msg_newa(len, 0);
+	
+	memset(ref->mem, 0, len);
+	if (len >= SSC_STR_REF_SIZE)
+		ssc_uint32_store_le(((char *) ref->mem) + 1, index);
+	return ref;
+}
+
+//Replaces submessage at index of a message of testcases[0] 
+//and tries to deserialize it
+static MdslStatus try_replaced(size_t index, MmcMsg *submsg)
+{
+	TestStruct res;
+	MmcMsg *msg;
+	MdslStatus status;
+	
+	msg = TestStruct__serialize(testcases);
+	mmc_msg_unref(msg->submsgs[index]);
+	msg->submsgs[index] = submsg;
+	
+	status = TestStruct__deserialize(msg, &res);
+	if (status == MDSL_SUCCESS)
+	{
+		ssc_assert(TestStruct__equal(testcases, &res), "Test failed");
+		TestStruct__free(&res);
+	}
+	mmc_msg_unref(msg);
+	
+	return status;
+}
+
+static size_t total_submsg_bytes(MmcMsg *msg)
+{
+	size_t i, res = 0;
+	
+	for (i = 0; i < msg->submsgs_len; i++)
+		res += msg->submsgs[i]->mem_len;
+	return res;
+}
+
+int main()
+{
+	SscStrPool *pool;
+	int i;
+	
+	test_struct_drive();
+	
+	pool = ssc_str_pool_new();
+	
+	//The same pool is reused for every message
+	for (i = 0; i < sizeof(testcases) / sizeof(testcases[0]); i++)
+	{
+		TestStruct res;
+		MmcMsg *msg;
+		
+		msg = TestStruct__serialize_pooled(testcases + i, pool);
+		if (TestStruct__deserialize(msg, &res) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(TestStruct__equal(testcases + i, &res), "Test failed");
+		TestStruct__free(&res);
+		
+		if (i == 0)
+		{
+			MmcMsg *plain;
+			
+			//Same pointer and same text refer back to the first 
+			//occurrence, short strings are shared, others are not
+			ssc_assert(msg->submsgs[1] == msg->submsgs[3], "Test failed");
+			ssc_assert(msg->submsgs[1]->mem_len == SSC_STR_REF_SIZE, 
+				"Test failed");
+			ssc_assert(((char *) msg->submsgs[1]->mem)[0] == '\0', 
+				"Test failed");
+			ssc_assert(ssc_uint32_load_le
+				(((char *) msg->submsgs[1]->mem) + 1) == 0, "Test failed");
+			ssc_assert(msg->submsgs[2] == msg->submsgs[5], "Test failed");
+			ssc_assert(msg->submsgs[2] != msg->submsgs[4], "Test failed");
+			ssc_assert(msg->submsgs[0] != msg->submsgs[6], "Test failed");
+			
+			//Fewer bytes to send
+			plain = TestStruct__serialize(testcases + i);
+			ssc_assert(total_submsg_bytes(msg) 
+				== total_submsg_bytes(plain) 
+					- 2 * (strlen(host) - SSC_STR_REF_SIZE), 
+				"Test failed");
+			mmc_msg_unref(plain);
+		}
+		
+		mmc_msg_unref(msg);
+	}
+	
+	//Many distinct strings, each repeated
+	{
+		char bufs[100][16];
+		char *many[200];
+		TestStruct value = {"line 0", {many, 200}}, res;
+		MmcMsg *msg;
+		
+		for (i = 0; i < 100; i++)
+		{
+			snprintf(bufs[i], sizeof(bufs[i]), "line %d", i);
+			many[i] = bufs[i];
+			many[199 - i] = bufs[i];
+		}
+		
+		msg = TestStruct__serialize_pooled(&value, pool);
+		if (TestStruct__deserialize(msg, &res) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		ssc_assert(TestStruct__equal(&value, &res), "Test failed");
+		TestStruct__free(&res);
+		ssc_assert(msg->submsgs[1] == msg->submsgs[200], "Test failed");
+		ssc_assert(msg->submsgs[199]->mem_len == SSC_STR_REF_SIZE, 
+			"Test failed");
+		ssc_assert(ssc_uint32_load_le
+			(((char *) msg->submsgs[199]->mem) + 1) == 2, "Test failed");
+		mmc_msg_unref(msg);
+	}
+	
+	ssc_str_pool_free(pool);
+	
+	//Back-references must point to an earlier string
+	ssc_assert(try_replaced(3, create_ref(0, SSC_STR_REF_SIZE)) 
+		== MDSL_SUCCESS, "Test failed");
+	ssc_assert(try_replaced(1, create_ref(1, SSC_STR_REF_SIZE)) 
+		== MDSL_FAILURE, "Test failed");
+	ssc_assert(try_replaced(1, create_ref(5, SSC_STR_REF_SIZE)) 
+		== MDSL_FAILURE, "Test failed");
+	ssc_assert(try_replaced(1, create_ref(0, SSC_STR_REF_SIZE + 1)) 
+		== MDSL_FAILURE, "Test failed");
+	ssc_assert(try_replaced(1, create_ref(0, 1)) 
+		== MDSL_FAILURE, "Test failed");
+	
+	//A back-reference to a back-reference is not allowed
+	{
+		TestStruct res;
+		MmcMsg *msg;
+		
+		msg = TestStruct__serialize(testcases);
+		mmc_msg_unref(msg->submsgs[1]);
+		msg->submsgs[1] = create_ref(0, SSC_STR_REF_SIZE);
+		mmc_msg_unref(msg->submsgs[3]);
+		msg->submsgs[3] = create_ref(1, SSC_STR_REF_SIZE);
+		ssc_assert(TestStruct__deserialize(msg, &res) == MDSL_FAILURE, 
+			"Test failed");
+		mmc_msg_unref(msg);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,233 @@
+/* main.c
+ * Table-driven codec test
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+#include "idl.h"
+
+Point points[] = {{0, 0}, {1, -1}, {-2, 2}, {3, 4}};
+char *tags[] = {"a", "bc", "def"};
+uint16_t shorts[] = {1, 2, 65535};
+TestStruct testcases[] = 
+{
+	{
+		255, -300, 4000000000u, -5000000000LL, 
+		{SSC_FLT_NORMAL, 1.5}, {SSC_FLT_NAN, 0},
+		{-1, 0, 1}, {shorts, 3}, "comment", NULL, NULL,
+		{{"first", {points, 4}, points + 3}, {"second", {NULL, 0}, NULL}},
+		{NULL, 0}, NULL, {tags, 3}
+	},
+	{
+		0, 0, 0, 0, 
+		{SSC_FLT_ZERO, 0}, {SSC_FLT_INFINITE, 0},
+		{0, 0, 0}, {NULL, 0}, NULL, NULL, NULL,
+		{{"", {NULL, 0}, NULL}, {"x", {points, 1}, points}},
+		{NULL, 0}, NULL, {NULL, 0}
+	}
+};
+Shape more_shapes[] = 
+{
+	{"one", {points, 2}, NULL},
+	{"two", {points + 2, 2}, points},
+	{"three", {NULL, 0}, points + 1}
+};
+int32_t count = 42;
+
+static int Point__equal(Point *a, Point *b)
+{
+	return a->x == b->x && a->y == b->y;
+}
+
+static int Shape__equal(Shape *a, Shape *b)
+{
+	int i;
+	
+	if (strcmp(a->name, b->name) != 0)
+		return 0;
+	if (a->points.len != b->points.len)
+		return 0;
+	for (i = 0; i < a->points.len; i++)
+	{
+		if (! Point__equal(a->points.data + i, b->points.data + i))
+			return 0;
+	}
+	if (a->center && b->center)
+		return Point__equal(a->center, b->center);
+	return a->center == b->center;
+}
+
+static int flt_equal(SscValFlt a, SscValFlt b)
+{
+	if (a.type != b.type)
+		return 0;
+	if (a.type == SSC_FLT_NORMAL)
+		return a.val == b.val;
+	return 1;
+}
+
+int TestStruct__equal(TestStruct *a, TestStruct *b)
+{
+	int i;
+	
+	if (a->u8 != b->u8 || a->i16 != b->i16 
+		|| a->u32 != b->u32 || a->i64 != b->i64)
+		return 0;
+	if (! flt_equal(a->f32, b->f32) || ! flt_equal(a->f64, b->f64))
+		return 0;
+	for (i = 0; i < 3; i++)
+	{
+		if (a->small[i] != b->small[i])
+			return 0;
+	}
+	if (a->bounded.len != b->bounded.len)
+		return 0;
+	for (i = 0; i < a->bounded.len; i++)
+	{
+		if (a->bounded.data[i] != b->bounded.data[i])
+			return 0;
+	}
+	
+	if (a->comment && b->comment)
+	{
+		if (strcmp(a->comment, b->comment) != 0)
+			return 0;
+	}
+	else if (a->comment || b->comment)
+		return 0;
+	
+	if (a->count && b->count)
+	{
+		if (*a->count != *b->count)
+			return 0;
+	}
+	else if (a->count || b->count)
+		return 0;
+	
+	if (a->attachment->mem_len != b->attachment->mem_len
+		|| memcmp(a->attachment->mem, b->attachment->mem, 
+			a->attachment->mem_len) != 0)
+		return 0;
+	
+	for (i = 0; i < 2; i++)
+	{
+		if (! Shape__equal(a->shapes + i, b->shapes + i))
+			return 0;
+	}
+	if (a->more_shapes.len != b->more_shapes.len)
+		return 0;
+	for (i = 0; i < a->more_shapes.len; i++)
+	{
+		if (! Shape__equal(a->more_shapes.data + i, 
+				b->more_shapes.data + i))
+			return 0;
+	}
+	if (a->extra && b->extra)
+	{
+		if (! Shape__equal(a->extra, b->extra))
+			return 0;
+	}
+	else if (a->extra || b->extra)
+		return 0;
+	
+	if (a->tags.len != b->tags.len)
+		return 0;
+	for (i = 0; i < a->tags.len; i++)
+	{
+		if (strcmp(a->tags.data[i], b->tags.data[i]) != 0)
+			return 0;
+	}
+	
+	return 1;
+}
+
+int main()
+{
+	MmcMsg *attachment;
+	
+	//Fill in what cannot be initialized statically
+	attachment = mmc_msg_newa(3, 0);
+	memcpy(attachment->mem, "abc", 3);
+	testcases[0].attachment = attachment;
+	testcases[0].count = &count;
+	testcases[0].more_shapes.data = more_shapes;
+	testcases[0].more_shapes.len = 3;
+	testcases[0].extra = more_shapes + 1;
+	testcases[1].attachment = attachment;
+	
+	test_struct_drive();
+	
+	//An invalid string in the last shape must be rejected, 
+	//freeing everything read before it
+	{
+		TestStruct res;
+		MmcMsg *msg, *bad_str;
+		int i;
+		
+		msg = TestStruct__serialize(testcases);
+		
+		//Find the name of the last shape in more_shapes
+		for (i = 0; i < msg->submsgs_len; i++)
+		{
+			MmcMsg *sub = msg->submsgs[i];
+			
+			if (sub->mem_len == 5 && memcmp(sub->mem, "three", 5) == 0)
+				break;
+		}
+		ssc_assert(i < msg->submsgs_len, "Test failed");
+		
+		bad_str = mmc_msg_newa(1, 0);
+		((char *) bad_str->mem)[0] = '\0';
+		mmc_msg_unref(msg->submsgs[i]);
+		msg->submsgs[i] = bad_str;
+		
+		if (TestStruct__deserialize(msg, &res) != MDSL_FAILURE)
+			ssc_error("Test failed");
+		
+		mmc_msg_unref(msg);
+	}
+	
+	//Sequence exceeding the bound must not be serialized
+	{
+		uint16_t many[5] = {0};
+		TestStruct big = testcases[1];
+		
+		ssc_assert(TestStruct__check_bounds(&big), "Test failed");
+		big.bounded.data = many;
+		big.bounded.len = 5;
+		ssc_assert(! TestStruct__check_bounds(&big), "Test failed");
+		ssc_assert(! TestStruct__serialize(&big), "Test failed");
+	}
+	
+	//Sequence exceeding the bound must not be deserialized
+	{
+		uint16_t many[5] = {0};
+		ShortUnbounded big = {{many, 5}};
+		Short res;
+		MmcMsg *msg;
+		
+		msg = ShortUnbounded__serialize(&big);
+		if (Short__deserialize(msg, &res) != MDSL_FAILURE)
+			ssc_error("Test failed");
+		mmc_msg_unref(msg);
+	}
+	
+	mmc_msg_unref(attachment);
+	
+	return 0;
+}
@@ -0,0 +1,240 @@
+/* test_transport.c
+ * Transport test over socket pairs
+ * 
+ * Copyright 2015-2020 Akash Rawal
+ * This file is part of Modular Middleware.
+ * 
+ * Modular Middleware is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * Modular Middleware is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Modular Middleware.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tests/libtest.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define N_CLIENTS 3
+#define N_MSGS 50
+
+//Servant that replies with the request itself
+static void echo_servant_call
+	(MmcServant *servant, MmcMsg *msg, MmcReplier *replier)
+{
+	mmc_replier_call(replier, msg);
+}
+
+static void echo_servant_destroy(MmcServant *servant)
+{
+	
+}
+
+//Builds a tree of messages, 
+//each node having mem_len bytes filled with its id
+static MmcMsg *build_tree(int depth, int fanout, int *id)
+{
+	MmcMsg *msg;
+	int i, n_sub, mem_len;
+	
+	n_sub = depth > 0 ? fanout : 0;
+	mem_len = (*id % 7) * 1500;
+	msg = mmc_msg_newa(mem_len, n_sub);
+	memset(msg->mem, *id, mem_len);
+	(*id)++;
+	for (i = 0; i < n_sub; i++)
+		msg->submsgs[i] = build_tree(depth - 1, fanout - i, id);
+	
+	return msg;
+}
+
+static int tree_equal(MmcMsg *a, MmcMsg *b)
+{
+	size_t i;
+	
+	if (a->mem_len != b->mem_len || a->submsgs_len != b->submsgs_len)
+		return 0;
+	if (memcmp(a->mem, b->mem, a->mem_len) != 0)
+		return 0;
+	for (i = 0; i < a->submsgs_len; i++)
+	{
+		if (! tree_equal(a->submsgs[i], b->submsgs[i]))
+			return 0;
+	}
+	
+	return 1;
+}
+
+//Client end of a connection
+typedef struct
+{
+	int fd;
+	SscMsgSender *sender;
+	SscMsgReader *reader;
+	MmcMsg *msgs[N_MSGS];
+	int n_recvd;
+} Client;
+
+static void client_poll(Client *client)
+{
+	char buf[4096];
+	ssize_t len, off, n;
+	
+	if (ssc_msg_sender_flush(client->sender, client->fd) != MDSL_SUCCESS)
+		ssc_error("Test failed");
+	
+	while ((len = read(client->fd, buf, sizeof(buf))) > 0)
+	{
+		for (off = 0; off < len; off += n)
+		{
+			MmcMsg *res;
+			
+			n = ssc_msg_reader_feed
+				(client->reader, buf + off, len - off, &res);
+			ssc_assert(n > 0, "Test failed");
+			if (res)
+			{
+				ssc_assert(client->n_recvd < N_MSGS, "Test failed");
+				ssc_assert(tree_equal(client->msgs[client->n_recvd], res),
+					"Test failed");
+				mmc_msg_unref(res);
+				client->n_recvd++;
+			}
+		}
+	}
+}
+
+static void test_backend(SscTransportBackend backend)
+{
+	MmcServant servant;
+	SscTransport *transport;
+	Client clients[N_CLIENTS];
+	int i, j, id, n_dispatched, done, iter;
+	
+	memset(&servant, 0, sizeof(servant));
+	mdsl_rc_init(&servant);
+	servant.destroy = echo_servant_destroy;
+	servant.call = echo_servant_call;
+	
+	transport = ssc_transport_new(backend, &servant);
+	if (! transport)
+	{
+		//io_uring may legitimately be unavailable
+		ssc_assert(backend == SSC_TRANSPORT_IO_URING, "Test failed");
+		return;
+	}
+	ssc_assert(backend == SSC_TRANSPORT_AUTO 
+		|| ssc_transport_get_backend(transport) == backend, "Test failed");
+	
+	//Connect clients, and queue requests
+	id = 0;
+	for (i = 0; i < N_CLIENTS; i++)
+	{
+		Client *client = clients + i;
+		int fds[2];
+		
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+			ssc_error("socketpair() failed");
+		fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+		if (ssc_transport_add(transport, fds[1]) != MDSL_SUCCESS)
+			ssc_error("Test failed");
+		
+		client->fd = fds[0];
+		client->sender = ssc_msg_sender_new();
+		client->reader = ssc_msg_reader_new();
+		client->n_recvd = 0;
+		for (j = 0; j < N_MSGS; j++)
+		{
+			client->msgs[j] = build_tree(j % 3, 3, &id);
+			if (ssc_msg_sender_queue(client->sender, client->msgs[j])
+				!= MDSL_SUCCESS)
+				ssc_error("Test failed");
+		}
+	}
+	ssc_assert(ssc_transport_get_n_conns(transport) == N_CLIENTS, 
+		"Test failed");
+	
+	//Run until every request has been echoed
+	n_dispatched = 0;
+	done = 0;
+	for (iter = 0; ! done; iter++)
+	{
+		int res;
+		
+		ssc_assert(iter < 100000, "Test failed");
+		
+		for (i = 0; i < N_CLIENTS; i++)
+			client_poll(clients + i);
+		res = ssc_transport_run_once(transport, 10);
+		ssc_assert(res >= 0, "Test failed");
+		n_dispatched += res;
+		
+		done = 1;
+		for (i = 0; i < N_CLIENTS; i++)
+			if (clients[i].n_recvd < N_MSGS)
+				done = 0;
+	}
+	ssc_assert(n_dispatched == N_CLIENTS * N_MSGS, "Test failed");
+	
+	//Invalid frame closes the connection
+	{
+		char bad[SSC_MSG_FRAME_HEADER_SIZE];
+		char buf[16];
+		
+		ssc_msg_frame_header_store(bad, 0, 0);
+		ssc_assert(write(clients[0].fd, bad, sizeof(bad)) == sizeof(bad), 
+			"Test failed");
+		for (iter = 0; ssc_transport_get_n_conns(transport) == N_CLIENTS; 
+			iter++)
+		{
+			ssc_assert(iter < 1000, "Test failed");
+			ssc_assert(ssc_transport_run_once(transport, 10) == 0, 
+				"Test failed");
+		}
+		ssc_assert(read(clients[0].fd, buf, sizeof(buf)) == 0, 
+			"Test failed");
+	}
+	
+	//Closing the other end closes the connection
+	close(clients[1].fd);
+	for (iter = 0; ssc_transport_get_n_conns(transport) == N_CLIENTS - 1; 
+		iter++)
+	{
+		ssc_assert(iter < 1000, "Test failed");
+		ssc_assert(ssc_transport_run_once(transport, 10) == 0, 
+			"Test failed");
+	}
+	
+	//The rest are closed with the transport
+	ssc_transport_free(transport);
+	
+	for (i = 0; i < N_CLIENTS; i++)
+	{
+		Client *client = clients + i;
+		
+		if (i != 1)
+			close(client->fd);
+		ssc_msg_sender_free(client->sender);
+		ssc_msg_reader_free(client->reader);
+		for (j = 0; j < N_MSGS; j++)
+			mmc_msg_unref(client->msgs[j]);
+	}
+}
+
+int main()
+{
+	test_backend(SSC_TRANSPORT_IO_URING);
+	test_backend(SSC_TRANSPORT_EPOLL);
+	test_backend(SSC_TRANSPORT_AUTO);
+	
+	return 0;
+}